@@ -0,0 +1,232 @@
+#ifndef __KINESIS_VIDEO_CANARY_ACK_TRACKER_INCLUDE_I__
+#define __KINESIS_VIDEO_CANARY_ACK_TRACKER_INCLUDE_I__
+
+#pragma once
+
+/*
+ * Fragment ack latency tracking shared by the producer canaries. Header only, the includer has to pull in the producer
+ * C headers (PIC types, atomics, GETTIME and PFragmentAck) first.
+ *
+ * The frame thread records when the last frame of every fragment went out into a fixed ring of slots keyed by the
+ * fragment timestamp the ack will carry. The ack thread looks the fragment up and records the latency into HDR style
+ * histograms. Nothing allocates after creation and neither side takes a lock, so there is no churn on the ack thread
+ * and tail latency can be reported per interval instead of a mean.
+ */
+
+// Ring slots, a power of two. At 2 second fragments this covers well over the 5 minutes the old map was kept for
+#define CANARY_ACK_RING_BITS   8
+#define CANARY_ACK_RING_SIZE   (1 << CANARY_ACK_RING_BITS)
+#define CANARY_ACK_RING_PROBES 8
+#define CANARY_ACK_EMPTY_SLOT  ((SIZE_T) -1)
+
+// Log-linear buckets: values below CANARY_HDR_SUB_BUCKET_COUNT are exact, above that every power of two is split into
+// CANARY_HDR_SUB_BUCKET_HALF buckets, i.e. about 3% relative precision. Values are capped at 2^31 - 1 microseconds
+#define CANARY_HDR_SUB_BUCKET_BITS  5
+#define CANARY_HDR_SUB_BUCKET_HALF  (1 << CANARY_HDR_SUB_BUCKET_BITS)
+#define CANARY_HDR_SUB_BUCKET_COUNT (2 * CANARY_HDR_SUB_BUCKET_HALF)
+#define CANARY_HDR_MAX_MSB          30
+#define CANARY_HDR_BUCKET_COUNT     ((CANARY_HDR_MAX_MSB - CANARY_HDR_SUB_BUCKET_BITS) * CANARY_HDR_SUB_BUCKET_HALF + CANARY_HDR_SUB_BUCKET_COUNT)
+
+typedef struct {
+    volatile SIZE_T buckets[CANARY_HDR_BUCKET_COUNT];
+    volatile SIZE_T max;
+} CanaryHdrHistogram, *PCanaryHdrHistogram;
+
+// Interval summary, values in microseconds
+typedef struct {
+    UINT64 count;
+    UINT64 p50;
+    UINT64 p90;
+    UINT64 p99;
+    UINT64 max;
+} CanaryHdrSummary, *PCanaryHdrSummary;
+
+typedef struct {
+    // Fragment timestamp in milliseconds as the ack reports it, CANARY_ACK_EMPTY_SLOT when free
+    volatile SIZE_T fragmentTimestamp;
+    // When the last frame of the fragment was sent, in 100ns
+    volatile SIZE_T endSendTime;
+} CanaryAckRingSlot;
+
+typedef struct {
+    CanaryAckRingSlot ring[CANARY_ACK_RING_SIZE];
+    CanaryHdrHistogram receivedLatency;
+    CanaryHdrHistogram persistedLatency;
+    // Acks for fragments that were never recorded or were already evicted from the ring
+    volatile SIZE_T untrackedAcks;
+} CanaryAckTracker, *PCanaryAckTracker;
+
+static INLINE UINT32 canaryHdrBucketIndex(UINT64 value)
+{
+    UINT32 shift;
+
+    if (value < CANARY_HDR_SUB_BUCKET_COUNT) {
+        return (UINT32) value;
+    }
+
+    value = MIN(value, (1ULL << (CANARY_HDR_MAX_MSB + 1)) - 1);
+    shift = (UINT32) (63 - __builtin_clzll(value)) - CANARY_HDR_SUB_BUCKET_BITS;
+    return shift * CANARY_HDR_SUB_BUCKET_HALF + (UINT32) (value >> shift);
+}
+
+// Largest value that lands in the bucket
+static INLINE UINT64 canaryHdrBucketValue(UINT32 index)
+{
+    UINT32 shift;
+
+    if (index < CANARY_HDR_SUB_BUCKET_COUNT) {
+        return index;
+    }
+
+    shift = index / CANARY_HDR_SUB_BUCKET_HALF - 1;
+    return ((UINT64) (index % CANARY_HDR_SUB_BUCKET_HALF + CANARY_HDR_SUB_BUCKET_HALF + 1) << shift) - 1;
+}
+
+static INLINE VOID canaryHdrHistogramRecord(PCanaryHdrHistogram pHistogram, UINT64 value)
+{
+    SIZE_T max = ATOMIC_LOAD(&pHistogram->max);
+
+    ATOMIC_INCREMENT(&pHistogram->buckets[canaryHdrBucketIndex(value)]);
+    while (value > max && !ATOMIC_COMPARE_EXCHANGE(&pHistogram->max, &max, (SIZE_T) value)) {
+        // max now holds the latest value, retry while ours is still larger
+    }
+}
+
+// Takes everything recorded since the last collect and resets the histogram. Values recorded concurrently land in
+// either this interval or the next one, none are lost
+static INLINE VOID canaryHdrHistogramCollect(PCanaryHdrHistogram pHistogram, PCanaryHdrSummary pSummary)
+{
+    SIZE_T counts[CANARY_HDR_BUCKET_COUNT];
+    UINT64 seen = 0, p50Rank, p90Rank, p99Rank;
+    UINT32 i;
+
+    MEMSET(pSummary, 0x00, SIZEOF(CanaryHdrSummary));
+    for (i = 0; i < CANARY_HDR_BUCKET_COUNT; i++) {
+        counts[i] = ATOMIC_EXCHANGE(&pHistogram->buckets[i], 0);
+        pSummary->count += counts[i];
+    }
+    pSummary->max = ATOMIC_EXCHANGE(&pHistogram->max, 0);
+
+    if (pSummary->count == 0) {
+        return;
+    }
+
+    // Nearest rank
+    p50Rank = (pSummary->count * 50 + 99) / 100;
+    p90Rank = (pSummary->count * 90 + 99) / 100;
+    p99Rank = (pSummary->count * 99 + 99) / 100;
+    for (i = 0; i < CANARY_HDR_BUCKET_COUNT && seen < p99Rank; i++) {
+        if (counts[i] == 0) {
+            continue;
+        }
+
+        seen += counts[i];
+        if (pSummary->p50 == 0 && seen >= p50Rank) {
+            pSummary->p50 = canaryHdrBucketValue(i);
+        }
+        if (pSummary->p90 == 0 && seen >= p90Rank) {
+            pSummary->p90 = canaryHdrBucketValue(i);
+        }
+        if (seen >= p99Rank) {
+            pSummary->p99 = canaryHdrBucketValue(i);
+        }
+    }
+
+    // Bucket bounds can overshoot the largest value actually seen
+    pSummary->p50 = MIN(pSummary->p50, pSummary->max);
+    pSummary->p90 = MIN(pSummary->p90, pSummary->max);
+    pSummary->p99 = MIN(pSummary->p99, pSummary->max);
+}
+
+static INLINE VOID canaryAckTrackerInit(PCanaryAckTracker pTracker)
+{
+    UINT32 i;
+
+    MEMSET(pTracker, 0x00, SIZEOF(CanaryAckTracker));
+    for (i = 0; i < CANARY_ACK_RING_SIZE; i++) {
+        pTracker->ring[i].fragmentTimestamp = CANARY_ACK_EMPTY_SLOT;
+    }
+}
+
+static INLINE UINT32 canaryAckRingHome(UINT64 fragmentTimestamp)
+{
+    // Fibonacci hashing spreads the evenly spaced fragment timestamps over the ring
+    return (UINT32) ((fragmentTimestamp * 0x9e3779b97f4a7c15ULL) >> (64 - CANARY_ACK_RING_BITS));
+}
+
+// Called from the frame thread once the fragment starting at fragmentTimestamp (milliseconds) has been fully sent
+static INLINE VOID canaryAckTrackerRecordFragmentEnd(PCanaryAckTracker pTracker, UINT64 fragmentTimestamp, UINT64 endSendTime)
+{
+    CanaryAckRingSlot *pSlot, *pVictim = NULL;
+    SIZE_T slotTimestamp;
+    UINT32 i, home = canaryAckRingHome(fragmentTimestamp);
+
+    for (i = 0; i < CANARY_ACK_RING_PROBES; i++) {
+        pSlot = &pTracker->ring[(home + i) & (CANARY_ACK_RING_SIZE - 1)];
+        slotTimestamp = ATOMIC_LOAD(&pSlot->fragmentTimestamp);
+        if (slotTimestamp == CANARY_ACK_EMPTY_SLOT || slotTimestamp == (SIZE_T) fragmentTimestamp) {
+            pVictim = pSlot;
+            break;
+        }
+
+        // Otherwise evict the oldest fragment that is still waiting for its acks
+        if (pVictim == NULL || ATOMIC_LOAD(&pSlot->endSendTime) < ATOMIC_LOAD(&pVictim->endSendTime)) {
+            pVictim = pSlot;
+        }
+    }
+
+    // Readers don't match the slot while it is being rewritten
+    ATOMIC_STORE(&pVictim->fragmentTimestamp, CANARY_ACK_EMPTY_SLOT);
+    ATOMIC_STORE(&pVictim->endSendTime, (SIZE_T) endSendTime);
+    ATOMIC_STORE(&pVictim->fragmentTimestamp, (SIZE_T) fragmentTimestamp);
+}
+
+// Called from the ack thread. The slot is released on the persisted or error ack, the last one a fragment gets
+static INLINE VOID canaryAckTrackerOnAck(PCanaryAckTracker pTracker, PFragmentAck pFragmentAck)
+{
+    CanaryAckRingSlot* pSlot = NULL;
+    SIZE_T fragmentTimestamp = (SIZE_T) pFragmentAck->timestamp, endSendTime = 0, expected;
+    UINT64 now = GETTIME(), latency;
+    UINT32 i, home = canaryAckRingHome(pFragmentAck->timestamp);
+
+    if (pFragmentAck->ackType != FRAGMENT_ACK_TYPE_RECEIVED && pFragmentAck->ackType != FRAGMENT_ACK_TYPE_PERSISTED &&
+        pFragmentAck->ackType != FRAGMENT_ACK_TYPE_ERROR) {
+        return;
+    }
+
+    for (i = 0; i < CANARY_ACK_RING_PROBES; i++) {
+        pSlot = &pTracker->ring[(home + i) & (CANARY_ACK_RING_SIZE - 1)];
+        if (ATOMIC_LOAD(&pSlot->fragmentTimestamp) == fragmentTimestamp) {
+            endSendTime = ATOMIC_LOAD(&pSlot->endSendTime);
+            // The frame thread may have reused the slot in between
+            if (ATOMIC_LOAD(&pSlot->fragmentTimestamp) == fragmentTimestamp) {
+                break;
+            }
+        }
+        pSlot = NULL;
+    }
+
+    if (pSlot == NULL) {
+        if (pFragmentAck->ackType != FRAGMENT_ACK_TYPE_ERROR) {
+            ATOMIC_INCREMENT(&pTracker->untrackedAcks);
+        }
+        return;
+    }
+
+    latency = now > endSendTime ? (now - endSendTime) / HUNDREDS_OF_NANOS_IN_A_MICROSECOND : 0;
+    switch (pFragmentAck->ackType) {
+        case FRAGMENT_ACK_TYPE_RECEIVED:
+            canaryHdrHistogramRecord(&pTracker->receivedLatency, latency);
+            return;
+        case FRAGMENT_ACK_TYPE_PERSISTED:
+            canaryHdrHistogramRecord(&pTracker->persistedLatency, latency);
+            break;
+        default:
+            break;
+    }
+
+    expected = fragmentTimestamp;
+    ATOMIC_COMPARE_EXCHANGE(&pSlot->fragmentTimestamp, &expected, CANARY_ACK_EMPTY_SLOT);
+}
+
+#endif /* __KINESIS_VIDEO_CANARY_ACK_TRACKER_INCLUDE_I__ */
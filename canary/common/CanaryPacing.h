@@ -0,0 +1,105 @@
+#ifndef __KINESIS_VIDEO_CANARY_PACING_INCLUDE_I__
+#define __KINESIS_VIDEO_CANARY_PACING_INCLUDE_I__
+
+#pragma once
+
+/*
+ * Absolute deadline pacing and the lateness histogram shared by the canary media loops. Header only, the includer has
+ * to pull in the PIC headers first.
+ *
+ * The loops sleep until the previous deadline plus one period on CLOCK_MONOTONIC, so the time spent between two waits
+ * and the sleep overshoot don't accumulate into drift the way a relative sleep does. How late each deadline was served
+ * goes into a log2 histogram to tell the jitter of the harness apart from the jitter of the SDK.
+ */
+
+#include <errno.h>
+#include <time.h>
+
+// Bucket 0 counts on-time deadlines, bucket i > 0 counts lateness in [2^(i-1), 2^i) microseconds
+#define CANARY_LATENESS_BUCKET_COUNT 24
+// A pacer that falls behind by more than this many periods drops the missed deadlines instead of bursting to catch up
+#define CANARY_PACER_MAX_LATE_PERIODS 4
+
+// In nanoseconds
+static INLINE UINT64 canaryMonotonicTime()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (UINT64) now.tv_sec * 1000000000ULL + (UINT64) now.tv_nsec;
+}
+
+static INLINE VOID canarySleepUntil(UINT64 deadline)
+{
+#if defined(__APPLE__)
+    UINT64 now = canaryMonotonicTime();
+
+    if (deadline > now) {
+        THREAD_SLEEP((deadline - now) / DEFAULT_TIME_UNIT_IN_NANOS);
+    }
+#else
+    struct timespec ts;
+
+    ts.tv_sec = (time_t) (deadline / 1000000000ULL);
+    ts.tv_nsec = (long) (deadline % 1000000000ULL);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        // Restart on signal, the deadline is absolute so nothing needs to be recomputed
+    }
+#endif
+}
+
+static INLINE UINT32 canaryLatenessBucket(UINT64 latenessUs)
+{
+    UINT32 bucket = 0;
+
+    while (latenessUs != 0 && bucket < CANARY_LATENESS_BUCKET_COUNT - 1) {
+        latenessUs >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+// Moves the deadline on by one period, or past the ones we are too far behind for. Returns the lateness of the deadline
+// being served and the number skipped in pSkipped, both for the caller's histogram
+static INLINE UINT64 canaryPacerAdvanceDeadline(PUINT64 pNextDeadline, UINT64 period, UINT64 now, PUINT64 pSkipped)
+{
+    UINT64 lateness = now > *pNextDeadline ? now - *pNextDeadline : 0;
+
+    *pSkipped = 0;
+    *pNextDeadline += period;
+
+    if (lateness > CANARY_PACER_MAX_LATE_PERIODS * period) {
+        *pSkipped = (now - *pNextDeadline) / period + 1;
+        *pNextDeadline += *pSkipped * period;
+    }
+
+    return lateness;
+}
+
+// Upper bound in microseconds of the bucket holding the given percentile (0-100)
+static INLINE UINT64 canaryLatenessPercentile(PSIZE_T pBuckets, DOUBLE percentile)
+{
+    UINT32 i;
+    UINT64 total = 0, target, seen = 0;
+
+    for (i = 0; i < CANARY_LATENESS_BUCKET_COUNT; i++) {
+        total += pBuckets[i];
+    }
+
+    if (total == 0) {
+        return 0;
+    }
+
+    target = (UINT64) ((percentile / 100.0) * (DOUBLE) total);
+    for (i = 0; i < CANARY_LATENESS_BUCKET_COUNT; i++) {
+        seen += pBuckets[i];
+        if (seen > target) {
+            break;
+        }
+    }
+
+    return i == 0 ? 0 : 1ULL << MIN(i, CANARY_LATENESS_BUCKET_COUNT - 1);
+}
+
+#endif /* __KINESIS_VIDEO_CANARY_PACING_INCLUDE_I__ */
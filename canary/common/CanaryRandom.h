@@ -0,0 +1,65 @@
+#ifndef __KINESIS_VIDEO_CANARY_RANDOM_INCLUDE_I__
+#define __KINESIS_VIDEO_CANARY_RANDOM_INCLUDE_I__
+
+#pragma once
+
+/*
+ * xoshiro256** generator the canaries use to fill their frame pools. Header only, the includer has to pull in the PIC
+ * headers first. The state is four UINT64, seeded from a single value with splitmix64
+ */
+
+#define CANARY_RANDOM_STATE_SIZE 4
+
+static INLINE UINT64 canaryRandomRotl(UINT64 x, INT32 k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+// splitmix64 is the recommended way to expand a single seed into the xoshiro state
+static INLINE VOID canaryRandomSeed(PUINT64 pState, UINT64 seed)
+{
+    UINT32 i;
+    UINT64 z;
+
+    for (i = 0; i < CANARY_RANDOM_STATE_SIZE; i++) {
+        seed += 0x9e3779b97f4a7c15ULL;
+        z = seed;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        pState[i] = z ^ (z >> 31);
+    }
+}
+
+static INLINE UINT64 canaryRandomNext(PUINT64 pState)
+{
+    UINT64 result = canaryRandomRotl(pState[1] * 5, 7) * 9;
+    UINT64 t = pState[1] << 17;
+
+    pState[2] ^= pState[0];
+    pState[3] ^= pState[1];
+    pState[1] ^= pState[2];
+    pState[0] ^= pState[3];
+    pState[2] ^= t;
+    pState[3] = canaryRandomRotl(pState[3], 45);
+
+    return result;
+}
+
+static INLINE VOID canaryRandomFill(PUINT64 pState, PBYTE pDst, UINT32 size)
+{
+    UINT64 value;
+    UINT32 i = 0;
+
+    // 8 bytes per generator step instead of one RAND() call per byte
+    for (; i + SIZEOF(UINT64) <= size; i += SIZEOF(UINT64)) {
+        value = canaryRandomNext(pState);
+        MEMCPY(pDst + i, &value, SIZEOF(UINT64));
+    }
+
+    if (i < size) {
+        value = canaryRandomNext(pState);
+        MEMCPY(pDst + i, &value, size - i);
+    }
+}
+
+#endif /* __KINESIS_VIDEO_CANARY_RANDOM_INCLUDE_I__ */
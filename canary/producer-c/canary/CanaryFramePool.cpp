@@ -0,0 +1,150 @@
+/**
+ * Pre-generated canary frame pool
+ */
+#define LOG_CLASS "CanaryFramePool"
+#include "CanaryUtils.h"
+
+STATUS createCanaryFramePool(UINT32 headerSize, UINT32 minBodySize, UINT32 maxBodySize, UINT32 entryCount, PCanaryFramePool* ppCanaryFramePool)
+{
+    ENTERS();
+    STATUS retStatus = STATUS_SUCCESS;
+    PCanaryFramePool pCanaryFramePool = NULL;
+    PCanaryFramePoolEntry pEntry;
+    UINT32 i, bodySize, stride = headerSize + maxBodySize;
+
+    CHK(ppCanaryFramePool != NULL, STATUS_NULL_ARG);
+    CHK(entryCount > 0 && minBodySize > 0 && minBodySize <= maxBodySize, STATUS_INVALID_ARG);
+
+    // Allocate the pool, the entries and the frame storage in one go
+    pCanaryFramePool = (PCanaryFramePool) MEMCALLOC(1, SIZEOF(CanaryFramePool) + entryCount * SIZEOF(CanaryFramePoolEntry) + (UINT64) stride * entryCount);
+    CHK(pCanaryFramePool != NULL, STATUS_NOT_ENOUGH_MEMORY);
+
+    pCanaryFramePool->headerSize = headerSize;
+    pCanaryFramePool->entryCount = entryCount;
+    pCanaryFramePool->pEntries = (PCanaryFramePoolEntry) (pCanaryFramePool + 1);
+    pCanaryFramePool->pBuffer = (PBYTE) (pCanaryFramePool->pEntries + entryCount);
+    canaryRandomSeed(pCanaryFramePool->prngState, GETTIME());
+
+    for (i = 0; i < entryCount; i++) {
+        pEntry = &pCanaryFramePool->pEntries[i];
+        bodySize = minBodySize + (UINT32) (canaryRandomNext(pCanaryFramePool->prngState) % (maxBodySize - minBodySize + 1));
+        pEntry->pData = pCanaryFramePool->pBuffer + (UINT64) stride * i;
+        pEntry->size = headerSize + bodySize;
+        canaryRandomFill(pCanaryFramePool->prngState, pEntry->pData + headerSize, bodySize);
+        pEntry->bodyCrc = COMPUTE_CRC32(pEntry->pData + headerSize, bodySize);
+    }
+
+    DLOGI("Generated %u canary frames with body size between %u and %u bytes", entryCount, minBodySize, maxBodySize);
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus)) {
+        SAFE_MEMFREE(pCanaryFramePool);
+    }
+
+    if (ppCanaryFramePool != NULL) {
+        *ppCanaryFramePool = pCanaryFramePool;
+    }
+
+    LEAVES();
+    return retStatus;
+}
+
+STATUS freeCanaryFramePool(PCanaryFramePool* ppCanaryFramePool)
+{
+    ENTERS();
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(ppCanaryFramePool != NULL, STATUS_NULL_ARG);
+
+    // Call is idempotent
+    SAFE_MEMFREE(*ppCanaryFramePool);
+
+CleanUp:
+
+    LEAVES();
+    return retStatus;
+}
+
+// The mean frame size is what the fragment size config has always meant per frame, the pool draws the sizes uniformly
+// around it so the bitrate stays the same
+VOID getCanaryFrameBodySizeRange(UINT64 fragmentSizeInBytes, UINT64 jitterPercent, PUINT32 pMinBodySize, PUINT32 pMaxBodySize)
+{
+    UINT64 meanSize = MAX(1, fragmentSizeInBytes / DEFAULT_FPS_VALUE);
+
+    jitterPercent = MIN(jitterPercent, CANARY_MAX_FRAME_SIZE_JITTER);
+    *pMinBodySize = (UINT32) MAX(1, meanSize * (100 - jitterPercent) / 100);
+    *pMaxBodySize = (UINT32) (meanSize * (100 + jitterPercent) / 100);
+}
+
+PCanaryFramePoolEntry getNextCanaryFramePoolEntry(PCanaryFramePool pCanaryFramePool)
+{
+    return &pCanaryFramePool->pEntries[canaryRandomNext(pCanaryFramePool->prngState) % pCanaryFramePool->entryCount];
+}
+
+static UINT32 gf2MatrixTimes(PUINT32 pMatrix, UINT32 vector)
+{
+    UINT32 sum = 0;
+
+    while (vector != 0) {
+        if (vector & 1) {
+            sum ^= *pMatrix;
+        }
+        vector >>= 1;
+        pMatrix++;
+    }
+
+    return sum;
+}
+
+static VOID gf2MatrixSquare(PUINT32 pSquare, PUINT32 pMatrix)
+{
+    UINT32 i;
+
+    for (i = 0; i < 32; i++) {
+        pSquare[i] = gf2MatrixTimes(pMatrix, pMatrix[i]);
+    }
+}
+
+// Returns the CRC32 of A followed by B given CRC32(A), CRC32(B) and the length of B. This is the zlib crc32_combine
+// algorithm and lets us reuse the body CRC of a pool entry instead of re-hashing the whole frame on every send.
+UINT32 canaryCrc32Combine(UINT32 crc1, UINT32 crc2, UINT64 len2)
+{
+    UINT32 i, row, even[32], odd[32];
+
+    if (len2 == 0) {
+        return crc1;
+    }
+
+    // Operator for one zero bit in odd
+    odd[0] = 0xedb88320;
+    row = 1;
+    for (i = 1; i < 32; i++) {
+        odd[i] = row;
+        row <<= 1;
+    }
+
+    // Operator for two zero bits in even, then four zero bits in odd
+    gf2MatrixSquare(even, odd);
+    gf2MatrixSquare(odd, even);
+
+    // Apply len2 zeros to crc1. The first square puts the operator for one zero byte, eight zero bits, in even
+    do {
+        gf2MatrixSquare(even, odd);
+        if (len2 & 1) {
+            crc1 = gf2MatrixTimes(even, crc1);
+        }
+        len2 >>= 1;
+        if (len2 == 0) {
+            break;
+        }
+
+        gf2MatrixSquare(odd, even);
+        if (len2 & 1) {
+            crc1 = gf2MatrixTimes(odd, crc1);
+        }
+        len2 >>= 1;
+    } while (len2 != 0);
+
+    return crc1 ^ crc2;
+}
@@ -0,0 +1,397 @@
+/**
+ * Multi-stream load generator. Drives CANARY_STREAM_COUNT streams on a single client from a small pool of worker
+ * threads, each of which paces its share of the streams on a timing wheel
+ */
+#define LOG_CLASS "CanaryMultiStream"
+#include "CanaryUtils.h"
+
+#include <sys/resource.h>
+
+STATUS createCanaryMultiStream(Aws::CloudWatch::CloudWatchClient* cwClient, PCanaryConfig pCanaryConfig, PCHAR streamNamePrefix,
+                               PClientCallbacks pClientCallbacks, PCanaryMultiStream* ppCanaryMultiStream)
+{
+    ENTERS();
+    STATUS retStatus = STATUS_SUCCESS;
+    PCanaryMultiStream pCanaryMultiStream = NULL;
+    PCanaryStreamContext pStream;
+    PCanaryStreamCallbacks pCanaryStreamCallbacks = NULL;
+    UINT32 i, streamCount;
+    INT64 cpuCount;
+
+    CHK(pCanaryConfig != NULL && streamNamePrefix != NULL && pClientCallbacks != NULL && ppCanaryMultiStream != NULL, STATUS_NULL_ARG);
+    CHK_ERR(pCanaryConfig->streamCount > 0 && pCanaryConfig->streamCount <= CANARY_MAX_STREAM_COUNT, STATUS_INVALID_ARG,
+            "Stream count must be between 1 and %u", CANARY_MAX_STREAM_COUNT);
+    streamCount = (UINT32) pCanaryConfig->streamCount;
+
+    pCanaryMultiStream = (PCanaryMultiStream) MEMCALLOC(
+        1, SIZEOF(CanaryMultiStream) + streamCount * SIZEOF(CanaryStreamContext) + CANARY_MULTI_STREAM_MAX_WORKERS * SIZEOF(CanaryMultiStreamWorker));
+    CHK(pCanaryMultiStream != NULL, STATUS_NOT_ENOUGH_MEMORY);
+
+    pCanaryMultiStream->pStreams = (PCanaryStreamContext) (pCanaryMultiStream + 1);
+    pCanaryMultiStream->pWorkers = (PCanaryMultiStreamWorker) (pCanaryMultiStream->pStreams + streamCount);
+    pCanaryMultiStream->fragmentSizeInBytes = pCanaryConfig->fragmentSizeInBytes;
+    pCanaryMultiStream->frameSizeJitterPercent = pCanaryConfig->frameSizeJitterPercent;
+    pCanaryMultiStream->metricsTimerId = MAX_UINT32;
+    pCanaryMultiStream->timerQueueHandle = INVALID_TIMER_QUEUE_HANDLE_VALUE;
+    ATOMIC_STORE_BOOL(&pCanaryMultiStream->terminate, FALSE);
+
+    // A handful of workers is enough to pace hundreds of streams, more only adds context switches
+    cpuCount = (INT64) sysconf(_SC_NPROCESSORS_ONLN);
+    pCanaryMultiStream->workerCount = (UINT32) MAX(1, MIN((INT64) MIN(streamCount, CANARY_MULTI_STREAM_MAX_WORKERS), cpuCount));
+
+    for (i = 0; i < streamCount; i++) {
+        pStream = &pCanaryMultiStream->pStreams[i];
+        SNPRINTF(pStream->streamName, MAX_STREAM_NAME_LEN, "%s-%u", streamNamePrefix, i);
+        pStream->customData.clientHandle = INVALID_CLIENT_HANDLE_VALUE;
+        pStream->customData.streamHandle = INVALID_STREAM_HANDLE_VALUE;
+        pStream->multiTrack = STRCMP(pCanaryConfig->canaryTrackType, CANARY_MULTI_TRACK_TYPE) == 0;
+
+        // The callbacks provider owns the stream callbacks once they are added
+        CHK_STATUS(createCanaryStreamCallbacks(cwClient, pStream->streamName, pCanaryConfig->canaryLabel, &pCanaryStreamCallbacks));
+        pCanaryStreamCallbacks->matchStreamHandle = TRUE;
+        CHK_STATUS(addStreamCallbacks(pClientCallbacks, &pCanaryStreamCallbacks->streamCallbacks));
+        pStream->customData.pCanaryStreamCallbacks = pCanaryStreamCallbacks;
+        pCanaryStreamCallbacks = NULL;
+    }
+
+    pCanaryMultiStream->streamCount = streamCount;
+
+CleanUp:
+
+    if (pCanaryStreamCallbacks != NULL) {
+        freeCanaryStreamCallbacks((PStreamCallbacks*) &pCanaryStreamCallbacks);
+    }
+
+    if (STATUS_FAILED(retStatus)) {
+        SAFE_MEMFREE(pCanaryMultiStream);
+    }
+
+    if (ppCanaryMultiStream != NULL) {
+        *ppCanaryMultiStream = pCanaryMultiStream;
+    }
+
+    LEAVES();
+    return retStatus;
+}
+
+// Streams have to be freed before the client. The stream callbacks are released with the callbacks provider
+STATUS freeCanaryMultiStream(PCanaryMultiStream* ppCanaryMultiStream)
+{
+    ENTERS();
+    STATUS retStatus = STATUS_SUCCESS;
+    PCanaryMultiStream pCanaryMultiStream;
+    PCanaryMultiStreamWorker pWorker;
+    UINT32 i;
+
+    CHK(ppCanaryMultiStream != NULL, STATUS_NULL_ARG);
+    pCanaryMultiStream = *ppCanaryMultiStream;
+
+    // Call is idempotent
+    CHK(pCanaryMultiStream != NULL, retStatus);
+
+    ATOMIC_STORE_BOOL(&pCanaryMultiStream->terminate, TRUE);
+    for (i = 0; i < pCanaryMultiStream->workerCount; i++) {
+        pWorker = &pCanaryMultiStream->pWorkers[i];
+        if (pWorker->started) {
+            THREAD_JOIN(pWorker->threadId, NULL);
+            pWorker->started = FALSE;
+        }
+
+        freeCanaryTimingWheel(&pWorker->pCanaryTimingWheel);
+        freeCanaryFramePool(&pWorker->pCanaryFramePool);
+    }
+
+    for (i = 0; i < pCanaryMultiStream->streamCount; i++) {
+        freeKinesisVideoStream(&pCanaryMultiStream->pStreams[i].customData.streamHandle);
+    }
+
+    SAFE_MEMFREE(*ppCanaryMultiStream);
+
+CleanUp:
+
+    LEAVES();
+    return retStatus;
+}
+
+// Timing wheel callback, puts one frame on the stream. A failed put is counted rather than stopping the run so that a
+// single misbehaving stream doesn't end the load test for the others
+static STATUS canaryMultiStreamPutFrame(UINT64 customData, UINT64 deadline)
+{
+    PCanaryStreamContext pStream = (PCanaryStreamContext) customData;
+    PFrame pFrame = &pStream->frame;
+    STATUS status;
+
+    UNUSED_PARAM(deadline);
+
+    pFrame->index = pStream->frameIndex;
+    pFrame->flags = pStream->frameIndex % DEFAULT_KEY_FRAME_INTERVAL == 0 ? FRAME_FLAG_KEY_FRAME : FRAME_FLAG_NONE;
+    pFrame->trackId = DEFAULT_VIDEO_TRACK_ID;
+    pFrame->decodingTs = GETTIME();
+    pFrame->presentationTs = pFrame->decodingTs;
+    createCanaryFrameData(pStream->pCanaryFramePool, pFrame);
+
+    if (pFrame->flags == FRAME_FLAG_KEY_FRAME) {
+        if (pStream->lastKeyFrameTimestamp != 0) {
+            canaryStreamRecordFragmentEndSendTime(pStream->customData.pCanaryStreamCallbacks, pStream->lastKeyFrameTimestamp,
+                                                  pFrame->presentationTs);
+        }
+        pStream->lastKeyFrameTimestamp = pFrame->presentationTs;
+    }
+
+    status = putKinesisVideoFrame(pStream->customData.streamHandle, pFrame);
+    if (STATUS_SUCCEEDED(status) && pStream->multiTrack) {
+        pFrame->flags = FRAME_FLAG_NONE;
+        pFrame->trackId = DEFAULT_AUDIO_TRACK_ID;
+        status = putKinesisVideoFrame(pStream->customData.streamHandle, pFrame);
+    }
+
+    if (STATUS_FAILED(status)) {
+        DLOGW("Failed to put frame %u on %s with 0x%08x", pFrame->index, pStream->streamName, status);
+        ATOMIC_INCREMENT(&pStream->putFrameErrors);
+    } else {
+        // Published from the metrics timer, pushing to cloudwatch from here would stall every stream on this worker
+        if (pStream->startUpLatency == 0) {
+            ATOMIC_STORE(&pStream->startUpLatency, (SIZE_T) MAX(1, GETTIME() - pStream->createTime));
+        }
+        ATOMIC_INCREMENT(&pStream->framesSent);
+        ATOMIC_ADD(&pStream->bytesSent, (SIZE_T) pFrame->size);
+    }
+
+    pStream->frameIndex++;
+
+    return STATUS_SUCCESS;
+}
+
+static PVOID canaryMultiStreamWorkerRoutine(PVOID args)
+{
+    PCanaryMultiStreamWorker pWorker = (PCanaryMultiStreamWorker) args;
+    STATUS retStatus = canaryTimingWheelRun(pWorker->pCanaryTimingWheel, pWorker->pTerminate);
+
+    CHK_LOG_ERR(retStatus);
+
+    return (PVOID) (ULONG_PTR) retStatus;
+}
+
+STATUS publishMultiStreamMetrics(UINT32 timerId, UINT64 currentTime, UINT64 customData)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PCanaryMultiStream pCanaryMultiStream = (PCanaryMultiStream) customData;
+    PCanaryStreamContext pStream;
+    PCanaryStreamCallbacks pAggregateCallbacks = NULL;
+    Aws::CloudWatch::Model::MetricDatum activeStreamsDatum, frameRateDatum;
+    UINT32 i, activeStreams = 0;
+    SIZE_T framesSent = 0;
+    DOUBLE duration;
+
+    CHK(pCanaryMultiStream != NULL, STATUS_NULL_ARG);
+
+    for (i = 0; i < pCanaryMultiStream->streamCount; i++) {
+        pStream = &pCanaryMultiStream->pStreams[i];
+        framesSent += ATOMIC_LOAD(&pStream->framesSent);
+
+        // Nothing to report until the first frame went through
+        if (ATOMIC_LOAD(&pStream->startUpLatency) == 0) {
+            continue;
+        }
+
+        activeStreams++;
+        pAggregateCallbacks = pStream->customData.pCanaryStreamCallbacks;
+        if (!pStream->startUpLatencyPublished) {
+            pushStartUpLatency(pStream->customData.pCanaryStreamCallbacks,
+                               (DOUBLE) ATOMIC_LOAD(&pStream->startUpLatency) / (DOUBLE) HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+            pStream->startUpLatencyPublished = TRUE;
+        }
+
+        CHK_LOG_ERR(publishMetrics(timerId, currentTime, (UINT64) &pStream->customData));
+        CHK_LOG_ERR(publishErrorRate(timerId, currentTime, (UINT64) &pStream->customData));
+    }
+
+    CHK(pAggregateCallbacks != NULL, retStatus);
+
+    activeStreamsDatum.SetMetricName("ActiveStreams");
+    activeStreamsDatum.AddDimensions(pAggregateCallbacks->aggregatedDimension);
+    pushMetric(pAggregateCallbacks, activeStreamsDatum, Aws::CloudWatch::Model::StandardUnit::Count, activeStreams);
+
+    if (pCanaryMultiStream->prevPublishTime != 0 && currentTime > pCanaryMultiStream->prevPublishTime) {
+        duration = (DOUBLE) (currentTime - pCanaryMultiStream->prevPublishTime) / (DOUBLE) HUNDREDS_OF_NANOS_IN_A_SECOND;
+        frameRateDatum.SetMetricName("AggregateFrameRate");
+        frameRateDatum.AddDimensions(pAggregateCallbacks->aggregatedDimension);
+        pushMetric(pAggregateCallbacks, frameRateDatum, Aws::CloudWatch::Model::StandardUnit::Count_Second,
+                   (DOUBLE) (framesSent - pCanaryMultiStream->publishedFramesSent) / duration);
+    }
+
+CleanUp:
+
+    if (pCanaryMultiStream != NULL) {
+        pCanaryMultiStream->publishedFramesSent = framesSent;
+        pCanaryMultiStream->prevPublishTime = currentTime;
+    }
+
+    return retStatus;
+}
+
+static UINT64 getProcessCpuTime()
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return (UINT64) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * HUNDREDS_OF_NANOS_IN_A_SECOND +
+        (UINT64) (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * HUNDREDS_OF_NANOS_IN_A_MICROSECOND;
+}
+
+// Logs what every stream achieved and what one stream costs, and publishes the per stream cost
+static VOID canaryMultiStreamSummary(PCanaryMultiStream pCanaryMultiStream, UINT64 runTime, UINT64 cpuTime, UINT64 allocationSize)
+{
+    PCanaryStreamContext pStream;
+    SIZE_T buckets[CANARY_LATENESS_BUCKET_COUNT];
+    SIZE_T framesSent, totalFrames = 0, totalBytes = 0, totalErrors = 0;
+    Aws::CloudWatch::Model::MetricDatum cpuDatum, memoryDatum;
+    struct rusage usage;
+    DOUBLE seconds = (DOUBLE) MAX(runTime, 1) / (DOUBLE) HUNDREDS_OF_NANOS_IN_A_SECOND;
+    DOUBLE cpuPerStream, memoryPerStream;
+    UINT32 i, j;
+
+    for (i = 0; i < pCanaryMultiStream->streamCount; i++) {
+        pStream = &pCanaryMultiStream->pStreams[i];
+        framesSent = ATOMIC_LOAD(&pStream->framesSent);
+        totalFrames += framesSent;
+        totalBytes += ATOMIC_LOAD(&pStream->bytesSent);
+        totalErrors += ATOMIC_LOAD(&pStream->putFrameErrors);
+
+        if (pStream->customData.pCanaryPacer != NULL) {
+            for (j = 0; j < CANARY_LATENESS_BUCKET_COUNT; j++) {
+                buckets[j] = ATOMIC_LOAD(&pStream->customData.pCanaryPacer->lateness.buckets[j]);
+            }
+        } else {
+            MEMSET(buckets, 0x00, SIZEOF(buckets));
+        }
+
+        DLOGI("%s: %" PRIu64 " frames (%.1lf fps), %" PRIu64 " put errors, lateness p99 <= %" PRIu64 " us", pStream->streamName, (UINT64) framesSent,
+              (DOUBLE) framesSent / seconds, (UINT64) ATOMIC_LOAD(&pStream->putFrameErrors), canaryLatenessPercentile(buckets, 99));
+    }
+
+    // Process wide numbers, so the SDK and cloudwatch client overhead is spread over the streams as well
+    cpuPerStream = 100.0 * (DOUBLE) cpuTime / (DOUBLE) MAX(runTime, 1) / pCanaryMultiStream->streamCount;
+    memoryPerStream = (DOUBLE) allocationSize / 1024.0 / pCanaryMultiStream->streamCount;
+    getrusage(RUSAGE_SELF, &usage);
+
+    DLOGI("Multi-stream summary: %u streams on %u workers for %.1lf s, %" PRIu64 " frames, %.1lf kbps, %" PRIu64 " put errors",
+          pCanaryMultiStream->streamCount, pCanaryMultiStream->workerCount, seconds, (UINT64) totalFrames,
+          (DOUBLE) totalBytes * 8.0 / 1000.0 / seconds, (UINT64) totalErrors);
+    DLOGI("Multi-stream summary: %.2lf%% CPU per stream, %.1lf KB allocated per stream, max RSS %ld KB", cpuPerStream, memoryPerStream,
+          usage.ru_maxrss);
+
+    if (pCanaryMultiStream->streamCount > 0 && pCanaryMultiStream->pStreams[0].customData.pCanaryStreamCallbacks != NULL) {
+        cpuDatum.SetMetricName("CpuPerStream");
+        cpuDatum.AddDimensions(pCanaryMultiStream->pStreams[0].customData.pCanaryStreamCallbacks->aggregatedDimension);
+        pushMetric(pCanaryMultiStream->pStreams[0].customData.pCanaryStreamCallbacks, cpuDatum, Aws::CloudWatch::Model::StandardUnit::Percent,
+                   cpuPerStream);
+
+        memoryDatum.SetMetricName("MemoryPerStream");
+        memoryDatum.AddDimensions(pCanaryMultiStream->pStreams[0].customData.pCanaryStreamCallbacks->aggregatedDimension);
+        pushMetric(pCanaryMultiStream->pStreams[0].customData.pCanaryStreamCallbacks, memoryDatum, Aws::CloudWatch::Model::StandardUnit::Kilobytes,
+                   memoryPerStream);
+    }
+}
+
+STATUS runCanaryMultiStream(PCanaryMultiStream pCanaryMultiStream, CLIENT_HANDLE clientHandle, PStreamInfo pStreamInfo,
+                            TIMER_QUEUE_HANDLE timerQueueHandle, UINT64 stopTime, volatile ATOMIC_BOOL* pInterrupted)
+{
+    ENTERS();
+    STATUS retStatus = STATUS_SUCCESS;
+    StreamInfo streamInfo;
+    PCanaryStreamContext pStream;
+    PCanaryMultiStreamWorker pWorker;
+    PCanaryTimingWheelEntry pEntry;
+    UINT64 period = HUNDREDS_OF_NANOS_IN_A_SECOND / DEFAULT_FPS_VALUE, startTime, cpuTime, allocationSize;
+    UINT32 i, minFrameSize, maxFrameSize;
+
+    CHK(pCanaryMultiStream != NULL && pStreamInfo != NULL && pInterrupted != NULL, STATUS_NULL_ARG);
+
+    startTime = GETTIME();
+    cpuTime = getProcessCpuTime();
+    allocationSize = getInstrumentedTotalAllocationSize();
+
+    // Created one after the other, startup latency of a stream includes waiting on the ones before it
+    for (i = 0; i < pCanaryMultiStream->streamCount; i++) {
+        pStream = &pCanaryMultiStream->pStreams[i];
+        streamInfo = *pStreamInfo;
+        STRNCPY(streamInfo.name, pStream->streamName, MAX_STREAM_NAME_LEN);
+        streamInfo.name[MAX_STREAM_NAME_LEN] = '\0';
+
+        pStream->createTime = GETTIME();
+        CHK_STATUS(createKinesisVideoStreamSync(clientHandle, &streamInfo, &pStream->customData.streamHandle));
+        pStream->customData.clientHandle = clientHandle;
+        pStream->customData.pCanaryStreamCallbacks->streamHandle = pStream->customData.streamHandle;
+
+        pStream->frame.version = FRAME_CURRENT_VERSION;
+        pStream->frame.duration = period;
+    }
+
+    getCanaryFrameBodySizeRange(pCanaryMultiStream->fragmentSizeInBytes, pCanaryMultiStream->frameSizeJitterPercent, &minFrameSize, &maxFrameSize);
+    for (i = 0; i < pCanaryMultiStream->workerCount; i++) {
+        pWorker = &pCanaryMultiStream->pWorkers[i];
+        pWorker->pTerminate = &pCanaryMultiStream->terminate;
+        CHK_STATUS(createCanaryFramePool(CANARY_METADATA_SIZE, minFrameSize, maxFrameSize, CANARY_FRAME_POOL_SIZE, &pWorker->pCanaryFramePool));
+        CHK_STATUS(createCanaryTimingWheel(CANARY_TIMING_WHEEL_TICK, CANARY_TIMING_WHEEL_DEFAULT_SLOT_COUNT, &pWorker->pCanaryTimingWheel));
+    }
+
+    // Every stream starts on a key frame, the start offsets spread those key frames evenly over one GOP so the
+    // fragments of all the streams don't close on the same tick
+    for (i = 0; i < pCanaryMultiStream->streamCount; i++) {
+        pStream = &pCanaryMultiStream->pStreams[i];
+        pWorker = &pCanaryMultiStream->pWorkers[i % pCanaryMultiStream->workerCount];
+        pStream->pCanaryFramePool = pWorker->pCanaryFramePool;
+        CHK_STATUS(canaryTimingWheelAddStream(pWorker->pCanaryTimingWheel, period,
+                                              (UINT64) i * DEFAULT_KEY_FRAME_INTERVAL * period / pCanaryMultiStream->streamCount,
+                                              canaryMultiStreamPutFrame, (UINT64) pStream, &pEntry));
+        // The put callback never fails, so the entry lives as long as the wheel
+        pStream->customData.pCanaryPacer = &pEntry->pacer;
+    }
+
+    // A single timer for all the streams, the timer queue only holds a limited number of timers
+    CHK_STATUS(timerQueueAddTimer(timerQueueHandle, CANARY_METRICS_PUBLISH_PERIOD, CANARY_METRICS_PUBLISH_PERIOD, publishMultiStreamMetrics,
+                                  (UINT64) pCanaryMultiStream, &pCanaryMultiStream->metricsTimerId));
+    pCanaryMultiStream->timerQueueHandle = timerQueueHandle;
+
+    for (i = 0; i < pCanaryMultiStream->workerCount; i++) {
+        pWorker = &pCanaryMultiStream->pWorkers[i];
+        CHK_STATUS(THREAD_CREATE(&pWorker->threadId, canaryMultiStreamWorkerRoutine, (PVOID) pWorker));
+        pWorker->started = TRUE;
+    }
+
+    DLOGI("Streaming to %u streams from %u workers", pCanaryMultiStream->streamCount, pCanaryMultiStream->workerCount);
+
+    while (GETTIME() < stopTime && !ATOMIC_LOAD_BOOL(pInterrupted)) {
+        THREAD_SLEEP(100 * HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+    }
+
+CleanUp:
+
+    CHK_LOG_ERR(retStatus);
+
+    if (pCanaryMultiStream != NULL) {
+        ATOMIC_STORE_BOOL(&pCanaryMultiStream->terminate, TRUE);
+        for (i = 0; i < pCanaryMultiStream->workerCount; i++) {
+            pWorker = &pCanaryMultiStream->pWorkers[i];
+            if (pWorker->started) {
+                THREAD_JOIN(pWorker->threadId, NULL);
+                pWorker->started = FALSE;
+            }
+        }
+
+        // The timer references the streams, it can't outlive this call
+        if (pCanaryMultiStream->metricsTimerId != MAX_UINT32) {
+            timerQueueCancelTimer(pCanaryMultiStream->timerQueueHandle, pCanaryMultiStream->metricsTimerId, (UINT64) pCanaryMultiStream);
+            pCanaryMultiStream->metricsTimerId = MAX_UINT32;
+        }
+
+        if (STATUS_SUCCEEDED(retStatus)) {
+            canaryMultiStreamSummary(pCanaryMultiStream, GETTIME() - startTime, getProcessCpuTime() - cpuTime,
+                                     MAX(getInstrumentedTotalAllocationSize(), allocationSize) - allocationSize);
+        }
+    }
+
+    LEAVES();
+    return retStatus;
+}
@@ -0,0 +1,232 @@
+/**
+ * Absolute deadline pacing for the canary media loops
+ */
+#define LOG_CLASS "CanaryPacer"
+#include "CanaryUtils.h"
+
+// Records how late the current deadline was served and moves the pacer on to the next one
+static VOID canaryPacerAdvance(PCanaryPacer pCanaryPacer, UINT64 now)
+{
+    PCanaryLatenessHistogram pHistogram = &pCanaryPacer->lateness;
+    UINT64 skipped, lateness = canaryPacerAdvanceDeadline(&pCanaryPacer->nextDeadline, pCanaryPacer->period, now, &skipped);
+
+    ATOMIC_INCREMENT(&pHistogram->buckets[canaryLatenessBucket(lateness / 1000)]);
+    if (lateness > ATOMIC_LOAD(&pHistogram->maxLateness)) {
+        ATOMIC_STORE(&pHistogram->maxLateness, (SIZE_T) lateness);
+    }
+
+    if (skipped != 0) {
+        ATOMIC_ADD(&pHistogram->skippedDeadlines, (SIZE_T) skipped);
+    }
+}
+
+STATUS initCanaryPacer(PCanaryPacer pCanaryPacer, UINT64 period)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pCanaryPacer != NULL, STATUS_NULL_ARG);
+    CHK(period > 0, STATUS_INVALID_ARG);
+
+    MEMSET(pCanaryPacer, 0x00, SIZEOF(CanaryPacer));
+    pCanaryPacer->period = period * DEFAULT_TIME_UNIT_IN_NANOS;
+    pCanaryPacer->nextDeadline = canaryMonotonicTime() + pCanaryPacer->period;
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS canaryPacerWait(PCanaryPacer pCanaryPacer)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pCanaryPacer != NULL, STATUS_NULL_ARG);
+
+    canarySleepUntil(pCanaryPacer->nextDeadline);
+    canaryPacerAdvance(pCanaryPacer, canaryMonotonicTime());
+
+CleanUp:
+
+    return retStatus;
+}
+
+// Restarts the deadline sequence from now, e.g. after an intentional pause. The histogram is kept
+STATUS canaryPacerReset(PCanaryPacer pCanaryPacer)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pCanaryPacer != NULL, STATUS_NULL_ARG);
+
+    pCanaryPacer->nextDeadline = canaryMonotonicTime() + pCanaryPacer->period;
+
+CleanUp:
+
+    return retStatus;
+}
+
+// Returns the bucket counts recorded since the previous collection. Must only be called from one thread
+VOID canaryLatenessHistogramCollect(PCanaryLatenessHistogram pHistogram, PSIZE_T pBuckets, PSIZE_T pSkippedDeadlines)
+{
+    UINT32 i;
+    SIZE_T current;
+
+    for (i = 0; i < CANARY_LATENESS_BUCKET_COUNT; i++) {
+        current = ATOMIC_LOAD(&pHistogram->buckets[i]);
+        pBuckets[i] = current - pHistogram->publishedBuckets[i];
+        pHistogram->publishedBuckets[i] = current;
+    }
+
+    current = ATOMIC_LOAD(&pHistogram->skippedDeadlines);
+    *pSkippedDeadlines = current - pHistogram->publishedSkippedDeadlines;
+    pHistogram->publishedSkippedDeadlines = current;
+}
+
+STATUS createCanaryTimingWheel(UINT64 tick, UINT32 slotCount, PCanaryTimingWheel* ppCanaryTimingWheel)
+{
+    ENTERS();
+    STATUS retStatus = STATUS_SUCCESS;
+    PCanaryTimingWheel pCanaryTimingWheel = NULL;
+
+    CHK(ppCanaryTimingWheel != NULL, STATUS_NULL_ARG);
+    CHK(tick > 0 && slotCount > 0, STATUS_INVALID_ARG);
+
+    pCanaryTimingWheel = (PCanaryTimingWheel) MEMCALLOC(1, SIZEOF(CanaryTimingWheel) + slotCount * SIZEOF(PCanaryTimingWheelEntry));
+    CHK(pCanaryTimingWheel != NULL, STATUS_NOT_ENOUGH_MEMORY);
+
+    pCanaryTimingWheel->tick = tick * DEFAULT_TIME_UNIT_IN_NANOS;
+    pCanaryTimingWheel->slotCount = slotCount;
+    pCanaryTimingWheel->pSlots = (PCanaryTimingWheelEntry*) (pCanaryTimingWheel + 1);
+    pCanaryTimingWheel->startTime = canaryMonotonicTime();
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus)) {
+        SAFE_MEMFREE(pCanaryTimingWheel);
+    }
+
+    if (ppCanaryTimingWheel != NULL) {
+        *ppCanaryTimingWheel = pCanaryTimingWheel;
+    }
+
+    LEAVES();
+    return retStatus;
+}
+
+STATUS freeCanaryTimingWheel(PCanaryTimingWheel* ppCanaryTimingWheel)
+{
+    ENTERS();
+    STATUS retStatus = STATUS_SUCCESS;
+    PCanaryTimingWheel pCanaryTimingWheel;
+    PCanaryTimingWheelEntry pEntry, pNext;
+    UINT32 i;
+
+    CHK(ppCanaryTimingWheel != NULL, STATUS_NULL_ARG);
+    pCanaryTimingWheel = *ppCanaryTimingWheel;
+
+    // Call is idempotent
+    CHK(pCanaryTimingWheel != NULL, retStatus);
+
+    for (i = 0; i < pCanaryTimingWheel->slotCount; i++) {
+        for (pEntry = pCanaryTimingWheel->pSlots[i]; pEntry != NULL; pEntry = pNext) {
+            pNext = pEntry->pNext;
+            MEMFREE(pEntry);
+        }
+    }
+
+    SAFE_MEMFREE(*ppCanaryTimingWheel);
+
+CleanUp:
+
+    LEAVES();
+    return retStatus;
+}
+
+static VOID canaryTimingWheelInsert(PCanaryTimingWheel pCanaryTimingWheel, PCanaryTimingWheelEntry pEntry)
+{
+    UINT64 entryTick = (pEntry->pacer.nextDeadline - pCanaryTimingWheel->startTime) / pCanaryTimingWheel->tick;
+    UINT32 slot;
+
+    // Never schedule into a slot the wheel has already passed
+    entryTick = MAX(entryTick, pCanaryTimingWheel->currentTick + 1);
+    slot = (UINT32) (entryTick % pCanaryTimingWheel->slotCount);
+    pEntry->pNext = pCanaryTimingWheel->pSlots[slot];
+    pCanaryTimingWheel->pSlots[slot] = pEntry;
+}
+
+// Adds a stream that is served every period, starting startOffset after now. Offsets let the caller stagger streams
+// that share a period so they don't all fire on the same tick. Streams must be added before the wheel is run
+STATUS canaryTimingWheelAddStream(PCanaryTimingWheel pCanaryTimingWheel, UINT64 period, UINT64 startOffset, CanaryTimingWheelCallbackFunc callbackFn,
+                                  UINT64 customData, PCanaryTimingWheelEntry* ppEntry)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PCanaryTimingWheelEntry pEntry = NULL;
+
+    CHK(pCanaryTimingWheel != NULL && callbackFn != NULL, STATUS_NULL_ARG);
+
+    pEntry = (PCanaryTimingWheelEntry) MEMCALLOC(1, SIZEOF(CanaryTimingWheelEntry));
+    CHK(pEntry != NULL, STATUS_NOT_ENOUGH_MEMORY);
+
+    CHK_STATUS(initCanaryPacer(&pEntry->pacer, period));
+    pEntry->pacer.nextDeadline += startOffset * DEFAULT_TIME_UNIT_IN_NANOS;
+    pEntry->callbackFn = callbackFn;
+    pEntry->customData = customData;
+    canaryTimingWheelInsert(pCanaryTimingWheel, pEntry);
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus)) {
+        SAFE_MEMFREE(pEntry);
+    }
+
+    if (ppEntry != NULL) {
+        *ppEntry = pEntry;
+    }
+
+    return retStatus;
+}
+
+// Drives every stream on the wheel from the calling thread until pTerminate is set. Each tick sleeps to an absolute
+// deadline and only visits the streams hashed into that tick's slot
+STATUS canaryTimingWheelRun(PCanaryTimingWheel pCanaryTimingWheel, volatile ATOMIC_BOOL* pTerminate)
+{
+    STATUS retStatus = STATUS_SUCCESS, status;
+    PCanaryTimingWheelEntry pEntry, pNext, pPending;
+    UINT64 now;
+    UINT32 slot;
+
+    CHK(pCanaryTimingWheel != NULL && pTerminate != NULL, STATUS_NULL_ARG);
+
+    while (!ATOMIC_LOAD_BOOL(pTerminate)) {
+        canarySleepUntil(pCanaryTimingWheel->startTime + (pCanaryTimingWheel->currentTick + 1) * pCanaryTimingWheel->tick);
+        now = canaryMonotonicTime();
+
+        // Catch up on every tick that has elapsed, e.g. after a slow callback
+        while (pCanaryTimingWheel->startTime + (pCanaryTimingWheel->currentTick + 1) * pCanaryTimingWheel->tick <= now) {
+            pCanaryTimingWheel->currentTick++;
+            slot = (UINT32) (pCanaryTimingWheel->currentTick % pCanaryTimingWheel->slotCount);
+            pPending = pCanaryTimingWheel->pSlots[slot];
+            pCanaryTimingWheel->pSlots[slot] = NULL;
+
+            for (pEntry = pPending; pEntry != NULL; pEntry = pNext) {
+                pNext = pEntry->pNext;
+
+                // Entries more than one rotation out share the slot, leave them for a later round
+                if (pEntry->pacer.nextDeadline <= now) {
+                    status = pEntry->callbackFn(pEntry->customData, pEntry->pacer.nextDeadline);
+                    canaryPacerAdvance(&pEntry->pacer, now);
+                    if (STATUS_FAILED(status)) {
+                        DLOGW("Removing stream 0x%" PRIx64 " from the timing wheel, callback failed with 0x%08x", pEntry->customData, status);
+                        MEMFREE(pEntry);
+                        continue;
+                    }
+                }
+
+                canaryTimingWheelInsert(pCanaryTimingWheel, pEntry);
+            }
+        }
+    }
+
+CleanUp:
+
+    return retStatus;
+}
@@ -2,7 +2,6 @@
  * Kinesis Video Producer Continuous Retry Stream Callbacks
  */
 #define LOG_CLASS "CanaryStreamCallbacks"
-#include <numeric>
 #include "CanaryUtils.h"
 
 std::atomic<UINT64> pendingMetrics;
@@ -23,7 +22,7 @@ STATUS createCanaryStreamCallbacks(Aws::CloudWatch::CloudWatchClient* cwClient,
     // Set the version, self
     pCanaryStreamCallbacks->streamCallbacks.version = STREAM_CALLBACKS_CURRENT_VERSION;
     pCanaryStreamCallbacks->streamCallbacks.customData = (UINT64) pCanaryStreamCallbacks;
-    pCanaryStreamCallbacks->timeOfNextKeyFrame = new std::map<UINT64, UINT64>();
+    canaryAckTrackerInit(&pCanaryStreamCallbacks->ackTracker);
 
     pCanaryStreamCallbacks->pCwClient = cwClient;
 
@@ -39,6 +38,9 @@ STATUS createCanaryStreamCallbacks(Aws::CloudWatch::CloudWatchClient* cwClient,
     pCanaryStreamCallbacks->streamCallbacks.freeStreamCallbacksFn = canaryStreamFreeHandler;
 
     pCanaryStreamCallbacks->aggregateMetrics = TRUE;
+    pCanaryStreamCallbacks->matchStreamHandle = FALSE;
+    pCanaryStreamCallbacks->streamHandle = INVALID_STREAM_HANDLE_VALUE;
+    pCanaryStreamCallbacks->historicStreamMetric.prevPublishTime = GETTIME();
 
 CleanUp:
 
@@ -68,7 +70,6 @@ STATUS freeCanaryStreamCallbacks(PStreamCallbacks* ppStreamCallbacks)
     // Call is idempotent
     CHK(pCanaryStreamCallbacks != NULL, retStatus);
 
-    delete (pCanaryStreamCallbacks->timeOfNextKeyFrame);
     // Release the object
     MEMFREE(pCanaryStreamCallbacks);
 
@@ -102,6 +103,11 @@ STATUS canaryStreamErrorReportHandler(UINT64 customData, STREAM_HANDLE streamHan
 {
     PCanaryStreamCallbacks pCanaryStreamCallbacks = (PCanaryStreamCallbacks) customData;
     Aws::CloudWatch::Model::MetricDatum streamErrorDatum, aggstreamErrorDatum;
+
+    if (pCanaryStreamCallbacks->matchStreamHandle && pCanaryStreamCallbacks->streamHandle != streamHandle) {
+        return STATUS_SUCCESS;
+    }
+
     DLOGE("CanaryStreamErrorReportHandler got error %lu at time %" PRIu64 " for stream % " PRIu64 " for upload handle %" PRIu64, statusCode,
             erroredTimecode, streamHandle, uploadHandle);
     streamErrorDatum.SetMetricName("StreamError");
@@ -191,28 +197,15 @@ VOID pushMetric(PCanaryStreamCallbacks pCanaryStreamCallback, Aws::CloudWatch::M
 STATUS canaryStreamFragmentAckHandler(UINT64 customData, STREAM_HANDLE streamHandle, UPLOAD_HANDLE uploadHandle, PFragmentAck pFragmentAck)
 {
     PCanaryStreamCallbacks pCanaryStreamCallbacks = (PCanaryStreamCallbacks) customData;
-    UINT64 timeOfFragmentEndSent = pCanaryStreamCallbacks->timeOfNextKeyFrame->find(pFragmentAck->timestamp)->second;
-    DOUBLE time;
-    switch (pFragmentAck->ackType) {
-        case FRAGMENT_ACK_TYPE_BUFFERING:
-            break;
-        case FRAGMENT_ACK_TYPE_RECEIVED:
-            time = (DOUBLE)(GETTIME() - timeOfFragmentEndSent) / (DOUBLE)HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
-            pCanaryStreamCallbacks->receivedAckLatencyVec.push_back(time);
-            break;
-
-        case FRAGMENT_ACK_TYPE_PERSISTED:
-            time = (DOUBLE)(GETTIME() - timeOfFragmentEndSent) / (DOUBLE)HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
-            pCanaryStreamCallbacks->persistedAckLatencyVec.push_back(time);
-            pCanaryStreamCallbacks->timeOfNextKeyFrame->erase(pFragmentAck->timestamp);
-
-            break;
-        case FRAGMENT_ACK_TYPE_ERROR:
-            DLOGE("Received Error Ack timestamp %" PRIu64 " fragment number %s error code %lu", pFragmentAck->timestamp, pFragmentAck->sequenceNumber,
-            pFragmentAck->result);
-            break;
-        default:
-            break;
+
+    if (pCanaryStreamCallbacks->matchStreamHandle && pCanaryStreamCallbacks->streamHandle != streamHandle) {
+        return STATUS_SUCCESS;
+    }
+
+    canaryAckTrackerOnAck(&pCanaryStreamCallbacks->ackTracker, pFragmentAck);
+    if (pFragmentAck->ackType == FRAGMENT_ACK_TYPE_ERROR) {
+        DLOGE("Received Error Ack timestamp %" PRIu64 " fragment number %s error code %lu", pFragmentAck->timestamp, pFragmentAck->sequenceNumber,
+              pFragmentAck->result);
     }
     return STATUS_SUCCESS;
 }
@@ -255,7 +248,6 @@ STATUS publishErrorRate(UINT32 timerId, UINT64 currentTime, UINT64 customData)
     StreamMetrics canaryStreamMetrics;
     canaryStreamMetrics.version = STREAM_METRICS_CURRENT_VERSION;
     CanaryCustomData* c = (CanaryCustomData*) customData;
-    static UINT64 currentTimeLocal = 0;
     UINT64 duration = 0;
 
     Aws::CloudWatch::Model::MetricDatum putFrameErrorRateDatum, errorAckDatum, totalErrorDatum;
@@ -265,7 +257,8 @@ STATUS publishErrorRate(UINT32 timerId, UINT64 currentTime, UINT64 customData)
     CHK(c->pCanaryStreamCallbacks != NULL, STATUS_NULL_ARG);
     CHK_STATUS(getKinesisVideoStreamMetrics(c->streamHandle, &canaryStreamMetrics));
 
-    duration = currentTime - currentTimeLocal;
+    // Kept per stream, several streams publish from the same process in multi-stream mode
+    duration = currentTime - c->pCanaryStreamCallbacks->historicStreamMetric.prevPublishTime;
 
     numberOfPutFrameErrors = canaryStreamMetrics.putFrameErrors - c->pCanaryStreamCallbacks->historicStreamMetric.prevPutFrameErrorCount;
     numberOfErrorAcks = canaryStreamMetrics.errorAcks - c->pCanaryStreamCallbacks->historicStreamMetric.prevErrorAckCount;
@@ -312,7 +305,7 @@ STATUS publishErrorRate(UINT32 timerId, UINT64 currentTime, UINT64 customData)
 
     DLOGD("Error ack rate: %lf", errorAckRate);
     DLOGD("PutFrame error rate: %lf", putFrameErrorRate);
-    currentTimeLocal = GETTIME();
+    c->pCanaryStreamCallbacks->historicStreamMetric.prevPublishTime = GETTIME();
 CleanUp:
     return retStatus;
 }
@@ -408,36 +401,47 @@ VOID currentMemoryAllocation(PCanaryStreamCallbacks pCanaryStreamCallbacks)
     }
 }
 
-STATUS computeAckMetricsFromCanary(PCanaryStreamCallbacks pCanaryStreamCallbacks) {
-    Aws::CloudWatch::Model::MetricDatum receiveAckDatum, persistedAckDatum, paggAckDatum, raggAckDatum;
-    DOUBLE rAckAvg, pAckAvg;
-    rAckAvg = (std::accumulate(pCanaryStreamCallbacks->receivedAckLatencyVec.begin(), pCanaryStreamCallbacks->receivedAckLatencyVec.end(), 0.0)) / pCanaryStreamCallbacks->receivedAckLatencyVec.size();
-    pCanaryStreamCallbacks->receivedAckLatencyVec.clear();
-    pAckAvg = (std::accumulate(pCanaryStreamCallbacks->persistedAckLatencyVec.begin(), pCanaryStreamCallbacks->persistedAckLatencyVec.end(), 0.0)) / pCanaryStreamCallbacks->persistedAckLatencyVec.size();
-    pCanaryStreamCallbacks->persistedAckLatencyVec.clear();
-
-    receiveAckDatum.SetMetricName("ReceivedAckLatency");
-    receiveAckDatum.AddDimensions(pCanaryStreamCallbacks->dimensionPerStream);
-    pushMetric(pCanaryStreamCallbacks, receiveAckDatum, Aws::CloudWatch::Model::StandardUnit::Milliseconds,
-               rAckAvg);
-    if (pCanaryStreamCallbacks->aggregateMetrics) {
-        raggAckDatum.SetMetricName("ReceivedAckLatency");
-        raggAckDatum.AddDimensions(pCanaryStreamCallbacks->aggregatedDimension);
-        pushMetric(pCanaryStreamCallbacks, raggAckDatum, Aws::CloudWatch::Model::StandardUnit::Milliseconds,
-                   rAckAvg);
+static VOID pushAckLatencyMetrics(PCanaryStreamCallbacks pCanaryStreamCallbacks, PCHAR prefix, PCanaryHdrSummary pSummary)
+{
+    CHAR metricName[64];
+    PCHAR suffixes[] = {(PCHAR) "P50", (PCHAR) "P90", (PCHAR) "P99", (PCHAR) "Max"};
+    UINT64 values[] = {pSummary->p50, pSummary->p90, pSummary->p99, pSummary->max};
+    UINT32 i;
+
+    for (i = 0; i < ARRAY_SIZE(values); i++) {
+        Aws::CloudWatch::Model::MetricDatum datum, aggDatum;
+        SNPRINTF(metricName, SIZEOF(metricName), "%s%s", prefix, suffixes[i]);
+
+        datum.SetMetricName(metricName);
+        datum.AddDimensions(pCanaryStreamCallbacks->dimensionPerStream);
+        pushMetric(pCanaryStreamCallbacks, datum, Aws::CloudWatch::Model::StandardUnit::Milliseconds, (DOUBLE) values[i] / 1000);
+        if (pCanaryStreamCallbacks->aggregateMetrics) {
+            aggDatum.SetMetricName(metricName);
+            aggDatum.AddDimensions(pCanaryStreamCallbacks->aggregatedDimension);
+            pushMetric(pCanaryStreamCallbacks, aggDatum, Aws::CloudWatch::Model::StandardUnit::Milliseconds, (DOUBLE) values[i] / 1000);
+        }
     }
+}
 
-    persistedAckDatum.SetMetricName("PersistedAckLatency");
-    persistedAckDatum.AddDimensions(pCanaryStreamCallbacks->dimensionPerStream);
-    pushMetric(pCanaryStreamCallbacks, persistedAckDatum, Aws::CloudWatch::Model::StandardUnit::Milliseconds,
-               pAckAvg);
-    if (pCanaryStreamCallbacks->aggregateMetrics) {
-        paggAckDatum.SetMetricName("PersistedAckLatency");
-        paggAckDatum.AddDimensions(pCanaryStreamCallbacks->aggregatedDimension);
-        pushMetric(pCanaryStreamCallbacks, paggAckDatum, Aws::CloudWatch::Model::StandardUnit::Milliseconds,
-                   pAckAvg);
+// Publishes the ack latency distribution since the last publish. Nothing is pushed for an interval without acks
+STATUS computeAckMetricsFromCanary(PCanaryStreamCallbacks pCanaryStreamCallbacks)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    CanaryHdrSummary receivedSummary, persistedSummary;
+
+    CHK(pCanaryStreamCallbacks != NULL, STATUS_NULL_ARG);
+    canaryHdrHistogramCollect(&pCanaryStreamCallbacks->ackTracker.receivedLatency, &receivedSummary);
+    canaryHdrHistogramCollect(&pCanaryStreamCallbacks->ackTracker.persistedLatency, &persistedSummary);
+
+    if (receivedSummary.count != 0) {
+        pushAckLatencyMetrics(pCanaryStreamCallbacks, (PCHAR) "ReceivedAckLatency", &receivedSummary);
     }
-    return STATUS_SUCCESS;
+    if (persistedSummary.count != 0) {
+        pushAckLatencyMetrics(pCanaryStreamCallbacks, (PCHAR) "PersistedAckLatency", &persistedSummary);
+    }
+
+CleanUp:
+    return retStatus;
 }
 
 STATUS publishMetrics(UINT32 timerId, UINT64 currentTime, UINT64 customData)
@@ -448,21 +452,47 @@ STATUS publishMetrics(UINT32 timerId, UINT64 currentTime, UINT64 customData)
     CHK_STATUS(computeClientMetricsFromCanary(c->clientHandle, c->pCanaryStreamCallbacks));
     CHK_STATUS(computeAckMetricsFromCanary(c->pCanaryStreamCallbacks));
     currentMemoryAllocation(c->pCanaryStreamCallbacks);
+    if (c->pCanaryPacer != NULL) {
+        CHK_STATUS(pushFrameLatenessMetrics(c->pCanaryStreamCallbacks, &c->pCanaryPacer->lateness));
+    }
+CleanUp:
+    return retStatus;
+}
+
+// Publishes how late the frame loop served its deadlines since the last publish
+STATUS pushFrameLatenessMetrics(PCanaryStreamCallbacks pCanaryStreamCallbacks, PCanaryLatenessHistogram pHistogram)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    SIZE_T buckets[CANARY_LATENESS_BUCKET_COUNT];
+    SIZE_T skippedDeadlines;
+    Aws::CloudWatch::Model::MetricDatum p50Datum, p99Datum, maxDatum, skippedDatum;
+
+    CHK(pCanaryStreamCallbacks != NULL && pHistogram != NULL, STATUS_NULL_ARG);
+    canaryLatenessHistogramCollect(pHistogram, buckets, &skippedDeadlines);
+
+    p50Datum.SetMetricName("FrameLatenessP50");
+    p50Datum.AddDimensions(pCanaryStreamCallbacks->dimensionPerStream);
+    pushMetric(pCanaryStreamCallbacks, p50Datum, Aws::CloudWatch::Model::StandardUnit::Microseconds, (DOUBLE) canaryLatenessPercentile(buckets, 50));
+
+    p99Datum.SetMetricName("FrameLatenessP99");
+    p99Datum.AddDimensions(pCanaryStreamCallbacks->dimensionPerStream);
+    pushMetric(pCanaryStreamCallbacks, p99Datum, Aws::CloudWatch::Model::StandardUnit::Microseconds, (DOUBLE) canaryLatenessPercentile(buckets, 99));
+
+    maxDatum.SetMetricName("FrameLatenessMax");
+    maxDatum.AddDimensions(pCanaryStreamCallbacks->dimensionPerStream);
+    pushMetric(pCanaryStreamCallbacks, maxDatum, Aws::CloudWatch::Model::StandardUnit::Microseconds,
+               (DOUBLE) ATOMIC_LOAD(&pHistogram->maxLateness) / 1000);
+
+    skippedDatum.SetMetricName("FrameDeadlinesSkipped");
+    skippedDatum.AddDimensions(pCanaryStreamCallbacks->dimensionPerStream);
+    pushMetric(pCanaryStreamCallbacks, skippedDatum, Aws::CloudWatch::Model::StandardUnit::Count, (DOUBLE) skippedDeadlines);
+
 CleanUp:
     return retStatus;
 }
 
 VOID canaryStreamRecordFragmentEndSendTime(PCanaryStreamCallbacks pCanaryStreamCallbacks, UINT64 lastKeyFrameTime, UINT64 curKeyFrameTime)
 {
-    auto mapPtr = pCanaryStreamCallbacks->timeOfNextKeyFrame;
-    (*mapPtr)[lastKeyFrameTime / HUNDREDS_OF_NANOS_IN_A_MILLISECOND] = curKeyFrameTime;
-    auto iter = mapPtr->begin();
-    while (iter != mapPtr->end()) {
-        // clean up from current timestamp of 5 min timestamps would be removed
-        if (iter->first < (GETTIME() - (300 * HUNDREDS_OF_NANOS_IN_A_SECOND)) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND) {
-            iter = mapPtr->erase(iter);
-        } else {
-            break;
-        }
-    }
-}
\ No newline at end of file
+    // Acks carry the fragment start timestamp in milliseconds
+    canaryAckTrackerRecordFragmentEnd(&pCanaryStreamCallbacks->ackTracker, lastKeyFrameTime / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, curKeyFrameTime);
+}
@@ -13,6 +13,9 @@
 #include <aws/logs/model/PutLogEventsRequest.h>
 #include <aws/logs/model/DeleteLogStreamRequest.h>
 #include <aws/logs/model/DescribeLogStreamsRequest.h>
+#include <CanaryAckTracker.h>
+#include <CanaryRandom.h>
+#include <CanaryPacing.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -27,6 +30,13 @@ extern "C" {
 
 #define NUMBER_OF_FRAME_FILES 403
 #define CANARY_METADATA_SIZE  (SIZEOF(INT64) + SIZEOF(UINT32) + SIZEOF(UINT32) + SIZEOF(UINT64))
+#define CANARY_FRAME_POOL_SIZE 128
+
+#define CANARY_TIMING_WHEEL_DEFAULT_SLOT_COUNT 256
+#define CANARY_TIMING_WHEEL_TICK               (1 * HUNDREDS_OF_NANOS_IN_A_MILLISECOND)
+#define CANARY_MAX_STREAM_COUNT                512
+#define CANARY_MULTI_STREAM_MAX_WORKERS        8
+#define CANARY_METRICS_PUBLISH_PERIOD          (60 * HUNDREDS_OF_NANOS_IN_A_SECOND)
 
 #define CANARY_FILE_LOGGING_BUFFER_SIZE (200 * 1024)
 #define CANARY_MAX_NUMBER_OF_LOG_FILES  10
@@ -50,6 +60,8 @@ extern "C" {
 #define CANARY_SCENARIO_ENV_VAR        (PCHAR) "CANARY_RUN_SCENARIO"
 #define CANARY_TRACK_TYPE_ENV_VAR      (PCHAR) "TRACK_TYPE"
 #define CANARY_CP_API_ENV_VAR          (PCHAR) "CANARY_CP_URL"
+#define CANARY_STREAM_COUNT_ENV_VAR    (PCHAR) "CANARY_STREAM_COUNT"
+#define FRAME_SIZE_JITTER_ENV_VAR      (PCHAR) "FRAME_SIZE_JITTER_PERCENT"
 
 // IoT related env
 #define CANARY_USE_IOT_CREDENTIALS_ENV_VAR   (PCHAR) "CANARY_USE_IOT_PROVIDER"
@@ -67,6 +79,10 @@ extern "C" {
 #define CANARY_DEFAULT_FRAGMENT_SIZE       (25 * 1024)
 #define CANARY_DEFAULT_CANARY_LABEL        (PCHAR) "Longrun"
 #define CANARY_DEFAULT_TRACK_TYPE          CANARY_SINGLE_TRACK_TYPE
+#define CANARY_DEFAULT_STREAM_COUNT        1
+// Frame sizes are drawn uniformly within this many percent of the mean, which keeps the bitrate
+#define CANARY_DEFAULT_FRAME_SIZE_JITTER   25
+#define CANARY_MAX_FRAME_SIZE_JITTER       100
 
 #define CANARY_TYPE_STR_LEN                20
 #define CANARY_STREAM_NAME_STR_LEN         255
@@ -105,6 +121,8 @@ typedef struct {
     UINT64 canaryDuration;
     UINT64 bufferDuration;
     UINT64 storageSizeInBytes;
+    UINT64 streamCount;
+    UINT64 frameSizeJitterPercent;
 } CanaryConfig;
 
 typedef CanaryConfig* PCanaryConfig;
@@ -127,6 +145,7 @@ typedef struct __CloudwatchLogsObject* PCloudwatchLogsObject;
 typedef struct {
     UINT64 prevErrorAckCount;
     UINT64 prevPutFrameErrorCount;
+    UINT64 prevPublishTime;
 } HistoricStreamMetric;
 
 typedef struct __CanaryStreamCallbacks CanaryStreamCallbacks;
@@ -134,25 +153,124 @@ struct __CanaryStreamCallbacks {
     // First member should be the stream callbacks
     StreamCallbacks streamCallbacks;
     PCHAR pStreamName;
+    // The callbacks provider invokes every stream callback for every stream of the client. When several streams share
+    // a client, only events for streamHandle are handled
+    BOOL matchStreamHandle;
+    STREAM_HANDLE streamHandle;
     UINT64 totalNumberOfErrors;
     BOOL aggregateMetrics;
-    Aws::Vector<DOUBLE> receivedAckLatencyVec;
-    Aws::Vector<DOUBLE> persistedAckLatencyVec;
     Aws::CloudWatch::CloudWatchClient* pCwClient;
     Aws::CloudWatch::Model::PutMetricDataRequest* cwRequest;
     Aws::CloudWatch::Model::Dimension dimensionPerStream;
     Aws::CloudWatch::Model::Dimension aggregatedDimension;
     HistoricStreamMetric historicStreamMetric;
-    std::map<UINT64, UINT64>* timeOfNextKeyFrame;
+    CanaryAckTracker ackTracker;
 };
 typedef struct __CanaryStreamCallbacks* PCanaryStreamCallbacks;
 
+typedef struct {
+    // Start of the frame. The first headerSize bytes of the pool are left for the canary metadata
+    PBYTE pData;
+    // Frame size including the header
+    UINT32 size;
+    // CRC32 of the random body, computed once when the pool is created
+    UINT32 bodyCrc;
+} CanaryFramePoolEntry, *PCanaryFramePoolEntry;
+
+typedef struct {
+    UINT64 prngState[CANARY_RANDOM_STATE_SIZE];
+    UINT32 headerSize;
+    UINT32 entryCount;
+    PCanaryFramePoolEntry pEntries;
+    PBYTE pBuffer;
+} CanaryFramePool, *PCanaryFramePool;
+
+typedef struct {
+    // Written by the pacing thread only
+    volatile SIZE_T buckets[CANARY_LATENESS_BUCKET_COUNT];
+    volatile SIZE_T maxLateness;
+    volatile SIZE_T skippedDeadlines;
+    // Bucket counts as of the last publish, owned by the publisher
+    SIZE_T publishedBuckets[CANARY_LATENESS_BUCKET_COUNT];
+    SIZE_T publishedSkippedDeadlines;
+} CanaryLatenessHistogram, *PCanaryLatenessHistogram;
+
+typedef struct {
+    // Pacing period in nanoseconds
+    UINT64 period;
+    // Absolute CLOCK_MONOTONIC deadline of the next frame in nanoseconds
+    UINT64 nextDeadline;
+    CanaryLatenessHistogram lateness;
+} CanaryPacer, *PCanaryPacer;
+
+// Invoked by the timing wheel with the deadline (monotonic nanoseconds) being served. Returning a failure removes the
+// stream from the wheel
+typedef STATUS (*CanaryTimingWheelCallbackFunc)(UINT64, UINT64);
+
+typedef struct __CanaryTimingWheelEntry CanaryTimingWheelEntry;
+struct __CanaryTimingWheelEntry {
+    CanaryPacer pacer;
+    CanaryTimingWheelCallbackFunc callbackFn;
+    UINT64 customData;
+    struct __CanaryTimingWheelEntry* pNext;
+};
+typedef struct __CanaryTimingWheelEntry* PCanaryTimingWheelEntry;
+
+typedef struct {
+    UINT64 tick;
+    UINT64 startTime;
+    UINT64 currentTick;
+    UINT32 slotCount;
+    PCanaryTimingWheelEntry* pSlots;
+} CanaryTimingWheel, *PCanaryTimingWheel;
+
 typedef struct {
     STREAM_HANDLE streamHandle;
     CLIENT_HANDLE clientHandle;
     PCanaryStreamCallbacks pCanaryStreamCallbacks;
+    PCanaryPacer pCanaryPacer;
 } CanaryCustomData;
 
+typedef struct {
+    CHAR streamName[MAX_STREAM_NAME_LEN + 1];
+    CanaryCustomData customData;
+    // Pool of the worker that drives this stream
+    PCanaryFramePool pCanaryFramePool;
+    Frame frame;
+    UINT32 frameIndex;
+    UINT64 lastKeyFrameTimestamp;
+    UINT64 createTime;
+    // Time from stream creation to the first successful put in 100ns, 0 until then
+    volatile SIZE_T startUpLatency;
+    BOOL startUpLatencyPublished;
+    BOOL multiTrack;
+    volatile SIZE_T framesSent;
+    volatile SIZE_T bytesSent;
+    volatile SIZE_T putFrameErrors;
+} CanaryStreamContext, *PCanaryStreamContext;
+
+typedef struct {
+    TID threadId;
+    BOOL started;
+    PCanaryTimingWheel pCanaryTimingWheel;
+    PCanaryFramePool pCanaryFramePool;
+    volatile ATOMIC_BOOL* pTerminate;
+} CanaryMultiStreamWorker, *PCanaryMultiStreamWorker;
+
+typedef struct {
+    UINT32 streamCount;
+    UINT32 workerCount;
+    UINT64 fragmentSizeInBytes;
+    UINT64 frameSizeJitterPercent;
+    volatile ATOMIC_BOOL terminate;
+    TIMER_QUEUE_HANDLE timerQueueHandle;
+    UINT32 metricsTimerId;
+    SIZE_T publishedFramesSent;
+    UINT64 prevPublishTime;
+    PCanaryStreamContext pStreams;
+    PCanaryMultiStreamWorker pWorkers;
+} CanaryMultiStream, *PCanaryMultiStream;
+
 ////////////////////////////////////////////////////////////////////////
 // Callback function implementations
 ////////////////////////////////////////////////////////////////////////
@@ -170,6 +288,36 @@ VOID pushMetric(PCanaryStreamCallbacks pCanaryStreamCallback, Aws::CloudWatch::M
 STATUS publishErrorRate(UINT32 timerId, UINT64 currentTime, UINT64 customData);
 STATUS pushStartUpLatency(PCanaryStreamCallbacks, DOUBLE);
 STATUS publishMetrics(UINT32 timerId, UINT64 currentTime, UINT64 customData);
+STATUS pushFrameLatenessMetrics(PCanaryStreamCallbacks, PCanaryLatenessHistogram);
+
+////////////////////////////////////////////////////////////////////////
+// Pre-generated frame pool
+////////////////////////////////////////////////////////////////////////
+STATUS createCanaryFramePool(UINT32, UINT32, UINT32, UINT32, PCanaryFramePool*);
+VOID getCanaryFrameBodySizeRange(UINT64, UINT64, PUINT32, PUINT32);
+STATUS freeCanaryFramePool(PCanaryFramePool*);
+PCanaryFramePoolEntry getNextCanaryFramePoolEntry(PCanaryFramePool);
+UINT32 canaryCrc32Combine(UINT32, UINT32, UINT64);
+
+////////////////////////////////////////////////////////////////////////
+// Absolute deadline pacing
+////////////////////////////////////////////////////////////////////////
+STATUS initCanaryPacer(PCanaryPacer, UINT64);
+STATUS canaryPacerWait(PCanaryPacer);
+STATUS canaryPacerReset(PCanaryPacer);
+VOID canaryLatenessHistogramCollect(PCanaryLatenessHistogram, PSIZE_T, PSIZE_T);
+STATUS createCanaryTimingWheel(UINT64, UINT32, PCanaryTimingWheel*);
+STATUS freeCanaryTimingWheel(PCanaryTimingWheel*);
+STATUS canaryTimingWheelAddStream(PCanaryTimingWheel, UINT64, UINT64, CanaryTimingWheelCallbackFunc, UINT64, PCanaryTimingWheelEntry*);
+STATUS canaryTimingWheelRun(PCanaryTimingWheel, volatile ATOMIC_BOOL*);
+
+////////////////////////////////////////////////////////////////////////
+// Multi-stream load generator
+////////////////////////////////////////////////////////////////////////
+STATUS createCanaryMultiStream(Aws::CloudWatch::CloudWatchClient*, PCanaryConfig, PCHAR, PClientCallbacks, PCanaryMultiStream*);
+STATUS freeCanaryMultiStream(PCanaryMultiStream*);
+STATUS runCanaryMultiStream(PCanaryMultiStream, CLIENT_HANDLE, PStreamInfo, TIMER_QUEUE_HANDLE, UINT64, volatile ATOMIC_BOOL*);
+STATUS publishMultiStreamMetrics(UINT32, UINT64, UINT64);
 
 ////////////////////////////////////////////////////////////////////////
 // Cloudwatch logging related functions
@@ -188,6 +336,7 @@ STATUS optenv(PCHAR, PCHAR, PCHAR);
 STATUS optenvUint64(PCHAR, PUINT64, UINT64);
 STATUS printConfig(PCanaryConfig);
 STATUS initWithEnvVars(PCanaryConfig);
+VOID createCanaryFrameData(PCanaryFramePool, PFrame);
 
 #ifdef __cplusplus
 }
@@ -7,27 +7,34 @@ VOID sigintHandler(INT32 sigNum)
     ATOMIC_STORE_BOOL(&sigCaptureInterrupt, TRUE);
 }
 
-// add frame pts, frame index, original frame size, CRC to beginning of buffer
-VOID addCanaryMetadataToFrameData(PFrame pFrame)
+// add frame pts, frame index, original frame size, CRC to beginning of buffer. The CRC covers the whole frame with the
+// CRC field zeroed, and is combined from the CRC of the header and the pre-computed CRC of the pool entry body
+VOID addCanaryMetadataToFrameData(PFrame pFrame, PCanaryFramePoolEntry pEntry)
 {
     PBYTE pCurPtr = pFrame->frameData;
+    UINT32 crc;
+
     putUnalignedInt64BigEndian((PINT64) pCurPtr, pFrame->presentationTs / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
     pCurPtr += SIZEOF(UINT64);
     putUnalignedInt32BigEndian((PINT32) pCurPtr, pFrame->index);
     pCurPtr += SIZEOF(UINT32);
     putUnalignedInt32BigEndian((PINT32) pCurPtr, pFrame->size);
     pCurPtr += SIZEOF(UINT32);
-    putUnalignedInt32BigEndian((PINT32) pCurPtr, COMPUTE_CRC32(pFrame->frameData, pFrame->size));
+    putUnalignedInt64BigEndian((PINT64) pCurPtr, 0);
+
+    crc = COMPUTE_CRC32(pFrame->frameData, CANARY_METADATA_SIZE);
+    crc = canaryCrc32Combine(crc, pEntry->bodyCrc, pFrame->size - CANARY_METADATA_SIZE);
+    putUnalignedInt64BigEndian((PINT64) pCurPtr, crc);
 }
 
-VOID createCanaryFrameData(PFrame pFrame)
+// The frame body is pre-generated random data from the pool, only the metadata header is written per frame
+VOID createCanaryFrameData(PCanaryFramePool pCanaryFramePool, PFrame pFrame)
 {
-    UINT32 i;
+    PCanaryFramePoolEntry pEntry = getNextCanaryFramePoolEntry(pCanaryFramePool);
 
-    for (i = CANARY_METADATA_SIZE; i < pFrame->size; i++) {
-        pFrame->frameData[i] = RAND();
-    }
-    addCanaryMetadataToFrameData(pFrame);
+    pFrame->frameData = pEntry->pData;
+    pFrame->size = pEntry->size;
+    addCanaryMetadataToFrameData(pFrame, pEntry);
 }
 
 VOID adjustStreamInfoToCanaryType(PStreamInfo pStreamInfo, PCHAR canaryType)
@@ -74,6 +81,7 @@ STATUS parseConfigFile(PCanaryConfig pCanaryConfig, PCHAR filePath)
     BYTE params[1024];
 
     CHK(pCanaryConfig != NULL, STATUS_NULL_ARG);
+    pCanaryConfig->streamCount = CANARY_DEFAULT_STREAM_COUNT;
     CHK_STATUS(readFile(filePath, TRUE, NULL, &size));
     CHK_ERR(size < 1024, STATUS_INVALID_ARG_LEN, "File size too big. Max allowed is 1024 bytes");
     CHK_STATUS(readFile(filePath, TRUE, params, &size));
@@ -107,6 +115,14 @@ STATUS parseConfigFile(PCanaryConfig pCanaryConfig, PCHAR filePath)
             getJsonValue(params, tokens[i + 1], final_attr_str);
             STRTOUI64(final_attr_str, NULL, 10, &pCanaryConfig->storageSizeInBytes);
             i++;
+        } else if (compareJsonString((PCHAR) params, &tokens[i], JSMN_STRING, CANARY_STREAM_COUNT_ENV_VAR)) {
+            getJsonValue(params, tokens[i + 1], final_attr_str);
+            STRTOUI64(final_attr_str, NULL, 10, &pCanaryConfig->streamCount);
+            i++;
+        } else if (compareJsonString((PCHAR) params, &tokens[i], JSMN_STRING, FRAME_SIZE_JITTER_ENV_VAR)) {
+            getJsonValue(params, tokens[i + 1], final_attr_str);
+            STRTOUI64(final_attr_str, NULL, 10, &pCanaryConfig->frameSizeJitterPercent);
+            i++;
         } else if (compareJsonString((PCHAR) params, &tokens[i], JSMN_STRING, CANARY_LABEL_ENV_VAR)) {
             getJsonValue(params, tokens[i + 1], pCanaryConfig->canaryLabel);
             i++;
@@ -212,11 +228,13 @@ STATUS printConfig(PCanaryConfig pCanaryConfig)
     DLOGI("Canary Stream name prefix: %s", pCanaryConfig->useIotCredentialProvider ? pCanaryConfig->iotThingName : pCanaryConfig->streamNamePrefix);
     DLOGI("Canary type: %s", pCanaryConfig->canaryTypeStr);
     DLOGI("Fragment size in bytes: %llu bytes", pCanaryConfig->fragmentSizeInBytes);
+    DLOGI("Frame size jitter: %llu%%", pCanaryConfig->frameSizeJitterPercent);
     DLOGI("Canary duration: %llu seconds", pCanaryConfig->canaryDuration);
     DLOGI("Canary buffer duration: %llu seconds", pCanaryConfig->bufferDuration);
     DLOGI("Canary storage size: %llu bytes", pCanaryConfig->storageSizeInBytes);
     DLOGI("Canary scenario: %s", pCanaryConfig->canaryScenario);
     DLOGI("Canary track type: %s", pCanaryConfig->canaryTrackType);
+    DLOGI("Canary stream count: %llu", pCanaryConfig->streamCount);
     DLOGI("Credential type: %s", pCanaryConfig->useIotCredentialProvider ? "IoT" : "Static");
 
     if(pCanaryConfig->useIotCredentialProvider == TRUE) {
@@ -266,6 +284,8 @@ STATUS initWithEnvVars(PCanaryConfig pCanaryConfig)
 
     CHK_STATUS(optenvUint64(CANARY_BUFFER_DURATION_ENV_VAR, &pCanaryConfig->bufferDuration, DEFAULT_BUFFER_DURATION));
     CHK_STATUS(optenvUint64(CANARY_STORAGE_SIZE_ENV_VAR, &pCanaryConfig->storageSizeInBytes, 0));
+    CHK_STATUS(optenvUint64(CANARY_STREAM_COUNT_ENV_VAR, &pCanaryConfig->streamCount, CANARY_DEFAULT_STREAM_COUNT));
+    CHK_STATUS(optenvUint64(FRAME_SIZE_JITTER_ENV_VAR, &pCanaryConfig->frameSizeJitterPercent, CANARY_DEFAULT_FRAME_SIZE_JITTER));
 
     CHK_STATUS(optenvBool(CANARY_USE_IOT_CREDENTIALS_ENV_VAR, &pCanaryConfig->useIotCredentialProvider, FALSE));
 
@@ -309,6 +329,10 @@ INT32 main(INT32 argc, CHAR* argv[])
     BOOL fileLoggingEnabled = FALSE;
     PAuthCallbacks pAuthCallbacks = NULL;
     CanaryConfig config;
+    PCanaryFramePool pCanaryFramePool = NULL;
+    UINT32 minFrameSize, maxFrameSize;
+    PCanaryMultiStream pCanaryMultiStream = NULL;
+    CanaryPacer canaryPacer;
     BOOL firstFrame = TRUE;
     UINT64 startTime;
     DOUBLE startUpLatency;
@@ -322,6 +346,7 @@ INT32 main(INT32 argc, CHAR* argv[])
     c.clientHandle = INVALID_CLIENT_HANDLE_VALUE;
     c.streamHandle = INVALID_STREAM_HANDLE_VALUE;
     c.pCanaryStreamCallbacks = NULL;
+    c.pCanaryPacer = NULL;
 
     initializeEndianness();
     SRAND(time(0));
@@ -341,7 +366,8 @@ INT32 main(INT32 argc, CHAR* argv[])
                   "\t\texport CANARY_BUFFER_DURATION_IN_SECONDS=<duration in seconds>"
                   "\t\texport CANARY_STORAGE_SIZE_IN_BYTES=<storage size in bytes>"
                   "\t\texport CANARY_LABEL=<canary label (longtime,periodic, etc >"
-                  "\t\texport CANARY_RUN_SCENARIO=<canary label (normal/intermittent) >");
+                  "\t\texport CANARY_RUN_SCENARIO=<canary label (normal/intermittent) >"
+                  "\t\texport CANARY_STREAM_COUNT=<number of streams to run on the client>");
             CHK_STATUS(initWithEnvVars(&config));
         } else {
             CHK_ERR(STRLEN(argv[1]) < (MAX_PATH_LEN + 1), STATUS_INVALID_ARG_LEN, "File path length too long");
@@ -384,6 +410,10 @@ INT32 main(INT32 argc, CHAR* argv[])
             CHK_STATUS(setDeviceInfoStorageSize(pDeviceInfo, config.storageSizeInBytes));
         }
 
+        if (config.streamCount > 1) {
+            pDeviceInfo->streamCount = MAX(pDeviceInfo->streamCount, (UINT32) config.streamCount);
+        }
+
         // adjust members of pDeviceInfo here if needed
         pDeviceInfo->clientInfo.loggerLogLevel = LOG_LEVEL_DEBUG;
         logLevel = getenv(DEBUG_LOG_LEVEL_ENV_VAR);
@@ -403,7 +433,9 @@ INT32 main(INT32 argc, CHAR* argv[])
         CHK_STATUS(timerQueueCreate(&timerQueueHandle));
 
         startTime = GETTIME();
-        CHK_STATUS(createAbstractDefaultCallbacksProvider(DEFAULT_CALLBACK_CHAIN_COUNT, API_CALL_CACHE_TYPE_NONE,
+        // Every stream in multi-stream mode adds its own canary stream callbacks to the chain
+        CHK_STATUS(createAbstractDefaultCallbacksProvider(DEFAULT_CALLBACK_CHAIN_COUNT + (UINT32) (config.streamCount > 1 ? config.streamCount : 0),
+                                                          API_CALL_CACHE_TYPE_NONE,
                                                           ENDPOINT_UPDATE_PERIOD_SENTINEL_VALUE, region, config.canaryCpUrl, cacertPath, NULL, NULL,
                                                           &pClientCallbacks));
         if (config.useIotCredentialProvider) {
@@ -431,101 +463,123 @@ INT32 main(INT32 argc, CHAR* argv[])
             }
         }
 
-        CHK_STATUS(createCanaryStreamCallbacks(&cw, streamName, config.canaryLabel, &c.pCanaryStreamCallbacks));
-        CHK_STATUS(addStreamCallbacks(pClientCallbacks, &c.pCanaryStreamCallbacks->streamCallbacks));
+        if (config.streamCount > 1) {
+            CHK_STATUS(createCanaryMultiStream(&cw, &config, streamName, pClientCallbacks, &pCanaryMultiStream));
+        } else {
+            CHK_STATUS(createCanaryStreamCallbacks(&cw, streamName, config.canaryLabel, &c.pCanaryStreamCallbacks));
+            CHK_STATUS(addStreamCallbacks(pClientCallbacks, &c.pCanaryStreamCallbacks->streamCallbacks));
+        }
 
         if (!fileLoggingEnabled) {
             pClientCallbacks->logPrintFn = cloudWatchLogger;
         }
 
         CHK_STATUS(createKinesisVideoClient(pDeviceInfo, pClientCallbacks, &c.clientHandle));
-        CHK_STATUS(createKinesisVideoStreamSync(c.clientHandle, pStreamInfo, &c.streamHandle));
-
-        // setup dummy frame
-        frame.size = CANARY_METADATA_SIZE + config.fragmentSizeInBytes / DEFAULT_FPS_VALUE;
-        frame.frameData = (PBYTE) MEMALLOC(frame.size);
-        CHK(frame.frameData != NULL, STATUS_NOT_ENOUGH_MEMORY);
-        frame.version = FRAME_CURRENT_VERSION;
-        frame.trackId = DEFAULT_VIDEO_TRACK_ID;
-        frame.duration = HUNDREDS_OF_NANOS_IN_A_MILLISECOND / DEFAULT_FPS_VALUE;
-        frame.decodingTs = GETTIME(); // current time
-        frame.presentationTs = frame.decodingTs;
-        currentTime = GETTIME();
-        canaryStopTime = currentTime + (config.canaryDuration * HUNDREDS_OF_NANOS_IN_A_SECOND);
-        UINT64 duration;
-
-        DLOGD("Producer SDK Log file name: %s", cloudwatchLogsObject.logStreamName);
-
-        printConfig(&config);
-
-        // Check if we have continuous run or intermittent scenario
-        if (STRCMP(config.canaryScenario, CANARY_INTERMITTENT_SCENARIO) == 0) {
-            // Set up runTill. This will be used if canary is run under intermittent scenario
-            randomTime = (RAND() % 10) + 1;
-            runTill = GETTIME() + randomTime * HUNDREDS_OF_NANOS_IN_A_MINUTE;
-            DLOGD("Intermittent run time is set to: %" PRIu64 " minutes", randomTime);
-            c.pCanaryStreamCallbacks->aggregateMetrics = FALSE;
-        }
+        if (pCanaryMultiStream != NULL) {
+            printConfig(&config);
+            if (STRCMP(config.canaryScenario, CANARY_INTERMITTENT_SCENARIO) == 0) {
+                DLOGW("Intermittent scenario is not supported with multiple streams, streams will run continuously");
+            }
+            if (!fileLoggingEnabled) {
+                CHK_STATUS(timerQueueAddTimer(timerQueueHandle, 60 * HUNDREDS_OF_NANOS_IN_A_SECOND, 60 * HUNDREDS_OF_NANOS_IN_A_SECOND,
+                                              canaryStreamSendLogs, (UINT64) &cloudwatchLogsObject, &timeoutTimerId));
+            }
+            CHK_STATUS(runCanaryMultiStream(pCanaryMultiStream, c.clientHandle, pStreamInfo, timerQueueHandle,
+                                            GETTIME() + config.canaryDuration * HUNDREDS_OF_NANOS_IN_A_SECOND, &sigCaptureInterrupt));
+        } else {
+            CHK_STATUS(createKinesisVideoStreamSync(c.clientHandle, pStreamInfo, &c.streamHandle));
+
+            // setup dummy frame. The frame data and size come from the pool for every frame
+            getCanaryFrameBodySizeRange(config.fragmentSizeInBytes, config.frameSizeJitterPercent, &minFrameSize, &maxFrameSize);
+            CHK_STATUS(createCanaryFramePool(CANARY_METADATA_SIZE, minFrameSize, maxFrameSize, CANARY_FRAME_POOL_SIZE, &pCanaryFramePool));
+            frame.version = FRAME_CURRENT_VERSION;
+            frame.trackId = DEFAULT_VIDEO_TRACK_ID;
+            frame.duration = HUNDREDS_OF_NANOS_IN_A_MILLISECOND / DEFAULT_FPS_VALUE;
+            frame.decodingTs = GETTIME(); // current time
+            frame.presentationTs = frame.decodingTs;
+            currentTime = GETTIME();
+            canaryStopTime = currentTime + (config.canaryDuration * HUNDREDS_OF_NANOS_IN_A_SECOND);
+            UINT64 duration;
 
-        // Say, the canary needs to be stopped before designated canary run time, signal capture
-        // must still be supported
+            DLOGD("Producer SDK Log file name: %s", cloudwatchLogsObject.logStreamName);
 
-        while (GETTIME() < canaryStopTime && ATOMIC_LOAD_BOOL(&sigCaptureInterrupt) != TRUE) {
-            frame.index = frameIndex;
-            frame.flags = frameIndex % DEFAULT_KEY_FRAME_INTERVAL == 0 ? FRAME_FLAG_KEY_FRAME : FRAME_FLAG_NONE;
-            createCanaryFrameData(&frame);
-            if (frame.flags == FRAME_FLAG_KEY_FRAME) {
-                if (lastKeyFrameTimestamp != 0) {
-                    canaryStreamRecordFragmentEndSendTime(c.pCanaryStreamCallbacks, lastKeyFrameTimestamp, frame.presentationTs);
-                }
-                lastKeyFrameTimestamp = frame.presentationTs;
+            printConfig(&config);
+
+            // Check if we have continuous run or intermittent scenario
+            if (STRCMP(config.canaryScenario, CANARY_INTERMITTENT_SCENARIO) == 0) {
+                // Set up runTill. This will be used if canary is run under intermittent scenario
+                randomTime = (RAND() % 10) + 1;
+                runTill = GETTIME() + randomTime * HUNDREDS_OF_NANOS_IN_A_MINUTE;
+                DLOGD("Intermittent run time is set to: %" PRIu64 " minutes", randomTime);
+                c.pCanaryStreamCallbacks->aggregateMetrics = FALSE;
             }
 
-            if (GETTIME() < runTill) {
-                frame.trackId = DEFAULT_VIDEO_TRACK_ID;
-                CHK_STATUS(putKinesisVideoFrame(c.streamHandle, &frame));
+            CHK_STATUS(initCanaryPacer(&canaryPacer, HUNDREDS_OF_NANOS_IN_A_SECOND / DEFAULT_FPS_VALUE));
+            c.pCanaryPacer = &canaryPacer;
+
+            // Say, the canary needs to be stopped before designated canary run time, signal capture
+            // must still be supported
+
+            while (GETTIME() < canaryStopTime && ATOMIC_LOAD_BOOL(&sigCaptureInterrupt) != TRUE) {
+                frame.index = frameIndex;
+                frame.flags = frameIndex % DEFAULT_KEY_FRAME_INTERVAL == 0 ? FRAME_FLAG_KEY_FRAME : FRAME_FLAG_NONE;
+                createCanaryFrameData(pCanaryFramePool, &frame);
+                if (frame.flags == FRAME_FLAG_KEY_FRAME) {
+                    if (lastKeyFrameTimestamp != 0) {
+                        canaryStreamRecordFragmentEndSendTime(c.pCanaryStreamCallbacks, lastKeyFrameTimestamp, frame.presentationTs);
+                    }
+                    lastKeyFrameTimestamp = frame.presentationTs;
+                }
 
-                // Send frame on another track only if we want to run multi track. For the sake of
-                // multitrack, we use the same frame for video and audio and just modify the flags.
-                if (STRCMP(config.canaryTrackType, CANARY_MULTI_TRACK_TYPE) == 0) {
-                    frame.flags = FRAME_FLAG_NONE;
-                    frame.trackId = DEFAULT_AUDIO_TRACK_ID;
+                if (GETTIME() < runTill) {
+                    frame.trackId = DEFAULT_VIDEO_TRACK_ID;
                     CHK_STATUS(putKinesisVideoFrame(c.streamHandle, &frame));
+
+                    // Send frame on another track only if we want to run multi track. For the sake of
+                    // multitrack, we use the same frame for video and audio and just modify the flags.
+                    if (STRCMP(config.canaryTrackType, CANARY_MULTI_TRACK_TYPE) == 0) {
+                        frame.flags = FRAME_FLAG_NONE;
+                        frame.trackId = DEFAULT_AUDIO_TRACK_ID;
+                        CHK_STATUS(putKinesisVideoFrame(c.streamHandle, &frame));
+                    }
+                    // Sleeps to an absolute deadline so the time spent in putKinesisVideoFrame doesn't add up to drift
+                    CHK_STATUS(canaryPacerWait(&canaryPacer));
+                } else {
+                    canaryStreamRecordFragmentEndSendTime(c.pCanaryStreamCallbacks, lastKeyFrameTimestamp, frame.presentationTs);
+                    DLOGD("Last frame type put before stopping: %s", (frame.flags == FRAME_FLAG_KEY_FRAME ? "Key Frame" : "Non key frame"));
+                    UINT64 sleepTime = ((RAND() % 10) + 1) * HUNDREDS_OF_NANOS_IN_A_MINUTE;
+                    DLOGD("Intermittent sleep time is set to: %" PRIu64 " minutes", sleepTime / HUNDREDS_OF_NANOS_IN_A_MINUTE);
+                    THREAD_SLEEP(sleepTime);
+                    // Reset runTill after 1 run of intermittent scenario
+                    randomTime = (RAND() % 10) + 1;
+                    DLOGD("Intermittent run time is set to: %" PRIu64 " minutes", randomTime);
+                    runTill = GETTIME() + randomTime * HUNDREDS_OF_NANOS_IN_A_MINUTE;
+                    // The idle period is intentional, start a fresh deadline sequence instead of counting it as lateness
+                    CHK_STATUS(canaryPacerReset(&canaryPacer));
                 }
-                THREAD_SLEEP(HUNDREDS_OF_NANOS_IN_A_SECOND / DEFAULT_FPS_VALUE);
-            } else {
-                canaryStreamRecordFragmentEndSendTime(c.pCanaryStreamCallbacks, lastKeyFrameTimestamp, frame.presentationTs);
-                DLOGD("Last frame type put before stopping: %s", (frame.flags == FRAME_FLAG_KEY_FRAME ? "Key Frame" : "Non key frame"));
-                UINT64 sleepTime = ((RAND() % 10) + 1) * HUNDREDS_OF_NANOS_IN_A_MINUTE;
-                DLOGD("Intermittent sleep time is set to: %" PRIu64 " minutes", sleepTime / HUNDREDS_OF_NANOS_IN_A_MINUTE);
-                THREAD_SLEEP(sleepTime);
-                // Reset runTill after 1 run of intermittent scenario
-                randomTime = (RAND() % 10) + 1;
-                DLOGD("Intermittent run time is set to: %" PRIu64 " minutes", randomTime);
-                runTill = GETTIME() + randomTime * HUNDREDS_OF_NANOS_IN_A_MINUTE;
-            }
-            // We measure this after first call to ensure that the latency is measured after the first SUCCESSFUL
-            // putKinesisVideoFrame() call
-            if (firstFrame) {
-                startUpLatency = (DOUBLE)(GETTIME() - startTime) / (DOUBLE) HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
-                STATUS startupLatencyStatus = pushStartUpLatency(c.pCanaryStreamCallbacks, startUpLatency);
-                DLOGD("Start up latency: %lf ms (push status: 0x%08x)", startUpLatency, startupLatencyStatus);
+                // We measure this after first call to ensure that the latency is measured after the first SUCCESSFUL
+                // putKinesisVideoFrame() call
+                if (firstFrame) {
+                    startUpLatency = (DOUBLE)(GETTIME() - startTime) / (DOUBLE) HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+                    STATUS startupLatencyStatus = pushStartUpLatency(c.pCanaryStreamCallbacks, startUpLatency);
+                    DLOGD("Start up latency: %lf ms (push status: 0x%08x)", startUpLatency, startupLatencyStatus);
 
-                CHK_STATUS(timerQueueAddTimer(timerQueueHandle, 60 * HUNDREDS_OF_NANOS_IN_A_SECOND, 60 * HUNDREDS_OF_NANOS_IN_A_SECOND,
-                                              publishMetrics, (UINT64) &c, &timeoutTimerId));
-                CHK_STATUS(timerQueueAddTimer(timerQueueHandle, 60 * HUNDREDS_OF_NANOS_IN_A_SECOND, 60 * HUNDREDS_OF_NANOS_IN_A_SECOND,
-                                              publishErrorRate, (UINT64) &c, &timeoutTimerId));
-                if(!fileLoggingEnabled) {
                     CHK_STATUS(timerQueueAddTimer(timerQueueHandle, 60 * HUNDREDS_OF_NANOS_IN_A_SECOND, 60 * HUNDREDS_OF_NANOS_IN_A_SECOND,
-                                                  canaryStreamSendLogs, (UINT64) &cloudwatchLogsObject, &timeoutTimerId));
+                                                  publishMetrics, (UINT64) &c, &timeoutTimerId));
+                    CHK_STATUS(timerQueueAddTimer(timerQueueHandle, 60 * HUNDREDS_OF_NANOS_IN_A_SECOND, 60 * HUNDREDS_OF_NANOS_IN_A_SECOND,
+                                                  publishErrorRate, (UINT64) &c, &timeoutTimerId));
+                    if(!fileLoggingEnabled) {
+                        CHK_STATUS(timerQueueAddTimer(timerQueueHandle, 60 * HUNDREDS_OF_NANOS_IN_A_SECOND, 60 * HUNDREDS_OF_NANOS_IN_A_SECOND,
+                                                      canaryStreamSendLogs, (UINT64) &cloudwatchLogsObject, &timeoutTimerId));
+                    }
+
+                    firstFrame = FALSE;
                 }
 
-                firstFrame = FALSE;
+                frame.decodingTs = GETTIME(); // current time
+                frame.presentationTs = frame.decodingTs;
+                frameIndex++;
             }
-
-            frame.decodingTs = GETTIME(); // current time
-            frame.presentationTs = frame.decodingTs;
-            frameIndex++;
         }
         CHK_LOG_ERR(retStatus);
         if (IS_VALID_TIMER_QUEUE_HANDLE(timerQueueHandle)) {
@@ -533,9 +587,10 @@ INT32 main(INT32 argc, CHAR* argv[])
         }
         DLOGI("Waiting to push all metrics");
         DLOGI("Cleaning up other objects");
-        SAFE_MEMFREE(frame.frameData);
+        freeCanaryFramePool(&pCanaryFramePool);
         freeDeviceInfo(&pDeviceInfo);
         freeStreamInfoProvider(&pStreamInfo);
+        freeCanaryMultiStream(&pCanaryMultiStream);
         freeKinesisVideoStream(&c.streamHandle);
         freeKinesisVideoClient(&c.clientHandle);
         freeCallbacksProvider(&pClientCallbacks); // This will also take care of freeing canaryStreamCallbacks
@@ -559,10 +614,11 @@ CleanUp:
     // which case the clean up related logs will be captured as well.
     if (!cleanUpDone) {
         CHK_LOG_ERR(retStatus);
-        SAFE_MEMFREE(frame.frameData);
+        freeCanaryFramePool(&pCanaryFramePool);
 
         freeDeviceInfo(&pDeviceInfo);
         freeStreamInfoProvider(&pStreamInfo);
+        freeCanaryMultiStream(&pCanaryMultiStream);
         freeKinesisVideoStream(&c.streamHandle);
         freeKinesisVideoClient(&c.clientHandle);
         freeCallbacksProvider(&pClientCallbacks); // This will also take care of freeing canaryStreamCallbacks
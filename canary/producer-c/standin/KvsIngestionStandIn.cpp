@@ -0,0 +1,324 @@
+/**
+ * Local stand-in for the KVS ingestion endpoints. Every connection is served on its own thread and closed after one
+ * request, which is how the producer's curl calls use them anyway
+ */
+#define LOG_CLASS "KvsIngestionStandIn"
+#include "StandIn.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+static STATUS standInOptenvUint64(PCHAR pKey, PUINT64 pValue, UINT64 defaultValue)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PCHAR pRaw = GETENV(pKey);
+
+    *pValue = defaultValue;
+    if (pRaw != NULL && pRaw[0] != '\0') {
+        CHK_ERR(STATUS_SUCCEEDED(STRTOUI64(pRaw, NULL, 10, pValue)), STATUS_INVALID_ARG, "Invalid value '%s' for %s", pRaw, pKey);
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+static STATUS initStandInConfig(PStandInConfig pConfig)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PCHAR pHost = GETENV(STANDIN_HOST_ENV_VAR);
+    PCHAR pBindAddress = GETENV(STANDIN_BIND_ADDRESS_ENV_VAR);
+    struct in_addr bindAddress;
+    UINT64 value;
+
+    MEMSET(pConfig, 0x00, SIZEOF(StandInConfig));
+
+    CHK_STATUS(standInOptenvUint64(STANDIN_PORT_ENV_VAR, &value, STANDIN_DEFAULT_PORT));
+    CHK_ERR(value > 0 && value <= MAX_UINT16, STATUS_INVALID_ARG, "Invalid port %" PRIu64, value);
+    pConfig->port = (UINT16) value;
+    STRNCPY(pConfig->host, pHost != NULL && pHost[0] != '\0' ? pHost : STANDIN_DEFAULT_HOST, STANDIN_MAX_HOST_LEN);
+    // Nothing is authenticated, so only listen beyond loopback when asked to
+    if (pBindAddress == NULL || pBindAddress[0] == '\0') {
+        pBindAddress = STANDIN_DEFAULT_BIND_ADDRESS;
+    }
+    CHK_ERR(inet_pton(AF_INET, pBindAddress, &bindAddress) == 1, STATUS_INVALID_ARG, "Invalid bind address '%s'", pBindAddress);
+    pConfig->bindAddress = bindAddress.s_addr;
+
+    CHK_STATUS(standInOptenvUint64(STANDIN_LATENCY_ENV_VAR, &value, 0));
+    pConfig->latency = value * HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+    CHK_STATUS(standInOptenvUint64(STANDIN_PERSIST_LATENCY_ENV_VAR, &value, STANDIN_DEFAULT_PERSIST_LATENCY));
+    pConfig->persistLatency = value * HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+    CHK_STATUS(standInOptenvUint64(STANDIN_THROUGHPUT_ENV_VAR, &pConfig->throughputKbps, 0));
+
+    CHK_STATUS(standInOptenvUint64(STANDIN_API_ERROR_PERCENT_ENV_VAR, &value, 0));
+    pConfig->apiErrorPercent = (UINT32) MIN(value, 100);
+    CHK_STATUS(standInOptenvUint64(STANDIN_FRAGMENT_ERROR_PERCENT_ENV_VAR, &value, 0));
+    pConfig->fragmentErrorPercent = (UINT32) MIN(value, 100);
+
+    DLOGI("Listening on %s:%u, data endpoint http://%s:%u", pBindAddress, pConfig->port, pConfig->host, pConfig->port);
+    DLOGI("Latency %" PRIu64 " ms, persist latency %" PRIu64 " ms, throughput cap %" PRIu64 " kbps, API errors %u%%, fragment errors %u%%",
+          pConfig->latency / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, pConfig->persistLatency / HUNDREDS_OF_NANOS_IN_A_MILLISECOND,
+          pConfig->throughputKbps, pConfig->apiErrorPercent, pConfig->fragmentErrorPercent);
+
+CleanUp:
+
+    return retStatus;
+}
+
+BOOL standInInjectError(UINT32 percent)
+{
+    return percent != 0 && (UINT32) (RAND() % 100) < percent;
+}
+
+// Copies the string value of "key" out of a flat JSON body. Enough for the control plane requests the producer sends
+static BOOL standInJsonString(PCHAR pBody, PCHAR pKey, PCHAR pValue, UINT32 maxLength)
+{
+    CHAR quotedKey[64];
+    PCHAR pStart, pEnd;
+
+    SNPRINTF(quotedKey, SIZEOF(quotedKey), "\"%s\"", pKey);
+    if ((pStart = STRSTR(pBody, quotedKey)) == NULL || (pStart = STRCHR(pStart + STRLEN(quotedKey), '"')) == NULL ||
+        (pEnd = STRCHR(++pStart, '"')) == NULL) {
+        return FALSE;
+    }
+
+    STRNCPY(pValue, pStart, MIN((UINT32) (pEnd - pStart), maxLength));
+    pValue[MIN((UINT32) (pEnd - pStart), maxLength)] = '\0';
+    return TRUE;
+}
+
+static UINT64 standInJsonUint64(PCHAR pBody, PCHAR pKey, UINT64 defaultValue)
+{
+    CHAR quotedKey[64];
+    PCHAR pStart;
+
+    SNPRINTF(quotedKey, SIZEOF(quotedKey), "\"%s\"", pKey);
+    if ((pStart = STRSTR(pBody, quotedKey)) == NULL || (pStart = STRCHR(pStart + STRLEN(quotedKey), ':')) == NULL) {
+        return defaultValue;
+    }
+
+    return strtoull(pStart + 1, NULL, 10);
+}
+
+// The stream is named either directly or through the ARN the stand-in handed out
+static BOOL standInRequestStreamName(PCHAR pBody, PCHAR pStreamName)
+{
+    CHAR arn[MAX_ARN_LEN + 1];
+    PCHAR pStart, pEnd;
+
+    if (standInJsonString(pBody, (PCHAR) "StreamName", pStreamName, MAX_STREAM_NAME_LEN)) {
+        return TRUE;
+    }
+
+    if (!standInJsonString(pBody, (PCHAR) "StreamARN", arn, MAX_ARN_LEN) && !standInJsonString(pBody, (PCHAR) "ResourceARN", arn, MAX_ARN_LEN)) {
+        return FALSE;
+    }
+
+    if ((pStart = STRSTR(arn, ":stream/")) == NULL || (pEnd = STRCHR(pStart += 8, '/')) == NULL) {
+        return FALSE;
+    }
+    *pEnd = '\0';
+    STRNCPY(pStreamName, pStart, MAX_STREAM_NAME_LEN);
+    return TRUE;
+}
+
+static PStandInStream standInFindStream(PStandInServer pServer, PCHAR pStreamName)
+{
+    UINT32 i;
+
+    for (i = 0; i < pServer->streamCount; i++) {
+        if (STRCMP(pServer->streams[i].streamName, pStreamName) == 0) {
+            return &pServer->streams[i];
+        }
+    }
+
+    return NULL;
+}
+
+static VOID standInFormatArn(PStandInStream pStream, PCHAR pArn)
+{
+    SNPRINTF(pArn, MAX_ARN_LEN + 1, "arn:aws:kinesisvideo:%s:%s:stream/%s/%" PRIu64, STANDIN_REGION, STANDIN_ACCOUNT_ID, pStream->streamName,
+             pStream->creationTime / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+}
+
+STATUS standInHandleControlPlane(PStandInServer pServer, PStandInConnection pConnection)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    CHAR body[STANDIN_MAX_BODY_SIZE + 1], response[STANDIN_MAX_BODY_SIZE], streamName[MAX_STREAM_NAME_LEN + 1], arn[MAX_ARN_LEN + 1];
+    PStandInStream pStream;
+    UINT32 bodySize = 0, read, statusCode = 200;
+
+    CHK(pServer != NULL && pConnection != NULL, STATUS_NULL_ARG);
+
+    do {
+        CHK_STATUS(standInReadBody(pConnection, (PBYTE) body + bodySize, STANDIN_MAX_BODY_SIZE - bodySize, &read));
+        bodySize += read;
+    } while (read != 0 && bodySize < STANDIN_MAX_BODY_SIZE);
+    body[bodySize] = '\0';
+
+    if (pServer->config.latency != 0) {
+        THREAD_SLEEP(pServer->config.latency);
+    }
+
+    if (standInInjectError(pServer->config.apiErrorPercent)) {
+        DLOGD("Injecting an error into %s", pConnection->path);
+        CHK_STATUS(standInWriteResponse(pConnection, 500, (PCHAR) "{\"__type\":\"ClientLimitExceededException\",\"Message\":\"Injected\"}"));
+        CHK(FALSE, retStatus);
+    }
+
+    if (!standInRequestStreamName(body, streamName)) {
+        CHK_STATUS(standInWriteResponse(pConnection, 400, (PCHAR) "{\"__type\":\"InvalidArgumentException\",\"Message\":\"No stream given\"}"));
+        CHK(FALSE, retStatus);
+    }
+
+    SNPRINTF(response, SIZEOF(response), "{\"__type\":\"ResourceNotFoundException\",\"Message\":\"Stream %s not found\"}", streamName);
+    MUTEX_LOCK(pServer->streamsLock);
+    pStream = standInFindStream(pServer, streamName);
+
+    if (STRCMP(pConnection->path, "/createStream") == 0) {
+        if (pStream != NULL) {
+            statusCode = 400;
+            SNPRINTF(response, SIZEOF(response), "{\"__type\":\"ResourceInUseException\",\"Message\":\"Stream %s exists\"}", streamName);
+        } else if (pServer->streamCount == STANDIN_MAX_STREAM_COUNT) {
+            statusCode = 400;
+            SNPRINTF(response, SIZEOF(response), "{\"__type\":\"AccountStreamLimitExceededException\",\"Message\":\"Too many streams\"}");
+        } else {
+            pStream = &pServer->streams[pServer->streamCount++];
+            MEMSET(pStream, 0x00, SIZEOF(StandInStream));
+            STRCPY(pStream->streamName, streamName);
+            if (!standInJsonString(body, (PCHAR) "MediaType", pStream->mediaType, MAX_CONTENT_TYPE_LEN)) {
+                STRCPY(pStream->mediaType, STANDIN_DEFAULT_MEDIA_TYPE);
+            }
+            pStream->retentionInHours = standInJsonUint64(body, (PCHAR) "DataRetentionInHours", 0);
+            pStream->creationTime = GETTIME();
+            standInFormatArn(pStream, arn);
+            SNPRINTF(response, SIZEOF(response), "{\"StreamARN\":\"%s\"}", arn);
+            DLOGI("Created stream %s", streamName);
+        }
+    } else if (pStream == NULL) {
+        statusCode = 404;
+    } else if (STRCMP(pConnection->path, "/describeStream") == 0) {
+        standInFormatArn(pStream, arn);
+        SNPRINTF(response, SIZEOF(response),
+                 "{\"StreamInfo\":{\"CreationTime\":%" PRIu64 ",\"DataRetentionInHours\":%" PRIu64 ",\"DeviceName\":\"\",\"KmsKeyId\":\"\","
+                 "\"MediaType\":\"%s\",\"Status\":\"ACTIVE\",\"StreamARN\":\"%s\",\"StreamName\":\"%s\",\"Version\":\"1\"}}",
+                 pStream->creationTime / HUNDREDS_OF_NANOS_IN_A_SECOND, pStream->retentionInHours, pStream->mediaType, arn, pStream->streamName);
+    } else if (STRCMP(pConnection->path, "/getDataEndpoint") == 0) {
+        SNPRINTF(response, SIZEOF(response), "{\"DataEndpoint\":\"http://%s:%u\"}", pServer->config.host, pServer->config.port);
+    } else if (STRCMP(pConnection->path, "/tagResource") == 0 || STRCMP(pConnection->path, "/tagStream") == 0) {
+        STRCPY(response, "{}");
+    } else {
+        statusCode = 404;
+        SNPRINTF(response, SIZEOF(response), "{\"__type\":\"UnknownOperationException\",\"Message\":\"%s\"}", pConnection->path);
+    }
+    MUTEX_UNLOCK(pServer->streamsLock);
+
+    CHK_STATUS(standInWriteResponse(pConnection, statusCode, response));
+
+CleanUp:
+
+    return retStatus;
+}
+
+typedef struct {
+    PStandInServer pServer;
+    INT32 socket;
+} StandInConnectionArgs, *PStandInConnectionArgs;
+
+static PVOID standInConnectionRoutine(PVOID args)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PStandInConnectionArgs pArgs = (PStandInConnectionArgs) args;
+    PStandInConnection pConnection = NULL;
+
+    pConnection = (PStandInConnection) MEMCALLOC(1, SIZEOF(StandInConnection));
+    CHK(pConnection != NULL, STATUS_NOT_ENOUGH_MEMORY);
+    pConnection->socket = pArgs->socket;
+
+    CHK_STATUS(standInReadRequestHead(pConnection));
+    DLOGV("%s %s", pConnection->method, pConnection->path);
+
+    if (STRCMP(pConnection->path, "/putMedia") == 0) {
+        CHK_STATUS(standInHandlePutMedia(pArgs->pServer, pConnection));
+    } else {
+        CHK_STATUS(standInHandleControlPlane(pArgs->pServer, pConnection));
+    }
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus) && retStatus != STATUS_STANDIN_CONNECTION_CLOSED) {
+        DLOGW("Request failed with 0x%08x", retStatus);
+    }
+
+    close(pArgs->socket);
+    SAFE_MEMFREE(pConnection);
+    MEMFREE(pArgs);
+
+    return NULL;
+}
+
+INT32 main(INT32 argc, CHAR* argv[])
+{
+    UNUSED_PARAM(argc);
+    UNUSED_PARAM(argv);
+    STATUS retStatus = STATUS_SUCCESS;
+    PStandInServer pServer = NULL;
+    PStandInConnectionArgs pArgs = NULL;
+    struct sockaddr_in address;
+    INT32 listenSocket = -1, clientSocket, enable = 1;
+    TID tid;
+
+    SET_LOGGER_LOG_LEVEL(LOG_LEVEL_INFO);
+
+    pServer = (PStandInServer) MEMCALLOC(1, SIZEOF(StandInServer));
+    CHK(pServer != NULL, STATUS_NOT_ENOUGH_MEMORY);
+    CHK_STATUS(initStandInConfig(&pServer->config));
+    pServer->streamsLock = MUTEX_CREATE(FALSE);
+    CHK(IS_VALID_MUTEX_VALUE(pServer->streamsLock), STATUS_INVALID_OPERATION);
+    SRAND((UINT32) GETTIME());
+
+    listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    CHK_ERR(listenSocket >= 0, STATUS_INVALID_OPERATION, "socket() failed with errno %d", errno);
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &enable, SIZEOF(enable));
+
+    MEMSET(&address, 0x00, SIZEOF(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = pServer->config.bindAddress;
+    address.sin_port = htons(pServer->config.port);
+    CHK_ERR(bind(listenSocket, (struct sockaddr*) &address, SIZEOF(address)) == 0, STATUS_INVALID_OPERATION, "bind() failed with errno %d", errno);
+    CHK_ERR(listen(listenSocket, STANDIN_LISTEN_BACKLOG) == 0, STATUS_INVALID_OPERATION, "listen() failed with errno %d", errno);
+
+    for (;;) {
+        clientSocket = accept(listenSocket, NULL, NULL);
+        if (clientSocket < 0) {
+            CHK_ERR(errno == EINTR || errno == ECONNABORTED, STATUS_INVALID_OPERATION, "accept() failed with errno %d", errno);
+            continue;
+        }
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &enable, SIZEOF(enable));
+
+        pArgs = (PStandInConnectionArgs) MEMALLOC(SIZEOF(StandInConnectionArgs));
+        if (pArgs != NULL) {
+            pArgs->pServer = pServer;
+            pArgs->socket = clientSocket;
+        }
+        if (pArgs == NULL || STATUS_FAILED(THREAD_CREATE(&tid, standInConnectionRoutine, (PVOID) pArgs))) {
+            DLOGW("Could not start a thread for a new connection");
+            SAFE_MEMFREE(pArgs);
+            close(clientSocket);
+            continue;
+        }
+        THREAD_DETACH(tid);
+    }
+
+CleanUp:
+
+    if (listenSocket >= 0) {
+        close(listenSocket);
+    }
+
+    // Connection threads may still hold the server, it goes away with the process
+    DLOGE("Exiting with status code 0x%08x", retStatus);
+    return STATUS_FAILED(retStatus) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,172 @@
+#ifndef __KINESIS_VIDEO_INGESTION_STAND_IN_INCLUDE_I__
+#define __KINESIS_VIDEO_INGESTION_STAND_IN_INCLUDE_I__
+
+#pragma once
+
+#include <com/amazonaws/kinesis/video/cproducer/Include.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Local stand-in for the KVS ingestion path: DescribeStream, CreateStream, TagResource, GetDataEndpoint and a
+ * PutMedia that parses the MKV stream and acks every fragment. Point the producer's control plane URL at it to
+ * benchmark the SDK without the network in the way.
+ */
+
+#define STANDIN_PORT_ENV_VAR                   (PCHAR) "STANDIN_PORT"
+#define STANDIN_HOST_ENV_VAR                   (PCHAR) "STANDIN_HOST"
+#define STANDIN_BIND_ADDRESS_ENV_VAR           (PCHAR) "STANDIN_BIND_ADDRESS"
+#define STANDIN_LATENCY_ENV_VAR                (PCHAR) "STANDIN_LATENCY_MS"
+#define STANDIN_PERSIST_LATENCY_ENV_VAR        (PCHAR) "STANDIN_PERSIST_LATENCY_MS"
+#define STANDIN_THROUGHPUT_ENV_VAR             (PCHAR) "STANDIN_THROUGHPUT_KBPS"
+#define STANDIN_API_ERROR_PERCENT_ENV_VAR      (PCHAR) "STANDIN_API_ERROR_PERCENT"
+#define STANDIN_FRAGMENT_ERROR_PERCENT_ENV_VAR (PCHAR) "STANDIN_FRAGMENT_ERROR_PERCENT"
+
+#define STANDIN_DEFAULT_PORT            8080
+#define STANDIN_DEFAULT_HOST            (PCHAR) "127.0.0.1"
+#define STANDIN_DEFAULT_BIND_ADDRESS    (PCHAR) "127.0.0.1"
+#define STANDIN_DEFAULT_PERSIST_LATENCY 200
+
+#define STANDIN_MAX_HOST_LEN        255
+#define STANDIN_MAX_STREAM_COUNT    1024
+#define STANDIN_MAX_HEAD_SIZE       (16 * 1024)
+#define STANDIN_MAX_BODY_SIZE       (16 * 1024)
+#define STANDIN_MAX_PATH_LEN        127
+#define STANDIN_READ_BUFFER_SIZE    (64 * 1024)
+#define STANDIN_MAX_PENDING_ACKS    256
+#define STANDIN_MAX_ACK_LEN         256
+#define STANDIN_LISTEN_BACKLOG      128
+#define STANDIN_ACCOUNT_ID          (PCHAR) "000000000000"
+#define STANDIN_REGION              (PCHAR) "us-west-2"
+#define STANDIN_DEFAULT_MEDIA_TYPE  (PCHAR) "video/h264"
+
+// Id and size vints plus the largest scalar value the parser reads
+#define STANDIN_MKV_MAX_HEADER_SIZE (4 + 8 + 8)
+#define STANDIN_MKV_DEFAULT_TIMECODE_SCALE 1000000
+
+#define STATUS_STANDIN_BASE              0x80100000
+#define STATUS_STANDIN_CONNECTION_CLOSED STATUS_STANDIN_BASE + 0x00000001
+#define STATUS_STANDIN_BAD_REQUEST       STATUS_STANDIN_BASE + 0x00000002
+#define STATUS_STANDIN_INVALID_MKV       STATUS_STANDIN_BASE + 0x00000003
+
+typedef struct {
+    UINT16 port;
+    // IPv4 address the listening socket is bound to, network byte order
+    UINT32 bindAddress;
+    // Host the data endpoint is advertised on
+    CHAR host[STANDIN_MAX_HOST_LEN + 1];
+    // Added before every control plane response and every RECEIVED ack
+    UINT64 latency;
+    // Between RECEIVED and PERSISTED
+    UINT64 persistLatency;
+    // PutMedia ingestion cap per connection, 0 for none
+    UINT64 throughputKbps;
+    UINT32 apiErrorPercent;
+    UINT32 fragmentErrorPercent;
+} StandInConfig, *PStandInConfig;
+
+typedef struct {
+    CHAR streamName[MAX_STREAM_NAME_LEN + 1];
+    CHAR mediaType[MAX_CONTENT_TYPE_LEN + 1];
+    UINT64 creationTime;
+    UINT64 retentionInHours;
+} StandInStream, *PStandInStream;
+
+typedef struct {
+    StandInConfig config;
+    MUTEX streamsLock;
+    UINT32 streamCount;
+    StandInStream streams[STANDIN_MAX_STREAM_COUNT];
+    volatile SIZE_T fragmentNumber;
+} StandInServer, *PStandInServer;
+
+typedef struct {
+    INT32 socket;
+    // Bytes received but not consumed yet
+    CHAR buffer[STANDIN_MAX_HEAD_SIZE];
+    UINT32 offset;
+    UINT32 size;
+    // Request head
+    CHAR method[8];
+    CHAR path[STANDIN_MAX_PATH_LEN + 1];
+    CHAR streamName[MAX_STREAM_NAME_LEN + 1];
+    BOOL chunked;
+    BOOL expectContinue;
+    UINT64 contentLength;
+    // Body decoding state
+    UINT64 bodyRemaining;
+    BOOL bodyDone;
+} StandInConnection, *PStandInConnection;
+
+typedef enum {
+    STANDIN_MKV_EVENT_FRAGMENT_START,
+    STANDIN_MKV_EVENT_FRAGMENT_END,
+} STANDIN_MKV_EVENT;
+
+// Invoked with the fragment timecode in milliseconds
+typedef VOID (*StandInMkvCallbackFunc)(UINT64, STANDIN_MKV_EVENT, UINT64);
+
+typedef struct {
+    BYTE header[STANDIN_MKV_MAX_HEADER_SIZE];
+    UINT32 headerSize;
+    UINT64 skipRemaining;
+    UINT64 timecodeScale;
+    BOOL awaitingClusterTimecode;
+    BOOL fragmentOpen;
+    UINT64 fragmentTimecode;
+    StandInMkvCallbackFunc callbackFn;
+    UINT64 customData;
+} StandInMkvParser, *PStandInMkvParser;
+
+typedef struct {
+    UINT64 dueTime;
+    CHAR ack[STANDIN_MAX_ACK_LEN];
+    UINT32 size;
+} StandInPendingAck, *PStandInPendingAck;
+
+// Acks of one PutMedia connection, ordered by due time and written out by a dedicated thread
+typedef struct {
+    PStandInServer pServer;
+    PStandInConnection pConnection;
+    MUTEX lock;
+    CVAR cvar;
+    StandInPendingAck acks[STANDIN_MAX_PENDING_ACKS];
+    UINT32 ackCount;
+    BOOL done;
+    BOOL failed;
+    // Number of the fragment being received, shared by all of its acks
+    UINT64 fragmentNumber;
+    UINT64 fragmentCount;
+    UINT64 errorCount;
+} StandInAckWriter, *PStandInAckWriter;
+
+////////////////////////////////////////////////////////////////////////
+// MKV parsing
+////////////////////////////////////////////////////////////////////////
+VOID initStandInMkvParser(PStandInMkvParser, StandInMkvCallbackFunc, UINT64);
+STATUS standInMkvParserFeed(PStandInMkvParser, PBYTE, UINT32);
+VOID standInMkvParserFinish(PStandInMkvParser);
+
+////////////////////////////////////////////////////////////////////////
+// HTTP
+////////////////////////////////////////////////////////////////////////
+STATUS standInReadRequestHead(PStandInConnection);
+STATUS standInReadBody(PStandInConnection, PBYTE, UINT32, PUINT32);
+STATUS standInWriteAll(PStandInConnection, PCHAR, UINT32);
+STATUS standInWriteResponse(PStandInConnection, UINT32, PCHAR);
+STATUS standInWriteChunk(PStandInConnection, PCHAR, UINT32);
+
+////////////////////////////////////////////////////////////////////////
+// API handlers
+////////////////////////////////////////////////////////////////////////
+STATUS standInHandleControlPlane(PStandInServer, PStandInConnection);
+STATUS standInHandlePutMedia(PStandInServer, PStandInConnection);
+BOOL standInInjectError(UINT32);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__KINESIS_VIDEO_INGESTION_STAND_IN_INCLUDE_I__
@@ -0,0 +1,212 @@
+/**
+ * Minimal HTTP/1.1 for the stand-in: one request per connection, Content-Length or chunked request bodies and
+ * chunked responses for the PutMedia acks
+ */
+#define LOG_CLASS "StandInHttp"
+#include "StandIn.h"
+
+#include <strings.h>
+#include <sys/socket.h>
+
+#define STANDIN_STREAM_NAME_HEADER (PCHAR) "x-amzn-stream-name"
+
+// Moves the unconsumed bytes to the front and receives more after them
+static STATUS standInReceive(PStandInConnection pConnection)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    ssize_t received;
+
+    if (pConnection->offset > 0) {
+        MEMMOVE(pConnection->buffer, pConnection->buffer + pConnection->offset, pConnection->size - pConnection->offset);
+        pConnection->size -= pConnection->offset;
+        pConnection->offset = 0;
+    }
+    CHK(pConnection->size < SIZEOF(pConnection->buffer), STATUS_STANDIN_BAD_REQUEST);
+
+    do {
+        received = recv(pConnection->socket, pConnection->buffer + pConnection->size, SIZEOF(pConnection->buffer) - pConnection->size, 0);
+    } while (received < 0 && errno == EINTR);
+    CHK(received > 0, STATUS_STANDIN_CONNECTION_CLOSED);
+    pConnection->size += (UINT32) received;
+
+CleanUp:
+
+    return retStatus;
+}
+
+// Line starting at the read offset, without the CRLF. NULL until the whole line has been received
+static PCHAR standInNextLine(PStandInConnection pConnection, PUINT32 pLength)
+{
+    PCHAR pStart = pConnection->buffer + pConnection->offset;
+    UINT32 i, available = pConnection->size - pConnection->offset;
+
+    for (i = 0; i + 1 < available; i++) {
+        if (pStart[i] == '\r' && pStart[i + 1] == '\n') {
+            pStart[i] = '\0';
+            pConnection->offset += i + 2;
+            *pLength = i;
+            return pStart;
+        }
+    }
+
+    return NULL;
+}
+
+STATUS standInReadRequestHead(PStandInConnection pConnection)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PCHAR pLine, pValue;
+    UINT32 length;
+    BOOL requestLine = TRUE;
+
+    CHK(pConnection != NULL, STATUS_NULL_ARG);
+
+    for (;;) {
+        while ((pLine = standInNextLine(pConnection, &length)) == NULL) {
+            CHK_STATUS(standInReceive(pConnection));
+        }
+
+        if (length == 0) {
+            break;
+        }
+
+        if (requestLine) {
+            requestLine = FALSE;
+            CHK(sscanf(pLine, "%7s %127s", pConnection->method, pConnection->path) == 2, STATUS_STANDIN_BAD_REQUEST);
+            continue;
+        }
+
+        pValue = STRCHR(pLine, ':');
+        CHK(pValue != NULL, STATUS_STANDIN_BAD_REQUEST);
+        *pValue++ = '\0';
+        while (*pValue == ' ') {
+            pValue++;
+        }
+
+        if (strcasecmp(pLine, "content-length") == 0) {
+            CHK_STATUS(STRTOUI64(pValue, NULL, 10, &pConnection->contentLength));
+        } else if (strcasecmp(pLine, "transfer-encoding") == 0) {
+            pConnection->chunked = strcasecmp(pValue, "chunked") == 0;
+        } else if (strcasecmp(pLine, "expect") == 0) {
+            pConnection->expectContinue = strcasecmp(pValue, "100-continue") == 0;
+        } else if (strcasecmp(pLine, STANDIN_STREAM_NAME_HEADER) == 0) {
+            STRNCPY(pConnection->streamName, pValue, MAX_STREAM_NAME_LEN);
+        }
+    }
+
+    CHK(!requestLine, STATUS_STANDIN_BAD_REQUEST);
+    pConnection->bodyRemaining = pConnection->chunked ? 0 : pConnection->contentLength;
+    pConnection->bodyDone = !pConnection->chunked && pConnection->contentLength == 0;
+
+CleanUp:
+
+    return retStatus;
+}
+
+// Decodes up to maxSize body bytes into pDst. *pRead is 0 only once the body has ended
+STATUS standInReadBody(PStandInConnection pConnection, PBYTE pDst, UINT32 maxSize, PUINT32 pRead)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PCHAR pLine;
+    UINT32 length, available;
+    UINT64 chunkSize;
+
+    CHK(pConnection != NULL && pDst != NULL && pRead != NULL, STATUS_NULL_ARG);
+    *pRead = 0;
+
+    while (!pConnection->bodyDone && pConnection->bodyRemaining == 0) {
+        // Between chunks: the CRLF closing the previous one, then the size line of the next
+        while ((pLine = standInNextLine(pConnection, &length)) == NULL) {
+            CHK_STATUS(standInReceive(pConnection));
+        }
+        if (length == 0) {
+            continue;
+        }
+
+        CHK(sscanf(pLine, "%" SCNx64, &chunkSize) == 1, STATUS_STANDIN_BAD_REQUEST);
+        if (chunkSize == 0) {
+            // Skip the trailers
+            do {
+                while ((pLine = standInNextLine(pConnection, &length)) == NULL) {
+                    CHK_STATUS(standInReceive(pConnection));
+                }
+            } while (length != 0);
+            pConnection->bodyDone = TRUE;
+        }
+        pConnection->bodyRemaining = chunkSize;
+    }
+
+    CHK(!pConnection->bodyDone || pConnection->bodyRemaining != 0, retStatus);
+
+    if (pConnection->offset == pConnection->size) {
+        CHK_STATUS(standInReceive(pConnection));
+    }
+
+    available = (UINT32) MIN((UINT64) MIN(maxSize, pConnection->size - pConnection->offset), pConnection->bodyRemaining);
+    MEMCPY(pDst, pConnection->buffer + pConnection->offset, available);
+    pConnection->offset += available;
+    pConnection->bodyRemaining -= available;
+    *pRead = available;
+
+    if (!pConnection->chunked && pConnection->bodyRemaining == 0) {
+        pConnection->bodyDone = TRUE;
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS standInWriteAll(PStandInConnection pConnection, PCHAR pData, UINT32 size)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    ssize_t sent;
+
+    while (size > 0) {
+        sent = send(pConnection->socket, pData, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        CHK(sent > 0, STATUS_STANDIN_CONNECTION_CLOSED);
+        pData += sent;
+        size -= (UINT32) sent;
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS standInWriteResponse(PStandInConnection pConnection, UINT32 statusCode, PCHAR pBody)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    CHAR head[256];
+    INT32 headSize;
+    UINT32 bodySize = (UINT32) STRLEN(pBody);
+
+    headSize = SNPRINTF(head, SIZEOF(head),
+                        "HTTP/1.1 %u %s\r\nContent-Type: application/json\r\nContent-Length: %u\r\nConnection: close\r\n\r\n", statusCode,
+                        statusCode == 200 ? "OK" : "Error", bodySize);
+    CHK_STATUS(standInWriteAll(pConnection, head, (UINT32) headSize));
+    CHK_STATUS(standInWriteAll(pConnection, pBody, bodySize));
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS standInWriteChunk(PStandInConnection pConnection, PCHAR pData, UINT32 size)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    CHAR sizeLine[32];
+    INT32 sizeLineSize;
+
+    sizeLineSize = SNPRINTF(sizeLine, SIZEOF(sizeLine), "%x\r\n", size);
+    CHK_STATUS(standInWriteAll(pConnection, sizeLine, (UINT32) sizeLineSize));
+    CHK_STATUS(standInWriteAll(pConnection, pData, size));
+    CHK_STATUS(standInWriteAll(pConnection, (PCHAR) "\r\n", 2));
+
+CleanUp:
+
+    return retStatus;
+}
@@ -0,0 +1,156 @@
+/**
+ * Streaming MKV parser for PutMedia bodies. Only the element headers are looked at: every cluster is a fragment,
+ * its timecode is the one acked, and block payloads are skipped without being copied
+ */
+#define LOG_CLASS "StandInMkvParser"
+#include "StandIn.h"
+
+#define MKV_EBML_ID           0x1A45DFA3
+#define MKV_SEGMENT_ID        0x18538067
+#define MKV_SEGMENT_INFO_ID   0x1549A966
+#define MKV_TIMECODE_SCALE_ID 0x2AD7B1
+#define MKV_CLUSTER_ID        0x1F43B675
+#define MKV_TIMECODE_ID       0xE7
+
+// Length of the vint starting with the given byte, 0 when it is invalid
+static UINT32 mkvVintLength(BYTE first, UINT32 maxLength)
+{
+    UINT32 length = 1;
+
+    while (length <= maxLength && (first & (0x80 >> (length - 1))) == 0) {
+        length++;
+    }
+
+    return length <= maxLength ? length : 0;
+}
+
+static UINT64 mkvReadUint(PBYTE pData, UINT32 size)
+{
+    UINT64 value = 0;
+    UINT32 i;
+
+    for (i = 0; i < size; i++) {
+        value = (value << 8) | pData[i];
+    }
+
+    return value;
+}
+
+static VOID mkvEndFragment(PStandInMkvParser pParser)
+{
+    if (pParser->fragmentOpen) {
+        pParser->fragmentOpen = FALSE;
+        pParser->callbackFn(pParser->customData, STANDIN_MKV_EVENT_FRAGMENT_END, pParser->fragmentTimecode);
+    }
+}
+
+VOID initStandInMkvParser(PStandInMkvParser pParser, StandInMkvCallbackFunc callbackFn, UINT64 customData)
+{
+    MEMSET(pParser, 0x00, SIZEOF(StandInMkvParser));
+    pParser->timecodeScale = STANDIN_MKV_DEFAULT_TIMECODE_SCALE;
+    pParser->callbackFn = callbackFn;
+    pParser->customData = customData;
+}
+
+// Bytes can be fed in pieces of any size, element headers split across calls are reassembled
+STATUS standInMkvParserFeed(PStandInMkvParser pParser, PBYTE pData, UINT32 size)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    UINT32 idLength, sizeLength, skipped, valueOffset;
+    UINT64 id, elementSize;
+    BOOL unknownSize;
+
+    CHK(pParser != NULL && (pData != NULL || size == 0), STATUS_NULL_ARG);
+
+    while (size > 0) {
+        if (pParser->skipRemaining > 0) {
+            skipped = (UINT32) MIN(pParser->skipRemaining, (UINT64) size);
+            pParser->skipRemaining -= skipped;
+            pData += skipped;
+            size -= skipped;
+            continue;
+        }
+
+        pParser->header[pParser->headerSize++] = *pData++;
+        size--;
+
+        idLength = mkvVintLength(pParser->header[0], 4);
+        CHK(idLength != 0, STATUS_STANDIN_INVALID_MKV);
+        if (pParser->headerSize <= idLength) {
+            continue;
+        }
+
+        sizeLength = mkvVintLength(pParser->header[idLength], 8);
+        CHK(sizeLength != 0, STATUS_STANDIN_INVALID_MKV);
+        valueOffset = idLength + sizeLength;
+        if (pParser->headerSize < valueOffset) {
+            continue;
+        }
+
+        id = mkvReadUint(pParser->header, idLength);
+        elementSize = mkvReadUint(pParser->header + idLength, sizeLength) & ((1ULL << (7 * sizeLength)) - 1);
+        unknownSize = elementSize == (1ULL << (7 * sizeLength)) - 1;
+
+        switch (id) {
+            case MKV_SEGMENT_ID:
+            case MKV_SEGMENT_INFO_ID:
+                // Masters are walked into rather than skipped
+                pParser->headerSize = 0;
+                continue;
+
+            case MKV_CLUSTER_ID:
+                mkvEndFragment(pParser);
+                pParser->awaitingClusterTimecode = TRUE;
+                pParser->headerSize = 0;
+                continue;
+
+            case MKV_TIMECODE_SCALE_ID:
+            case MKV_TIMECODE_ID:
+                if (id == MKV_TIMECODE_SCALE_ID || pParser->awaitingClusterTimecode) {
+                    CHK(!unknownSize && elementSize <= 8, STATUS_STANDIN_INVALID_MKV);
+                    if (pParser->headerSize < valueOffset + elementSize) {
+                        continue;
+                    }
+
+                    if (id == MKV_TIMECODE_SCALE_ID) {
+                        pParser->timecodeScale = mkvReadUint(pParser->header + valueOffset, (UINT32) elementSize);
+                        CHK(pParser->timecodeScale != 0, STATUS_STANDIN_INVALID_MKV);
+                    } else {
+                        pParser->awaitingClusterTimecode = FALSE;
+                        pParser->fragmentOpen = TRUE;
+                        pParser->fragmentTimecode = mkvReadUint(pParser->header + valueOffset, (UINT32) elementSize) * pParser->timecodeScale /
+                            STANDIN_MKV_DEFAULT_TIMECODE_SCALE;
+                        pParser->callbackFn(pParser->customData, STANDIN_MKV_EVENT_FRAGMENT_START, pParser->fragmentTimecode);
+                    }
+
+                    pParser->headerSize = 0;
+                    continue;
+                }
+                break;
+
+            case MKV_EBML_ID:
+                // The producer restarts the stream with a new header after an error, whatever came before is complete
+                mkvEndFragment(pParser);
+                pParser->awaitingClusterTimecode = FALSE;
+                pParser->timecodeScale = STANDIN_MKV_DEFAULT_TIMECODE_SCALE;
+                break;
+
+            default:
+                break;
+        }
+
+        CHK(!unknownSize, STATUS_STANDIN_INVALID_MKV);
+        pParser->skipRemaining = elementSize;
+        pParser->headerSize = 0;
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+// Called once the body has ended, the last cluster has no successor to close it
+VOID standInMkvParserFinish(PStandInMkvParser pParser)
+{
+    mkvEndFragment(pParser);
+}
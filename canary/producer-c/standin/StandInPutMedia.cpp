@@ -0,0 +1,205 @@
+/**
+ * PutMedia: the body is parsed as it arrives and every fragment is acked with BUFFERING, then RECEIVED and PERSISTED
+ * (or ERROR) after the configured latencies. Acks go out on their own thread so the delays never stall ingestion
+ */
+#define LOG_CLASS "StandInPutMedia"
+#include "StandIn.h"
+
+#define STANDIN_CONTINUE_RESPONSE       (PCHAR) "HTTP/1.1 100 Continue\r\n\r\n"
+#define STANDIN_PUT_MEDIA_RESPONSE_HEAD (PCHAR) "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n"
+
+static VOID standInQueueAck(PStandInAckWriter pWriter, UINT64 dueTime, PCHAR pEventType, UINT64 fragmentTimecode, PCHAR pErrorFields)
+{
+    PStandInPendingAck pAck;
+    UINT32 i;
+
+    MUTEX_LOCK(pWriter->lock);
+    if (pWriter->ackCount == STANDIN_MAX_PENDING_ACKS) {
+        MUTEX_UNLOCK(pWriter->lock);
+        DLOGW("Too many pending acks, dropping %s for fragment %" PRIu64, pEventType, fragmentTimecode);
+        return;
+    }
+
+    // Kept sorted by due time, equal times stay in the order they were queued
+    for (i = pWriter->ackCount; i > 0 && pWriter->acks[i - 1].dueTime > dueTime; i--) {
+        pWriter->acks[i] = pWriter->acks[i - 1];
+    }
+    pAck = &pWriter->acks[i];
+    pAck->dueTime = dueTime;
+    pAck->size = (UINT32) SNPRINTF(pAck->ack, SIZEOF(pAck->ack), "{\"EventType\":\"%s\",\"FragmentTimecode\":%" PRIu64 ",\"FragmentNumber\":\"%" PRIu64 "\"%s}",
+                                   pEventType, fragmentTimecode, pWriter->fragmentNumber, pErrorFields);
+    pWriter->ackCount++;
+
+    CVAR_SIGNAL(pWriter->cvar);
+    MUTEX_UNLOCK(pWriter->lock);
+}
+
+static VOID standInOnMkvEvent(UINT64 customData, STANDIN_MKV_EVENT event, UINT64 fragmentTimecode)
+{
+    PStandInAckWriter pWriter = (PStandInAckWriter) customData;
+    PStandInConfig pConfig = &pWriter->pServer->config;
+    UINT64 now = GETTIME();
+
+    switch (event) {
+        case STANDIN_MKV_EVENT_FRAGMENT_START:
+            // Unique across connections, like the service's
+            pWriter->fragmentNumber = (UINT64) ATOMIC_INCREMENT(&pWriter->pServer->fragmentNumber);
+            standInQueueAck(pWriter, now, (PCHAR) "BUFFERING", fragmentTimecode, (PCHAR) "");
+            break;
+
+        case STANDIN_MKV_EVENT_FRAGMENT_END:
+            pWriter->fragmentCount++;
+            if (standInInjectError(pConfig->fragmentErrorPercent)) {
+                pWriter->errorCount++;
+                standInQueueAck(pWriter, now + pConfig->latency, (PCHAR) "ERROR", fragmentTimecode,
+                                (PCHAR) ",\"ErrorId\":5000,\"ErrorCode\":\"INTERNAL_ERROR\"");
+            } else {
+                standInQueueAck(pWriter, now + pConfig->latency, (PCHAR) "RECEIVED", fragmentTimecode, (PCHAR) "");
+                standInQueueAck(pWriter, now + pConfig->latency + pConfig->persistLatency, (PCHAR) "PERSISTED", fragmentTimecode, (PCHAR) "");
+            }
+            break;
+    }
+}
+
+static PVOID standInAckWriterRoutine(PVOID args)
+{
+    PStandInAckWriter pWriter = (PStandInAckWriter) args;
+    StandInPendingAck ack;
+    UINT64 now;
+
+    MUTEX_LOCK(pWriter->lock);
+    while (!pWriter->failed && (!pWriter->done || pWriter->ackCount > 0)) {
+        if (pWriter->ackCount == 0) {
+            CVAR_WAIT(pWriter->cvar, pWriter->lock, INFINITE_TIME_VALUE);
+            continue;
+        }
+
+        now = GETTIME();
+        if (pWriter->acks[0].dueTime > now) {
+            CVAR_WAIT(pWriter->cvar, pWriter->lock, pWriter->acks[0].dueTime - now);
+            continue;
+        }
+
+        ack = pWriter->acks[0];
+        pWriter->ackCount--;
+        MEMMOVE(pWriter->acks, pWriter->acks + 1, pWriter->ackCount * SIZEOF(StandInPendingAck));
+
+        MUTEX_UNLOCK(pWriter->lock);
+        if (STATUS_FAILED(standInWriteChunk(pWriter->pConnection, ack.ack, ack.size))) {
+            // The producer hung up, the reader notices on its next recv
+            pWriter->failed = TRUE;
+        }
+        MUTEX_LOCK(pWriter->lock);
+    }
+    MUTEX_UNLOCK(pWriter->lock);
+
+    return NULL;
+}
+
+// Sleeps as long as the connection is ahead of the configured throughput
+static VOID standInThrottle(PStandInConfig pConfig, UINT64 startTime, UINT64 totalBytes)
+{
+    UINT64 allowedTime, now;
+
+    if (pConfig->throughputKbps == 0) {
+        return;
+    }
+
+    allowedTime = startTime + totalBytes * 8 * HUNDREDS_OF_NANOS_IN_A_MILLISECOND / pConfig->throughputKbps;
+    now = GETTIME();
+    if (allowedTime > now) {
+        THREAD_SLEEP(allowedTime - now);
+    }
+}
+
+STATUS standInHandlePutMedia(PStandInServer pServer, PStandInConnection pConnection)
+{
+    STATUS retStatus = STATUS_SUCCESS, readStatus = STATUS_SUCCESS;
+    PStandInAckWriter pWriter = NULL;
+    StandInMkvParser parser;
+    PBYTE pReadBuffer = NULL;
+    TID writerTid = INVALID_TID_VALUE;
+    UINT64 startTime, totalBytes = 0, elapsed;
+    UINT32 read, i;
+    BOOL found = FALSE;
+
+    CHK(pServer != NULL && pConnection != NULL, STATUS_NULL_ARG);
+
+    MUTEX_LOCK(pServer->streamsLock);
+    for (i = 0; i < pServer->streamCount && !found; i++) {
+        found = STRCMP(pServer->streams[i].streamName, pConnection->streamName) == 0;
+    }
+    MUTEX_UNLOCK(pServer->streamsLock);
+    if (!found) {
+        CHK_STATUS(standInWriteResponse(pConnection, 404, (PCHAR) "{\"__type\":\"ResourceNotFoundException\",\"Message\":\"Stream not found\"}"));
+        CHK(FALSE, retStatus);
+    }
+
+    pWriter = (PStandInAckWriter) MEMCALLOC(1, SIZEOF(StandInAckWriter));
+    pReadBuffer = (PBYTE) MEMALLOC(STANDIN_READ_BUFFER_SIZE);
+    CHK(pWriter != NULL && pReadBuffer != NULL, STATUS_NOT_ENOUGH_MEMORY);
+    pWriter->pServer = pServer;
+    pWriter->pConnection = pConnection;
+    pWriter->lock = MUTEX_CREATE(FALSE);
+    pWriter->cvar = CVAR_CREATE();
+    CHK(IS_VALID_MUTEX_VALUE(pWriter->lock) && IS_VALID_CVAR_VALUE(pWriter->cvar), STATUS_INVALID_OPERATION);
+
+    if (pConnection->expectContinue) {
+        CHK_STATUS(standInWriteAll(pConnection, STANDIN_CONTINUE_RESPONSE, (UINT32) STRLEN(STANDIN_CONTINUE_RESPONSE)));
+    }
+    CHK_STATUS(standInWriteAll(pConnection, STANDIN_PUT_MEDIA_RESPONSE_HEAD, (UINT32) STRLEN(STANDIN_PUT_MEDIA_RESPONSE_HEAD)));
+    CHK_STATUS(THREAD_CREATE(&writerTid, standInAckWriterRoutine, (PVOID) pWriter));
+
+    initStandInMkvParser(&parser, standInOnMkvEvent, (UINT64) pWriter);
+    startTime = GETTIME();
+    DLOGI("PutMedia started for stream %s", pConnection->streamName);
+
+    for (;;) {
+        readStatus = standInReadBody(pConnection, pReadBuffer, STANDIN_READ_BUFFER_SIZE, &read);
+        if (STATUS_FAILED(readStatus) || read == 0 || pWriter->failed) {
+            break;
+        }
+
+        totalBytes += read;
+        readStatus = standInMkvParserFeed(&parser, pReadBuffer, read);
+        if (STATUS_FAILED(readStatus)) {
+            DLOGW("Stream %s sent invalid MKV, status 0x%08x", pConnection->streamName, readStatus);
+            break;
+        }
+        standInThrottle(&pServer->config, startTime, totalBytes);
+    }
+    standInMkvParserFinish(&parser);
+
+    elapsed = MAX(GETTIME() - startTime, 1);
+    DLOGI("PutMedia ended for stream %s: %" PRIu64 " bytes, %" PRIu64 " fragments (%" PRIu64 " errored) in %" PRIu64 " ms, %.1f kbps",
+          pConnection->streamName, totalBytes, pWriter->fragmentCount, pWriter->errorCount, elapsed / HUNDREDS_OF_NANOS_IN_A_MILLISECOND,
+          (DOUBLE) totalBytes * 8 * HUNDREDS_OF_NANOS_IN_A_MILLISECOND / elapsed);
+
+CleanUp:
+
+    if (writerTid != INVALID_TID_VALUE) {
+        // Let the writer flush whatever is still pending, then end the chunked response
+        MUTEX_LOCK(pWriter->lock);
+        pWriter->done = TRUE;
+        CVAR_SIGNAL(pWriter->cvar);
+        MUTEX_UNLOCK(pWriter->lock);
+        THREAD_JOIN(writerTid, NULL);
+
+        if (!pWriter->failed && STATUS_SUCCEEDED(readStatus)) {
+            standInWriteAll(pConnection, (PCHAR) "0\r\n\r\n", 5);
+        }
+    }
+
+    if (pWriter != NULL) {
+        if (IS_VALID_CVAR_VALUE(pWriter->cvar)) {
+            CVAR_FREE(pWriter->cvar);
+        }
+        if (IS_VALID_MUTEX_VALUE(pWriter->lock)) {
+            MUTEX_FREE(pWriter->lock);
+        }
+        MEMFREE(pWriter);
+    }
+    SAFE_MEMFREE(pReadBuffer);
+
+    return retStatus;
+}
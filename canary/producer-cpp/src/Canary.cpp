@@ -44,26 +44,16 @@ VOID determineCredentials(GstElement *kvssink, CanaryConfig* config) {
     }
 }
 
-VOID updateFragmentEndTimes(UINT64 curKeyFrameTime, UINT64 &lastKeyFrameTime, std::map<UINT64, UINT64> *mapPtr)
+VOID updateFragmentEndTimes(UINT64 curKeyFrameTime, UINT64 &lastKeyFrameTime, PCanaryAckTracker pAckTracker)
 {
     if (lastKeyFrameTime != 0)
     {
-        (*mapPtr)[lastKeyFrameTime / HUNDREDS_OF_NANOS_IN_A_MILLISECOND] = curKeyFrameTime / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
-        auto iter = mapPtr->begin();
-        while (iter != mapPtr->end()) {
-            // clean up map: removing timestamps older than 5 min from now
-            if (iter->first < (std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count() - (300000)))
-            {
-                iter = mapPtr->erase(iter);
-            } else {
-                break;
-            }
-        }
+        // Acks carry the fragment start timestamp in milliseconds
+        canaryAckTrackerRecordFragmentEnd(pAckTracker, lastKeyFrameTime / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, curKeyFrameTime);
     }
     lastKeyFrameTime = curKeyFrameTime;
 }
 
-
 VOID pushStartupLatencyMetric(CustomData *cusData)
 {
     DOUBLE currentTimestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
@@ -119,6 +109,47 @@ VOID pushErrorMetrics(CustomData *cusData, double duration, KinesisVideoStreamMe
     cusData->pCwClient->PutMetricDataAsync(cwRequest, onPutMetricDataResponseReceivedHandler);
 }
 
+VOID pushAckLatencyMetrics(CustomData *cusData, std::string prefix, CanaryHdrSummary &summary, Aws::CloudWatch::Model::PutMetricDataRequest &cwRequest)
+{
+    Aws::CloudWatch::Model::MetricDatum metricDatum;
+    std::string suffixes[] = {"P50", "P90", "P99", "Max"};
+    UINT64 values[] = {summary.p50, summary.p90, summary.p99, summary.max};
+
+    for (UINT32 i = 0; i < ARRAY_SIZE(values); i++)
+    {
+        pushMetric(prefix + suffixes[i], values[i] / 1000.0, Aws::CloudWatch::Model::StandardUnit::Milliseconds, metricDatum, cusData->pDimensionPerStream, cwRequest);
+        if (cusData->pCanaryConfig->useAggMetrics)
+        {
+            pushMetric(prefix + suffixes[i], values[i] / 1000.0, Aws::CloudWatch::Model::StandardUnit::Milliseconds, metricDatum, cusData->pAggregatedDimension, cwRequest);
+        }
+    }
+    LOG_DEBUG(prefix << " p50: " << summary.p50 << "us p99: " << summary.p99 << "us over " << summary.count << " acks");
+}
+
+// Publishes the ack latency distribution since the last call. Intervals without acks push nothing
+VOID pushAckMetrics(CustomData *cusData)
+{
+    CanaryHdrSummary receivedSummary, persistedSummary;
+    Aws::CloudWatch::Model::PutMetricDataRequest cwRequest;
+    cwRequest.SetNamespace("KinesisVideoSDKCanary");
+
+    canaryHdrHistogramCollect(&cusData->ackTracker.receivedLatency, &receivedSummary);
+    canaryHdrHistogramCollect(&cusData->ackTracker.persistedLatency, &persistedSummary);
+    if (receivedSummary.count != 0)
+    {
+        pushAckLatencyMetrics(cusData, "ReceivedAckLatency", receivedSummary, cwRequest);
+    }
+    if (persistedSummary.count != 0)
+    {
+        pushAckLatencyMetrics(cusData, "PersistedAckLatency", persistedSummary, cwRequest);
+    }
+
+    if (!cwRequest.GetMetricData().empty())
+    {
+        cusData->pCwClient->PutMetricDataAsync(cwRequest, onPutMetricDataResponseReceivedHandler);
+    }
+}
+
 VOID pushClientMetrics(CustomData *cusData, KinesisVideoProducerMetrics clientMetrics)
 {
     Aws::CloudWatch::Model::MetricDatum metricDatum;
@@ -179,7 +210,7 @@ VOID pushStreamMetrics(CustomData *cusData, KinesisVideoStreamMetrics streamMetr
 VOID metricHandler(GstElement *kvssink, KvsSinkMetric *kvssinkMetric, CustomData *cusData)
 {
     LOG_DEBUG("put frame at canary");
-    updateFragmentEndTimes(kvssinkMetric->frame_pts, cusData->lastKeyFrameTime, cusData->timeOfNextKeyFrame);
+    updateFragmentEndTimes(kvssinkMetric->frame_pts, cusData->lastKeyFrameTime, &cusData->ackTracker);
     pushStreamMetrics(cusData, kvssinkMetric->stream_metrics);
     pushClientMetrics(cusData, kvssinkMetric->client_metrics);
 
@@ -188,6 +219,7 @@ VOID metricHandler(GstElement *kvssink, KvsSinkMetric *kvssinkMetric, CustomData
     if(duration > 60)
     {
         pushErrorMetrics(cusData, duration, kvssinkMetric->stream_metrics);
+        pushAckMetrics(cusData);
         cusData->timeCounter = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
     }
 }
@@ -218,75 +250,11 @@ STATUS fragmentAckReceivedHandler(GstElement *kvssink, PFragmentAck pFragmentAck
     LOG_DEBUG("Fragment ack received handler canary cpp invoked " << pFragmentAck->timestamp);
     CustomData *cusData = reinterpret_cast<CustomData *>(data);
 
-    std::map<UINT64, UINT64>::iterator iter;
-    iter = cusData->timeOfNextKeyFrame->find(pFragmentAck->timestamp);
-    BOOL temp = (iter == cusData->timeOfNextKeyFrame->end());
-    LOG_DEBUG("Timestamp found(0) in map: "<<temp);
-
-    UINT64 timeOfFragmentEndSent;
-    timeOfFragmentEndSent = (temp == true) ? 0 : cusData->timeOfNextKeyFrame->find(pFragmentAck->timestamp)->second;
-    LOG_DEBUG("Time of the fragment end sent "<<timeOfFragmentEndSent);
-
-    if (timeOfFragmentEndSent > pFragmentAck->timestamp)
+    // Only records into the tracker, the distribution is published with the error metrics
+    canaryAckTrackerOnAck(&cusData->ackTracker, pFragmentAck);
+    if (pFragmentAck->ackType == FRAGMENT_ACK_TYPE_ERROR)
     {
-        switch (pFragmentAck->ackType)
-        {
-            case FRAGMENT_ACK_TYPE_PERSISTED:
-            {
-                Aws::CloudWatch::Model::MetricDatum persistedAckLatencyDatum;
-                Aws::CloudWatch::Model::PutMetricDataRequest cwRequest;
-                cwRequest.SetNamespace("KinesisVideoSDKCanary");
-
-                auto currentTimestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-                auto persistedAckLatency = (currentTimestamp - timeOfFragmentEndSent); // [milliseconds]
-                pushMetric("PersistedAckLatency", persistedAckLatency, Aws::CloudWatch::Model::StandardUnit::Milliseconds, persistedAckLatencyDatum, cusData->pDimensionPerStream, cwRequest);
-                LOG_DEBUG("Persisted Ack Latency: " << persistedAckLatency);
-                if (cusData->pCanaryConfig->useAggMetrics)
-                {
-                    pushMetric("PersistedAckLatency", persistedAckLatency, Aws::CloudWatch::Model::StandardUnit::Milliseconds, persistedAckLatencyDatum, cusData->pAggregatedDimension, cwRequest);
-
-                }
-                cusData->pCwClient->PutMetricDataAsync(cwRequest, onPutMetricDataResponseReceivedHandler);
-                break;
-            }
-            case FRAGMENT_ACK_TYPE_RECEIVED:
-            {
-                Aws::CloudWatch::Model::MetricDatum receivedAckLatencyDatum;
-                Aws::CloudWatch::Model::PutMetricDataRequest cwRequest;
-                cwRequest.SetNamespace("KinesisVideoSDKCanary");
-
-                auto currentTimestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-                auto receivedAckLatency = (currentTimestamp - timeOfFragmentEndSent); // [milliseconds]
-                pushMetric("ReceivedAckLatency", receivedAckLatency, Aws::CloudWatch::Model::StandardUnit::Milliseconds, receivedAckLatencyDatum, cusData->pDimensionPerStream, cwRequest);
-                LOG_DEBUG("Received Ack Latency: " << receivedAckLatency);
-                if (cusData->pCanaryConfig->useAggMetrics)
-                {
-                    pushMetric("ReceivedAckLatency", receivedAckLatency, Aws::CloudWatch::Model::StandardUnit::Milliseconds, receivedAckLatencyDatum, cusData->pAggregatedDimension, cwRequest);
-                }
-                cusData->pCwClient->PutMetricDataAsync(cwRequest, onPutMetricDataResponseReceivedHandler);
-                break;
-            }
-            case FRAGMENT_ACK_TYPE_BUFFERING:
-            {
-                LOG_DEBUG("FRAGMENT_ACK_TYPE_BUFFERING callback invoked");
-                break;
-            }
-            case FRAGMENT_ACK_TYPE_ERROR:
-            {
-                LOG_DEBUG("FRAGMENT_ACK_TYPE_ERROR callback invoked");
-                break;
-            }
-            case FRAGMENT_ACK_TYPE_UNDEFINED:
-            {
-                LOG_DEBUG("FRAGMENT_ACK_TYPE_UNDEFINED callback invoked");
-                break;
-            }
-            case  FRAGMENT_ACK_TYPE_IDLE:
-            {
-                LOG_DEBUG("FRAGMENT_ACK_TYPE_IDLE callback invoked");
-                break;
-            }
-        }
+        LOG_DEBUG("FRAGMENT_ACK_TYPE_ERROR callback invoked");
     }
     return STATUS_SUCCESS;
 }
@@ -306,6 +274,27 @@ static VOID error_cb(GstBus *bus, GstMessage *msg, CustomData *cusData) {
     g_main_loop_quit(cusData->mainLoop);
 }
 
+VOID configureKvsSink(CustomData *cusData, GstElement *kvssink) {
+    if (kvssink == NULL) {
+        return;
+    }
+
+    g_object_set(G_OBJECT (kvssink), "stream-name", cusData->streamName, NULL);
+    g_object_set(G_OBJECT (kvssink), "storage-size", cusData->pCanaryConfig->storageSizeInMB, NULL);
+    g_object_set(G_OBJECT (kvssink), "get-kvs-metrics", TRUE, NULL);
+    g_object_set(G_OBJECT (kvssink), "user-agent", CANARY_USER_AGENT_NAME, NULL);
+    g_object_set(G_OBJECT (kvssink), "log-config", NULL, NULL);
+
+    if(cusData->pCanaryConfig->streamType == "Realtime") {
+        g_object_set(G_OBJECT (kvssink), "streaming-type", STREAMING_TYPE_REALTIME, NULL);
+    } else if (cusData->pCanaryConfig->streamType == "Offline") {
+        g_object_set(G_OBJECT (kvssink), "streaming-type", STREAMING_TYPE_OFFLINE, NULL);
+    }
+    g_signal_connect(G_OBJECT(kvssink), "stream-client-metric", (GCallback) putFrameHandler, cusData);
+    g_signal_connect(G_OBJECT(kvssink), "fragment-ack", (GCallback) fragmentAckReceivedHandler, cusData);
+    determineCredentials(kvssink, cusData->pCanaryConfig);
+}
+
 int gstreamer_test_source_init(CustomData *cusData, GstElement *pipeline) {
     GstElement *kvssink, *source, *video_src_filter, *h264parse, *video_filter, *h264enc, *autoVidCon;
 
@@ -322,21 +311,7 @@ int gstreamer_test_source_init(CustomData *cusData, GstElement *pipeline) {
     // videotestsrc must be set to "live" in order for pts and dts to be incremented
     g_object_set(source, "is-live", TRUE, NULL);
 
-    // configure kvssink
-    g_object_set(G_OBJECT (kvssink), "stream-name", cusData->streamName, NULL);
-    g_object_set(G_OBJECT (kvssink), "storage-size", cusData->pCanaryConfig->storageSizeInMB, NULL);
-    g_object_set(G_OBJECT (kvssink), "get-kvs-metrics", TRUE, NULL);
-    g_object_set(G_OBJECT (kvssink), "user-agent", CANARY_USER_AGENT_NAME, NULL);
-    g_object_set(G_OBJECT (kvssink), "log-config", NULL, NULL);
-
-    if(cusData->pCanaryConfig->streamType == "Realtime") {
-        g_object_set(G_OBJECT (kvssink), "streaming-type", STREAMING_TYPE_REALTIME, NULL);
-    } else if (cusData->pCanaryConfig->streamType == "Offline") {
-        g_object_set(G_OBJECT (kvssink), "streaming-type", STREAMING_TYPE_OFFLINE, NULL);
-    }
-    g_signal_connect(G_OBJECT(kvssink), "stream-client-metric", (GCallback) putFrameHandler, cusData);
-    g_signal_connect(G_OBJECT(kvssink), "fragment-ack", (GCallback) fragmentAckReceivedHandler, cusData);
-    determineCredentials(kvssink, cusData->pCanaryConfig);
+    configureKvsSink(cusData, kvssink);
 
     // define and configure video filter, we only want the specified format to pass to the sink
     // ("caps" is short for "capabilities")
@@ -376,13 +351,274 @@ int gstreamer_test_source_init(CustomData *cusData, GstElement *pipeline) {
     return 0;
 }
 
+// Matroska and elementary streams may only carry presentation times, which run backwards in decode order once
+// there are B-frames. When any decode time is missing or goes backwards, every frame gets one from its index at
+// the average frame spacing, and presentation is delayed by the deepest reorder so no frame presents before it decodes
+static VOID rebuildFileDecodeTimes(std::vector<GstBuffer*> &frames, UINT32 fps) {
+    GstClockTime minPts = GST_CLOCK_TIME_NONE, maxPts = 0, prevDts = 0, frameDuration, dts, delay = 0;
+    BOOL monotonic = TRUE;
+    UINT64 i;
+
+    for (GstBuffer *frame : frames) {
+        if (!GST_BUFFER_DTS_IS_VALID(frame) || GST_BUFFER_DTS(frame) < prevDts) {
+            monotonic = FALSE;
+        } else {
+            prevDts = GST_BUFFER_DTS(frame);
+        }
+        minPts = MIN(minPts, GST_BUFFER_PTS(frame));
+        maxPts = MAX(maxPts, GST_BUFFER_PTS(frame));
+    }
+    if (monotonic) {
+        return;
+    }
+
+    frameDuration = frames.size() > 1 ? (maxPts - minPts) / (frames.size() - 1) : 0;
+    if (frameDuration == 0) {
+        frameDuration = GST_SECOND / fps;
+    }
+    for (i = 0; i < frames.size(); i++) {
+        dts = minPts + i * frameDuration;
+        GST_BUFFER_DTS(frames[i]) = dts;
+        if (dts > GST_BUFFER_PTS(frames[i])) {
+            delay = MAX(delay, dts - GST_BUFFER_PTS(frames[i]));
+        }
+    }
+    for (GstBuffer *frame : frames) {
+        GST_BUFFER_PTS(frame) += delay;
+    }
+
+    LOG_INFO("Rebuilt decode times at " << frameDuration << " ns per frame, presentation delayed by " << delay << " ns");
+}
+
+// Links the first video stream parsebin finds to the loader appsink, converted to what kvssink accepts
+static VOID onLoaderPadAdded(GstElement *parsebin, GstPad *pad, GstElement *appsink) {
+    GstElement *bin = GST_ELEMENT(gst_element_get_parent(parsebin));
+    GstElement *parser = NULL, *filter = NULL, *fakesink;
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    GstPad *sinkPad;
+    const gchar *mediaType;
+    std::string filterCaps;
+
+    if (caps == NULL) {
+        caps = gst_pad_query_caps(pad, NULL);
+    }
+    mediaType = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+
+    if (g_object_get_data(G_OBJECT(appsink), "linked") == NULL && strcmp(mediaType, "video/x-h264") == 0) {
+        parser = gst_element_factory_make("h264parse", NULL);
+        filterCaps = "video/x-h264, stream-format=(string) avc, alignment=(string) au";
+    } else if (g_object_get_data(G_OBJECT(appsink), "linked") == NULL && strcmp(mediaType, "video/x-h265") == 0) {
+        parser = gst_element_factory_make("h265parse", NULL);
+        filterCaps = "video/x-h265, stream-format=(string) hvc1, alignment=(string) au";
+    }
+
+    if (parser != NULL) {
+        LOG_INFO("Loading " << mediaType << " stream from file");
+        filter = gst_element_factory_make("capsfilter", NULL);
+        GstCaps *outCaps = gst_caps_from_string(filterCaps.c_str());
+        g_object_set(G_OBJECT(filter), "caps", outCaps, NULL);
+        gst_caps_unref(outCaps);
+        gst_bin_add_many(GST_BIN(bin), parser, filter, NULL);
+        gst_element_link_many(parser, filter, appsink, NULL);
+        gst_element_sync_state_with_parent(filter);
+        gst_element_sync_state_with_parent(parser);
+        sinkPad = gst_element_get_static_pad(parser, "sink");
+        g_object_set_data(G_OBJECT(appsink), "linked", GINT_TO_POINTER(1));
+    } else {
+        // Other tracks and extra video streams are drained so the demuxer does not stall on them
+        LOG_DEBUG("Ignoring " << mediaType << " stream from file");
+        fakesink = gst_element_factory_make("fakesink", NULL);
+        g_object_set(G_OBJECT(fakesink), "sync", FALSE, NULL);
+        gst_bin_add(GST_BIN(bin), fakesink);
+        gst_element_sync_state_with_parent(fakesink);
+        sinkPad = gst_element_get_static_pad(fakesink, "sink");
+    }
+
+    gst_pad_link(pad, sinkPad);
+    gst_object_unref(sinkPad);
+    gst_caps_unref(caps);
+    gst_object_unref(bin);
+}
+
+// Reads every video access unit of the file into memory up front so that neither the demuxer nor the parser
+// runs while the canary measures kvssink
+int loadFileSource(CustomData *cusData) {
+    GstElement *pipeline, *filesrc, *parsebin, *appsink;
+    GstSample *sample;
+    GstBuffer *buffer;
+    GstMessage *msg;
+    GstBus *bus;
+    UINT64 totalBytes = 0;
+    int ret = 0;
+
+    pipeline = gst_pipeline_new("file-loader");
+    filesrc = gst_element_factory_make("filesrc", "file_source");
+    parsebin = gst_element_factory_make("parsebin", "file_parse");
+    appsink = gst_element_factory_make("appsink", "file_frames");
+    if (!pipeline || !filesrc || !parsebin || !appsink) {
+        LOG_ERROR("Not all file loader elements could be created");
+        return 1;
+    }
+
+    g_object_set(G_OBJECT(filesrc), "location", cusData->pCanaryConfig->sourceFile.c_str(), NULL);
+    g_object_set(G_OBJECT(appsink), "sync", FALSE, NULL);
+    gst_bin_add_many(GST_BIN(pipeline), filesrc, parsebin, appsink, NULL);
+    gst_element_link(filesrc, parsebin);
+    g_signal_connect(parsebin, "pad-added", G_CALLBACK(onLoaderPadAdded), appsink);
+
+    if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        LOG_ERROR("Unable to start reading " << cusData->pCanaryConfig->sourceFile);
+        gst_object_unref(pipeline);
+        return 1;
+    }
+
+    bus = gst_element_get_bus(pipeline);
+    while (!gst_app_sink_is_eos(GST_APP_SINK(appsink))) {
+        sample = gst_app_sink_try_pull_sample(GST_APP_SINK(appsink), 100 * GST_MSECOND);
+        if (sample == NULL) {
+            // Nothing to pull either means eos or a failure the appsink will never hear about
+            if ((msg = gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR)) != NULL) {
+                GError *err;
+                gst_message_parse_error(msg, &err, NULL);
+                LOG_ERROR("Failed to read " << cusData->pCanaryConfig->sourceFile << ": " << err->message);
+                g_clear_error(&err);
+                gst_message_unref(msg);
+                ret = 1;
+                break;
+            }
+            continue;
+        }
+
+        buffer = gst_sample_get_buffer(sample);
+        if (cusData->fileCaps == NULL) {
+            cusData->fileCaps = gst_caps_ref(gst_sample_get_caps(sample));
+        }
+        // Every loop has to start on a key frame
+        if (buffer != NULL && (!cusData->fileFrames.empty() || !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT))) {
+            buffer = gst_buffer_make_writable(gst_buffer_ref(buffer));
+            // Elementary streams without timing info are spaced at the configured frame rate
+            if (!GST_BUFFER_PTS_IS_VALID(buffer) && !GST_BUFFER_DTS_IS_VALID(buffer)) {
+                GST_BUFFER_DTS(buffer) = cusData->fileFrames.size() * GST_SECOND / cusData->pCanaryConfig->testVideoFps;
+            }
+            if (!GST_BUFFER_PTS_IS_VALID(buffer)) {
+                GST_BUFFER_PTS(buffer) = GST_BUFFER_DTS(buffer);
+            }
+            cusData->fileFrames.push_back(buffer);
+            totalBytes += gst_buffer_get_size(buffer);
+        }
+        gst_sample_unref(sample);
+    }
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    if (ret == 0 && cusData->fileFrames.empty()) {
+        LOG_ERROR("No H.264 or H.265 key frame found in " << cusData->pCanaryConfig->sourceFile);
+        ret = 1;
+    }
+    if (ret == 0) {
+        rebuildFileDecodeTimes(cusData->fileFrames, cusData->pCanaryConfig->testVideoFps);
+        LOG_INFO("Loaded " << cusData->fileFrames.size() << " frames (" << totalBytes << " bytes) from " << cusData->pCanaryConfig->sourceFile);
+    }
+
+    return ret;
+}
+
+VOID freeFileSource(CustomData *cusData) {
+    for (GstBuffer *buffer : cusData->fileFrames) {
+        gst_buffer_unref(buffer);
+    }
+    cusData->fileFrames.clear();
+    if (cusData->fileCaps != NULL) {
+        gst_caps_unref(cusData->fileCaps);
+        cusData->fileCaps = NULL;
+    }
+}
+
+// Loops the loaded access units into appsrc. Timestamps keep increasing across loops so kvssink sees one long
+// recording. Realtime pacing holds each frame until its decode time, Max pacing only waits on appsrc backpressure
+VOID fileSourceFeeder(CustomData *cusData) {
+    std::vector<GstBuffer*> &frames = cusData->fileFrames;
+    BOOL realtime = cusData->pCanaryConfig->sourcePacing != SOURCE_PACING_MAX;
+    GstClockTime base = GST_BUFFER_DTS(frames.front()), loopDuration, offset = 0;
+    auto start = std::chrono::steady_clock::now();
+    UINT64 loops = 0;
+
+    // Leading B-frames of an open GOP may present before the key frame they follow
+    for (GstBuffer *frame : frames) {
+        base = MIN(base, GST_BUFFER_PTS(frame));
+    }
+
+    // The file has no duration for its last frame, assume it matches the average frame spacing
+    if (frames.size() > 1) {
+        loopDuration = (GST_BUFFER_DTS(frames.back()) - base) * frames.size() / (frames.size() - 1);
+    } else {
+        loopDuration = GST_SECOND / cusData->pCanaryConfig->testVideoFps;
+    }
+
+    while (!cusData->stopFeeding) {
+        for (GstBuffer *frame : frames) {
+            // Shallow copy, only the metadata is rewritten and the memory is shared with the loaded frame
+            GstBuffer *buffer = gst_buffer_copy(frame);
+            GST_BUFFER_PTS(buffer) = offset + GST_BUFFER_PTS(frame) - base;
+            GST_BUFFER_DTS(buffer) = offset + GST_BUFFER_DTS(frame) - base;
+            // kvssink drops discontinuous buffers, which the demuxer may have flagged on the first frame
+            GST_BUFFER_FLAG_UNSET(buffer, GST_BUFFER_FLAG_DISCONT);
+
+            if (realtime) {
+                std::this_thread::sleep_until(start + std::chrono::nanoseconds(GST_BUFFER_DTS(buffer)));
+            }
+
+            // Takes ownership of the buffer. Anything but ok means the pipeline is flushing for shutdown
+            if (cusData->stopFeeding || gst_app_src_push_buffer(GST_APP_SRC(cusData->appSrc), buffer) != GST_FLOW_OK) {
+                LOG_DEBUG("File source stopped after " << loops << " loops");
+                return;
+            }
+        }
+        offset += loopDuration;
+        loops++;
+    }
+}
+
+int gstreamer_file_source_init(CustomData *cusData, GstElement *pipeline) {
+    GstElement *kvssink;
+
+    if (loadFileSource(cusData) != 0) {
+        return 1;
+    }
+    // Loading is canary setup, it should not count towards the startup latency
+    cusData->startTime = std::chrono::duration_cast<std::chrono::nanoseconds>(systemCurrentTime().time_since_epoch()).count();
+
+    cusData->appSrc = gst_element_factory_make("appsrc", "source");
+    kvssink = gst_element_factory_make("kvssink", "kvssink");
+    configureKvsSink(cusData, kvssink);
+
+    if (!pipeline || !cusData->appSrc || !kvssink) {
+        LOG_ERROR("Not all elements could be created");
+        return 1;
+    }
+
+    // The loaded caps already carry the codec data, so no parser is needed in front of kvssink
+    g_object_set(G_OBJECT(cusData->appSrc), "caps", cusData->fileCaps, "format", GST_FORMAT_TIME, "block", TRUE, NULL);
+
+    gst_bin_add_many(GST_BIN (pipeline), cusData->appSrc, kvssink, NULL);
+    if (!gst_element_link(cusData->appSrc, kvssink))
+    {
+        LOG_ERROR("Elements could not be linked");
+        gst_object_unref(pipeline);
+        return 1;
+    }
+
+    return 0;
+}
+
 int gstreamer_init(int argc, char* argv[], CustomData *cusData) {
 
     // init GStreamer
     gst_init(&argc, &argv);
 
     GstElement *pipeline;
-    int ret;
+    int ret = 1;
     GstStateChangeReturn gst_ret;
 
     // Reset first frame pts
@@ -395,7 +631,9 @@ int gstreamer_init(int argc, char* argv[], CustomData *cusData) {
             ret = gstreamer_test_source_init(cusData, pipeline);
             break;
         case FILE_SOURCE:
-            LOG_WARN("File source unsupported");
+            LOG_INFO("Streaming from file source " << cusData->pCanaryConfig->sourceFile);
+            pipeline = gst_pipeline_new("file-kinesis-pipeline");
+            ret = gstreamer_file_source_init(cusData, pipeline);
             break;
         case LIVE_SOURCE:
             LOG_WARN("Unsupported live source");
@@ -405,6 +643,7 @@ int gstreamer_init(int argc, char* argv[], CustomData *cusData) {
             break;
     }
     if (ret != 0){
+        freeFileSource(cusData);
         return ret;
     }
 
@@ -422,13 +661,24 @@ int gstreamer_init(int argc, char* argv[], CustomData *cusData) {
         return 1;
     }
 
+    if (cusData->streamSource == FILE_SOURCE) {
+        cusData->stopFeeding = false;
+        cusData->fileFeeder = std::thread(fileSourceFeeder, cusData);
+    }
+
     cusData->mainLoop = g_main_loop_new(NULL, FALSE);
     g_main_loop_run(cusData->mainLoop);
 
     // free resources
     LOG_INFO("Cleaning up for stream "<<cusData->streamName);
     gst_bus_remove_signal_watch(bus);
+    // Going to NULL flushes appsrc, which releases a feeder blocked on a full queue
+    cusData->stopFeeding = true;
     gst_element_set_state(pipeline, GST_STATE_NULL);
+    if (cusData->fileFeeder.joinable()) {
+        cusData->fileFeeder.join();
+    }
+    freeFileSource(cusData);
     gst_object_unref(pipeline);
     g_main_loop_unref(cusData->mainLoop);
     cusData->mainLoop = NULL;
@@ -471,6 +721,8 @@ int main(int argc, char* argv[]) {
         // Set the video stream source
         if (cusData.pCanaryConfig->sourceType == "TEST_SOURCE") {
             cusData.streamSource = TEST_SOURCE;
+        } else if (cusData.pCanaryConfig->sourceType == "FILE_SOURCE") {
+            cusData.streamSource = FILE_SOURCE;
         }
 
         // Non-aggregate CW dimension
@@ -488,12 +740,10 @@ int main(int argc, char* argv[]) {
         // Set start time after CW initializations
         cusData.startTime = std::chrono::duration_cast<std::chrono::nanoseconds>(systemCurrentTime().time_since_epoch()).count();
 
-        if (cusData.streamSource == TEST_SOURCE) {
+        if (cusData.streamSource == TEST_SOURCE || cusData.streamSource == FILE_SOURCE) {
             gstreamer_init(argc, argv, &cusData);
         }
 
-        // CleanUp
-        delete (cusData.timeOfNextKeyFrame);
         LOG_DEBUG("end of canary");
     }
     CleanUp:
@@ -4,6 +4,7 @@ CanaryConfig::CanaryConfig()
 {
     this->streamName = DEFAULT_CANARY_STREAM_NAME;
     this->sourceType = DEFAULT_SOURCE_TYPE;
+    this->sourcePacing = DEFAULT_SOURCE_PACING;
     this->canaryRunScenario = DEFAULT_RUN_SCENARIO; // (or intermittent)
     this->streamType = DEFAULT_STREAM_TYPE_REALTIME;
     this->canaryLabel = DEFAULT_CANARY_RUN_LABEL; // need to decide on a default value
@@ -94,6 +95,26 @@ STATUS CanaryConfig::initConfigWithEnvVars()
 
     setEnvVarsString(this->canaryLabel, CANARY_LABEL_ENV_VAR);
 
+    setEnvVarsString(this->sourceType, CANARY_SOURCE_TYPE_ENV_VAR);
+    setEnvVarsString(this->sourceFile, CANARY_SOURCE_FILE_ENV_VAR);
+    setEnvVarsString(this->sourcePacing, CANARY_SOURCE_PACING_ENV_VAR);
+
+    if(this->sourceType.compare("TEST_SOURCE") && this->sourceType.compare("FILE_SOURCE")) {
+        LOG_ERROR("Unsupported source type provided. Supported types are TEST_SOURCE and FILE_SOURCE..." << this->sourceType << " found");
+        CHK(FALSE, STATUS_INVALID_ARG);
+    }
+
+    if(this->sourceType == "FILE_SOURCE") {
+        if(this->sourceFile.empty()) {
+            LOG_ERROR("FILE_SOURCE needs a pre-encoded file in " << CANARY_SOURCE_FILE_ENV_VAR);
+            CHK(FALSE, STATUS_INVALID_ARG);
+        }
+        if(this->sourcePacing.compare(DEFAULT_SOURCE_PACING) && this->sourcePacing.compare(SOURCE_PACING_MAX)) {
+            LOG_ERROR("Unsupported source pacing provided. Supported pacings are Realtime and Max..." << this->sourcePacing << " found");
+            CHK(FALSE, STATUS_INVALID_ARG);
+        }
+    }
+
 
     setEnvVarsInt(&this->fragmentSize, CANARY_FRAGMENT_SIZE_ENV_VAR);
     setEnvVarsInt(&this->canaryDuration, CANARY_RUN_DURATION_ENV_VAR);
@@ -114,6 +135,7 @@ VOID CanaryConfig::print() {
           "\n\tDuration           : " << this->canaryDuration << " seconds" <<
           "\n\tCanary run scenario: " << this->canaryRunScenario <<
           "\n\tSource type:       : " << this->sourceType <<
+          (this->sourceType == "FILE_SOURCE" ? "\n\tSource file        : " + this->sourceFile + " (" + this->sourcePacing + " pacing)" : "") <<
           "\n\tStreaming type:    : " << this->streamType <<
           "\n\tCredential type    : " << (this->useIotCredentialProvider ? "IoT" : "Static") <<
           "\n");
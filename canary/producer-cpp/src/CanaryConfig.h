@@ -7,6 +7,8 @@
 #define DEFAULT_BUFFER_DURATION_SECONDS 120
 #define DEFAULT_STORAGE_MB              256
 #define DEFAULT_CANARY_FRAME_RATE       25
+#define DEFAULT_SOURCE_PACING           "Realtime"
+#define SOURCE_PACING_MAX               "Max"
 
 #define CANARY_USE_IOT_ENV_VAR              "CANARY_USE_IOT"
 #define CANARY_RUN_SCENARIO_ENV_VAR         "CANARY_RUN_SCENARIO"
@@ -18,6 +20,9 @@
 #define CANARY_BUFFER_DURATION_ENV_VAR      "CANARY_BUFFER_DURATION"
 #define CANARY_STORAGE_SIZE_MB_ENV_VAR      "CANARY_STORAGE_SIZE"
 #define CANARY_FRAME_RATE_ENV_VAR           "CANARY_FPS"
+#define CANARY_SOURCE_TYPE_ENV_VAR          "CANARY_SOURCE_TYPE"
+#define CANARY_SOURCE_FILE_ENV_VAR          "CANARY_SOURCE_FILE"
+#define CANARY_SOURCE_PACING_ENV_VAR        "CANARY_SOURCE_PACING"
 
 #define IOT_CORE_CREDENTIAL_ENDPOINT_ENV_VAR "AWS_IOT_CORE_CREDENTIAL_ENDPOINT"
 #define IOT_CORE_CERT_ENV_VAR                "AWS_IOT_CORE_CERT"
@@ -31,6 +36,8 @@ class CanaryConfig {
 public: 
     std::string streamName;
     std::string sourceType;
+    std::string sourceFile; // pre-encoded file looped by FILE_SOURCE
+    std::string sourcePacing; // Realtime or Max, for FILE_SOURCE
     std::string canaryRunScenario; // continuous or intermittent
     std::string streamType; // real-time or offline
     std::string canaryLabel; // typically: longrun or periodic
@@ -14,6 +14,9 @@ CustomData::CustomData()
     streamStatus = STATUS_SUCCESS;
     mainLoop = NULL;
     firstPts = GST_CLOCK_TIME_NONE;
+    fileCaps = NULL;
+    appSrc = NULL;
+    stopFeeding = false;
     useAbsoluteFragmentTimes = true;
 
     producerStartTime = std::chrono::duration_cast<std::chrono::nanoseconds>(systemCurrentTime().time_since_epoch()).count(); // [nanoSeconds]
@@ -22,7 +25,7 @@ CustomData::CustomData()
     pCwClient = nullptr;
     pDimensionPerStream = nullptr;
     pAggregatedDimension = nullptr;
-    timeOfNextKeyFrame = new std::map<UINT64, UINT64>();
+    canaryAckTrackerInit(&ackTracker);
     timeCounter = producerStartTime / 1000000000; // [seconds]
     // Default first intermittent run to 1 min for testing
     runTill = producerStartTime / 1000000000 / 60 + 1; // [minutes]
@@ -40,7 +40,7 @@ public:
     PCHAR streamName;
     std::string rtspUrl;
 
-    std::map<UINT64, UINT64> *timeOfNextKeyFrame;
+    CanaryAckTracker ackTracker;
     UINT64 lastKeyFrameTime;
     UINT64 curKeyFrameTime;
 
@@ -60,5 +60,12 @@ public:
     // Pts of first video frame
     UINT64 firstPts;
 
+    // File source. The access units of the file are held in memory and looped into appsrc by the feeder thread
+    std::vector<GstBuffer*> fileFrames;
+    GstCaps* fileCaps;
+    GstElement* appSrc;
+    std::thread fileFeeder;
+    std::atomic<bool> stopFeeding;
+
     CustomData();
 };
\ No newline at end of file
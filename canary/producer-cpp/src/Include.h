@@ -7,6 +7,8 @@
 #include <vector>
 #include <stdlib.h>
 #include <mutex>
+#include <thread>
+#include <atomic>
 #include <unistd.h>
 
 #include <IotCertCredentialProvider.h>
@@ -14,10 +16,12 @@
 #include <aws/core/Aws.h>
 #include <aws/monitoring/CloudWatchClient.h>
 #include <aws/monitoring/model/PutMetricDataRequest.h>
+#include <CanaryAckTracker.h>
 
 #include <gstreamer/gstkvssink.h>
 #include <gst/gst.h>
 #include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
 
 #include "CanaryConfig.h"
 #include "CustomData.h"
@@ -0,0 +1,9 @@
+#!/bin/bash
+
+# Self signed certificate for kvsWebrtcSignalingStandIn. The canary trusts it through AWS_KVS_CACERT_PATH
+out=${1:-.}
+host=${2:-127.0.0.1}
+
+openssl req -x509 -newkey rsa:2048 -nodes -days 30 \
+    -keyout "$out/stand-in-key.pem" -out "$out/stand-in-cert.pem" \
+    -subj "/CN=$host" -addext "subjectAltName=IP:$host,DNS:localhost"
@@ -0,0 +1,204 @@
+#include "Include.h"
+
+#if defined(__SSE4_2__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace Canary {
+
+// Field widths in bytes once split into 7 bit groups
+#define CANARY_PAYLOAD_VERSION_FIELD_SIZE 1
+#define CANARY_PAYLOAD_UINT32_FIELD_SIZE  5
+#define CANARY_PAYLOAD_UINT64_FIELD_SIZE  10
+
+static PBYTE putField(PBYTE pDst, UINT64 value, UINT32 fieldSize)
+{
+    UINT32 i;
+
+    for (i = fieldSize; i > 0; i--) {
+        pDst[i - 1] = (BYTE) (0x80 | (value & 0x7f));
+        value >>= 7;
+    }
+
+    return pDst + fieldSize;
+}
+
+static PBYTE getField(PBYTE pSrc, UINT32 fieldSize, PUINT64 pValue, PBOOL pValid)
+{
+    UINT32 i;
+    UINT64 value = 0;
+
+    for (i = 0; i < fieldSize; i++) {
+        *pValid = *pValid && (pSrc[i] & 0x80) != 0;
+        value = (value << 7) | (pSrc[i] & 0x7f);
+    }
+    *pValue = value;
+
+    return pSrc + fieldSize;
+}
+
+// pDst has to have room for CANARY_PAYLOAD_HEADER_SIZE bytes
+VOID writeCanaryPayloadHeader(PBYTE pDst, PCanaryPayloadHeader pHeader)
+{
+    MEMCPY(pDst, CANARY_PAYLOAD_MAGIC, CANARY_PAYLOAD_MAGIC_LEN);
+    pDst += CANARY_PAYLOAD_MAGIC_LEN;
+    pDst = putField(pDst, pHeader->version, CANARY_PAYLOAD_VERSION_FIELD_SIZE);
+    pDst = putField(pDst, pHeader->sequenceNumber, CANARY_PAYLOAD_UINT32_FIELD_SIZE);
+    pDst = putField(pDst, pHeader->timestamp, CANARY_PAYLOAD_UINT64_FIELD_SIZE);
+    pDst = putField(pDst, pHeader->size, CANARY_PAYLOAD_UINT32_FIELD_SIZE);
+    putField(pDst, pHeader->bodyCrc, CANARY_PAYLOAD_UINT32_FIELD_SIZE);
+}
+
+// Returns the length of the start code the frame arrived with and the offset of the payload header, past the NAL header
+STATUS findCanaryPayload(PBYTE pFrame, UINT32 size, PUINT32 pStartCodeSize, PUINT32 pOffset)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    UINT32 startCodeSize;
+
+    CHK(pFrame != NULL && pStartCodeSize != NULL && pOffset != NULL, STATUS_NULL_ARG);
+
+    if (size >= 4 && pFrame[0] == 0x00 && pFrame[1] == 0x00 && pFrame[2] == 0x00 && pFrame[3] == 0x01) {
+        startCodeSize = 4;
+    } else if (size >= 3 && pFrame[0] == 0x00 && pFrame[1] == 0x00 && pFrame[2] == 0x01) {
+        startCodeSize = 3;
+    } else {
+        CHK(FALSE, STATUS_CANARY_INVALID_PAYLOAD);
+    }
+
+    CHK(size > startCodeSize && pFrame[startCodeSize] == CANARY_PAYLOAD_NAL_HEADER, STATUS_CANARY_INVALID_PAYLOAD);
+
+    *pStartCodeSize = startCodeSize;
+    *pOffset = startCodeSize + CANARY_PAYLOAD_NAL_HEADER_SIZE;
+
+CleanUp:
+
+    return retStatus;
+}
+
+// Reads the header in place. pSrc points right after the NAL header
+STATUS parseCanaryPayloadHeader(PBYTE pSrc, UINT32 size, PCanaryPayloadHeader pHeader)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    BOOL valid = TRUE;
+    UINT64 value;
+
+    CHK(pSrc != NULL && pHeader != NULL, STATUS_NULL_ARG);
+    CHK(size >= CANARY_PAYLOAD_HEADER_SIZE && MEMCMP(pSrc, CANARY_PAYLOAD_MAGIC, CANARY_PAYLOAD_MAGIC_LEN) == 0, STATUS_CANARY_INVALID_PAYLOAD);
+    pSrc += CANARY_PAYLOAD_MAGIC_LEN;
+
+    pSrc = getField(pSrc, CANARY_PAYLOAD_VERSION_FIELD_SIZE, &value, &valid);
+    pHeader->version = (UINT32) value;
+    CHK(valid && pHeader->version == CANARY_PAYLOAD_VERSION, STATUS_CANARY_INVALID_PAYLOAD);
+
+    pSrc = getField(pSrc, CANARY_PAYLOAD_UINT32_FIELD_SIZE, &value, &valid);
+    pHeader->sequenceNumber = (UINT32) value;
+    pSrc = getField(pSrc, CANARY_PAYLOAD_UINT64_FIELD_SIZE, &pHeader->timestamp, &valid);
+    pSrc = getField(pSrc, CANARY_PAYLOAD_UINT32_FIELD_SIZE, &value, &valid);
+    pHeader->size = (UINT32) value;
+    getField(pSrc, CANARY_PAYLOAD_UINT32_FIELD_SIZE, &value, &valid);
+    pHeader->bodyCrc = (UINT32) value;
+    CHK(valid, STATUS_CANARY_INVALID_PAYLOAD);
+
+CleanUp:
+
+    return retStatus;
+}
+
+#if !defined(__SSE4_2__) || !defined(__x86_64__)
+struct Crc32cTable {
+    UINT32 entries[256];
+
+    Crc32cTable()
+    {
+        UINT32 i, j, crc;
+
+        for (i = 0; i < 256; i++) {
+            crc = i;
+            for (j = 0; j < 8; j++) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0x82f63b78 : crc >> 1;
+            }
+            this->entries[i] = crc;
+        }
+    }
+};
+#endif
+
+// CRC32C (Castagnoli). Uses the SSE4.2 crc32 instruction when the build targets it
+UINT32 crc32c(PBYTE pData, UINT32 size)
+{
+    UINT32 crc = 0xffffffff, i = 0;
+
+#if defined(__SSE4_2__) && defined(__x86_64__)
+    UINT64 crc64 = crc, value;
+
+    for (; i + SIZEOF(UINT64) <= size; i += SIZEOF(UINT64)) {
+        MEMCPY(&value, pData + i, SIZEOF(UINT64));
+        crc64 = _mm_crc32_u64(crc64, value);
+    }
+    crc = (UINT32) crc64;
+    for (; i < size; i++) {
+        crc = _mm_crc32_u8(crc, pData[i]);
+    }
+#else
+    static const Crc32cTable table;
+
+    for (; i < size; i++) {
+        crc = table.entries[(crc ^ pData[i]) & 0xff] ^ (crc >> 8);
+    }
+#endif
+
+    return crc ^ 0xffffffff;
+}
+
+SequenceTracker::SequenceTracker() : started(FALSE), maxSequenceNumber(0), window(0)
+{
+}
+
+// pNewlyLost receives the number of frames that left the window without ever arriving
+CANARY_SEQUENCE_STATUS SequenceTracker::update(UINT32 sequenceNumber, PUINT32 pNewlyLost)
+{
+    // Wrap safe distance from the newest frame seen so far
+    INT32 delta = (INT32) (sequenceNumber - this->maxSequenceNumber);
+    UINT64 bit;
+
+    *pNewlyLost = 0;
+
+    if (!this->started) {
+        // Nothing before the first frame is known, so count it as seen rather than as lost once it leaves the window
+        this->started = TRUE;
+        this->maxSequenceNumber = sequenceNumber;
+        this->window = MAX_UINT64;
+        return CANARY_SEQUENCE_IN_ORDER;
+    }
+
+    if (delta > 0) {
+        if (delta >= CANARY_SEQUENCE_WINDOW_SIZE) {
+            // Everything in the window and everything between it and the new frame is gone
+            *pNewlyLost = (UINT32) delta - (UINT32) __builtin_popcountll(this->window);
+            this->window = 1;
+        } else {
+            *pNewlyLost = (UINT32) delta - (UINT32) __builtin_popcountll(this->window >> (CANARY_SEQUENCE_WINDOW_SIZE - delta));
+            this->window = (this->window << delta) | 1;
+        }
+        this->maxSequenceNumber = sequenceNumber;
+        return CANARY_SEQUENCE_IN_ORDER;
+    }
+
+    if (delta == 0) {
+        return CANARY_SEQUENCE_DUPLICATE;
+    }
+
+    if (-delta >= CANARY_SEQUENCE_WINDOW_SIZE) {
+        return CANARY_SEQUENCE_LATE;
+    }
+
+    bit = 1ULL << -delta;
+    if ((this->window & bit) != 0) {
+        return CANARY_SEQUENCE_DUPLICATE;
+    }
+
+    this->window |= bit;
+    return CANARY_SEQUENCE_REORDERED;
+}
+
+} // namespace Canary
@@ -0,0 +1,57 @@
+#pragma once
+
+namespace Canary {
+
+/*
+ * Binary canary frame payload. After the Annex-B start code and an SEI NAL header every frame carries
+ *
+ *   magic "KVSC" | version | sequence number | send timestamp | frame size | body CRC32C | random body
+ *
+ * Frames are sent with a 4 byte start code but the receiving end can get them back with a 3 byte one.
+ * The packetizer splits frames on start codes, so nothing after the start code may contain two consecutive zero bytes.
+ * Header fields are written big endian in 7 bit groups with the top bit of every byte set, and the frame pool never
+ * generates a zero body byte. That keeps the payload within a few percent of its raw size where hex encoding doubled it.
+ */
+typedef struct {
+    UINT32 version;
+    UINT32 sequenceNumber;
+    // Send time in 100ns units
+    UINT64 timestamp;
+    // Frame size as sent, including the 4 byte start code, the NAL header, the header and the body
+    UINT32 size;
+    UINT32 bodyCrc;
+} CanaryPayloadHeader;
+typedef CanaryPayloadHeader* PCanaryPayloadHeader;
+
+VOID writeCanaryPayloadHeader(PBYTE, PCanaryPayloadHeader);
+STATUS parseCanaryPayloadHeader(PBYTE, UINT32, PCanaryPayloadHeader);
+STATUS findCanaryPayload(PBYTE, UINT32, PUINT32, PUINT32);
+UINT32 crc32c(PBYTE, UINT32);
+
+typedef enum {
+    CANARY_SEQUENCE_IN_ORDER,
+    CANARY_SEQUENCE_REORDERED,
+    CANARY_SEQUENCE_DUPLICATE,
+    // Arrived after it had already left the window and been counted as lost
+    CANARY_SEQUENCE_LATE,
+} CANARY_SEQUENCE_STATUS;
+
+/*
+ * Classifies received sequence numbers against a sliding window of the last CANARY_SEQUENCE_WINDOW_SIZE frames. A gap
+ * is only reported as lost once it slides out of the window, so frames that are merely reordered are never counted
+ * as lost first and then taken back.
+ */
+class SequenceTracker {
+  public:
+    SequenceTracker();
+
+    CANARY_SEQUENCE_STATUS update(UINT32, PUINT32);
+
+  private:
+    BOOL started;
+    UINT32 maxSequenceNumber;
+    // Bit i is set when maxSequenceNumber - i has been received
+    UINT64 window;
+};
+
+} // namespace Canary
@@ -3,8 +3,10 @@
 STATUS onNewConnection(Canary::PPeer);
 STATUS run(Canary::PConfig);
 VOID runPeer(Canary::PConfig, TIMER_QUEUE_HANDLE, STATUS*);
-VOID sendLocalFrames(Canary::PPeer, MEDIA_STREAM_TRACK_KIND, const std::string&, UINT64, UINT32);
-VOID sendCustomFrames(Canary::PPeer, MEDIA_STREAM_TRACK_KIND, UINT64, UINT64);
+VOID runLoad(Canary::PConfig, TIMER_QUEUE_HANDLE, STATUS*);
+VOID reportLoad(Canary::PPeer, std::vector<std::unique_ptr<Canary::Peer>>&, UINT32, UINT64);
+VOID sendLocalFrames(Canary::PPeer, MEDIA_STREAM_TRACK_KIND, Canary::PFrameArchive);
+VOID sendCustomFrames(Canary::PPeer, MEDIA_STREAM_TRACK_KIND, UINT64, UINT64, PUINT64);
 VOID sendProfilingMetrics(Canary::PPeer);
 STATUS canaryRtpOutboundStats(UINT32, UINT64, UINT64);
 STATUS canaryRtpInboundStats(UINT32, UINT64, UINT64);
@@ -18,29 +20,27 @@ VOID handleSignal(INT32 signal)
     terminated = TRUE;
 }
 
-// add frame pts, original frame size, CRC to beginning of buffer after Annex-B format NALu
-VOID addCanaryMetadataToFrameData(PBYTE buffer, PFrame pFrame)
+// Frame Data format: NALu (4 bytes) + SEI NAL header + canary payload header + random body, see CanaryPayload.h. The body and its CRC32C
+// come pre-generated from the frame pool, so only the header needs to be written for every frame that is sent out
+STATUS createCanaryFrameData(Canary::PFramePoolEntry pEntry, UINT32 sequenceNumber, PFrame pFrame)
 {
-    PBYTE pCurPtr = buffer + ANNEX_B_NALU_SIZE;
-    putUnalignedInt64BigEndian((PINT64) pCurPtr, pFrame->presentationTs);
-    pCurPtr += SIZEOF(UINT64);
-    putUnalignedInt32BigEndian((PINT32) pCurPtr, pFrame->size);
-    pCurPtr += SIZEOF(UINT32);
-    putUnalignedInt32BigEndian((PINT32) pCurPtr, COMPUTE_CRC32(buffer, pFrame->size));
-}
-
-// Frame Data format: NALu (4 bytes) + Header (PTS, Size (including header), CRC (frame data) + Randomly generated frameBits
+    Canary::CanaryPayloadHeader header;
 
-// TODO: Support dynamic random frame sizes to bring it closer to real time scenarios
-VOID createCanaryFrameData(PBYTE buffer, PFrame pFrame)
-{
-    UINT32 i;
     // For decoding purposes, the first 4 bytes need to be a NALu
-    putUnalignedInt32BigEndian((PINT32) buffer, 0x00000001);
-    for (i = ANNEX_B_NALU_SIZE + CANARY_METADATA_SIZE; i < pFrame->size; i++) {
-        buffer[i] = RAND();
-    }
-    addCanaryMetadataToFrameData(buffer, pFrame);
+    putUnalignedInt32BigEndian((PINT32) pEntry->pData, 0x00000001);
+    pEntry->pData[ANNEX_B_NALU_SIZE] = CANARY_PAYLOAD_NAL_HEADER;
+
+    header.version = CANARY_PAYLOAD_VERSION;
+    header.sequenceNumber = sequenceNumber;
+    header.timestamp = pFrame->presentationTs;
+    header.size = pEntry->size;
+    header.bodyCrc = pEntry->bodyCrc;
+    Canary::writeCanaryPayloadHeader(pEntry->pData + ANNEX_B_NALU_SIZE + CANARY_PAYLOAD_NAL_HEADER_SIZE, &header);
+
+    pFrame->frameData = pEntry->pData;
+    pFrame->size = pEntry->size;
+
+    return STATUS_SUCCESS;
 }
 
 INT32 main(INT32 argc, CHAR* argv[])
@@ -111,7 +111,9 @@ STATUS run(Canary::PConfig pConfig)
                                       &timeoutTimerId));
     }
 
-    if (!pConfig->runBothPeers.value) {
+    if (pConfig->viewerCount.value != 0) {
+        runLoad(pConfig, timerQueueHandle, &retStatus);
+    } else if (!pConfig->runBothPeers.value) {
         runPeer(pConfig, timerQueueHandle, &retStatus);
     } else {
         // Modify config to differentiate master and viewer
@@ -209,7 +211,7 @@ VOID runPeer(Canary::PConfig pConfig, TIMER_QUEUE_HANDLE timerQueueHandle, STATU
     {
         // Since the goal of the canary is to test robustness of the SDK, there is not an immediate need
         // to send audio frames as well. It can always be added in if needed in the future
-        std::thread videoThread(sendCustomFrames, &peer, MEDIA_STREAM_TRACK_KIND_VIDEO, pConfig->bitRate.value, pConfig->frameRate.value);
+        std::thread videoThread(sendCustomFrames, &peer, MEDIA_STREAM_TRACK_KIND_VIDEO, pConfig->bitRate.value, pConfig->frameRate.value, nullptr);
         // All metrics tracking will happen on a time queue to simplify handling periodicity
         CHK_STATUS(timerQueueAddTimer(timerQueueHandle, METRICS_INVOCATION_PERIOD, METRICS_INVOCATION_PERIOD, canaryRtpOutboundStats, (UINT64) &peer,
                                       &timeoutTimerId));
@@ -231,6 +233,182 @@ CleanUp:
     *pRetStatus = retStatus;
 }
 
+// One master against viewerCount in-process viewers. Viewers join evenly spread over the ramp up and, when the run has a
+// duration, leave evenly spread over the ramp down at its end. All peers share the timer queue and one credential provider
+VOID runLoad(Canary::PConfig pConfig, TIMER_QUEUE_HANDLE timerQueueHandle, STATUS* pRetStatus)
+{
+    STATUS retStatus = STATUS_SUCCESS, viewerStatus;
+    UINT32 timerId, viewerCount = 0, joined = 0, left = 0, failed = 0;
+    UINT64 startTime, rampDownStartTime = MAX_UINT64, now, cpuTime = 0;
+    PAwsCredentialProvider pCredentialProvider = NULL;
+    std::unique_ptr<Canary::Peer> pMaster;
+    std::vector<std::unique_ptr<Canary::Peer>> viewers;
+    std::thread videoThread;
+    std::stringstream ss;
+    Canary::Config masterConfig, viewerConfig;
+    Canary::Peer::Callbacks masterCallbacks, viewerCallbacks;
+
+    CHK(pConfig != NULL, STATUS_NULL_ARG);
+    pConfig->print();
+
+    viewerCount = (UINT32) pConfig->viewerCount.value;
+    masterConfig = *pConfig;
+    masterConfig.isMaster.value = TRUE;
+    ss << pConfig->clientId.value << "Master";
+    masterConfig.clientId.value = ss.str();
+    viewerConfig = *pConfig;
+    viewerConfig.isMaster.value = FALSE;
+
+    masterCallbacks.onNewConnection = onNewConnection;
+    masterCallbacks.onDisconnected = []() { terminated = TRUE; };
+    // A viewer dropping is a data point, not a reason to stop the run
+    viewerCallbacks.onNewConnection = onNewConnection;
+    viewerCallbacks.onDisconnected = nullptr;
+
+    CHK_STATUS(Canary::Peer::createCredentialProvider(pConfig, &pCredentialProvider));
+
+    pMaster.reset(new Canary::Peer());
+    pMaster->setMaxSessions(viewerCount);
+    CHK_STATUS(timerQueueAddTimer(timerQueueHandle, KVS_METRICS_INVOCATION_PERIOD, KVS_METRICS_INVOCATION_PERIOD, canaryKvsStats,
+                                  (UINT64) pMaster.get(), &timerId));
+    CHK_STATUS(pMaster->init(&masterConfig, masterCallbacks, pCredentialProvider));
+    CHK_STATUS(pMaster->connect());
+    videoThread = std::thread(sendCustomFrames, pMaster.get(), MEDIA_STREAM_TRACK_KIND_VIDEO, pConfig->bitRate.value, pConfig->frameRate.value,
+                              &cpuTime);
+
+    startTime = GETTIME();
+    if (pConfig->duration.value != 0 && pConfig->rampDownDuration.value != 0) {
+        rampDownStartTime = startTime + pConfig->duration.value - pConfig->rampDownDuration.value;
+    }
+
+    while (!terminated.load()) {
+        now = GETTIME();
+
+        // Joining is synchronous, so a slow signaling connect delays the viewers behind it rather than bunching them up
+        while (joined < viewerCount && now - startTime >= pConfig->rampUpDuration.value * joined / viewerCount && !terminated.load()) {
+            ss.str("");
+            ss << pConfig->clientId.value << "Viewer" << joined;
+            viewerConfig.clientId.value = ss.str();
+
+            viewers.emplace_back(new Canary::Peer());
+            viewerStatus = viewers.back()->init(&viewerConfig, viewerCallbacks, pCredentialProvider);
+            if (STATUS_SUCCEEDED(viewerStatus)) {
+                viewerStatus = viewers.back()->connect();
+            }
+            if (STATUS_FAILED(viewerStatus)) {
+                DLOGW("Viewer %u failed to join with 0x%08x", joined, viewerStatus);
+                failed++;
+            }
+
+            joined++;
+            now = GETTIME();
+        }
+
+        while (left < joined && now >= rampDownStartTime && now - rampDownStartTime >= pConfig->rampDownDuration.value * left / viewerCount) {
+            // Keep the channel, the master and the remaining viewers are still on it
+            CHK_LOG_ERR(viewers[left]->shutdown(FALSE));
+            left++;
+        }
+
+        THREAD_SLEEP(CANARY_LOAD_POLL_INTERVAL);
+    }
+
+    videoThread.join();
+    reportLoad(pMaster.get(), viewers, failed, cpuTime);
+
+    for (; left < joined; left++) {
+        CHK_LOG_ERR(viewers[left]->shutdown(FALSE));
+    }
+    CHK_STATUS(pMaster->shutdown());
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus)) {
+        terminated = TRUE;
+    }
+    if (videoThread.joinable()) {
+        videoThread.join();
+    }
+
+    // The peers hold on to the shared credential provider, so it goes last
+    viewers.clear();
+    pMaster.reset();
+    if (pCredentialProvider != NULL) {
+        CHK_LOG_ERR(Canary::Peer::freeCredentialProvider(pConfig, &pCredentialProvider));
+    }
+
+    *pRetStatus = retStatus;
+}
+
+VOID reportLoad(Canary::PPeer pMaster, std::vector<std::unique_ptr<Canary::Peer>>& viewers, UINT32 failed, UINT64 cpuTime)
+{
+    std::vector<UINT64> connectTimes, timesToAnswer, timesToFirstFrame;
+    UINT32 percentiles[] = {50, 90, 99}, i;
+    UINT64 now = GETTIME(), sample, viewerTime = 0;
+    DOUBLE bitrate, minBitrate = 0, maxBitrate = 0, totalBitrate = 0, cpuPerViewer = 0;
+
+    // Sorts the samples, then logs and pushes their nearest rank percentiles
+    auto reportPercentiles = [&percentiles](std::vector<UINT64>& samples, PCHAR pName,
+                                            VOID (Canary::CloudwatchMonitoring::*pushFn)(UINT32, UINT64)) -> VOID {
+        UINT64 value;
+
+        if (samples.empty()) {
+            return;
+        }
+
+        std::sort(samples.begin(), samples.end());
+        for (auto percentile : percentiles) {
+            value = samples[(percentile * samples.size() + 99) / 100 - 1];
+            DLOGI("Viewer %s p%u: %" PRIu64 " ms", pName, percentile, value);
+            (Canary::Cloudwatch::getInstance().monitoring.*pushFn)(percentile, value);
+        }
+        DLOGI("Viewer %s max: %" PRIu64 " ms", pName, samples.back());
+    };
+
+    for (auto& pViewer : viewers) {
+        if ((sample = pViewer->getConnectTime()) != 0) {
+            connectTimes.push_back(sample / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+        }
+        if ((sample = pViewer->getTimeToAnswer()) != 0) {
+            timesToAnswer.push_back(sample / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+        }
+        if ((sample = pViewer->getTimeToFirstFrame()) != 0) {
+            timesToFirstFrame.push_back(sample / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+        }
+    }
+
+    DLOGI("Load: %u viewers joined, %u connected, %u failed to join", (UINT32) viewers.size(), (UINT32) connectTimes.size(), failed);
+    Canary::Cloudwatch::getInstance().monitoring.pushViewerCount(connectTimes.size(), viewers.size() - connectTimes.size());
+    reportPercentiles(timesToAnswer, (PCHAR) "time to answer", &Canary::CloudwatchMonitoring::pushViewerTimeToAnswerPercentile);
+    reportPercentiles(connectTimes, (PCHAR) "connect time", &Canary::CloudwatchMonitoring::pushViewerConnectTimePercentile);
+    reportPercentiles(timesToFirstFrame, (PCHAR) "time to first frame", &Canary::CloudwatchMonitoring::pushViewerTimeToFirstFramePercentile);
+
+    auto sessions = pMaster->getSessions(), endedSessions = pMaster->getEndedSessions();
+    sessions.insert(sessions.end(), endedSessions.begin(), endedSessions.end());
+    for (i = 0; i < sessions.size(); i++) {
+        bitrate = sessions[i]->getOutgoingBitrate(now) / 1000;
+        viewerTime += sessions[i]->getConnectedDuration(now);
+        DLOGI("Session %u outbound bitrate %.1lf kbps over %" PRIu64 " s", i, bitrate,
+              sessions[i]->getConnectedDuration(now) / HUNDREDS_OF_NANOS_IN_A_SECOND);
+        Canary::Cloudwatch::getInstance().monitoring.pushPeerOutgoingBitrate(bitrate);
+
+        minBitrate = i == 0 ? bitrate : MIN(minBitrate, bitrate);
+        maxBitrate = MAX(maxBitrate, bitrate);
+        totalBitrate += bitrate;
+    }
+    if (!sessions.empty()) {
+        DLOGI("Session outbound bitrate min %.1lf kbps, avg %.1lf kbps, max %.1lf kbps", minBitrate, totalBitrate / sessions.size(), maxBitrate);
+    }
+
+    // The whole process is shared with the viewers, so the master's cost is taken from its send thread, which is where
+    // packetization and SRTP happen for every session
+    if (viewerTime != 0) {
+        cpuPerViewer = (DOUBLE) cpuTime / viewerTime * 100;
+        DLOGI("Master send thread CPU per connected viewer: %.3lf %%", cpuPerViewer);
+        Canary::Cloudwatch::getInstance().monitoring.pushMasterCpuPerViewer(cpuPerViewer);
+    }
+}
+
 STATUS onNewConnection(Canary::PPeer pPeer)
 {
     STATUS retStatus = STATUS_SUCCESS;
@@ -261,62 +439,44 @@ CleanUp:
     return retStatus;
 }
 
-VOID sendCustomFrames(Canary::PPeer pPeer, MEDIA_STREAM_TRACK_KIND kind, UINT64 dataRate, UINT64 frameRate)
+// pCpuTime, when given, receives the CPU time this thread used in 100ns units
+VOID sendCustomFrames(Canary::PPeer pPeer, MEDIA_STREAM_TRACK_KIND kind, UINT64 dataRate, UINT64 frameRate, PUINT64 pCpuTime)
 {
     STATUS retStatus = STATUS_SUCCESS;
     Frame frame;
-    UINT32 hexStrLen = 0;
-    UINT32 actualFrameSize = 0;
-    UINT32 frameSizeWithoutNalu = 0;
-    UINT32 minFrameSize = CANARY_METADATA_SIZE + ((dataRate / 8) / frameRate);
-    UINT32 maxFrameSize = (CANARY_METADATA_SIZE + ((dataRate / 8) / frameRate)) * 2;
-    PBYTE canaryFrameData = NULL;
-    
-    canaryFrameData = (PBYTE) MEMALLOC(maxFrameSize);
-
-    // We allocate a bigger buffer to accomodate the hex encoded string
-    frame.frameData = (PBYTE) MEMALLOC(maxFrameSize * 3 + 1 + ANNEX_B_NALU_SIZE);
+    Canary::FramePool framePool;
+    Canary::PFramePoolEntry pEntry;
+    Canary::FramePacer framePacer;
+    UINT32 minBodySize = (UINT32) ((dataRate / 8) / frameRate);
+    UINT32 maxBodySize = minBodySize * 2, sequenceNumber = 0;
+    struct timespec threadCpuTime;
+
+    // The body must not contain an ANNEX-B start code or the packetizer would split the frame on it. The header is written
+    // per frame, so reserve room for it in every pool entry
+    CHK_STATUS(framePool.init(ANNEX_B_NALU_SIZE + CANARY_PAYLOAD_NAL_HEADER_SIZE + CANARY_PAYLOAD_HEADER_SIZE, minBodySize, maxBodySize, CANARY_FRAME_POOL_SIZE, TRUE));
+
+    MEMSET(&frame, 0x00, SIZEOF(Frame));
     frame.version = FRAME_CURRENT_VERSION;
     frame.presentationTs = GETTIME();
+    CHK_STATUS(framePacer.init(HUNDREDS_OF_NANOS_IN_A_SECOND / frameRate));
 
     while (!terminated.load()) {
+        pEntry = framePool.next();
+        CHK_STATUS(createCanaryFrameData(pEntry, sequenceNumber++, &frame));
 
-        // This is the actual frame size that includes the metadata and the actual frame data
-        // It generates a number between 1082 and 2164 but the actual frame.size may be larger 
-        // because hexStrLen will vary
-        actualFrameSize = (RAND() % (maxFrameSize - minFrameSize + 1)) + minFrameSize;
-        frameSizeWithoutNalu = actualFrameSize - ANNEX_B_NALU_SIZE;
-
-        frame.size = actualFrameSize;
-        createCanaryFrameData(canaryFrameData, &frame);
-
-        // Hex encode the data (without the ANNEX-B NALu) to ensure parts of random frame data is not skipped if they
-        // are the same as the ANNEX-B NALu
-        CHK_STATUS(hexEncode(frame.frameData + ANNEX_B_NALU_SIZE, frameSizeWithoutNalu, NULL, &hexStrLen));
-
-        // This re-alloc is done in case the estimated size does not match the actual requirement.
-        // We do not want to constantly malloc within a loop. Hence, we re-allocate only if required
-        // Either ways, the realloc should not happen
-        if (hexStrLen != (frameSizeWithoutNalu * 2 + 1)) {
-            DLOGW("Re allocating...this should not happen...something might be wrong");
-            frame.frameData = (PBYTE) REALLOC(frame.frameData, hexStrLen + ANNEX_B_NALU_SIZE);
-            CHK_ERR(frame.frameData != NULL, STATUS_NOT_ENOUGH_MEMORY, "Failed to realloc media buffer");
-        }
-        CHK_STATUS(hexEncode(canaryFrameData + ANNEX_B_NALU_SIZE, frameSizeWithoutNalu, (PCHAR)(frame.frameData + ANNEX_B_NALU_SIZE), &hexStrLen));
-        MEMCPY(frame.frameData, canaryFrameData, ANNEX_B_NALU_SIZE);
-
-        // We must update the size to reflect the original data with hex encoded data
-        frame.size = hexStrLen + ANNEX_B_NALU_SIZE;
         pPeer->writeFrame(&frame, kind);
-        THREAD_SLEEP(HUNDREDS_OF_NANOS_IN_A_SECOND / frameRate);
+        framePacer.wait();
         frame.presentationTs = GETTIME();
     }
 CleanUp:
 
-    SAFE_MEMFREE(frame.frameData);
-    SAFE_MEMFREE(canaryFrameData);
+    if (pCpuTime != NULL && clock_gettime(CLOCK_THREAD_CPUTIME_ID, &threadCpuTime) == 0) {
+        *pCpuTime = (UINT64) threadCpuTime.tv_sec * HUNDREDS_OF_NANOS_IN_A_SECOND + (UINT64) threadCpuTime.tv_nsec / DEFAULT_TIME_UNIT_IN_NANOS;
+    }
 
     auto threadKind = kind == MEDIA_STREAM_TRACK_KIND_VIDEO ? "video" : "audio";
+    framePacer.logStats((PCHAR) threadKind);
+    Canary::Cloudwatch::getInstance().monitoring.pushFramePacerStats(&framePacer);
     if (STATUS_FAILED(retStatus)) {
         DLOGE("%s thread exited with 0x%08x", threadKind, retStatus);
     } else {
@@ -384,53 +544,38 @@ STATUS canaryKvsStats(UINT32 timerId, UINT64 currentTime, UINT64 customData)
     return retStatus;
 }
 
-VOID sendLocalFrames(Canary::PPeer pPeer, MEDIA_STREAM_TRACK_KIND kind, const std::string& pattern, UINT64 frameCount, UINT32 frameDuration)
+VOID sendLocalFrames(Canary::PPeer pPeer, MEDIA_STREAM_TRACK_KIND kind, Canary::PFrameArchive pFrameArchive)
 {
     STATUS retStatus = STATUS_SUCCESS;
     Frame frame;
-    UINT64 fileIndex = 0, frameSize;
-    CHAR filePath[MAX_PATH_LEN + 1];
-    UINT64 startTime, lastFrameTime, elapsed;
+    Canary::FramePacer framePacer;
+    UINT32 frameIndex = 0, frameCount;
 
     frame.frameData = NULL;
     frame.size = 0;
     frame.presentationTs = 0;
-    startTime = GETTIME();
-    lastFrameTime = startTime;
+    frameCount = pFrameArchive->getFrameCount();
+    CHK(frameCount > 0, STATUS_INVALID_OPERATION);
+    // The archive is packed with a fixed frame duration
+    CHK_STATUS(pFrameArchive->getFrame(0, &frame));
+    CHK_STATUS(framePacer.init(frame.duration));
 
     while (!terminated.load()) {
-        fileIndex = fileIndex % frameCount + 1;
-        SNPRINTF(filePath, MAX_PATH_LEN, pattern.c_str(), fileIndex);
+        // Frames are served straight out of the mapped archive, so there is no file I/O or copy on this path
+        CHK_STATUS(pFrameArchive->getFrame(frameIndex, &frame));
+        frameIndex = (frameIndex + 1) % frameCount;
 
-        CHK_STATUS(readFile(filePath, TRUE, NULL, &frameSize));
-
-        // Re-alloc if needed
-        if (frameSize > frame.size) {
-            frame.frameData = (PBYTE) REALLOC(frame.frameData, frameSize);
-            CHK_ERR(frame.frameData != NULL, STATUS_NOT_ENOUGH_MEMORY, "Failed to realloc media buffer");
-        }
-        frame.size = (UINT32) frameSize;
-
-        CHK_STATUS(readFile(filePath, TRUE, frame.frameData, &frameSize));
-
-        frame.presentationTs += frameDuration;
+        frame.presentationTs += frame.duration;
 
         pPeer->writeFrame(&frame, kind);
 
-        // Adjust sleep in the case the sleep itself and writeFrame take longer than expected. Since sleep makes sure that the thread
-        // will be paused at least until the given amount, we can assume that there's no too early frame scenario.
-        // Also, it's very unlikely to have a delay greater than SAMPLE_VIDEO_FRAME_DURATION, so the logic assumes that this is always
-        // true for simplicity.
-        elapsed = lastFrameTime - startTime;
-        THREAD_SLEEP(frameDuration - elapsed % frameDuration);
-        lastFrameTime = GETTIME();
+        framePacer.wait();
     }
 
 CleanUp:
 
-    SAFE_MEMFREE(frame.frameData);
-
     auto threadKind = kind == MEDIA_STREAM_TRACK_KIND_VIDEO ? "video" : "audio";
+    framePacer.logStats((PCHAR) threadKind);
     if (STATUS_FAILED(retStatus)) {
         DLOGE("%s thread exited with 0x%08x", threadKind, retStatus);
     } else {
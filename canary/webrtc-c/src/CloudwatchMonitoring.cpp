@@ -50,20 +50,8 @@ static const CHAR* unitToString(const Aws::CloudWatch::Model::StandardUnit& unit
     }
 }
 
-VOID CloudwatchMonitoring::push(const MetricDatum& datum)
+VOID CloudwatchMonitoring::putMetricData(const Aws::CloudWatch::Model::PutMetricDataRequest& cwRequest)
 {
-    Aws::CloudWatch::Model::PutMetricDataRequest cwRequest;
-    MetricDatum single = datum;
-    MetricDatum aggregated = datum;
-
-    single.AddDimensions(this->channelDimension);
-    single.AddDimensions(this->labelDimension);
-    aggregated.AddDimensions(this->labelDimension);
-
-    cwRequest.SetNamespace(DEFAULT_CLOUDWATCH_NAMESPACE);
-    cwRequest.AddMetricData(single);
-    cwRequest.AddMetricData(aggregated);
-
     auto asyncHandler = [this](const Aws::CloudWatch::CloudWatchClient* cwClient, const Aws::CloudWatch::Model::PutMetricDataRequest& request,
                                const Aws::CloudWatch::Model::PutMetricDataOutcome& outcome,
                                const std::shared_ptr<const Aws::Client::AsyncCallerContext>& context) {
@@ -80,6 +68,22 @@ VOID CloudwatchMonitoring::push(const MetricDatum& datum)
     };
     this->pendingMetrics++;
     this->client.PutMetricDataAsync(cwRequest, asyncHandler);
+}
+
+VOID CloudwatchMonitoring::push(const MetricDatum& datum)
+{
+    Aws::CloudWatch::Model::PutMetricDataRequest cwRequest;
+    MetricDatum single = datum;
+    MetricDatum aggregated = datum;
+
+    single.AddDimensions(this->channelDimension);
+    single.AddDimensions(this->labelDimension);
+    aggregated.AddDimensions(this->labelDimension);
+
+    cwRequest.SetNamespace(DEFAULT_CLOUDWATCH_NAMESPACE);
+    cwRequest.AddMetricData(single);
+    cwRequest.AddMetricData(aggregated);
+    this->putMetricData(cwRequest);
 
     std::stringstream ss;
 
@@ -118,6 +122,40 @@ VOID CloudwatchMonitoring::push(const MetricDatum& datum)
     DLOGD("%s", ss.str().c_str());
 }
 
+// Same dimensions as push(), but packs the datums into as few requests as PutMetricData allows and logs one line
+VOID CloudwatchMonitoring::pushBatch(const Aws::Vector<MetricDatum>& data)
+{
+    Aws::CloudWatch::Model::PutMetricDataRequest cwRequest;
+    UINT32 requestCount = 0;
+
+    for (auto& datum : data) {
+        MetricDatum single = datum;
+        MetricDatum aggregated = datum;
+
+        single.AddDimensions(this->channelDimension);
+        single.AddDimensions(this->labelDimension);
+        aggregated.AddDimensions(this->labelDimension);
+
+        if (cwRequest.GetMetricData().size() + 2 > MAX_CLOUDWATCH_DATUMS_PER_REQUEST) {
+            this->putMetricData(cwRequest);
+            requestCount++;
+            cwRequest = Aws::CloudWatch::Model::PutMetricDataRequest();
+        }
+        if (cwRequest.GetMetricData().empty()) {
+            cwRequest.SetNamespace(DEFAULT_CLOUDWATCH_NAMESPACE);
+        }
+        cwRequest.AddMetricData(single);
+        cwRequest.AddMetricData(aggregated);
+    }
+
+    if (!cwRequest.GetMetricData().empty()) {
+        this->putMetricData(cwRequest);
+        requestCount++;
+    }
+
+    DLOGD("Emitted %u metrics in %u requests", (UINT32) data.size(), requestCount);
+}
+
 VOID CloudwatchMonitoring::pushExitStatus(STATUS retStatus)
 {
     MetricDatum datum;
@@ -422,7 +460,7 @@ VOID CloudwatchMonitoring::pushInboundRtpStats(Canary::PIncomingRTPMetricsContex
 
 VOID CloudwatchMonitoring::pushEndToEndMetrics(Canary::EndToEndMetricsContext ctx)
 {
-    MetricDatum endToEndLatencyDatum, sizeMatchDatum;
+    MetricDatum endToEndLatencyDatum, sizeMatchDatum, dataMatchDatum, receivedDatum, lostDatum, reorderedDatum, duplicatedDatum, malformedDatum;
     DOUBLE latency = ctx.frameLatencyAvg / (DOUBLE) HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
 
     // TODO: due to https://github.com/aws-samples/amazon-kinesis-video-streams-demos/issues/96,
@@ -442,6 +480,36 @@ VOID CloudwatchMonitoring::pushEndToEndMetrics(Canary::EndToEndMetricsContext ct
     sizeMatchDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Count);
     sizeMatchDatum.SetValue(ctx.sizeMatchAvg);
     this->push(sizeMatchDatum);
+
+    dataMatchDatum.SetMetricName("FrameDataMatch");
+    dataMatchDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Count);
+    dataMatchDatum.SetValue(ctx.dataMatchAvg);
+    this->push(dataMatchDatum);
+
+    receivedDatum.SetMetricName("FramesReceived");
+    receivedDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Count);
+    receivedDatum.SetValue(ctx.framesReceived);
+    this->push(receivedDatum);
+
+    lostDatum.SetMetricName("FramesLost");
+    lostDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Count);
+    lostDatum.SetValue(ctx.framesLost);
+    this->push(lostDatum);
+
+    reorderedDatum.SetMetricName("FramesReordered");
+    reorderedDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Count);
+    reorderedDatum.SetValue(ctx.framesReordered);
+    this->push(reorderedDatum);
+
+    duplicatedDatum.SetMetricName("FramesDuplicated");
+    duplicatedDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Count);
+    duplicatedDatum.SetValue(ctx.framesDuplicated);
+    this->push(duplicatedDatum);
+
+    malformedDatum.SetMetricName("FramesMalformed");
+    malformedDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Count);
+    malformedDatum.SetValue(ctx.framesMalformed);
+    this->push(malformedDatum);
 }
 
 VOID CloudwatchMonitoring::pushRetryCount(UINT32 retryCount)
@@ -454,6 +522,129 @@ VOID CloudwatchMonitoring::pushRetryCount(UINT32 retryCount)
     this->push(currentRetryCountDatum);
 }
 
+VOID CloudwatchMonitoring::pushFramePacerStats(Canary::PFramePacer pFramePacer)
+{
+    MetricDatum p50Datum, p99Datum, maxDatum, skippedDatum;
+
+    p50Datum.SetMetricName("FrameLatenessP50");
+    p50Datum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Microseconds);
+    p50Datum.SetValue(pFramePacer->getLatenessPercentile(50));
+    this->push(p50Datum);
+
+    p99Datum.SetMetricName("FrameLatenessP99");
+    p99Datum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Microseconds);
+    p99Datum.SetValue(pFramePacer->getLatenessPercentile(99));
+    this->push(p99Datum);
+
+    maxDatum.SetMetricName("FrameLatenessMax");
+    maxDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Microseconds);
+    maxDatum.SetValue(pFramePacer->getMaxLateness());
+    this->push(maxDatum);
+
+    skippedDatum.SetMetricName("FrameDeadlinesSkipped");
+    skippedDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Count);
+    skippedDatum.SetValue(pFramePacer->getSkippedDeadlines());
+    this->push(skippedDatum);
+}
+
+// Average and max time in microseconds the storage master's video loop held the session list lock per frame
+VOID CloudwatchMonitoring::pushSessionLockHoldTime(UINT64 average, UINT64 max)
+{
+    MetricDatum averageDatum, maxDatum;
+
+    averageDatum.SetMetricName("SessionLockHoldTimeAvg");
+    averageDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Microseconds);
+    averageDatum.SetValue(average);
+    this->push(averageDatum);
+
+    maxDatum.SetMetricName("SessionLockHoldTimeMax");
+    maxDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Microseconds);
+    maxDatum.SetValue(max);
+    this->push(maxDatum);
+}
+
+VOID CloudwatchMonitoring::pushVideoRenditionSwitch(UINT64 bitrate, UINT64 switchDelay)
+{
+    MetricDatum bitrateDatum, switchDelayDatum;
+
+    bitrateDatum.SetMetricName("VideoRenditionBitrate");
+    bitrateDatum.SetValue(bitrate);
+    bitrateDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Kilobits_Second);
+    this->push(bitrateDatum);
+
+    // Time from the bandwidth estimate asking for the rendition to the key frame it started on
+    switchDelayDatum.SetMetricName("VideoRenditionSwitchDelay");
+    switchDelayDatum.SetValue(switchDelay);
+    switchDelayDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Milliseconds);
+    this->push(switchDelayDatum);
+}
+
+VOID CloudwatchMonitoring::pushMillisecondsPercentile(const std::string& prefix, UINT32 percentile, UINT64 value)
+{
+    MetricDatum datum;
+    std::stringstream ss;
+
+    ss << prefix << "P" << percentile;
+    datum.SetMetricName(ss.str());
+    datum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Milliseconds);
+    datum.SetValue(value);
+
+    this->push(datum);
+}
+
+VOID CloudwatchMonitoring::pushViewerConnectTimePercentile(UINT32 percentile, UINT64 connectTime)
+{
+    this->pushMillisecondsPercentile("ViewerConnectTime", percentile, connectTime);
+}
+
+VOID CloudwatchMonitoring::pushViewerTimeToAnswerPercentile(UINT32 percentile, UINT64 timeToAnswer)
+{
+    this->pushMillisecondsPercentile("ViewerTimeToAnswer", percentile, timeToAnswer);
+}
+
+VOID CloudwatchMonitoring::pushViewerTimeToFirstFramePercentile(UINT32 percentile, UINT64 timeToFirstFrame)
+{
+    this->pushMillisecondsPercentile("ViewerTimeToFirstFrame", percentile, timeToFirstFrame);
+}
+
+VOID CloudwatchMonitoring::pushViewerCount(UINT64 connected, UINT64 failed)
+{
+    MetricDatum connectedDatum, failedDatum;
+
+    connectedDatum.SetMetricName("ViewersConnected");
+    connectedDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Count);
+    connectedDatum.SetValue(connected);
+    this->push(connectedDatum);
+
+    failedDatum.SetMetricName("ViewersFailed");
+    failedDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Count);
+    failedDatum.SetValue(failed);
+    this->push(failedDatum);
+}
+
+// One datum per peer so that CloudWatch statistics give the spread across peers
+VOID CloudwatchMonitoring::pushPeerOutgoingBitrate(DOUBLE bitrate)
+{
+    MetricDatum datum;
+
+    datum.SetMetricName("PeerOutgoingBitrate");
+    datum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Kilobits_Second);
+    datum.SetValue(bitrate);
+
+    this->push(datum);
+}
+
+VOID CloudwatchMonitoring::pushMasterCpuPerViewer(DOUBLE cpuPercent)
+{
+    MetricDatum datum;
+
+    datum.SetMetricName("MasterCpuPerViewer");
+    datum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Percent);
+    datum.SetValue(cpuPercent);
+
+    this->push(datum);
+}
+
 VOID CloudwatchMonitoring::pushJoinStorageSessionAvailability(DOUBLE availability)
 {
     MetricDatum datum;
@@ -8,6 +8,7 @@ class CloudwatchMonitoring {
     STATUS init();
     VOID deinit();
     VOID push(const MetricDatum&);
+    VOID pushBatch(const Aws::Vector<MetricDatum>&);
     VOID pushExitStatus(STATUS);
     VOID pushSignalingRoundtripStatus(STATUS);
     VOID pushSignalingInitDelay(UINT64, Aws::CloudWatch::Model::StandardUnit);
@@ -22,6 +23,17 @@ class CloudwatchMonitoring {
     VOID pushKvsIceAgentMetrics(PKvsIceAgentMetrics);
     VOID pushSignalingClientMetrics(PSignalingClientMetrics);
     VOID pushRetryCount(UINT32);
+    VOID pushFramePacerStats(Canary::PFramePacer);
+    VOID pushSessionLockHoldTime(UINT64, UINT64);
+    VOID pushVideoRenditionSwitch(UINT64, UINT64);
+
+    // Load mode
+    VOID pushViewerConnectTimePercentile(UINT32, UINT64);
+    VOID pushViewerTimeToAnswerPercentile(UINT32, UINT64);
+    VOID pushViewerTimeToFirstFramePercentile(UINT32, UINT64);
+    VOID pushViewerCount(UINT64, UINT64);
+    VOID pushPeerOutgoingBitrate(DOUBLE);
+    VOID pushMasterCpuPerViewer(DOUBLE);
 
     VOID pushStorageDisconnectToFrameSentTime(UINT64, Aws::CloudWatch::Model::StandardUnit);
     VOID pushJoinSessionTime(UINT64, Aws::CloudWatch::Model::StandardUnit);
@@ -51,6 +63,9 @@ class CloudwatchMonitoring {
     VOID pushTotalFramesDiscardedPercentage(DOUBLE);
 
   private:
+    VOID putMetricData(const Aws::CloudWatch::Model::PutMetricDataRequest&);
+    VOID pushMillisecondsPercentile(const std::string&, UINT32, UINT64);
+
     Dimension channelDimension;
     Dimension labelDimension;
     PConfig pConfig;
@@ -23,6 +23,18 @@ STATUS Config::init(INT32 argc, PCHAR argv[])
         duration.value = CANARY_MIN_DURATION;
     }
 
+    if (viewerCount.value > CANARY_MAX_VIEWER_COUNT) {
+        DLOGW("Canary viewer count can be at most %u. Overriding with the max viewer count.", CANARY_MAX_VIEWER_COUNT);
+        viewerCount.value = CANARY_MAX_VIEWER_COUNT;
+    }
+
+    // Ramps have to fit in the run, otherwise viewers would still be joining when they should be leaving
+    if (duration.value != 0 && rampUpDuration.value + rampDownDuration.value > duration.value) {
+        DLOGW("Canary ramp up and ramp down don't fit in the canary duration. Overriding with no ramps.");
+        rampUpDuration.value = 0;
+        rampDownDuration.value = 0;
+    }
+
     // Need to impose a min iteration duration
     if (iterationDuration.value < CANARY_MIN_ITERATION_DURATION) {
         DLOGW("Canary iterations duration should be at least %u seconds. Overriding with minimal iterations duration.",
@@ -169,6 +181,7 @@ STATUS Config::initWithEnvVars()
     CHK_STATUS(optenvBool(CANARY_FORCE_TURN_ENV_VAR, &forceTurn, FALSE));
     CHK_STATUS(optenvBool(CANARY_USE_IOT_CREDENTIALS_ENV_VAR, &useIotCredentialProvider, FALSE));
     CHK_STATUS(optenvBool(CANARY_RUN_IN_PROFILING_MODE_ENV_VAR, &isProfilingMode, FALSE));
+    CHK_STATUS(optenvBool(CANARY_PREFAULT_FRAME_ARCHIVE_ENV_VAR, &prefaultFrameArchive, FALSE));
     
     CHK_STATUS(optenv(CANARY_VIDEO_CODEC_ENV_VAR, &videoCodec, CANARY_VIDEO_CODEC_H264));
     CHK_STATUS(optenv(CACERT_PATH_ENV_VAR, &caCertPath, KVS_CA_CERT_PATH));
@@ -225,8 +238,19 @@ STATUS Config::initWithEnvVars()
     CHK_STATUS(optenvUint64(CANARY_BIT_RATE_ENV_VAR, &bitRate, CANARY_DEFAULT_BITRATE));
     CHK_STATUS(optenvUint64(CANARY_FRAME_RATE_ENV_VAR, &frameRate, CANARY_DEFAULT_FRAMERATE));
 
+    CHK_STATUS(optenvUint64(CANARY_VIEWER_COUNT_ENV_VAR, &viewerCount, 0));
+    if (!rampUpDuration.initialized) {
+        CHK_STATUS(optenvUint64(CANARY_RAMP_UP_IN_SECONDS_ENV_VAR, &rampUpDuration, 0));
+        rampUpDuration.value *= HUNDREDS_OF_NANOS_IN_A_SECOND;
+    }
+    if (!rampDownDuration.initialized) {
+        CHK_STATUS(optenvUint64(CANARY_RAMP_DOWN_IN_SECONDS_ENV_VAR, &rampDownDuration, 0));
+        rampDownDuration.value *= HUNDREDS_OF_NANOS_IN_A_SECOND;
+    }
+
     if (this->isStorage) {
         CHK_STATUS(optenv(STORAGE_CANARY_FIRST_FRAME_TS_FILE_ENV_VAR, &storageFristFrameSentTSFileName, STORAGE_CANARY_DEFAULT_FIRST_FRAME_TS_FILE));
+        CHK_STATUS(optenv(STORAGE_CANARY_VIDEO_RENDITIONS_ENV_VAR, &storageVideoRenditions, ""));
     }
 
 CleanUp:
@@ -254,12 +278,18 @@ VOID Config::print()
           "\tRun both peers  : %s\n"
           "\tCredential type : %s\n"
           "\tStorage         : %s\n"
+          "\tPrefault frames : %s\n"
+          "\tViewer count    : %lu\n"
+          "\tRamp up         : %lu seconds\n"
+          "\tRamp down       : %lu seconds\n"
           "\n",
           this->endpoint.value.c_str(), this->region.value.c_str(), this->label.value.c_str(), this->channelName.value.c_str(),
           this->clientId.value.c_str(), this->isMaster.value ? "Master" : "Viewer", this->trickleIce.value ? "True" : "False",
           this->useTurn.value ? "True" : "False", this->logLevel.value, this->logGroupName.value.c_str(), this->logStreamName.value.c_str(),
           this->duration.value / HUNDREDS_OF_NANOS_IN_A_SECOND, this->videoCodec.value.c_str(), this->iterationDuration.value / HUNDREDS_OF_NANOS_IN_A_SECOND,
-          this->runBothPeers.value ? "True" : "False", this->useIotCredentialProvider.value ? "IoT" : "Static", this->isStorage ? "True" : "False");
+          this->runBothPeers.value ? "True" : "False", this->useIotCredentialProvider.value ? "IoT" : "Static", this->isStorage ? "True" : "False",
+          this->prefaultFrameArchive.value ? "True" : "False", this->viewerCount.value, this->rampUpDuration.value / HUNDREDS_OF_NANOS_IN_A_SECOND,
+          this->rampDownDuration.value / HUNDREDS_OF_NANOS_IN_A_SECOND);
     if(this->useIotCredentialProvider.value) {
         DLOGD("\tIoT endpoint : %s\n"
               "\tIoT cert filename : %s\n"
@@ -271,8 +301,10 @@ VOID Config::print()
               this->iotCoreRoleAlias.value.c_str());
     }
     if(this->isStorage) {
-        DLOGD("\n\n\tFirstFrameSentTSFileName : %s\n",
-               this->storageFristFrameSentTSFileName.value.c_str()
+        DLOGD("\n\n\tFirstFrameSentTSFileName : %s\n"
+              "\tVideoRenditions : %s\n",
+               this->storageFristFrameSentTSFileName.value.c_str(),
+               this->storageVideoRenditions.value.empty() ? "N/A" : this->storageVideoRenditions.value.c_str()
         );
     }
 }
@@ -356,6 +388,18 @@ STATUS Config::initWithJSON(PCHAR filePath)
             jsonUint64(raw, tokens[++i], &frameRate);
         } else if (compareJsonString((PCHAR) raw, &tokens[i], JSMN_STRING, (PCHAR) CANARY_RUN_BOTH_PEERS_ENV_VAR)) {
             jsonBool(raw, tokens[++i], &runBothPeers);
+        } else if (compareJsonString((PCHAR) raw, &tokens[i], JSMN_STRING, (PCHAR) CANARY_PREFAULT_FRAME_ARCHIVE_ENV_VAR)) {
+            jsonBool(raw, tokens[++i], &prefaultFrameArchive);
+        } else if (compareJsonString((PCHAR) raw, &tokens[i], JSMN_STRING, (PCHAR) CANARY_VIEWER_COUNT_ENV_VAR)) {
+            jsonUint64(raw, tokens[++i], &viewerCount);
+        } else if (compareJsonString((PCHAR) raw, &tokens[i], JSMN_STRING, (PCHAR) CANARY_RAMP_UP_IN_SECONDS_ENV_VAR)) {
+            jsonUint64(raw, tokens[++i], &rampUpDuration);
+            rampUpDuration.value *= HUNDREDS_OF_NANOS_IN_A_SECOND;
+        } else if (compareJsonString((PCHAR) raw, &tokens[i], JSMN_STRING, (PCHAR) CANARY_RAMP_DOWN_IN_SECONDS_ENV_VAR)) {
+            jsonUint64(raw, tokens[++i], &rampDownDuration);
+            rampDownDuration.value *= HUNDREDS_OF_NANOS_IN_A_SECOND;
+        } else if (compareJsonString((PCHAR) raw, &tokens[i], JSMN_STRING, (PCHAR) STORAGE_CANARY_VIDEO_RENDITIONS_ENV_VAR)) {
+            jsonString(raw, tokens[++i], &storageVideoRenditions);
         } else if (compareJsonString((PCHAR) raw, &tokens[i], JSMN_STRING, (PCHAR) DEFAULT_REGION_ENV_VAR)) {
             jsonString(raw, tokens[++i], &region);
         } else if (compareJsonString((PCHAR) raw, &tokens[i], JSMN_STRING, (PCHAR) DEBUG_LOG_LEVEL_ENV_VAR)) {
@@ -26,6 +26,7 @@ class Config {
     Value<BOOL> forceTurn;
     Value<BOOL> useIotCredentialProvider;
     Value<BOOL> isProfilingMode;
+    Value<BOOL> prefaultFrameArchive;
 
     BOOL isStorage;
 
@@ -49,8 +50,15 @@ class Config {
     Value<UINT64> bitRate;
     Value<UINT64> frameRate;
 
+    // load mode, viewerCount > 0 runs one master against that many in-process viewers
+    Value<UINT64> viewerCount;
+    Value<UINT64> rampUpDuration;
+    Value<UINT64> rampDownDuration;
+
     Value<std::string> caCertPath;
     Value<std::string> storageFristFrameSentTSFileName;
+    // Comma separated <kbps>:<frame directory> pairs, one per pre-encoded rendition of the sample video
+    Value<std::string> storageVideoRenditions;
 
     BYTE iotEndpoint[MAX_CONFIG_JSON_FILE_SIZE];
 
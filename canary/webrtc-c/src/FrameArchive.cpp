@@ -0,0 +1,240 @@
+#include "Include.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace Canary {
+
+static BOOL isKeyFrame(PBYTE pData, UINT32 size, RTC_CODEC codec)
+{
+    UINT32 i, zeroCount = 0;
+    BYTE naluType;
+
+    if (codec == RTC_CODEC_OPUS) {
+        return TRUE;
+    }
+
+    // Walk the Annex-B start codes and look for an IDR slice or a parameter set
+    for (i = 0; i + 1 < size; i++) {
+        if (pData[i] == 0x00) {
+            zeroCount++;
+            continue;
+        }
+
+        if (pData[i] == 0x01 && zeroCount >= 2) {
+            if (codec == RTC_CODEC_H265) {
+                naluType = (pData[i + 1] >> 1) & 0x3F;
+                // IDR_W_RADL, IDR_N_LP or VPS
+                if (naluType == 19 || naluType == 20 || naluType == 32) {
+                    return TRUE;
+                }
+            } else {
+                naluType = pData[i + 1] & 0x1F;
+                // IDR slice or SPS
+                if (naluType == 5 || naluType == 7) {
+                    return TRUE;
+                }
+            }
+        }
+
+        zeroCount = 0;
+    }
+
+    return FALSE;
+}
+
+FrameArchive::FrameArchive() : pMapping(nullptr), mappingSize(0), pIndex(nullptr), frameCount(0)
+{
+}
+
+FrameArchive::~FrameArchive()
+{
+    this->close();
+}
+
+// Packs frameCount frame files following a printf style pattern (1-based, same as the sample assets) into a single
+// archive. The archive is written to a temporary file first and renamed so readers never observe a partial archive.
+STATUS FrameArchive::create(PCHAR pattern, UINT32 frameCount, UINT64 frameDuration, RTC_CODEC codec, PCHAR outputPath)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    CHAR filePath[MAX_PATH_LEN + 1];
+    CHAR tmpPath[MAX_PATH_LEN + 1];
+    UINT32 i;
+    UINT64 frameSize, dataOffset, totalSize = 0;
+    PBYTE pArchive = NULL;
+    PFrameArchiveHeader pHeader;
+    PFrameArchiveIndexEntry pEntry;
+    std::vector<UINT64> frameSizes(frameCount);
+
+    CHK(pattern != NULL && outputPath != NULL, STATUS_NULL_ARG);
+    CHK(frameCount > 0, STATUS_INVALID_ARG);
+
+    // First pass only sizes the archive so it can be assembled in a single allocation
+    dataOffset = SIZEOF(FrameArchiveHeader) + (UINT64) frameCount * SIZEOF(FrameArchiveIndexEntry);
+    totalSize = dataOffset;
+    for (i = 0; i < frameCount; i++) {
+        SNPRINTF(filePath, MAX_PATH_LEN, pattern, i + 1);
+        CHK_STATUS(readFile(filePath, TRUE, NULL, &frameSizes[i]));
+        totalSize += frameSizes[i];
+    }
+
+    pArchive = (PBYTE) MEMCALLOC(1, totalSize);
+    CHK(pArchive != NULL, STATUS_NOT_ENOUGH_MEMORY);
+
+    pHeader = (PFrameArchiveHeader) pArchive;
+    MEMCPY(pHeader->magic, CANARY_FRAME_ARCHIVE_MAGIC, CANARY_FRAME_ARCHIVE_MAGIC_LEN);
+    pHeader->version = CANARY_FRAME_ARCHIVE_VERSION;
+    pHeader->frameCount = frameCount;
+
+    pEntry = (PFrameArchiveIndexEntry) (pHeader + 1);
+    for (i = 0; i < frameCount; i++, pEntry++) {
+        SNPRINTF(filePath, MAX_PATH_LEN, pattern, i + 1);
+        frameSize = frameSizes[i];
+        CHK_STATUS(readFile(filePath, TRUE, pArchive + dataOffset, &frameSize));
+
+        pEntry->offset = dataOffset;
+        pEntry->size = (UINT32) frameSize;
+        pEntry->duration = frameDuration;
+        pEntry->flags = isKeyFrame(pArchive + dataOffset, (UINT32) frameSize, codec) ? CANARY_FRAME_ARCHIVE_FLAG_KEY_FRAME : 0;
+        dataOffset += frameSize;
+    }
+
+    SNPRINTF(tmpPath, MAX_PATH_LEN, "%s.tmp", outputPath);
+    CHK_STATUS(writeFile(tmpPath, TRUE, FALSE, pArchive, totalSize));
+    CHK_ERR(rename(tmpPath, outputPath) == 0, STATUS_WRITE_TO_FILE_FAILED, "Failed to move %s to %s", tmpPath, outputPath);
+
+    DLOGI("Packed %u frames from %s into %s (%" PRIu64 " bytes)", frameCount, pattern, outputPath, totalSize);
+
+CleanUp:
+
+    SAFE_MEMFREE(pArchive);
+
+    return retStatus;
+}
+
+STATUS FrameArchive::open(PCHAR path, BOOL prefault)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    INT32 fd = -1;
+    struct stat st;
+    PFrameArchiveHeader pHeader;
+    UINT64 i, indexEnd;
+    volatile BYTE touch;
+    UINT64 pageSize;
+
+    CHK(path != NULL, STATUS_NULL_ARG);
+    CHK(this->pMapping == NULL, STATUS_INVALID_OPERATION);
+
+    fd = ::open(path, O_RDONLY);
+    CHK_ERR(fd >= 0, STATUS_OPEN_FILE_FAILED, "Failed to open frame archive %s", path);
+    CHK_ERR(fstat(fd, &st) == 0 && (UINT64) st.st_size >= SIZEOF(FrameArchiveHeader), STATUS_CANARY_INVALID_FRAME_ARCHIVE,
+            "Frame archive %s is truncated", path);
+
+    this->pMapping = (PBYTE) mmap(NULL, (SIZE_T) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    CHK_ERR(this->pMapping != MAP_FAILED, STATUS_OPEN_FILE_FAILED, "Failed to map frame archive %s", path);
+    this->mappingSize = (UINT64) st.st_size;
+
+    pHeader = (PFrameArchiveHeader) this->pMapping;
+    CHK_ERR(MEMCMP(pHeader->magic, CANARY_FRAME_ARCHIVE_MAGIC, CANARY_FRAME_ARCHIVE_MAGIC_LEN) == 0 && pHeader->version == CANARY_FRAME_ARCHIVE_VERSION,
+            STATUS_CANARY_INVALID_FRAME_ARCHIVE, "%s is not a version %u frame archive", path, CANARY_FRAME_ARCHIVE_VERSION);
+
+    indexEnd = SIZEOF(FrameArchiveHeader) + (UINT64) pHeader->frameCount * SIZEOF(FrameArchiveIndexEntry);
+    CHK_ERR(pHeader->frameCount > 0 && indexEnd <= this->mappingSize, STATUS_CANARY_INVALID_FRAME_ARCHIVE, "Frame archive %s has a bad index", path);
+    this->pIndex = (PFrameArchiveIndexEntry) (pHeader + 1);
+    this->frameCount = pHeader->frameCount;
+
+    // Validate once here so that getFrame doesn't have to
+    for (i = 0; i < this->frameCount; i++) {
+        CHK_ERR(this->pIndex[i].offset >= indexEnd && this->pIndex[i].offset + this->pIndex[i].size <= this->mappingSize,
+                STATUS_CANARY_INVALID_FRAME_ARCHIVE, "Frame %" PRIu64 " in %s is out of bounds", i, path);
+    }
+
+    if (prefault) {
+        // Fault in every page up front so that the media threads never take a page fault in steady state
+        madvise(this->pMapping, (SIZE_T) this->mappingSize, MADV_WILLNEED);
+        pageSize = (UINT64) sysconf(_SC_PAGESIZE);
+        for (i = 0; i < this->mappingSize; i += pageSize) {
+            touch = this->pMapping[i];
+        }
+        UNUSED_PARAM(touch);
+    } else {
+        madvise(this->pMapping, (SIZE_T) this->mappingSize, MADV_SEQUENTIAL);
+    }
+
+    DLOGI("Mapped frame archive %s with %u frames (%" PRIu64 " bytes, prefault: %s)", path, this->frameCount, this->mappingSize,
+          prefault ? "true" : "false");
+
+CleanUp:
+
+    if (fd >= 0) {
+        ::close(fd);
+    }
+
+    if (STATUS_FAILED(retStatus)) {
+        if (this->pMapping == MAP_FAILED) {
+            this->pMapping = NULL;
+        }
+        this->close();
+    }
+
+    return retStatus;
+}
+
+// Maps the archive at archivePath, packing it from the individual frame files first if it doesn't exist yet
+STATUS FrameArchive::openOrCreate(PCHAR archivePath, PCHAR pattern, UINT32 frameCount, UINT64 frameDuration, RTC_CODEC codec, BOOL prefault)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(archivePath != NULL, STATUS_NULL_ARG);
+
+    if (access(archivePath, R_OK) != 0) {
+        DLOGI("Frame archive %s not found, packing it from %s", archivePath, pattern);
+        CHK_STATUS(FrameArchive::create(pattern, frameCount, frameDuration, codec, archivePath));
+    }
+
+    CHK_STATUS(this->open(archivePath, prefault));
+
+CleanUp:
+
+    return retStatus;
+}
+
+VOID FrameArchive::close()
+{
+    if (this->pMapping != NULL) {
+        munmap(this->pMapping, (SIZE_T) this->mappingSize);
+    }
+
+    this->pMapping = NULL;
+    this->mappingSize = 0;
+    this->pIndex = NULL;
+    this->frameCount = 0;
+}
+
+UINT32 FrameArchive::getFrameCount()
+{
+    return this->frameCount;
+}
+
+// Points the frame at the archived data. The data is read only and stays valid for as long as the archive is open
+STATUS FrameArchive::getFrame(UINT32 index, PFrame pFrame)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PFrameArchiveIndexEntry pEntry;
+
+    CHK(pFrame != NULL, STATUS_NULL_ARG);
+    CHK(index < this->frameCount, STATUS_INVALID_ARG);
+
+    pEntry = &this->pIndex[index];
+    pFrame->frameData = this->pMapping + pEntry->offset;
+    pFrame->size = pEntry->size;
+    pFrame->duration = pEntry->duration;
+    pFrame->flags = (pEntry->flags & CANARY_FRAME_ARCHIVE_FLAG_KEY_FRAME) ? FRAME_FLAG_KEY_FRAME : FRAME_FLAG_NONE;
+
+CleanUp:
+
+    return retStatus;
+}
+
+} // namespace Canary
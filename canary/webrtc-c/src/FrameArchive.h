@@ -0,0 +1,53 @@
+#pragma once
+
+namespace Canary {
+
+class FrameArchive;
+typedef FrameArchive* PFrameArchive;
+
+/*
+ * Packed frame archive layout. All fields are in host byte order since the archive is produced and consumed on the
+ * same machine:
+ *
+ * FrameArchiveHeader | FrameArchiveIndexEntry[frameCount] | frame data
+ */
+typedef struct {
+    CHAR magic[CANARY_FRAME_ARCHIVE_MAGIC_LEN];
+    UINT32 version;
+    UINT32 frameCount;
+} FrameArchiveHeader;
+typedef FrameArchiveHeader* PFrameArchiveHeader;
+
+typedef struct {
+    // Offset of the frame data from the beginning of the archive
+    UINT64 offset;
+    UINT32 size;
+    UINT32 flags;
+    UINT64 duration;
+} FrameArchiveIndexEntry;
+typedef FrameArchiveIndexEntry* PFrameArchiveIndexEntry;
+
+/*
+ * Read only, memory mapped view over a packed frame archive. Frames are handed out as pointers into the mapping, so
+ * serving a frame costs no syscall and no copy once the archive is open.
+ */
+class FrameArchive {
+  public:
+    FrameArchive();
+    ~FrameArchive();
+
+    static STATUS create(PCHAR, UINT32, UINT64, RTC_CODEC, PCHAR);
+    STATUS open(PCHAR, BOOL);
+    STATUS openOrCreate(PCHAR, PCHAR, UINT32, UINT64, RTC_CODEC, BOOL);
+    VOID close();
+    UINT32 getFrameCount();
+    STATUS getFrame(UINT32, PFrame);
+
+  private:
+    PBYTE pMapping;
+    UINT64 mappingSize;
+    PFrameArchiveIndexEntry pIndex;
+    UINT32 frameCount;
+};
+
+} // namespace Canary
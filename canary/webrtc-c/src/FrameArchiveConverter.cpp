@@ -0,0 +1,42 @@
+#include "Include.h"
+
+// Packs a directory of per-frame sample files into a single frame archive that the canaries can memory map, e.g.
+// kvsWebrtcFrameArchiveConverter ./assets/h264SampleFrames/frame-%04d.h264 4676 30 h264 ./assets/h264SampleFrames.kvsfa
+INT32 main(INT32 argc, CHAR* argv[])
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    UINT64 frameCount = 0, frameRate = 0;
+    RTC_CODEC codec;
+    Canary::FrameArchive frameArchive;
+
+    SET_LOGGER_LOG_LEVEL(LOG_LEVEL_INFO);
+
+    CHK_ERR(argc == 6, STATUS_INVALID_ARG, "Usage: %s <frame file pattern> <frame count> <frames per second> <h264|h265|opus> <output path>",
+            argv[0]);
+    CHK_STATUS(STRTOUI64(argv[2], NULL, 10, &frameCount));
+    CHK_STATUS(STRTOUI64(argv[3], NULL, 10, &frameRate));
+    CHK_ERR(frameCount > 0 && frameCount <= MAX_UINT32 && frameRate > 0, STATUS_INVALID_ARG, "Invalid frame count or frame rate");
+
+    if (STRCMPI(argv[4], CANARY_VIDEO_CODEC_H264) == 0) {
+        codec = RTC_CODEC_H264_PROFILE_42E01F_LEVEL_ASYMMETRY_ALLOWED_PACKETIZATION_MODE;
+    } else if (STRCMPI(argv[4], CANARY_VIDEO_CODEC_H265) == 0) {
+        codec = RTC_CODEC_H265;
+    } else if (STRCMPI(argv[4], "opus") == 0) {
+        codec = RTC_CODEC_OPUS;
+    } else {
+        CHK_ERR(FALSE, STATUS_INVALID_ARG, "Unsupported codec %s", argv[4]);
+    }
+
+    CHK_STATUS(Canary::FrameArchive::create(argv[1], (UINT32) frameCount, HUNDREDS_OF_NANOS_IN_A_SECOND / frameRate, codec, argv[5]));
+
+    // Map the result once to validate it
+    CHK_STATUS(frameArchive.open(argv[5], FALSE));
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus)) {
+        DLOGE("Failed to create frame archive with 0x%08x", retStatus);
+    }
+
+    return STATUS_FAILED(retStatus) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
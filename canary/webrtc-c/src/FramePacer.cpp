@@ -0,0 +1,78 @@
+#include "Include.h"
+
+namespace Canary {
+
+FramePacer::FramePacer() : period(0), nextDeadline(0), maxLateness(0), skippedDeadlines(0)
+{
+    for (auto& bucket : this->buckets) {
+        bucket = 0;
+    }
+}
+
+STATUS FramePacer::init(UINT64 period)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(period > 0, STATUS_INVALID_ARG);
+
+    this->period = period * DEFAULT_TIME_UNIT_IN_NANOS;
+    this->reset();
+
+CleanUp:
+
+    return retStatus;
+}
+
+// Restarts the deadline sequence from now. The histogram is kept
+VOID FramePacer::reset()
+{
+    this->nextDeadline = canaryMonotonicTime() + this->period;
+}
+
+VOID FramePacer::wait()
+{
+    UINT64 lateness, skipped;
+
+    canarySleepUntil(this->nextDeadline);
+    lateness = canaryPacerAdvanceDeadline(&this->nextDeadline, this->period, canaryMonotonicTime(), &skipped);
+
+    this->buckets[canaryLatenessBucket(lateness / 1000)]++;
+    if (lateness > this->maxLateness) {
+        this->maxLateness = lateness;
+    }
+
+    this->skippedDeadlines += skipped;
+}
+
+// Upper bound in microseconds of the bucket holding the given percentile (0-100)
+UINT64 FramePacer::getLatenessPercentile(DOUBLE percentile)
+{
+    SIZE_T counts[CANARY_LATENESS_BUCKET_COUNT];
+    UINT32 i;
+
+    for (i = 0; i < CANARY_LATENESS_BUCKET_COUNT; i++) {
+        counts[i] = (SIZE_T) this->buckets[i];
+    }
+
+    return canaryLatenessPercentile(counts, percentile);
+}
+
+// In microseconds
+UINT64 FramePacer::getMaxLateness()
+{
+    return this->maxLateness / 1000;
+}
+
+UINT64 FramePacer::getSkippedDeadlines()
+{
+    return this->skippedDeadlines;
+}
+
+VOID FramePacer::logStats(PCHAR name)
+{
+    DLOGI("%s pacing lateness: p50 <= %" PRIu64 " us, p90 <= %" PRIu64 " us, p99 <= %" PRIu64 " us, max %" PRIu64 " us, skipped deadlines %" PRIu64, name,
+          this->getLatenessPercentile(50), this->getLatenessPercentile(90), this->getLatenessPercentile(99), this->getMaxLateness(),
+          this->getSkippedDeadlines());
+}
+
+} // namespace Canary
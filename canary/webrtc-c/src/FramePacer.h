@@ -0,0 +1,36 @@
+#pragma once
+
+namespace Canary {
+
+class FramePacer;
+typedef FramePacer* PFramePacer;
+
+/*
+ * Paces a media loop against absolute CLOCK_MONOTONIC deadlines. Every wait() sleeps until the previous deadline plus
+ * one period, so time spent in writeFrame and sleep overshoot don't accumulate into drift the way a relative sleep
+ * does. How late each deadline was served is recorded in a log2 histogram so that send jitter caused by the harness
+ * can be told apart from jitter caused by the SDK.
+ */
+class FramePacer {
+  public:
+    FramePacer();
+
+    STATUS init(UINT64 period);
+    VOID wait();
+    VOID reset();
+    UINT64 getLatenessPercentile(DOUBLE percentile);
+    UINT64 getMaxLateness();
+    UINT64 getSkippedDeadlines();
+    VOID logStats(PCHAR name);
+
+  private:
+    // Period and deadlines are in nanoseconds
+    UINT64 period;
+    UINT64 nextDeadline;
+    // Bucket 0 counts on-time deadlines, bucket i > 0 counts lateness in [2^(i-1), 2^i) microseconds
+    std::atomic<UINT64> buckets[CANARY_LATENESS_BUCKET_COUNT];
+    std::atomic<UINT64> maxLateness;
+    std::atomic<UINT64> skippedDeadlines;
+};
+
+} // namespace Canary
@@ -0,0 +1,88 @@
+#include "Include.h"
+
+namespace Canary {
+
+FramePool::FramePool() : pBuffer(nullptr), headerSize(0), maxFrameSize(0)
+{
+    MEMSET(this->state, 0x00, SIZEOF(this->state));
+}
+
+FramePool::~FramePool()
+{
+    SAFE_MEMFREE(this->pBuffer);
+}
+
+STATUS FramePool::init(UINT32 headerSize, UINT32 minBodySize, UINT32 maxBodySize, UINT32 entryCount, BOOL nonZeroBody)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    UINT32 i, j, stride, bodySize;
+    PBYTE pBody;
+    PFramePoolEntry pEntry;
+
+    CHK(this->pBuffer == NULL, STATUS_INVALID_OPERATION);
+    CHK(entryCount > 0 && minBodySize > 0 && minBodySize <= maxBodySize, STATUS_INVALID_ARG);
+
+    canaryRandomSeed(this->state, GETTIME());
+
+    stride = headerSize + maxBodySize;
+    this->headerSize = headerSize;
+    this->maxFrameSize = stride;
+
+    this->pBuffer = (PBYTE) MEMALLOC((UINT64) stride * entryCount);
+    CHK(this->pBuffer != NULL, STATUS_NOT_ENOUGH_MEMORY);
+
+    this->entries.resize(entryCount);
+    for (i = 0; i < entryCount; i++) {
+        pEntry = &this->entries[i];
+        bodySize = minBodySize + (UINT32) (canaryRandomNext(this->state) % (maxBodySize - minBodySize + 1));
+
+        pEntry->pData = this->pBuffer + (UINT64) stride * i;
+        pBody = pEntry->pData + headerSize;
+        canaryRandomFill(this->state, pBody, bodySize);
+        if (nonZeroBody) {
+            // Without zero bytes the body can never contain an Annex-B start code
+            for (j = 0; j < bodySize; j++) {
+                if (pBody[j] == 0) {
+                    pBody[j] = (BYTE) (1 + canaryRandomNext(this->state) % 255);
+                }
+            }
+        }
+
+        pEntry->size = headerSize + bodySize;
+        pEntry->bodySize = bodySize;
+        pEntry->bodyCrc = crc32c(pBody, bodySize);
+        MEMSET(pEntry->pData, 0x00, headerSize);
+    }
+
+    DLOGI("Generated %u canary frames with body size between %u and %u bytes", entryCount, minBodySize, maxBodySize);
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus)) {
+        this->entries.clear();
+        SAFE_MEMFREE(this->pBuffer);
+    }
+
+    return retStatus;
+}
+
+PFramePoolEntry FramePool::next()
+{
+    if (this->entries.empty()) {
+        return NULL;
+    }
+
+    return &this->entries[canaryRandomNext(this->state) % this->entries.size()];
+}
+
+UINT32 FramePool::getHeaderSize()
+{
+    return this->headerSize;
+}
+
+UINT32 FramePool::getMaxFrameSize()
+{
+    return this->maxFrameSize;
+}
+
+} // namespace Canary
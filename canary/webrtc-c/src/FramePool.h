@@ -0,0 +1,45 @@
+#pragma once
+
+namespace Canary {
+
+class FramePool;
+typedef FramePool* PFramePool;
+
+typedef struct {
+    // Points at the start of the frame. The first headerSize bytes are reserved for the caller to patch per send
+    PBYTE pData;
+    // Total frame size including the header
+    UINT32 size;
+    // Size of the random body that follows the header
+    UINT32 bodySize;
+    // CRC32C of the body. Computed once when the pool is generated
+    UINT32 bodyCrc;
+} FramePoolEntry;
+typedef FramePoolEntry* PFramePoolEntry;
+
+/*
+ * Pool of pre-generated random frames. Frame bodies are produced once at start up with xoshiro256** so that the
+ * media threads only have to patch the canary payload header before handing the frame to the SDK.
+ *
+ * Body sizes are drawn uniformly from [minBodySize, maxBodySize] when the pool is generated and entries are picked
+ * randomly on every call to next(), which gives a variable frame size distribution with the same mean as before.
+ */
+class FramePool {
+  public:
+    FramePool();
+    ~FramePool();
+
+    STATUS init(UINT32 headerSize, UINT32 minBodySize, UINT32 maxBodySize, UINT32 entryCount, BOOL nonZeroBody);
+    PFramePoolEntry next();
+    UINT32 getHeaderSize();
+    UINT32 getMaxFrameSize();
+
+  private:
+    UINT64 state[CANARY_RANDOM_STATE_SIZE];
+    PBYTE pBuffer;
+    std::vector<FramePoolEntry> entries;
+    UINT32 headerSize;
+    UINT32 maxFrameSize;
+};
+
+} // namespace Canary
@@ -7,6 +7,8 @@
 #define DEFAULT_FILE_LOGGING_BUFFER_SIZE (200 * 1024)
 
 #define MAX_CLOUDWATCH_LOG_COUNT       128
+// PutMetricData takes at most 20 datums per call, each batched metric costs two (per channel and per label)
+#define MAX_CLOUDWATCH_DATUMS_PER_REQUEST 20
 #define MAX_NUMBER_OF_LOG_FILES        10
 #define MAX_CONCURRENT_CONNECTIONS     10
 #define MAX_TURN_SERVERS               1
@@ -36,16 +38,40 @@
 #define SIGNALING_CANARY_CHANNEL_NAME                            (PCHAR) "ScaryTestChannel_"
 #define SIGNALING_CANARY_MAX_CONSECUTIVE_ITERATION_FAILURE_COUNT 5
 
-#define CANARY_METADATA_SIZE (SIZEOF(UINT64) + SIZEOF(UINT32) + SIZEOF(UINT32))
+// Binary canary payload, see CanaryPayload.h. The header is magic, version and four fields in 7 bit groups
+#define CANARY_PAYLOAD_MAGIC        "KVSC"
+#define CANARY_PAYLOAD_MAGIC_LEN    4
+#define CANARY_PAYLOAD_VERSION      2
+#define CANARY_PAYLOAD_HEADER_SIZE  (CANARY_PAYLOAD_MAGIC_LEN + 1 + 5 + 10 + 5 + 5)
+#define CANARY_SEQUENCE_WINDOW_SIZE 64
 #define ANNEX_B_NALU_SIZE    4
+// The payload goes in an SEI NAL unit so the packetizer and decoders don't take the magic for the NAL header
+#define CANARY_PAYLOAD_NAL_HEADER      0x06
+#define CANARY_PAYLOAD_NAL_HEADER_SIZE 1
 
 #define CANARY_DEFAULT_FRAMERATE 30
 #define CANARY_DEFAULT_BITRATE   (250 * 1024)
 
 #define CANARY_DEFAULT_ITERATION_DURATION_IN_SECONDS 30
 
+// Number of pre-generated frames the custom frame sender cycles through
+#define CANARY_FRAME_POOL_SIZE 128
+
+#define CANARY_FRAME_ARCHIVE_MAGIC          "KVSFARC1"
+#define CANARY_FRAME_ARCHIVE_MAGIC_LEN      8
+#define CANARY_FRAME_ARCHIVE_VERSION        1
+#define CANARY_FRAME_ARCHIVE_FLAG_KEY_FRAME 0x00000001
+
 #define CANARY_DEFAULT_VIEWER_INIT_DELAY (5 * HUNDREDS_OF_NANOS_IN_A_SECOND)
 
+#define CANARY_MAX_VIEWER_COUNT   256
+#define CANARY_LOAD_POLL_INTERVAL (100 * HUNDREDS_OF_NANOS_IN_A_MILLISECOND)
+
+// Side effect queue of the storage master's media loops. The size has to be a power of two
+#define CANARY_SIDE_EFFECT_QUEUE_SIZE    1024
+#define CANARY_SIDE_EFFECT_BATCH_SIZE    64
+#define CANARY_SIDE_EFFECT_POLL_INTERVAL (100 * HUNDREDS_OF_NANOS_IN_A_MILLISECOND)
+
 #define CANARY_MIN_DURATION           (30 * HUNDREDS_OF_NANOS_IN_A_SECOND)
 #define CANARY_MIN_ITERATION_DURATION (15 * HUNDREDS_OF_NANOS_IN_A_SECOND)
 
@@ -68,6 +94,10 @@
 #define CANARY_RUN_BOTH_PEERS_ENV_VAR                    "CANARY_RUN_BOTH_PEERS"
 #define CANARY_USE_IOT_CREDENTIALS_ENV_VAR               "CANARY_USE_IOT_PROVIDER"
 #define CANARY_RUN_IN_PROFILING_MODE_ENV_VAR             "CANARY_IS_PROFILING_MODE"
+#define CANARY_PREFAULT_FRAME_ARCHIVE_ENV_VAR            "CANARY_PREFAULT_FRAME_ARCHIVE"
+#define CANARY_VIEWER_COUNT_ENV_VAR                      "CANARY_VIEWER_COUNT"
+#define CANARY_RAMP_UP_IN_SECONDS_ENV_VAR                "CANARY_RAMP_UP_IN_SECONDS"
+#define CANARY_RAMP_DOWN_IN_SECONDS_ENV_VAR              "CANARY_RAMP_DOWN_IN_SECONDS"
 #define IOT_CORE_CREDENTIAL_ENDPOINT_ENV_VAR             "AWS_IOT_CORE_CREDENTIAL_ENDPOINT"
 #define IOT_CORE_CERT_ENV_VAR                            "AWS_IOT_CORE_CERT"
 #define IOT_CORE_PRIVATE_KEY_ENV_VAR                     "AWS_IOT_CORE_PRIVATE_KEY"
@@ -75,6 +105,7 @@
 #define IOT_CORE_THING_NAME_ENV_VAR                      "AWS_IOT_CORE_THING_NAME"
 #define CONTROL_PLANE_URI_ENV_VAR                        "CONTROL_PLANE_URI"
 #define STORAGE_CANARY_FIRST_FRAME_TS_FILE_ENV_VAR       "STORAGE_CANARY_FIRST_FRAME_TS_FILE"
+#define STORAGE_CANARY_VIDEO_RENDITIONS_ENV_VAR          "STORAGE_CANARY_VIDEO_RENDITIONS"
 
 #define CANARY_DEFAULT_LABEL                       "ScaryTestLabel"
 #define CANARY_DEFAULT_CHANNEL_NAME                "ScaryTestStream"
@@ -102,19 +133,33 @@
 #define STATUS_WEBRTC_CANARY_BASE                       0x74000000
 #define STATUS_WEBRTC_EMPTY_IOT_CRED_FILE               STATUS_WEBRTC_CANARY_BASE + 0x00000001
 #define STATUS_WAITING_ON_FIRST_FRAME                   STATUS_WEBRTC_CANARY_BASE + 0x00000002
+#define STATUS_CANARY_INVALID_FRAME_ARCHIVE             STATUS_WEBRTC_CANARY_BASE + 0x00000003
+#define STATUS_CANARY_INVALID_PAYLOAD                   STATUS_WEBRTC_CANARY_BASE + 0x00000004
+#define STATUS_CANARY_SIDE_EFFECT_QUEUE_FULL            STATUS_WEBRTC_CANARY_BASE + 0x00000005
+#define STATUS_CANARY_STAND_IN_CONNECTION_CLOSED        STATUS_WEBRTC_CANARY_BASE + 0x00000006
+#define STATUS_CANARY_STAND_IN_BAD_REQUEST              STATUS_WEBRTC_CANARY_BASE + 0x00000007
 
 #define CANARY_VIDEO_FRAMES_PATH (PCHAR) "./assets/h264SampleFrames/frame-%04d.h264"
 #define CANARY_AUDIO_FRAMES_PATH (PCHAR) "./assets/opusSampleFrames/sample-%03d.opus"
+#define CANARY_VIDEO_FRAME_ARCHIVE_PATH (PCHAR) "./assets/h264SampleFrames.kvsfa"
+#define CANARY_AUDIO_FRAME_ARCHIVE_PATH (PCHAR) "./assets/opusSampleFrames.kvsfa"
+// Each extra video rendition is a directory laid out like h264SampleFrames, packed into <directory>.kvsfa
+#define CANARY_VIDEO_RENDITION_FRAMES_FILE "/frame-%04d.h264"
+#define CANARY_FRAME_ARCHIVE_EXTENSION     ".kvsfa"
 
 #define METRICS_INVOCATION_PERIOD            (60 * HUNDREDS_OF_NANOS_IN_A_SECOND)
 #define END_TO_END_METRICS_INVOCATION_PERIOD (30 * HUNDREDS_OF_NANOS_IN_A_SECOND)
 #define KVS_METRICS_INVOCATION_PERIOD        (5 * HUNDREDS_OF_NANOS_IN_A_SECOND)
 #define STREAMING_AVAILABILITY_PERIOD        (20 * HUNDREDS_OF_NANOS_IN_A_SECOND)
-#define CANARY_METADATA_SIZE                 (SIZEOF(UINT64) + SIZEOF(UINT32) + SIZEOF(UINT32))
 
 #define MAX_CALL_RETRY_COUNT                 10
 
+#include <algorithm>
+#include <map>
+#include <memory>
 #include <numeric>
+#include <sstream>
+#include <vector>
 
 #include <aws/core/Aws.h>
 #include <aws/monitoring/CloudWatchClient.h>
@@ -127,6 +172,8 @@
 #include <aws/logs/model/DescribeLogStreamsRequest.h>
 
 #include <com/amazonaws/kinesis/video/webrtcclient/Include.h>
+#include <CanaryRandom.h>
+#include <CanaryPacing.h>
 
 using namespace Aws::Client;
 using namespace Aws::CloudWatchLogs;
@@ -136,6 +183,11 @@ using namespace Aws::CloudWatch;
 using namespace std;
 
 #include "Config.h"
+#include "FramePool.h"
+#include "CanaryPayload.h"
+#include "FrameArchive.h"
+#include "FramePacer.h"
+#include "SideEffectWorker.h"
 #include "CloudwatchLogs.h"
 #include "Peer.h"
 #include "CloudwatchMonitoring.h"
@@ -3,24 +3,85 @@
 namespace Canary {
 
 Peer::Peer()
-    : pAwsCredentialProvider(nullptr), terminated(FALSE), iceGatheringDone(FALSE), receivedOffer(FALSE), receivedAnswer(FALSE), foundPeerId(FALSE),
-      pPeerConnection(nullptr), status(STATUS_SUCCESS)
+    : pAwsCredentialProvider(nullptr), ownsCredentialProvider(TRUE), signalingClientHandle(INVALID_SIGNALING_CLIENT_HANDLE_VALUE),
+      ownsSignalingClient(TRUE), terminated(FALSE), iceGatheringDone(FALSE), receivedOffer(FALSE), receivedAnswer(FALSE), foundPeerId(FALSE),
+      recorded(FALSE), pPeerConnection(nullptr), status(STATUS_SUCCESS), maxSessions(0), connectStartTime(0), connectedTime(0),
+      offerSentTime(0), answerReceivedTime(0), firstFrameReceivedTime(0), disconnectedTime(0), bytesWritten(0)
 {
 }
 
 Peer::~Peer()
 {
+    // Sessions share the signaling client, so they have to go before it does
+    this->terminated = TRUE;
+    this->sessions.clear();
+    this->closingSessions.clear();
+    this->endedSessions.clear();
     CHK_LOG_ERR(freePeerConnection(&this->pPeerConnection));
-    CHK_LOG_ERR(freeSignalingClient(&this->signalingClientHandle));
-    if(this->useIotCredentialProvider) {
-        CHK_LOG_ERR(freeIotCredentialProvider(&this->pAwsCredentialProvider));
+    if (this->ownsSignalingClient) {
+        CHK_LOG_ERR(freeSignalingClient(&this->signalingClientHandle));
+    }
+    if (this->ownsCredentialProvider && this->pAwsCredentialProvider != NULL) {
+        if(this->useIotCredentialProvider) {
+            CHK_LOG_ERR(freeIotCredentialProvider(&this->pAwsCredentialProvider));
+        }
+        else {
+            CHK_LOG_ERR(freeStaticCredentialProvider(&this->pAwsCredentialProvider));
+        }
+    }
+}
+
+STATUS Peer::createCredentialProvider(const Canary::PConfig pConfig, PAwsCredentialProvider* ppAwsCredentialProvider)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pConfig != NULL && ppAwsCredentialProvider != NULL, STATUS_NULL_ARG);
+
+    if(pConfig->useIotCredentialProvider.value) {
+        CHK_STATUS(createLwsIotCredentialProvider((PCHAR) pConfig->iotEndpoint,
+                                                  (PCHAR) pConfig->iotCoreCert.value.c_str(),
+                                                  (PCHAR) pConfig->iotCorePrivateKey.value.c_str(),
+                                                  (PCHAR) pConfig->caCertPath.value.c_str(),
+                                                  (PCHAR) pConfig->iotCoreRoleAlias.value.c_str(),
+                                                  (PCHAR) pConfig->channelName.value.c_str(),
+                                                  ppAwsCredentialProvider));
     }
     else {
-        CHK_LOG_ERR(freeStaticCredentialProvider(&this->pAwsCredentialProvider));
+        if(IS_EMPTY_STRING(pConfig->sessionToken.value.c_str())) {
+            CHK_STATUS(createStaticCredentialProvider((PCHAR) pConfig->accessKey.value.c_str(), 0, (PCHAR) pConfig->secretKey.value.c_str(), 0,
+                                                      NULL, 0, MAX_UINT64, ppAwsCredentialProvider));
+        } else {
+            CHK_STATUS(createStaticCredentialProvider((PCHAR) pConfig->accessKey.value.c_str(), 0, (PCHAR) pConfig->secretKey.value.c_str(), 0,
+                                                      (PCHAR) pConfig->sessionToken.value.c_str(), 0, MAX_UINT64, ppAwsCredentialProvider));
+        }
+
     }
+
+CleanUp:
+
+    return retStatus;
 }
 
-STATUS Peer::init(const Canary::PConfig pConfig, const Callbacks& callbacks)
+STATUS Peer::freeCredentialProvider(const Canary::PConfig pConfig, PAwsCredentialProvider* ppAwsCredentialProvider)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pConfig != NULL && ppAwsCredentialProvider != NULL, STATUS_NULL_ARG);
+
+    if(pConfig->useIotCredentialProvider.value) {
+        CHK_STATUS(freeIotCredentialProvider(ppAwsCredentialProvider));
+    }
+    else {
+        CHK_STATUS(freeStaticCredentialProvider(ppAwsCredentialProvider));
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+// A shared credential provider stays owned by the caller and has to outlive the peer
+STATUS Peer::init(const Canary::PConfig pConfig, const Callbacks& callbacks, PAwsCredentialProvider pSharedCredentialProvider)
 {
     STATUS retStatus = STATUS_SUCCESS;
 
@@ -45,24 +106,11 @@ STATUS Peer::init(const Canary::PConfig pConfig, const Callbacks& callbacks)
         this->videoCodec = RTC_CODEC_H265;
     }
 
-    if(this->useIotCredentialProvider) {
-        CHK_STATUS(createLwsIotCredentialProvider((PCHAR) pConfig->iotEndpoint,
-                                                  (PCHAR) pConfig->iotCoreCert.value.c_str(),
-                                                  (PCHAR) pConfig->iotCorePrivateKey.value.c_str(),
-                                                  (PCHAR) pConfig->caCertPath.value.c_str(),
-                                                  (PCHAR) pConfig->iotCoreRoleAlias.value.c_str(),
-                                                  (PCHAR) pConfig->channelName.value.c_str(),
-                                                  &pAwsCredentialProvider));
-    }
-    else {
-        if(IS_EMPTY_STRING(pConfig->sessionToken.value.c_str())) {
-            CHK_STATUS(createStaticCredentialProvider((PCHAR) pConfig->accessKey.value.c_str(), 0, (PCHAR) pConfig->secretKey.value.c_str(), 0,
-                                                      NULL, 0, MAX_UINT64, &pAwsCredentialProvider));
-        } else {
-            CHK_STATUS(createStaticCredentialProvider((PCHAR) pConfig->accessKey.value.c_str(), 0, (PCHAR) pConfig->secretKey.value.c_str(), 0,
-                                                      (PCHAR) pConfig->sessionToken.value.c_str(), 0, MAX_UINT64, &pAwsCredentialProvider));
-        }
-
+    if (pSharedCredentialProvider != NULL) {
+        this->pAwsCredentialProvider = pSharedCredentialProvider;
+        this->ownsCredentialProvider = FALSE;
+    } else {
+        CHK_STATUS(Peer::createCredentialProvider(pConfig, &this->pAwsCredentialProvider));
     }
 
     CHK_STATUS(initSignaling(pConfig));
@@ -106,7 +154,7 @@ STATUS Peer::initSignaling(const Canary::PConfig pConfig)
     channelInfo.asyncIceServerConfig = TRUE;
     channelInfo.retry = TRUE;
     channelInfo.reconnect = TRUE;
-    channelInfo.pCertPath = (PCHAR) DEFAULT_KVS_CACERT_PATH;
+    channelInfo.pCertPath = (PCHAR) pConfig->caCertPath.value.c_str();
     channelInfo.messageTtl = 0; // Default is 60 seconds
 
     this->clientInfo.signalingClientCreationMaxRetryAttempts = MAX_CALL_RETRY_COUNT;
@@ -162,6 +210,11 @@ STATUS Peer::initSignaling(const Canary::PConfig pConfig)
         PPeer pPeer = (PPeer) customData;
         std::lock_guard<std::recursive_mutex> lock(pPeer->mutex);
 
+        if (pPeer->isMaster && pPeer->maxSessions > 0) {
+            CHK_STATUS(pPeer->handleSessionMsg(pMsg));
+            CHK(FALSE, retStatus);
+        }
+
         if (!pPeer->foundPeerId.load()) {
             pPeer->peerId = pMsg->signalingMessage.peerClientId;
             DLOGI("Found peer id: %s", pPeer->peerId.c_str());
@@ -309,6 +362,7 @@ STATUS Peer::initPeerConnection()
 
                 break;
             case RTC_PEER_CONNECTION_STATE_CONNECTED: {
+                pPeer->connectedTime = GETTIME();
                 if(!pPeer->isProfilingMode) {
                     auto duration = (GETTIME() - pPeer->iceHolePunchingStartTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
                     DLOGI("ICE hole punching took %lu ms", duration);
@@ -324,6 +378,9 @@ STATUS Peer::initPeerConnection()
             case RTC_PEER_CONNECTION_STATE_CLOSED:
                 // explicit fallthrough
             case RTC_PEER_CONNECTION_STATE_DISCONNECTED:
+                if (pPeer->disconnectedTime.load() == 0) {
+                    pPeer->disconnectedTime = GETTIME();
+                }
                 // Let the higher level to terminate
                 if (pPeer->callbacks.onDisconnected != NULL) {
                     pPeer->callbacks.onDisconnected();
@@ -349,10 +406,216 @@ CleanUp:
     return retStatus;
 }
 
-STATUS Peer::shutdown()
+// Sessions borrow the parent's signaling client, credentials and ICE servers. Only the peer connection is their own
+STATUS Peer::initSession(Peer* pParent, const std::string& sessionPeerId)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pParent != NULL, STATUS_NULL_ARG);
+
+    this->isMaster = TRUE;
+    this->trickleIce = pParent->trickleIce;
+    this->isProfilingMode = pParent->isProfilingMode;
+    this->videoCodec = pParent->videoCodec;
+    this->useIotCredentialProvider = pParent->useIotCredentialProvider;
+    this->pAwsCredentialProvider = pParent->pAwsCredentialProvider;
+    this->ownsCredentialProvider = FALSE;
+    this->signalingClientHandle = pParent->signalingClientHandle;
+    this->ownsSignalingClient = FALSE;
+    this->rtcConfiguration = pParent->rtcConfiguration;
+    this->firstFrame = TRUE;
+    this->canaryOutgoingRTPMetricsContext.prevTs = GETTIME();
+    this->canaryIncomingRTPMetricsContext.prevTs = GETTIME();
+
+    // A viewer going away only ends its own session
+    this->callbacks.onNewConnection = pParent->callbacks.onNewConnection;
+    this->callbacks.onDisconnected = [pParent, sessionPeerId]() { pParent->endSession(sessionPeerId); };
+
+    this->connectStartTime = GETTIME();
+    this->peerId = sessionPeerId;
+    this->foundPeerId = TRUE;
+    CHK_STATUS(this->initPeerConnection());
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS Peer::handleSessionMsg(PReceivedSignalingMessage pMsg)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    std::shared_ptr<Peer> pSession;
+    std::string sessionPeerId = pMsg->signalingMessage.peerClientId;
+
+    CHK(!this->terminated.load(), retStatus);
+
+    this->reapSessions();
+
+    // Only the signaling thread adds sessions, so the peer connection is created without holding up the media thread
+    {
+        std::lock_guard<std::mutex> lock(this->sessionsMutex);
+        auto it = this->sessions.find(sessionPeerId);
+        if (it != this->sessions.end()) {
+            pSession = it->second;
+        } else {
+            CHK_WARN(this->sessions.size() < this->maxSessions, retStatus, "Session limit %u reached, ignoring peer %s", this->maxSessions,
+                     sessionPeerId.c_str());
+        }
+    }
+
+    if (pSession == nullptr) {
+        pSession = std::make_shared<Peer>();
+        CHK_STATUS(pSession->initSession(this, sessionPeerId));
+
+        std::lock_guard<std::mutex> lock(this->sessionsMutex);
+        this->sessions[sessionPeerId] = pSession;
+        DLOGI("New session for peer %s, %u sessions", sessionPeerId.c_str(), (UINT32) this->sessions.size());
+    }
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(pSession->mutex);
+        CHK_STATUS(pSession->handleSignalingMsg(pMsg));
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+// Runs on the session's connection state callback, so the session only gives up its slot here and is freed later
+VOID Peer::endSession(const std::string& sessionPeerId)
+{
+    std::lock_guard<std::mutex> lock(this->sessionsMutex);
+
+    if (this->terminated.load()) {
+        return;
+    }
+
+    auto it = this->sessions.find(sessionPeerId);
+    if (it != this->sessions.end()) {
+        this->closingSessions.push_back(it->second);
+        this->sessions.erase(it);
+        DLOGI("Session for peer %s ended, %u sessions", sessionPeerId.c_str(), (UINT32) this->sessions.size());
+    }
+}
+
+// Frees the ended sessions on the signaling thread. Snapshots only come from the live sessions, so once the media thread
+// dropped its last one, nothing else can get hold of a closing session
+VOID Peer::reapSessions()
+{
+    std::vector<std::shared_ptr<Peer>> reaped;
+
+    {
+        std::lock_guard<std::mutex> lock(this->sessionsMutex);
+        for (auto it = this->closingSessions.begin(); it != this->closingSessions.end();) {
+            if (it->use_count() == 1) {
+                reaped.push_back(*it);
+                it = this->closingSessions.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+
+    for (auto& pSession : reaped) {
+        CHK_LOG_ERR(pSession->shutdown(FALSE));
+        CHK_LOG_ERR(freePeerConnection(&pSession->pPeerConnection));
+        pSession->audioTransceivers.clear();
+        pSession->videoTransceivers.clear();
+    }
+
+    if (!reaped.empty()) {
+        std::lock_guard<std::mutex> lock(this->sessionsMutex);
+        this->endedSessions.insert(this->endedSessions.end(), reaped.begin(), reaped.end());
+    }
+}
+
+VOID Peer::setMaxSessions(UINT32 maxSessions)
+{
+    this->maxSessions = maxSessions;
+}
+
+std::vector<std::shared_ptr<Peer>> Peer::getSessions()
+{
+    std::vector<std::shared_ptr<Peer>> snapshot;
+    std::lock_guard<std::mutex> lock(this->sessionsMutex);
+
+    snapshot.reserve(this->sessions.size());
+    for (auto& session : this->sessions) {
+        snapshot.push_back(session.second);
+    }
+
+    return snapshot;
+}
+
+// Sessions that ended during the run, whether or not they were freed yet
+std::vector<std::shared_ptr<Peer>> Peer::getEndedSessions()
+{
+    std::vector<std::shared_ptr<Peer>> snapshot;
+    std::lock_guard<std::mutex> lock(this->sessionsMutex);
+
+    snapshot.reserve(this->closingSessions.size() + this->endedSessions.size());
+    snapshot.insert(snapshot.end(), this->closingSessions.begin(), this->closingSessions.end());
+    snapshot.insert(snapshot.end(), this->endedSessions.begin(), this->endedSessions.end());
+
+    return snapshot;
+}
+
+// Time from connect() (or the first offer for a session) to the peer connection reaching CONNECTED. 0 if it never did
+UINT64 Peer::getConnectTime()
+{
+    UINT64 connected = this->connectedTime.load();
+
+    return connected == 0 ? 0 : connected - this->connectStartTime;
+}
+
+// Time from the viewer's offer going out to its answer coming back. 0 if either never happened
+UINT64 Peer::getTimeToAnswer()
+{
+    UINT64 sent = this->offerSentTime.load(), received = this->answerReceivedTime.load();
+
+    return sent == 0 || received < sent ? 0 : received - sent;
+}
+
+// Time from connect() to the first canary video frame. 0 if none arrived
+UINT64 Peer::getTimeToFirstFrame()
+{
+    UINT64 firstFrame = this->firstFrameReceivedTime.load();
+
+    return firstFrame == 0 ? 0 : firstFrame - this->connectStartTime;
+}
+
+UINT64 Peer::getConnectedDuration(UINT64 now)
+{
+    UINT64 connected = this->connectedTime.load(), disconnected = this->disconnectedTime.load();
+
+    if (connected == 0) {
+        return 0;
+    }
+
+    return (disconnected > connected ? disconnected : now) - connected;
+}
+
+// Frame payload written while connected, in bits per second. RTP and SRTP overhead is not included
+DOUBLE Peer::getOutgoingBitrate(UINT64 now)
+{
+    UINT64 duration = this->getConnectedDuration(now);
+
+    if (duration == 0) {
+        return 0;
+    }
+
+    return (DOUBLE) this->bytesWritten.load() * 8 * HUNDREDS_OF_NANOS_IN_A_SECOND / duration;
+}
+
+STATUS Peer::shutdown(BOOL deleteSignalingChannel)
 {
     this->terminated = TRUE;
 
+    for (auto& pSession : this->getSessions()) {
+        CHK_LOG_ERR(pSession->shutdown(FALSE));
+    }
+
     this->cvar.notify_all();
     {
         // lock to wait until awoken thread finish.
@@ -363,7 +626,7 @@ STATUS Peer::shutdown()
         CHK_LOG_ERR(closePeerConnection(this->pPeerConnection));
     }
 
-    if (!this->isMaster && IS_VALID_SIGNALING_CLIENT_HANDLE(this->signalingClientHandle)) {
+    if (!this->isMaster && deleteSignalingChannel && IS_VALID_SIGNALING_CLIENT_HANDLE(this->signalingClientHandle)) {
         CHK_LOG_ERR(signalingClientDeleteSync(this->signalingClientHandle));
     }
 
@@ -390,6 +653,8 @@ STATUS Peer::connect()
         msg.messageType = SIGNALING_MESSAGE_TYPE_OFFER;
         CHK_STATUS(serializeSessionDescriptionInit(&offerSDPInit, NULL, &buffLen));
         CHK_STATUS(serializeSessionDescriptionInit(&offerSDPInit, msg.payload, &buffLen));
+        // Stamped before sending, a local signaling endpoint can answer before send() returns
+        this->offerSentTime = GETTIME();
         CHK_STATUS(this->send(&msg));
 
     CleanUp:
@@ -398,6 +663,7 @@ STATUS Peer::connect()
     };
 
     STATUS retStatus = STATUS_SUCCESS;
+    this->connectStartTime = GETTIME();
     CHK_STATUS(signalingClientConnectSync(signalingClientHandle));
 
     if (!this->isMaster) {
@@ -501,6 +767,7 @@ STATUS Peer::handleSignalingMsg(PReceivedSignalingMessage pMsg)
         } else if (receivedAnswer.exchange(TRUE)) {
             DLOGW("Offer already received, ignore new offer from client id %s", msg.peerClientId);
         } else {
+            this->answerReceivedTime = GETTIME();
             MEMSET(&answerSDPInit, 0x00, SIZEOF(RtcSessionDescriptionInit));
 
             CHK_STATUS(deserializeSessionDescriptionInit(msg.payload, msg.payloadLen, &answerSDPInit));
@@ -557,34 +824,51 @@ STATUS Peer::addTransceiver(RtcMediaStreamTrack& track)
         DLOGV("received bitrate suggestion: %f", maxiumBitrate);
     };
 
+    // The payload is verified where it lies, without copies or allocations. Only the metrics update takes a lock, and
+    // not the peer mutex, so the measured latency is the network and the SDK rather than the canary itself
     auto handleVideoFrame = [](UINT64 customData, PFrame pFrame) -> VOID {
         PPeer pPeer = (Canary::PPeer)(customData);
-        std::unique_lock<std::recursive_mutex> lock(pPeer->mutex);
-        PBYTE frameDataPtr = pFrame->frameData + ANNEX_B_NALU_SIZE;
-        UINT32 rawPacketSize = 0;
-
-        // Get size of hex encoded data
-        hexDecode((PCHAR) frameDataPtr, pFrame->size - ANNEX_B_NALU_SIZE, NULL, &rawPacketSize);
-        PBYTE rawPacket = (PBYTE) MEMCALLOC(1, (rawPacketSize * SIZEOF(BYTE)));
-        hexDecode((PCHAR) frameDataPtr, pFrame->size - ANNEX_B_NALU_SIZE, rawPacket, &rawPacketSize);
-
-        // Extract the timestamp field from raw packet
-        frameDataPtr = rawPacket;
-        UINT64 receivedTs = getUnalignedInt64BigEndian((PINT64)(frameDataPtr));
-        frameDataPtr += SIZEOF(UINT64);
-        UINT32 receivedSize = getUnalignedInt32BigEndian((PINT32)(frameDataPtr));
-
-        pPeer->endToEndMetricsContext.frameLatencyAvg =
-            EMA_ACCUMULATOR_GET_NEXT(pPeer->endToEndMetricsContext.frameLatencyAvg, GETTIME() - receivedTs);
-
-        // Do a size match of the raw packet. Since raw packet does not contain the NALu, the
-        // comparison would be rawPacketSize + ANNEX_B_NALU_SIZE and the received size
-        if (rawPacketSize + ANNEX_B_NALU_SIZE == receivedSize) {
-            pPeer->endToEndMetricsContext.sizeMatchAvg = EMA_ACCUMULATOR_GET_NEXT(pPeer->endToEndMetricsContext.sizeMatchAvg, 1);
-        } else {
-            pPeer->endToEndMetricsContext.sizeMatchAvg = EMA_ACCUMULATOR_GET_NEXT(pPeer->endToEndMetricsContext.sizeMatchAvg, 0);
+        UINT64 now = GETTIME(), firstFrameReceivedTime = 0;
+        CanaryPayloadHeader header;
+        CANARY_SEQUENCE_STATUS sequenceStatus;
+        UINT32 newlyLost, startCodeSize = 0, payloadOffset = 0, bodyOffset;
+        BOOL sizeMatch, dataMatch;
+
+        // The start code can come back shorter than it was sent, the NAL header and the payload follow whichever it is
+        if (STATUS_FAILED(findCanaryPayload(pFrame->frameData, pFrame->size, &startCodeSize, &payloadOffset)) ||
+            STATUS_FAILED(parseCanaryPayloadHeader(pFrame->frameData + payloadOffset, pFrame->size - payloadOffset, &header))) {
+            std::lock_guard<std::mutex> lock(pPeer->e2eLock);
+            pPeer->endToEndMetricsContext.framesMalformed++;
+            return;
         }
-        SAFE_MEMFREE(rawPacket);
+
+        pPeer->firstFrameReceivedTime.compare_exchange_strong(firstFrameReceivedTime, now);
+
+        bodyOffset = payloadOffset + CANARY_PAYLOAD_HEADER_SIZE;
+        sizeMatch = header.size - ANNEX_B_NALU_SIZE == pFrame->size - startCodeSize;
+        dataMatch = sizeMatch && crc32c(pFrame->frameData + bodyOffset, pFrame->size - bodyOffset) == header.bodyCrc;
+        sequenceStatus = pPeer->sequenceTracker.update(header.sequenceNumber, &newlyLost);
+
+        std::lock_guard<std::mutex> lock(pPeer->e2eLock);
+        auto& ctx = pPeer->endToEndMetricsContext;
+        ctx.framesLost += newlyLost;
+        switch (sequenceStatus) {
+            case CANARY_SEQUENCE_DUPLICATE:
+                // Already accounted for, don't let it skew the averages
+                ctx.framesDuplicated++;
+                return;
+            case CANARY_SEQUENCE_REORDERED:
+            case CANARY_SEQUENCE_LATE:
+                ctx.framesReordered++;
+                break;
+            default:
+                break;
+        }
+
+        ctx.framesReceived++;
+        ctx.frameLatencyAvg = EMA_ACCUMULATOR_GET_NEXT(ctx.frameLatencyAvg, now - header.timestamp);
+        ctx.sizeMatchAvg = EMA_ACCUMULATOR_GET_NEXT(ctx.sizeMatchAvg, sizeMatch ? 1 : 0);
+        ctx.dataMatchAvg = EMA_ACCUMULATOR_GET_NEXT(ctx.dataMatchAvg, dataMatch ? 1 : 0);
     };
 
     PRtcRtpTransceiver pTransceiver;
@@ -660,6 +944,20 @@ STATUS Peer::writeFrame(PFrame pFrame, MEDIA_STREAM_TRACK_KIND kind)
     STATUS retStatus = STATUS_SUCCESS;
     DOUBLE timeToFirstFrame;
     auto& transceivers = kind == MEDIA_STREAM_TRACK_KIND_VIDEO ? this->videoTransceivers : this->audioTransceivers;
+
+    // A load master fans the frame out to every viewer that is still around. One viewer failing must not stall the rest
+    if (this->maxSessions > 0) {
+        for (auto& pSession : this->getSessions()) {
+            if (pSession->disconnectedTime.load() == 0) {
+                CHK_LOG_ERR(pSession->writeFrame(pFrame, kind));
+            }
+        }
+        CHK(FALSE, retStatus);
+    }
+
+    if (this->connectedTime.load() != 0) {
+        this->bytesWritten += pFrame->size;
+    }
     if (kind == MEDIA_STREAM_TRACK_KIND_VIDEO) {
         std::lock_guard<std::mutex> lock(this->countUpdateMutex);
         if (this->recorded.load()) {
@@ -778,8 +1076,20 @@ CleanUp:
 
 STATUS Peer::publishEndToEndMetrics()
 {
-    std::unique_lock<std::recursive_mutex> lock(this->mutex);
-    Canary::Cloudwatch::getInstance().monitoring.pushEndToEndMetrics(this->endToEndMetricsContext);
+    EndToEndMetricsContext snapshot;
+
+    {
+        // Don't hold up the receiving thread while the metrics go out
+        std::lock_guard<std::mutex> lock(this->e2eLock);
+        auto& ctx = this->endToEndMetricsContext;
+        snapshot = ctx;
+        ctx.framesReceived = 0;
+        ctx.framesLost = 0;
+        ctx.framesReordered = 0;
+        ctx.framesDuplicated = 0;
+        ctx.framesMalformed = 0;
+    }
+    Canary::Cloudwatch::getInstance().monitoring.pushEndToEndMetrics(snapshot);
 
     return STATUS_SUCCESS;
 }
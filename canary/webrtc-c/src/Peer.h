@@ -40,6 +40,12 @@ struct EndToEndMetricsContext{
     DOUBLE frameLatencyAvg = 0.0;
     DOUBLE dataMatchAvg = 0.0;
     DOUBLE sizeMatchAvg = 0.0;
+    // Frame counts since the last publish
+    UINT64 framesReceived = 0;
+    UINT64 framesLost = 0;
+    UINT64 framesReordered = 0;
+    UINT64 framesDuplicated = 0;
+    UINT64 framesMalformed = 0;
 };
 typedef EndToEndMetricsContext* PEndToEndMetricsContext;
 
@@ -54,8 +60,8 @@ class Peer {
     ~Peer();
 
     RTC_CODEC videoCodec;
-    STATUS init(const Canary::PConfig, const Callbacks&);
-    STATUS shutdown();
+    STATUS init(const Canary::PConfig, const Callbacks&, PAwsCredentialProvider = NULL);
+    STATUS shutdown(BOOL deleteSignalingChannel = TRUE);
     STATUS connect();
     STATUS addTransceiver(RtcMediaStreamTrack&);
     STATUS addSupportedCodec(RTC_CODEC);
@@ -67,10 +73,24 @@ class Peer {
     STATUS publishEndToEndMetrics();
     STATUS publishRetryCount();
 
+    // Load mode. A master with a session limit answers every viewer on its own peer connection
+    static STATUS createCredentialProvider(const Canary::PConfig, PAwsCredentialProvider*);
+    static STATUS freeCredentialProvider(const Canary::PConfig, PAwsCredentialProvider*);
+    VOID setMaxSessions(UINT32);
+    std::vector<std::shared_ptr<Peer>> getSessions();
+    std::vector<std::shared_ptr<Peer>> getEndedSessions();
+    UINT64 getConnectTime();
+    UINT64 getTimeToAnswer();
+    UINT64 getTimeToFirstFrame();
+    UINT64 getConnectedDuration(UINT64);
+    DOUBLE getOutgoingBitrate(UINT64);
+
   private:
     Callbacks callbacks;
     PAwsCredentialProvider pAwsCredentialProvider;
+    BOOL ownsCredentialProvider;
     SIGNALING_CLIENT_HANDLE signalingClientHandle;
+    BOOL ownsSignalingClient;
     std::recursive_mutex mutex;
     std::mutex countUpdateMutex;
     std::mutex e2eLock;
@@ -106,10 +126,33 @@ class Peer {
     OutgoingRTPMetricsContext canaryOutgoingRTPMetricsContext;
     IncomingRTPMetricsContext canaryIncomingRTPMetricsContext;
     EndToEndMetricsContext endToEndMetricsContext;
+    // Only touched by the receiving thread
+    SequenceTracker sequenceTracker;
+
+    // load mode
+    UINT32 maxSessions;
+    std::mutex sessionsMutex;
+    std::map<std::string, std::shared_ptr<Peer>> sessions;
+    // Sessions whose viewer went away, waiting for the media thread to let go of them
+    std::vector<std::shared_ptr<Peer>> closingSessions;
+    // Freed sessions, kept for the load report
+    std::vector<std::shared_ptr<Peer>> endedSessions;
+    UINT64 connectStartTime;
+    std::atomic<UINT64> connectedTime;
+    // Viewer side signaling milestones, the offer going out, the answer and the first decodable video frame
+    std::atomic<UINT64> offerSentTime;
+    std::atomic<UINT64> answerReceivedTime;
+    std::atomic<UINT64> firstFrameReceivedTime;
+    std::atomic<UINT64> disconnectedTime;
+    std::atomic<UINT64> bytesWritten;
 
     STATUS initSignaling(const Canary::PConfig);
     STATUS initRtcConfiguration(const Canary::PConfig);
     STATUS initPeerConnection();
+    STATUS initSession(Peer*, const std::string&);
+    STATUS handleSessionMsg(PReceivedSignalingMessage);
+    VOID endSession(const std::string&);
+    VOID reapSessions();
     STATUS awaitIceGathering(PRtcSessionDescriptionInit);
     STATUS handleSignalingMsg(PReceivedSignalingMessage);
     STATUS send(PSignalingMessage);
@@ -0,0 +1,202 @@
+#include "Include.h"
+
+namespace Canary {
+
+SideEffectWorker::SideEffectWorker()
+    : handler(NULL), customData(0), inlined(FALSE), enqueuePosition(0), dequeuePosition(0), droppedCount(0), running(FALSE),
+      postingCount(0), lock(INVALID_MUTEX_VALUE), cvar(INVALID_CVAR_VALUE), tid(INVALID_TID_VALUE)
+{
+    UINT64 i;
+
+    for (i = 0; i < CANARY_SIDE_EFFECT_QUEUE_SIZE; i++) {
+        this->slots[i].sequence = i;
+    }
+}
+
+SideEffectWorker::~SideEffectWorker()
+{
+    this->shutdown();
+
+    // Freed here rather than in shutdown() since a media loop may still be in post() when the worker stops
+    if (IS_VALID_CVAR_VALUE(this->cvar)) {
+        CVAR_FREE(this->cvar);
+    }
+    if (IS_VALID_MUTEX_VALUE(this->lock)) {
+        MUTEX_FREE(this->lock);
+    }
+}
+
+STATUS SideEffectWorker::init(SideEffectHandlerFunc handler, UINT64 customData, BOOL inlined)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(handler != NULL, STATUS_NULL_ARG);
+    CHK(!this->running, STATUS_INVALID_OPERATION);
+
+    this->handler = handler;
+    this->customData = customData;
+    this->inlined = inlined;
+    if (!inlined) {
+        this->lock = MUTEX_CREATE(FALSE);
+        this->cvar = CVAR_CREATE();
+        CHK(IS_VALID_MUTEX_VALUE(this->lock) && IS_VALID_CVAR_VALUE(this->cvar), STATUS_INVALID_OPERATION);
+    }
+
+    this->running = TRUE;
+    if (!inlined) {
+        CHK_STATUS(THREAD_CREATE(&this->tid, SideEffectWorker::routine, (PVOID) this));
+    }
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus)) {
+        this->running = FALSE;
+    }
+
+    return retStatus;
+}
+
+// Stops accepting events, runs what is still queued and joins the worker thread
+STATUS SideEffectWorker::shutdown()
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    SideEffect events[CANARY_SIDE_EFFECT_BATCH_SIZE];
+    UINT32 count;
+
+    CHK(this->running.exchange(FALSE), retStatus);
+
+    // A post that passed the running check before the exchange may still be publishing its event
+    while (this->postingCount != 0) {
+        THREAD_SLEEP(HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+    }
+
+    if (this->tid != INVALID_TID_VALUE) {
+        MUTEX_LOCK(this->lock);
+        CVAR_SIGNAL(this->cvar);
+        MUTEX_UNLOCK(this->lock);
+        THREAD_JOIN(this->tid, NULL);
+        this->tid = INVALID_TID_VALUE;
+
+        // Whatever was published after the worker's last pass
+        while ((count = this->drain(events, ARRAY_SIZE(events))) != 0) {
+            this->handler(this->customData, events, count);
+        }
+    }
+
+    if (this->getDroppedCount() != 0) {
+        DLOGW("[Canary] Side effect queue was full, dropped %" PRIu64 " events", this->getDroppedCount());
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+// Safe to call from any number of threads, including with locks held. Never blocks
+STATUS SideEffectWorker::post(UINT32 type, UINT64 time, UINT64 arg0, UINT64 arg1, UINT64 arg2)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    SideEffect event;
+    Slot* pSlot;
+    UINT64 position, sequence;
+
+    // Counted before the running check so that shutdown() either sees this post or this post sees it stopped
+    this->postingCount++;
+    CHK(this->running, STATUS_INVALID_OPERATION);
+
+    event.type = type;
+    event.time = time;
+    event.args[0] = arg0;
+    event.args[1] = arg1;
+    event.args[2] = arg2;
+
+    if (this->inlined) {
+        this->handler(this->customData, &event, 1);
+        CHK(FALSE, retStatus);
+    }
+
+    position = this->enqueuePosition.load(std::memory_order_relaxed);
+    for (;;) {
+        pSlot = &this->slots[position & (CANARY_SIDE_EFFECT_QUEUE_SIZE - 1)];
+        sequence = pSlot->sequence.load(std::memory_order_acquire);
+        if (sequence == position) {
+            // Slot is free, claim the position. On failure position is reloaded and we retry
+            if (this->enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (sequence < position) {
+            // The consumer hasn't freed this slot yet, a full lap behind
+            this->droppedCount++;
+            CHK(FALSE, STATUS_CANARY_SIDE_EFFECT_QUEUE_FULL);
+        } else {
+            position = this->enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    pSlot->event = event;
+    pSlot->sequence.store(position + 1, std::memory_order_release);
+
+    // Doesn't take the lock, a missed wakeup only delays the event until the next poll
+    CVAR_SIGNAL(this->cvar);
+
+CleanUp:
+
+    this->postingCount--;
+
+    return retStatus;
+}
+
+UINT64 SideEffectWorker::getDroppedCount()
+{
+    return this->droppedCount;
+}
+
+BOOL SideEffectWorker::isInlined()
+{
+    return this->inlined;
+}
+
+// Copies out up to maxCount published events and frees their slots
+UINT32 SideEffectWorker::drain(PSideEffect pEvents, UINT32 maxCount)
+{
+    Slot* pSlot;
+    UINT32 count = 0;
+
+    while (count < maxCount) {
+        pSlot = &this->slots[this->dequeuePosition & (CANARY_SIDE_EFFECT_QUEUE_SIZE - 1)];
+        if (pSlot->sequence.load(std::memory_order_acquire) != this->dequeuePosition + 1) {
+            break;
+        }
+
+        pEvents[count++] = pSlot->event;
+        pSlot->sequence.store(this->dequeuePosition + CANARY_SIDE_EFFECT_QUEUE_SIZE, std::memory_order_release);
+        this->dequeuePosition++;
+    }
+
+    return count;
+}
+
+PVOID SideEffectWorker::routine(PVOID args)
+{
+    PSideEffectWorker pWorker = (PSideEffectWorker) args;
+    SideEffect events[CANARY_SIDE_EFFECT_BATCH_SIZE];
+    UINT32 count;
+    BOOL running = TRUE;
+
+    while (running) {
+        running = pWorker->running;
+        while ((count = pWorker->drain(events, ARRAY_SIZE(events))) != 0) {
+            pWorker->handler(pWorker->customData, events, count);
+        }
+
+        if (running) {
+            MUTEX_LOCK(pWorker->lock);
+            CVAR_WAIT(pWorker->cvar, pWorker->lock, CANARY_SIDE_EFFECT_POLL_INTERVAL);
+            MUTEX_UNLOCK(pWorker->lock);
+        }
+    }
+
+    return NULL;
+}
+
+} // namespace Canary
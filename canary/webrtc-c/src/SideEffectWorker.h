@@ -0,0 +1,63 @@
+#pragma once
+
+namespace Canary {
+
+class SideEffectWorker;
+typedef SideEffectWorker* PSideEffectWorker;
+
+// Event posted by a media loop. The meaning of type and the arguments is up to the handler
+typedef struct {
+    UINT32 type;
+    // When the event happened, in 100ns
+    UINT64 time;
+    UINT64 args[3];
+} SideEffect;
+typedef SideEffect* PSideEffect;
+
+// Invoked on the worker thread with every event drained in one pass, in posting order
+typedef VOID (*SideEffectHandlerFunc)(UINT64, PSideEffect, UINT32);
+
+/*
+ * Runs the side effects of a media loop (file writes, CloudWatch pushes, stats updates) on a dedicated thread so that
+ * the loop's critical section is left with only the writeFrame calls. Events go through a bounded lock free MPSC
+ * queue: posting never blocks or allocates, and an event that finds the queue full is dropped and counted.
+ *
+ * With inlined set, post() runs the handler on the caller's thread instead, which is how the loops behaved before.
+ */
+class SideEffectWorker {
+  public:
+    SideEffectWorker();
+    ~SideEffectWorker();
+
+    STATUS init(SideEffectHandlerFunc handler, UINT64 customData, BOOL inlined);
+    STATUS shutdown();
+    STATUS post(UINT32 type, UINT64 time, UINT64 arg0 = 0, UINT64 arg1 = 0, UINT64 arg2 = 0);
+    UINT64 getDroppedCount();
+    BOOL isInlined();
+
+  private:
+    typedef struct {
+        // Vyukov style ticket: equals the enqueue position when free, position + 1 once the event is published
+        std::atomic<UINT64> sequence;
+        SideEffect event;
+    } Slot;
+
+    SideEffectHandlerFunc handler;
+    UINT64 customData;
+    BOOL inlined;
+    Slot slots[CANARY_SIDE_EFFECT_QUEUE_SIZE];
+    std::atomic<UINT64> enqueuePosition;
+    UINT64 dequeuePosition;
+    std::atomic<UINT64> droppedCount;
+    std::atomic<BOOL> running;
+    // Posts past the running check, shutdown() waits for them before its final drain
+    std::atomic<UINT32> postingCount;
+    MUTEX lock;
+    CVAR cvar;
+    TID tid;
+
+    static PVOID routine(PVOID);
+    UINT32 drain(PSideEffect, UINT32);
+};
+
+} // namespace Canary
@@ -0,0 +1,912 @@
+#include "Include.h"
+#include "SignalingStandIn.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <fstream>
+#include <thread>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#define STANDIN_PORT_ENV_VAR                 "STANDIN_PORT"
+#define STANDIN_HOST_ENV_VAR                 "STANDIN_HOST"
+#define STANDIN_BIND_ADDRESS_ENV_VAR         "STANDIN_BIND_ADDRESS"
+#define STANDIN_CERT_ENV_VAR                 "STANDIN_CERT"
+#define STANDIN_KEY_ENV_VAR                  "STANDIN_KEY"
+#define STANDIN_LATENCY_ENV_VAR              "STANDIN_LATENCY_MS"
+#define STANDIN_STORM_VIEWERS_ENV_VAR        "STANDIN_STORM_VIEWERS"
+#define STANDIN_STORM_RATE_ENV_VAR           "STANDIN_STORM_OFFERS_PER_SECOND"
+#define STANDIN_STORM_ICE_CANDIDATES_ENV_VAR "STANDIN_STORM_ICE_CANDIDATES"
+#define STANDIN_STORM_ICE_INTERVAL_ENV_VAR   "STANDIN_STORM_ICE_INTERVAL_MS"
+#define STANDIN_STORM_TIMEOUT_ENV_VAR        "STANDIN_STORM_TIMEOUT_SECONDS"
+#define STANDIN_STORM_OFFER_ENV_VAR          "STANDIN_STORM_OFFER_FILE"
+
+#define STANDIN_DEFAULT_PORT                8443
+#define STANDIN_DEFAULT_HOST                "127.0.0.1"
+#define STANDIN_DEFAULT_BIND_ADDRESS        "127.0.0.1"
+#define STANDIN_DEFAULT_STORM_RATE          50
+#define STANDIN_DEFAULT_STORM_ICE           4
+#define STANDIN_DEFAULT_STORM_ICE_INTERVAL  20
+#define STANDIN_DEFAULT_STORM_TIMEOUT       30
+#define STANDIN_READ_SIZE                   (16 * 1024)
+#define STANDIN_MAX_HEAD_SIZE               (16 * 1024)
+#define STANDIN_MAX_MESSAGE_SIZE            (1024 * 1024)
+#define STANDIN_POLL_INTERVAL_MS            100
+#define STANDIN_STORM_POLL_INTERVAL         (100 * HUNDREDS_OF_NANOS_IN_A_MILLISECOND)
+#define STANDIN_LISTEN_BACKLOG              256
+#define STANDIN_CHANNEL_ARN_PREFIX          "arn:aws:kinesisvideo:us-west-2:000000000000:channel/"
+#define STANDIN_STORM_CLIENT_ID_PREFIX      "StandInStormViewer"
+#define STANDIN_WEBSOCKET_GUID              "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+#define WEBSOCKET_OPCODE_CONTINUATION 0x0
+#define WEBSOCKET_OPCODE_TEXT         0x1
+#define WEBSOCKET_OPCODE_BINARY       0x2
+#define WEBSOCKET_OPCODE_CLOSE        0x8
+#define WEBSOCKET_OPCODE_PING         0x9
+#define WEBSOCKET_OPCODE_PONG         0xA
+
+// Trickle offer in the shape the SDK produces, the ICE credentials are filled in per storm viewer
+#define STANDIN_DEFAULT_OFFER                                                                                                                  \
+    "v=0\r\no=- %u 2 IN IP4 127.0.0.1\r\ns=-\r\nt=0 0\r\na=group:BUNDLE 0 1\r\na=msid-semantic: WMS myKvsVideoStream\r\n"                      \
+    "m=video 9 UDP/TLS/RTP/SAVPF 125\r\nc=IN IP4 127.0.0.1\r\na=rtcp:9 IN IP4 0.0.0.0\r\na=ice-ufrag:%s\r\na=ice-pwd:%s\r\n"                  \
+    "a=ice-options:trickle\r\na=fingerprint:sha-256 %s\r\na=setup:actpass\r\na=mid:0\r\na=sendrecv\r\na=rtcp-mux\r\na=rtcp-rsize\r\n"         \
+    "a=rtpmap:125 H264/90000\r\na=fmtp:125 level-asymmetry-allowed=1;packetization-mode=1;profile-level-id=42e01f\r\n"                          \
+    "a=rtcp-fb:125 nack\r\na=rtcp-fb:125 nack pli\r\n"                                                                                          \
+    "m=audio 9 UDP/TLS/RTP/SAVPF 111\r\nc=IN IP4 127.0.0.1\r\na=rtcp:9 IN IP4 0.0.0.0\r\na=ice-ufrag:%s\r\na=ice-pwd:%s\r\n"                  \
+    "a=ice-options:trickle\r\na=fingerprint:sha-256 %s\r\na=setup:actpass\r\na=mid:1\r\na=sendrecv\r\na=rtcp-mux\r\n"                         \
+    "a=rtpmap:111 opus/48000/2\r\na=fmtp:111 minptime=10;useinbandfec=1\r\n"
+
+namespace Canary {
+
+static std::string envString(PCHAR pKey, const std::string& defaultValue)
+{
+    PCHAR pValue = GETENV(pKey);
+
+    return pValue != NULL && pValue[0] != '\0' ? std::string(pValue) : defaultValue;
+}
+
+static STATUS envUint64(PCHAR pKey, UINT64 defaultValue, PUINT64 pValue)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PCHAR pRaw = GETENV(pKey);
+
+    *pValue = defaultValue;
+    if (pRaw != NULL && pRaw[0] != '\0') {
+        CHK_ERR(STATUS_SUCCEEDED(STRTOUI64(pRaw, NULL, 10, pValue)), STATUS_INVALID_ARG, "Invalid value '%s' for %s", pRaw, pKey);
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+// String value of "key" in a flat JSON object, which is all the SDK sends
+static std::string jsonString(const std::string& json, const std::string& key)
+{
+    size_t start, end;
+
+    if ((start = json.find("\"" + key + "\"")) == std::string::npos || (start = json.find(':', start + key.size() + 2)) == std::string::npos ||
+        (start = json.find('"', start)) == std::string::npos || (end = json.find('"', start + 1)) == std::string::npos) {
+        return "";
+    }
+
+    return json.substr(start + 1, end - start - 1);
+}
+
+static std::string jsonEscape(const std::string& value)
+{
+    std::string escaped;
+
+    for (auto c : value) {
+        switch (c) {
+            case '"':
+                escaped += "\\\"";
+                break;
+            case '\\':
+                escaped += "\\\\";
+                break;
+            case '\r':
+                escaped += "\\r";
+                break;
+            case '\n':
+                escaped += "\\n";
+                break;
+            default:
+                escaped += c;
+        }
+    }
+
+    return escaped;
+}
+
+static std::string base64Encode(const std::string& value)
+{
+    std::string encoded(4 * ((value.size() + 2) / 3) + 1, '\0');
+    INT32 size = EVP_EncodeBlock((PBYTE) &encoded[0], (const BYTE*) value.data(), (INT32) value.size());
+
+    encoded.resize(MAX(size, 0));
+    return encoded;
+}
+
+static std::string queryParameter(const std::string& target, const std::string& name)
+{
+    std::string value, encoded;
+    size_t start = target.find(name + "="), end, i;
+    CHAR hex[3] = {0};
+
+    if (start == std::string::npos || (start > 0 && target[start - 1] != '?' && target[start - 1] != '&')) {
+        return "";
+    }
+
+    start += name.size() + 1;
+    end = target.find('&', start);
+    encoded = target.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    for (i = 0; i < encoded.size(); i++) {
+        if (encoded[i] == '%' && i + 2 < encoded.size()) {
+            hex[0] = encoded[i + 1];
+            hex[1] = encoded[i + 2];
+            value += (CHAR) strtoul(hex, NULL, 16);
+            i += 2;
+        } else {
+            value += encoded[i];
+        }
+    }
+
+    return value;
+}
+
+// arn:aws:kinesisvideo:<region>:<account>:channel/<name>/<creation time>
+static std::string channelNameFromArn(const std::string& arn)
+{
+    size_t start = arn.find(":channel/"), end;
+
+    if (start == std::string::npos || (end = arn.find('/', start + 9)) == std::string::npos) {
+        return "";
+    }
+
+    return arn.substr(start + 9, end - start - 9);
+}
+
+static std::string randomToken(UINT32 length)
+{
+    static const CHAR alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    std::string token;
+
+    while (token.size() < length) {
+        token += alphabet[RAND() % (ARRAY_SIZE(alphabet) - 1)];
+    }
+
+    return token;
+}
+
+SignalingStandIn::SignalingStandIn() : pSslCtx(nullptr), listenSocket(-1), stormStarted(FALSE)
+{
+}
+
+SignalingStandIn::~SignalingStandIn()
+{
+    if (this->stormThread.joinable()) {
+        this->stormThread.join();
+    }
+    if (this->listenSocket >= 0) {
+        close(this->listenSocket);
+    }
+    if (this->pSslCtx != nullptr) {
+        SSL_CTX_free(this->pSslCtx);
+    }
+}
+
+STATUS SignalingStandIn::init(const Config& config)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    struct sockaddr_in address;
+    INT32 enable = 1;
+    UINT32 i;
+    CHAR fingerprint[32 * 3], offer[4096];
+    std::string ufrag, pwd;
+    std::ifstream offerFile;
+    std::stringstream ss;
+
+    this->config = config;
+
+    if (!config.certPath.empty() && !config.keyPath.empty()) {
+        this->pSslCtx = SSL_CTX_new(TLS_server_method());
+        CHK(this->pSslCtx != nullptr, STATUS_INVALID_OPERATION);
+        CHK_ERR(SSL_CTX_use_certificate_chain_file(this->pSslCtx, config.certPath.c_str()) == 1 &&
+                    SSL_CTX_use_PrivateKey_file(this->pSslCtx, config.keyPath.c_str(), SSL_FILETYPE_PEM) == 1,
+                STATUS_INVALID_ARG, "Could not load %s and %s", config.certPath.c_str(), config.keyPath.c_str());
+        SSL_CTX_set_mode(this->pSslCtx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    } else {
+        DLOGW("No certificate given, serving plain HTTP. The SDK will only connect over TLS");
+    }
+
+    if (!config.stormOfferPath.empty()) {
+        offerFile.open(config.stormOfferPath);
+        CHK_ERR(offerFile.is_open(), STATUS_OPEN_FILE_FAILED, "Could not open %s", config.stormOfferPath.c_str());
+        ss << offerFile.rdbuf();
+        this->stormOffer = ss.str();
+    }
+
+    for (i = 0; i < config.stormViewers; i++) {
+        std::unique_ptr<StormViewer> pViewer(new StormViewer());
+        pViewer->clientId = STANDIN_STORM_CLIENT_ID_PREFIX + std::to_string(i);
+        pViewer->offerTime = 0;
+        pViewer->answerTime = 0;
+        this->stormViewers.push_back(std::move(pViewer));
+    }
+    if (config.stormViewers > 0 && this->stormOffer.empty()) {
+        for (i = 0; i < 32; i++) {
+            SNPRINTF(fingerprint + 3 * i, 4, "%02X%s", (UINT32) (RAND() & 0xff), i == 31 ? "" : ":");
+        }
+        ufrag = randomToken(4);
+        pwd = randomToken(24);
+        SNPRINTF(offer, SIZEOF(offer), STANDIN_DEFAULT_OFFER, (UINT32) RAND(), ufrag.c_str(), pwd.c_str(), fingerprint, ufrag.c_str(), pwd.c_str(),
+                 fingerprint);
+        this->stormOffer = offer;
+    }
+
+    this->listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    CHK_ERR(this->listenSocket >= 0, STATUS_INVALID_OPERATION, "socket() failed with errno %d", errno);
+    setsockopt(this->listenSocket, SOL_SOCKET, SO_REUSEADDR, &enable, SIZEOF(enable));
+
+    MEMSET(&address, 0x00, SIZEOF(address));
+    address.sin_family = AF_INET;
+    CHK_ERR(inet_pton(AF_INET, config.bindAddress.c_str(), &address.sin_addr) == 1, STATUS_INVALID_ARG, "Invalid bind address '%s'",
+            config.bindAddress.c_str());
+    address.sin_port = htons(config.port);
+    CHK_ERR(bind(this->listenSocket, (struct sockaddr*) &address, SIZEOF(address)) == 0, STATUS_INVALID_OPERATION, "bind() failed with errno %d",
+            errno);
+    CHK_ERR(listen(this->listenSocket, STANDIN_LISTEN_BACKLOG) == 0, STATUS_INVALID_OPERATION, "listen() failed with errno %d", errno);
+
+    DLOGI("Signaling stand-in listening on %s:%u, endpoints %s", config.bindAddress.c_str(), config.port, this->endpointUrl("https").c_str());
+    if (config.stormViewers > 0) {
+        DLOGI("Storm of %u viewers at %.1lf offers/s with %u ICE candidates %" PRIu64 " ms apart, starts when a master connects",
+              config.stormViewers, config.stormRate, config.stormIceCandidates, config.stormIceInterval / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+std::string SignalingStandIn::endpointUrl(const std::string& secureScheme)
+{
+    std::stringstream ss;
+
+    // Plain schemes drop the trailing s, https -> http and wss -> ws
+    ss << (this->pSslCtx != nullptr ? secureScheme : secureScheme.substr(0, secureScheme.size() - 1)) << "://" << this->config.host << ":"
+       << this->config.port;
+    return ss.str();
+}
+
+// Every connection gets its own thread, control plane calls are one request per connection
+STATUS SignalingStandIn::run()
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    INT32 clientSocket, enable = 1;
+
+    for (;;) {
+        clientSocket = accept(this->listenSocket, NULL, NULL);
+        if (clientSocket < 0) {
+            CHK_ERR(errno == EINTR || errno == ECONNABORTED, STATUS_INVALID_OPERATION, "accept() failed with errno %d", errno);
+            continue;
+        }
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &enable, SIZEOF(enable));
+
+        auto pConnection = std::make_shared<Connection>();
+        pConnection->socket = clientSocket;
+        std::thread(&SignalingStandIn::serve, this, pConnection).detach();
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+VOID SignalingStandIn::serve(ConnectionPtr pConnection)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    Request request;
+
+    if (this->pSslCtx != nullptr) {
+        pConnection->pSsl = SSL_new(this->pSslCtx);
+        CHK(pConnection->pSsl != nullptr, STATUS_NOT_ENOUGH_MEMORY);
+        SSL_set_fd(pConnection->pSsl, pConnection->socket);
+        CHK_ERR(SSL_accept(pConnection->pSsl) == 1, STATUS_CANARY_STAND_IN_CONNECTION_CLOSED, "TLS handshake failed: %s",
+                ERR_reason_error_string(ERR_get_error()));
+    }
+    fcntl(pConnection->socket, F_SETFL, fcntl(pConnection->socket, F_GETFL) | O_NONBLOCK);
+
+    CHK_STATUS(this->readRequest(pConnection, request));
+    DLOGV("%s %s", request.method.c_str(), request.target.c_str());
+
+    if (STRCMPI(request.headers["upgrade"].c_str(), "websocket") == 0) {
+        CHK_STATUS(this->handleWebSocket(pConnection, request));
+    } else {
+        CHK_STATUS(this->handleControlPlane(pConnection, request));
+    }
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus) && retStatus != STATUS_CANARY_STAND_IN_CONNECTION_CLOSED) {
+        DLOGW("Request failed with 0x%08x", retStatus);
+    }
+
+    pConnection->closed = TRUE;
+    {
+        std::lock_guard<std::mutex> lock(pConnection->sslMutex);
+        if (pConnection->pSsl != nullptr) {
+            SSL_shutdown(pConnection->pSsl);
+            SSL_free(pConnection->pSsl);
+            pConnection->pSsl = nullptr;
+        }
+        close(pConnection->socket);
+    }
+}
+
+STATUS SignalingStandIn::readSome(ConnectionPtr pConnection)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    CHAR buffer[STANDIN_READ_SIZE];
+    struct pollfd pollFd;
+    INT32 size, error;
+
+    for (;;) {
+        CHK(!pConnection->closed, STATUS_CANARY_STAND_IN_CONNECTION_CLOSED);
+        pollFd.events = POLLIN;
+
+        if (pConnection->pSsl != nullptr) {
+            std::lock_guard<std::mutex> lock(pConnection->sslMutex);
+            size = SSL_read(pConnection->pSsl, buffer, SIZEOF(buffer));
+            error = size > 0 ? SSL_ERROR_NONE : SSL_get_error(pConnection->pSsl, size);
+            CHK(error == SSL_ERROR_NONE || error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE, STATUS_CANARY_STAND_IN_CONNECTION_CLOSED);
+            pollFd.events = error == SSL_ERROR_WANT_WRITE ? POLLOUT : POLLIN;
+        } else {
+            size = (INT32) recv(pConnection->socket, buffer, SIZEOF(buffer), 0);
+            CHK(size > 0 || (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)), STATUS_CANARY_STAND_IN_CONNECTION_CLOSED);
+        }
+
+        if (size > 0) {
+            pConnection->buffer.append(buffer, size);
+            break;
+        }
+
+        pollFd.fd = pConnection->socket;
+        poll(&pollFd, 1, STANDIN_POLL_INTERVAL_MS);
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS SignalingStandIn::readExact(ConnectionPtr pConnection, SIZE_T size, std::string& data)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    while (pConnection->buffer.size() < size) {
+        CHK_STATUS(this->readSome(pConnection));
+    }
+    data = pConnection->buffer.substr(0, size);
+    pConnection->buffer.erase(0, size);
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS SignalingStandIn::writeAll(ConnectionPtr pConnection, const std::string& data)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    std::lock_guard<std::mutex> writeLock(pConnection->writeMutex);
+    struct pollfd pollFd;
+    SIZE_T offset = 0;
+    INT32 size, error;
+
+    while (offset < data.size()) {
+        CHK(!pConnection->closed, STATUS_CANARY_STAND_IN_CONNECTION_CLOSED);
+        pollFd.events = POLLOUT;
+
+        if (pConnection->pSsl != nullptr) {
+            std::lock_guard<std::mutex> lock(pConnection->sslMutex);
+            size = SSL_write(pConnection->pSsl, data.data() + offset, (INT32) (data.size() - offset));
+            error = size > 0 ? SSL_ERROR_NONE : SSL_get_error(pConnection->pSsl, size);
+            CHK(error == SSL_ERROR_NONE || error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE, STATUS_CANARY_STAND_IN_CONNECTION_CLOSED);
+            pollFd.events = error == SSL_ERROR_WANT_READ ? POLLIN : POLLOUT;
+        } else {
+            size = (INT32) send(pConnection->socket, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+            CHK(size > 0 || (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)), STATUS_CANARY_STAND_IN_CONNECTION_CLOSED);
+        }
+
+        if (size > 0) {
+            offset += size;
+            continue;
+        }
+
+        pollFd.fd = pConnection->socket;
+        poll(&pollFd, 1, STANDIN_POLL_INTERVAL_MS);
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS SignalingStandIn::readRequest(ConnectionPtr pConnection, Request& request)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    std::string head, line, name;
+    std::stringstream ss;
+    size_t end, colon;
+    UINT64 contentLength = 0;
+
+    while ((end = pConnection->buffer.find("\r\n\r\n")) == std::string::npos) {
+        CHK(pConnection->buffer.size() < STANDIN_MAX_HEAD_SIZE, STATUS_CANARY_STAND_IN_BAD_REQUEST);
+        CHK_STATUS(this->readSome(pConnection));
+    }
+    head = pConnection->buffer.substr(0, end);
+    pConnection->buffer.erase(0, end + 4);
+
+    ss.str(head);
+    std::getline(ss, line);
+    std::stringstream(line) >> request.method >> request.target;
+    CHK(!request.method.empty() && !request.target.empty(), STATUS_CANARY_STAND_IN_BAD_REQUEST);
+
+    while (std::getline(ss, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if ((colon = line.find(':')) == std::string::npos) {
+            continue;
+        }
+
+        name = line.substr(0, colon);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        request.headers[name] = line.substr(line.find_first_not_of(' ', colon + 1) == std::string::npos ? line.size()
+                                                                                                          : line.find_first_not_of(' ', colon + 1));
+    }
+
+    if (request.headers.count("content-length") != 0) {
+        CHK_STATUS(STRTOUI64((PCHAR) request.headers["content-length"].c_str(), NULL, 10, &contentLength));
+        CHK(contentLength <= STANDIN_MAX_MESSAGE_SIZE, STATUS_CANARY_STAND_IN_BAD_REQUEST);
+        CHK_STATUS(this->readExact(pConnection, (SIZE_T) contentLength, request.body));
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS SignalingStandIn::respond(ConnectionPtr pConnection, UINT32 statusCode, const std::string& body)
+{
+    std::stringstream ss;
+
+    ss << "HTTP/1.1 " << statusCode << (statusCode == 200 ? " OK" : " Error") << "\r\nContent-Type: application/json\r\nContent-Length: " << body.size()
+       << "\r\nConnection: close\r\n\r\n"
+       << body;
+    return this->writeAll(pConnection, ss.str());
+}
+
+STATUS SignalingStandIn::handleControlPlane(ConnectionPtr pConnection, Request& request)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    std::string channelName = jsonString(request.body, "ChannelName");
+    std::stringstream ss;
+    UINT32 statusCode = 200;
+
+    if (channelName.empty()) {
+        channelName = channelNameFromArn(jsonString(request.body, "ChannelARN"));
+    }
+    if (channelName.empty()) {
+        channelName = channelNameFromArn(jsonString(request.body, "ResourceARN"));
+    }
+
+    if (this->config.latency != 0) {
+        THREAD_SLEEP(this->config.latency);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->channelsMutex);
+        auto it = this->channels.find(channelName);
+
+        if (request.target == "/createSignalingChannel") {
+            if (channelName.empty()) {
+                statusCode = 400;
+                ss << R"({"__type":"InvalidArgumentException","Message":"No channel name"})";
+            } else if (it != this->channels.end()) {
+                statusCode = 400;
+                ss << R"({"__type":"ResourceInUseException","Message":"Channel exists"})";
+            } else {
+                auto& channel = this->channels[channelName];
+                channel.creationTime = GETTIME();
+                channel.arn = STANDIN_CHANNEL_ARN_PREFIX + channelName + "/" + std::to_string(channel.creationTime / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+                ss << R"({"ChannelARN":")" << channel.arn << R"("})";
+                DLOGI("Created channel %s", channelName.c_str());
+            }
+        } else if (it == this->channels.end()) {
+            statusCode = 404;
+            ss << R"({"__type":"ResourceNotFoundException","Message":"Channel not found"})";
+        } else if (request.target == "/describeSignalingChannel") {
+            ss << R"({"ChannelInfo":{"ChannelARN":")" << it->second.arn << R"(","ChannelName":")" << channelName
+               << R"(","ChannelStatus":"ACTIVE","ChannelType":"SINGLE_MASTER","CreationTime":)"
+               << it->second.creationTime / HUNDREDS_OF_NANOS_IN_A_SECOND
+               << R"(,"SingleMasterConfiguration":{"MessageTtlSeconds":60},"Version":"1"}})";
+        } else if (request.target == "/getSignalingChannelEndpoint") {
+            ss << R"({"ResourceEndpointList":[{"Protocol":"HTTPS","ResourceEndpoint":")" << this->endpointUrl("https")
+               << R"("},{"Protocol":"WSS","ResourceEndpoint":")" << this->endpointUrl("wss") << R"("}]})";
+        } else if (request.target == "/v1/get-ice-server-config") {
+            // No TURN, the peers are on the same box
+            ss << R"({"IceServerList":[]})";
+        } else if (request.target == "/deleteSignalingChannel") {
+            // Open connections keep their own references
+            this->channels.erase(it);
+            ss << "{}";
+            DLOGI("Deleted channel %s", channelName.c_str());
+        } else if (request.target == "/tagResource") {
+            ss << "{}";
+        } else {
+            statusCode = 404;
+            ss << R"({"__type":"UnknownOperationException","Message":")" << jsonEscape(request.target) << R"("})";
+        }
+    }
+
+    CHK_STATUS(this->respond(pConnection, statusCode, ss.str()));
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS SignalingStandIn::handleWebSocket(ConnectionPtr pConnection, Request& request)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    BYTE digest[SHA_DIGEST_LENGTH];
+    std::string key = request.headers["sec-websocket-key"] + STANDIN_WEBSOCKET_GUID, protocol = request.headers["sec-websocket-protocol"], message;
+    std::stringstream ss;
+    BOOL registered = FALSE, startStorm = FALSE;
+
+    pConnection->channelName = channelNameFromArn(queryParameter(request.target, "X-Amz-ChannelARN"));
+    pConnection->clientId = queryParameter(request.target, "X-Amz-ClientId");
+    pConnection->isMaster = pConnection->clientId.empty();
+
+    {
+        std::lock_guard<std::mutex> lock(this->channelsMutex);
+        auto it = this->channels.find(pConnection->channelName);
+        if (it != this->channels.end()) {
+            if (pConnection->isMaster) {
+                it->second.master = pConnection;
+                startStorm = !this->stormViewers.empty() && !this->stormStarted.exchange(TRUE);
+            } else {
+                it->second.viewers[pConnection->clientId] = pConnection;
+            }
+            registered = TRUE;
+        }
+    }
+
+    if (!registered) {
+        CHK_STATUS(this->respond(pConnection, 404, R"({"__type":"ResourceNotFoundException","Message":"Channel not found"})"));
+        CHK(FALSE, retStatus);
+    }
+
+    SHA1((const BYTE*) key.data(), key.size(), digest);
+    ss << "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: "
+       << base64Encode(std::string((PCHAR) digest, SIZEOF(digest))) << "\r\n";
+    if (!protocol.empty()) {
+        ss << "Sec-WebSocket-Protocol: " << protocol.substr(0, protocol.find(',')) << "\r\n";
+    }
+    ss << "\r\n";
+    CHK_STATUS(this->writeAll(pConnection, ss.str()));
+    DLOGI("%s connected to channel %s", pConnection->isMaster ? "Master" : pConnection->clientId.c_str(), pConnection->channelName.c_str());
+
+    if (startStorm) {
+        this->stormThread = std::thread(&SignalingStandIn::runStorm, this, pConnection);
+    }
+
+    for (;;) {
+        CHK_STATUS(this->readWebSocketMessage(pConnection, message));
+        CHK_LOG_ERR(this->relay(pConnection, message));
+    }
+
+CleanUp:
+
+    if (registered) {
+        std::lock_guard<std::mutex> lock(this->channelsMutex);
+        auto it = this->channels.find(pConnection->channelName);
+        if (it != this->channels.end()) {
+            if (pConnection->isMaster && it->second.master == pConnection) {
+                it->second.master.reset();
+            } else if (!pConnection->isMaster && it->second.viewers[pConnection->clientId] == pConnection) {
+                it->second.viewers.erase(pConnection->clientId);
+            }
+        }
+        DLOGI("%s disconnected from channel %s", pConnection->isMaster ? "Master" : pConnection->clientId.c_str(), pConnection->channelName.c_str());
+    }
+
+    return retStatus;
+}
+
+// Returns the next text or binary message, answering pings and closes on the way
+STATUS SignalingStandIn::readWebSocketMessage(ConnectionPtr pConnection, std::string& message)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    std::string header, extended, mask, payload;
+    UINT64 length;
+    BYTE opcode;
+    BOOL fin;
+    UINT32 i;
+
+    message.clear();
+    for (;;) {
+        CHK_STATUS(this->readExact(pConnection, 2, header));
+        fin = (header[0] & 0x80) != 0;
+        opcode = header[0] & 0x0f;
+        length = header[1] & 0x7f;
+
+        if (length >= 126) {
+            CHK_STATUS(this->readExact(pConnection, length == 126 ? 2 : 8, extended));
+            for (length = 0, i = 0; i < extended.size(); i++) {
+                length = (length << 8) | (BYTE) extended[i];
+            }
+        }
+        CHK(length + message.size() <= STANDIN_MAX_MESSAGE_SIZE, STATUS_CANARY_STAND_IN_BAD_REQUEST);
+
+        mask.clear();
+        if ((header[1] & 0x80) != 0) {
+            CHK_STATUS(this->readExact(pConnection, 4, mask));
+        }
+        CHK_STATUS(this->readExact(pConnection, (SIZE_T) length, payload));
+        for (i = 0; !mask.empty() && i < payload.size(); i++) {
+            payload[i] ^= mask[i % 4];
+        }
+
+        switch (opcode) {
+            case WEBSOCKET_OPCODE_PING:
+                CHK_STATUS(this->writeWebSocketFrame(pConnection, WEBSOCKET_OPCODE_PONG, payload));
+                break;
+            case WEBSOCKET_OPCODE_PONG:
+                break;
+            case WEBSOCKET_OPCODE_CLOSE:
+                this->writeWebSocketFrame(pConnection, WEBSOCKET_OPCODE_CLOSE, payload);
+                CHK(FALSE, STATUS_CANARY_STAND_IN_CONNECTION_CLOSED);
+                break;
+            case WEBSOCKET_OPCODE_TEXT:
+            case WEBSOCKET_OPCODE_BINARY:
+            case WEBSOCKET_OPCODE_CONTINUATION:
+                message += payload;
+                CHK(!fin, retStatus);
+                break;
+            default:
+                CHK(FALSE, STATUS_CANARY_STAND_IN_BAD_REQUEST);
+        }
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+// Server frames are never masked
+STATUS SignalingStandIn::writeWebSocketFrame(ConnectionPtr pConnection, BYTE opcode, const std::string& payload)
+{
+    std::string frame;
+    INT32 i;
+
+    frame += (CHAR) (0x80 | opcode);
+    if (payload.size() < 126) {
+        frame += (CHAR) payload.size();
+    } else if (payload.size() <= MAX_UINT16) {
+        frame += (CHAR) 126;
+        frame += (CHAR) (payload.size() >> 8);
+        frame += (CHAR) (payload.size() & 0xff);
+    } else {
+        frame += (CHAR) 127;
+        for (i = 7; i >= 0; i--) {
+            frame += (CHAR) (((UINT64) payload.size() >> (8 * i)) & 0xff);
+        }
+    }
+    frame += payload;
+
+    return this->writeAll(pConnection, frame);
+}
+
+VOID SignalingStandIn::deliver(ConnectionPtr pRecipient, const std::string& senderClientId, const std::string& messageType, const std::string& payload)
+{
+    std::stringstream ss;
+
+    ss << R"({"senderClientId":")" << senderClientId << R"(","messageType":")" << messageType << R"(","messagePayload":")" << payload << R"("})";
+    if (STATUS_FAILED(this->writeWebSocketFrame(pRecipient, WEBSOCKET_OPCODE_TEXT, ss.str()))) {
+        DLOGD("Could not deliver %s to a closed connection", messageType.c_str());
+    }
+}
+
+// Viewers only talk to the master. The master addresses a viewer by client id, storm viewers are answered here
+STATUS SignalingStandIn::relay(ConnectionPtr pSender, const std::string& message)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    std::string action = jsonString(message, "action"), recipientClientId = jsonString(message, "RecipientClientId"),
+                payload = jsonString(message, "MessagePayload");
+    ConnectionPtr pRecipient;
+    UINT64 index;
+
+    CHK_WARN(!action.empty(), STATUS_CANARY_STAND_IN_BAD_REQUEST, "Message without an action from %s",
+             pSender->isMaster ? "master" : pSender->clientId.c_str());
+
+    if (this->config.latency != 0) {
+        THREAD_SLEEP(this->config.latency);
+    }
+
+    if (pSender->isMaster && recipientClientId.compare(0, STRLEN(STANDIN_STORM_CLIENT_ID_PREFIX), STANDIN_STORM_CLIENT_ID_PREFIX) == 0) {
+        index = strtoull(recipientClientId.c_str() + STRLEN(STANDIN_STORM_CLIENT_ID_PREFIX), NULL, 10);
+        if (action == "SDP_ANSWER" && index < this->stormViewers.size()) {
+            UINT64 expected = 0;
+            this->stormViewers[index]->answerTime.compare_exchange_strong(expected, GETTIME());
+        }
+        CHK(FALSE, retStatus);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->channelsMutex);
+        auto it = this->channels.find(pSender->channelName);
+        if (it != this->channels.end()) {
+            if (pSender->isMaster) {
+                auto viewer = it->second.viewers.find(recipientClientId);
+                if (viewer != it->second.viewers.end()) {
+                    pRecipient = viewer->second;
+                }
+            } else {
+                pRecipient = it->second.master;
+            }
+        }
+    }
+
+    CHK_WARN(pRecipient != nullptr, retStatus, "No recipient for %s from %s", action.c_str(), pSender->isMaster ? "master" : pSender->clientId.c_str());
+    this->deliver(pRecipient, pSender->isMaster ? "" : pSender->clientId, action, payload);
+
+CleanUp:
+
+    return retStatus;
+}
+
+// Offers go out at the configured rate, each followed by its trickle candidates. Runs once, against the first master
+VOID SignalingStandIn::runStorm(ConnectionPtr pMaster)
+{
+    struct StormEvent {
+        UINT64 time;
+        UINT32 viewer;
+        // -1 for the offer
+        INT32 candidate;
+    };
+    std::vector<StormEvent> events;
+    std::stringstream ss;
+    std::string offerPayload, candidatePayload;
+    UINT64 startTime = GETTIME(), offerTime, deadline, now;
+    UINT32 i, answered;
+    INT32 c;
+
+    ss << R"({"type":"offer","sdp":")" << jsonEscape(this->stormOffer) << R"("})";
+    offerPayload = base64Encode(ss.str());
+
+    for (i = 0; i < this->stormViewers.size(); i++) {
+        offerTime = startTime + (UINT64) (i * HUNDREDS_OF_NANOS_IN_A_SECOND / this->config.stormRate);
+        events.push_back({offerTime, i, -1});
+        for (c = 0; c < (INT32) this->config.stormIceCandidates; c++) {
+            events.push_back({offerTime + (c + 1) * this->config.stormIceInterval, i, c});
+        }
+    }
+    std::stable_sort(events.begin(), events.end(), [](const StormEvent& a, const StormEvent& b) { return a.time < b.time; });
+
+    DLOGI("Storm started, %u viewers", (UINT32) this->stormViewers.size());
+    for (auto& event : events) {
+        if (pMaster->closed) {
+            break;
+        }
+        if ((now = GETTIME()) < event.time) {
+            THREAD_SLEEP(event.time - now);
+        }
+
+        auto& pViewer = this->stormViewers[event.viewer];
+        if (event.candidate < 0) {
+            pViewer->offerTime = GETTIME();
+            this->deliver(pMaster, pViewer->clientId, "SDP_OFFER", offerPayload);
+        } else {
+            ss.str("");
+            ss << R"({"candidate":"candidate:)" << event.candidate << " 1 udp 2130706431 127.0.0.1 " << 40000 + event.viewer % 20000
+               << R"( typ host","sdpMid":"0","sdpMLineIndex":0})";
+            this->deliver(pMaster, pViewer->clientId, "ICE_CANDIDATE", base64Encode(ss.str()));
+        }
+    }
+
+    deadline = GETTIME() + this->config.stormTimeout;
+    do {
+        for (answered = 0, i = 0; i < this->stormViewers.size(); i++) {
+            answered += this->stormViewers[i]->answerTime.load() != 0 ? 1 : 0;
+        }
+        if (answered == this->stormViewers.size()) {
+            break;
+        }
+        THREAD_SLEEP(STANDIN_STORM_POLL_INTERVAL);
+    } while (GETTIME() < deadline && !pMaster->closed);
+
+    this->reportStorm();
+}
+
+VOID SignalingStandIn::reportStorm()
+{
+    std::vector<UINT64> timesToAnswer;
+    UINT32 percentiles[] = {50, 90, 99}, sent = 0;
+    UINT64 offerTime, answerTime;
+
+    for (auto& pViewer : this->stormViewers) {
+        offerTime = pViewer->offerTime.load();
+        answerTime = pViewer->answerTime.load();
+        sent += offerTime != 0 ? 1 : 0;
+        if (offerTime != 0 && answerTime >= offerTime) {
+            timesToAnswer.push_back((answerTime - offerTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+        }
+    }
+    std::sort(timesToAnswer.begin(), timesToAnswer.end());
+
+    DLOGI("Storm: %u offers sent, %u answered", sent, (UINT32) timesToAnswer.size());
+    if (!timesToAnswer.empty()) {
+        for (auto percentile : percentiles) {
+            // Nearest rank
+            DLOGI("Storm time to answer p%u: %" PRIu64 " ms", percentile, timesToAnswer[(percentile * timesToAnswer.size() + 99) / 100 - 1]);
+        }
+        DLOGI("Storm time to answer max: %" PRIu64 " ms", timesToAnswer.back());
+    }
+}
+
+} // namespace Canary
+
+INT32 main(INT32 argc, CHAR* argv[])
+{
+    UNUSED_PARAM(argc);
+    UNUSED_PARAM(argv);
+    STATUS retStatus = STATUS_SUCCESS;
+    Canary::SignalingStandIn::Config config;
+    Canary::SignalingStandIn standIn;
+    UINT64 value;
+
+    SET_LOGGER_LOG_LEVEL(LOG_LEVEL_INFO);
+    // Peers hang up at any time, that is not a reason to exit
+    signal(SIGPIPE, SIG_IGN);
+    SRAND((UINT32) GETTIME());
+
+    CHK_STATUS(Canary::envUint64((PCHAR) STANDIN_PORT_ENV_VAR, STANDIN_DEFAULT_PORT, &value));
+    CHK_ERR(value > 0 && value <= MAX_UINT16, STATUS_INVALID_ARG, "Invalid port %" PRIu64, value);
+    config.port = (UINT16) value;
+    // Nothing is authenticated, so only listen beyond loopback when asked to
+    config.bindAddress = Canary::envString((PCHAR) STANDIN_BIND_ADDRESS_ENV_VAR, STANDIN_DEFAULT_BIND_ADDRESS);
+    config.host = Canary::envString((PCHAR) STANDIN_HOST_ENV_VAR, STANDIN_DEFAULT_HOST);
+    config.certPath = Canary::envString((PCHAR) STANDIN_CERT_ENV_VAR, "");
+    config.keyPath = Canary::envString((PCHAR) STANDIN_KEY_ENV_VAR, "");
+    CHK_STATUS(Canary::envUint64((PCHAR) STANDIN_LATENCY_ENV_VAR, 0, &value));
+    config.latency = value * HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+
+    CHK_STATUS(Canary::envUint64((PCHAR) STANDIN_STORM_VIEWERS_ENV_VAR, 0, &value));
+    config.stormViewers = (UINT32) MIN(value, MAX_UINT32);
+    CHK_STATUS(Canary::envUint64((PCHAR) STANDIN_STORM_RATE_ENV_VAR, STANDIN_DEFAULT_STORM_RATE, &value));
+    CHK_ERR(value > 0, STATUS_INVALID_ARG, "The storm rate has to be positive");
+    config.stormRate = (DOUBLE) value;
+    CHK_STATUS(Canary::envUint64((PCHAR) STANDIN_STORM_ICE_CANDIDATES_ENV_VAR, STANDIN_DEFAULT_STORM_ICE, &value));
+    config.stormIceCandidates = (UINT32) MIN(value, MAX_UINT32);
+    CHK_STATUS(Canary::envUint64((PCHAR) STANDIN_STORM_ICE_INTERVAL_ENV_VAR, STANDIN_DEFAULT_STORM_ICE_INTERVAL, &value));
+    config.stormIceInterval = value * HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+    CHK_STATUS(Canary::envUint64((PCHAR) STANDIN_STORM_TIMEOUT_ENV_VAR, STANDIN_DEFAULT_STORM_TIMEOUT, &value));
+    config.stormTimeout = value * HUNDREDS_OF_NANOS_IN_A_SECOND;
+    config.stormOfferPath = Canary::envString((PCHAR) STANDIN_STORM_OFFER_ENV_VAR, "");
+
+    CHK_STATUS(standIn.init(config));
+    CHK_STATUS(standIn.run());
+
+CleanUp:
+
+    DLOGE("Exiting with status code 0x%08x", retStatus);
+    return STATUS_FAILED(retStatus) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
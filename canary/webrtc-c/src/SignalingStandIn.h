@@ -0,0 +1,115 @@
+#pragma once
+
+#include <openssl/ssl.h>
+
+namespace Canary {
+
+class SignalingStandIn;
+typedef SignalingStandIn* PSignalingStandIn;
+
+/*
+ * Local stand-in for the KVS signaling service: the control plane calls the SDK makes (describe, create, get endpoint,
+ * get ICE config, delete) and the WebSocket connect with message relay between a master and its viewers. Point
+ * CANARY_ENDPOINT at it to benchmark the master's signaling path without the real service in the loop.
+ *
+ * It can also run a storm of synthetic viewers against the first master that connects. Each one sends an SDP offer
+ * at the configured rate followed by trickle ICE candidates, and the time until the master's answer is reported.
+ * Synthetic viewers never complete ICE, for time to first frame run the canary's multi-viewer load mode against it.
+ */
+class SignalingStandIn {
+  public:
+    struct Config {
+        UINT16 port;
+        // IPv4 address the listening socket is bound to
+        std::string bindAddress;
+        // Host the endpoints are advertised on
+        std::string host;
+        // TLS is on when both are set. The SDK only connects over TLS
+        std::string certPath;
+        std::string keyPath;
+        // Added before every control plane response and every relayed message
+        UINT64 latency;
+        UINT32 stormViewers;
+        // Offers per second
+        DOUBLE stormRate;
+        UINT32 stormIceCandidates;
+        UINT64 stormIceInterval;
+        // How long to wait for outstanding answers once every offer went out
+        UINT64 stormTimeout;
+        std::string stormOfferPath;
+    };
+
+    SignalingStandIn();
+    ~SignalingStandIn();
+
+    STATUS init(const Config&);
+    STATUS run();
+
+  private:
+    struct Connection {
+        INT32 socket = -1;
+        SSL* pSsl = nullptr;
+        // An SSL object can't be read and written concurrently, the socket is non blocking and every SSL call holds
+        // sslMutex. writeMutex keeps whole frames from interleaving
+        std::mutex sslMutex;
+        std::mutex writeMutex;
+        std::string buffer;
+        std::string channelName;
+        std::string clientId;
+        BOOL isMaster = FALSE;
+        std::atomic<BOOL> closed;
+
+        Connection() : closed(FALSE)
+        {
+        }
+    };
+    typedef std::shared_ptr<Connection> ConnectionPtr;
+
+    struct Request {
+        std::string method;
+        std::string target;
+        std::map<std::string, std::string> headers;
+        std::string body;
+    };
+
+    struct Channel {
+        std::string arn;
+        UINT64 creationTime;
+        ConnectionPtr master;
+        std::map<std::string, ConnectionPtr> viewers;
+    };
+
+    struct StormViewer {
+        std::string clientId;
+        std::atomic<UINT64> offerTime;
+        std::atomic<UINT64> answerTime;
+    };
+
+    Config config;
+    SSL_CTX* pSslCtx;
+    INT32 listenSocket;
+    std::mutex channelsMutex;
+    std::map<std::string, Channel> channels;
+    std::string stormOffer;
+    std::vector<std::unique_ptr<StormViewer>> stormViewers;
+    std::atomic<BOOL> stormStarted;
+    std::thread stormThread;
+
+    VOID serve(ConnectionPtr);
+    STATUS readRequest(ConnectionPtr, Request&);
+    STATUS readSome(ConnectionPtr);
+    STATUS readExact(ConnectionPtr, SIZE_T, std::string&);
+    STATUS writeAll(ConnectionPtr, const std::string&);
+    STATUS respond(ConnectionPtr, UINT32, const std::string&);
+    STATUS handleControlPlane(ConnectionPtr, Request&);
+    STATUS handleWebSocket(ConnectionPtr, Request&);
+    STATUS readWebSocketMessage(ConnectionPtr, std::string&);
+    STATUS writeWebSocketFrame(ConnectionPtr, BYTE, const std::string&);
+    STATUS relay(ConnectionPtr, const std::string&);
+    VOID deliver(ConnectionPtr, const std::string&, const std::string&, const std::string&);
+    VOID runStorm(ConnectionPtr);
+    VOID reportStorm();
+    std::string endpointUrl(const std::string&);
+};
+
+} // namespace Canary
@@ -75,145 +75,198 @@ VOID onDataChannel(UINT64 customData, PRtcDataChannel pRtcDataChannel)
 
 /******************************* CANARY FUNCTIONS *******************************/
 
-STATUS populateOutgoingRtpMetricsContext(PSampleStreamingSession pSampleStreamingSession)
+// Reads the raw counters of one session. Runs with sessionCoummunalLock held so the session can't be freed underneath
+static VOID snapshotRtcStats(PSampleStreamingSession pSampleStreamingSession, PRtcStatsSnapshot pSnapshot)
 {
-    DLOGD("[Canary] populateOutgoingRtpMetricsContext(...) invoked");
+    RtcStats rtcStats;
+
+    MEMSET(pSnapshot, 0x00, SIZEOF(RtcStatsSnapshot));
+    pSnapshot->pSampleStreamingSession = pSampleStreamingSession;
+    pSnapshot->offerReceiveTime = pSampleStreamingSession->offerReceiveTime;
+    pSnapshot->connectedTime = pSampleStreamingSession->connectedTime;
+    STRCPY(pSnapshot->peerId, pSampleStreamingSession->peerId);
+
+    rtcStats.requestedTypeOfStats = RTC_STATS_TYPE_OUTBOUND_RTP;
+    if (pSampleStreamingSession->pVideoRtcRtpTransceiver != NULL &&
+        STATUS_SUCCEEDED(rtcPeerConnectionGetMetrics(pSampleStreamingSession->pPeerConnection, pSampleStreamingSession->pVideoRtcRtpTransceiver,
+                                                     &rtcStats))) {
+        pSnapshot->outboundRtp.valid = TRUE;
+        pSnapshot->outboundRtp.timestamp = rtcStats.timestamp;
+        pSnapshot->outboundRtp.framesSent = rtcStats.rtcStatsObject.outboundRtpStreamStats.framesSent;
+        pSnapshot->outboundRtp.framesDiscardedOnSend = rtcStats.rtcStatsObject.outboundRtpStreamStats.framesDiscardedOnSend;
+        pSnapshot->outboundRtp.nackCount = rtcStats.rtcStatsObject.outboundRtpStreamStats.nackCount;
+        pSnapshot->outboundRtp.retransmittedBytesSent = rtcStats.rtcStatsObject.outboundRtpStreamStats.retransmittedBytesSent;
+        pSnapshot->outboundRtp.pliCount = rtcStats.rtcStatsObject.outboundRtpStreamStats.pliCount;
+
+        // Only taken along with the RTP counters, otherwise they keep adding up for the next snapshot
+        std::lock_guard<std::mutex> lock(pSampleStreamingSession->countUpdateMutex);
+        pSnapshot->outboundRtp.videoFramesGenerated = pSampleStreamingSession->canaryOutgoingRTPMetricsContext.videoFramesGenerated;
+        pSnapshot->outboundRtp.videoBytesGenerated = pSampleStreamingSession->canaryOutgoingRTPMetricsContext.videoBytesGenerated;
+        pSampleStreamingSession->canaryOutgoingRTPMetricsContext.videoFramesGenerated = 0;
+        pSampleStreamingSession->canaryOutgoingRTPMetricsContext.videoBytesGenerated = 0;
+    }
 
-    DOUBLE currentDuration = 0;
+    rtcStats.requestedTypeOfStats = RTC_STATS_TYPE_CANDIDATE_PAIR;
+    if (STATUS_SUCCEEDED(rtcPeerConnectionGetMetrics(pSampleStreamingSession->pPeerConnection, NULL, &rtcStats))) {
+        pSnapshot->candidatePair.valid = TRUE;
+        pSnapshot->candidatePair.timestamp = rtcStats.timestamp;
+        pSnapshot->candidatePair.packetsSent = rtcStats.rtcStatsObject.iceCandidatePairStats.packetsSent;
+        pSnapshot->candidatePair.packetsReceived = rtcStats.rtcStatsObject.iceCandidatePairStats.packetsReceived;
+        pSnapshot->candidatePair.bytesSent = rtcStats.rtcStatsObject.iceCandidatePairStats.bytesSent;
+        pSnapshot->candidatePair.currentRoundTripTime = rtcStats.rtcStatsObject.iceCandidatePairStats.currentRoundTripTime;
+    }
+}
 
-    currentDuration = (DOUBLE)(pSampleStreamingSession->canaryMetrics.timestamp - pSampleStreamingSession->canaryOutgoingRTPMetricsContext.prevTs) / HUNDREDS_OF_NANOS_IN_A_SECOND;
-    {
-        std::lock_guard<std::mutex> lock(pSampleStreamingSession->countUpdateMutex);
-        pSampleStreamingSession->canaryOutgoingRTPMetricsContext.framesPercentageDiscarded =
-            ((DOUBLE)(pSampleStreamingSession->canaryMetrics.rtcStatsObject.outboundRtpStreamStats.framesDiscardedOnSend -
-                      pSampleStreamingSession->canaryOutgoingRTPMetricsContext.prevFramesDiscardedOnSend) /
-             (DOUBLE) pSampleStreamingSession->canaryOutgoingRTPMetricsContext.videoFramesGenerated) *
-            100.0;
-        pSampleStreamingSession->canaryOutgoingRTPMetricsContext.retxBytesPercentage =
-            (((DOUBLE) pSampleStreamingSession->canaryMetrics.rtcStatsObject.outboundRtpStreamStats.retransmittedBytesSent -
-              (DOUBLE)(pSampleStreamingSession->canaryOutgoingRTPMetricsContext.prevRetxBytesSent)) /
-             (DOUBLE) pSampleStreamingSession->canaryOutgoingRTPMetricsContext.videoBytesGenerated) *
-            100.0;
-    }
-
-    // This flag ensures the reset of video bytes count is done only when this flag is set
-    pSampleStreamingSession->recorded = TRUE;
-    pSampleStreamingSession->canaryOutgoingRTPMetricsContext.averageFramesSentPerSecond =
-        ((DOUBLE)(pSampleStreamingSession->canaryMetrics.rtcStatsObject.outboundRtpStreamStats.framesSent -
-                  (DOUBLE) pSampleStreamingSession->canaryOutgoingRTPMetricsContext.prevFramesSent)) /
-        currentDuration;
-    pSampleStreamingSession->canaryOutgoingRTPMetricsContext.nacksPerSecond =
-        ((DOUBLE) pSampleStreamingSession->canaryMetrics.rtcStatsObject.outboundRtpStreamStats.nackCount - pSampleStreamingSession->canaryOutgoingRTPMetricsContext.prevNackCount) /
-        currentDuration;
-    pSampleStreamingSession->canaryOutgoingRTPMetricsContext.prevFramesSent = pSampleStreamingSession->canaryMetrics.rtcStatsObject.outboundRtpStreamStats.framesSent;
-    pSampleStreamingSession->canaryOutgoingRTPMetricsContext.prevTs = pSampleStreamingSession->canaryMetrics.timestamp;
-    pSampleStreamingSession->canaryOutgoingRTPMetricsContext.prevFramesDiscardedOnSend = pSampleStreamingSession->canaryMetrics.rtcStatsObject.outboundRtpStreamStats.framesDiscardedOnSend;
-    pSampleStreamingSession->canaryOutgoingRTPMetricsContext.prevNackCount = pSampleStreamingSession->canaryMetrics.rtcStatsObject.outboundRtpStreamStats.nackCount;
-    pSampleStreamingSession->canaryOutgoingRTPMetricsContext.prevRetxBytesSent = pSampleStreamingSession->canaryMetrics.rtcStatsObject.outboundRtpStreamStats.retransmittedBytesSent;
-    pSampleStreamingSession->canaryOutgoingRTPMetricsContext.prevPliCount = pSampleStreamingSession->canaryMetrics.rtcStatsObject.outboundRtpStreamStats.pliCount;
+// Previous snapshot of the same session. A session sampled for the first time is measured from when it connected
+static VOID getPreviousRtcStatsSnapshot(PRtcStatsSampler pSampler, PRtcStatsSnapshot pSnapshot, PRtcStatsSnapshot pPrevious)
+{
+    PRtcStatsSnapshot pCandidate;
+    UINT32 i;
 
-    return STATUS_SUCCESS;
+    for (i = 0; i < pSampler->snapshotCount[pSampler->current]; i++) {
+        pCandidate = &pSampler->snapshots[pSampler->current][i];
+        if (pCandidate->pSampleStreamingSession == pSnapshot->pSampleStreamingSession &&
+            pCandidate->offerReceiveTime == pSnapshot->offerReceiveTime) {
+            *pPrevious = *pCandidate;
+            return;
+        }
+    }
+
+    MEMSET(pPrevious, 0x00, SIZEOF(RtcStatsSnapshot));
+    pPrevious->outboundRtp.valid = TRUE;
+    pPrevious->outboundRtp.timestamp = pSnapshot->connectedTime;
+    pPrevious->candidatePair.valid = TRUE;
+    pPrevious->candidatePair.timestamp = pSnapshot->connectedTime;
 }
 
-STATUS canaryRtpOutboundStats(UINT32 timerId, UINT64 currentTime, UINT64 customData)
+static VOID addRtcStatsDatum(Aws::Vector<MetricDatum>& data, const CHAR* name, DOUBLE value, Aws::CloudWatch::Model::StandardUnit unit)
 {
-    DLOGD("[Canary] canaryRtpOutboundStats(...) invoked");
-    UNUSED_PARAM(timerId);
-    UNUSED_PARAM(currentTime);
-    STATUS retStatus = STATUS_SUCCESS;
+    MetricDatum datum;
 
-    PSampleStreamingSession pSampleStreamingSession = (PSampleStreamingSession) customData;
-    PSampleConfiguration pSampleConfiguration;
-    BOOL sampleConfigurationObjLockLocked = FALSE;
-    BOOL sessionCoummunalLockLocked = FALSE;
+    datum.SetMetricName(name);
+    datum.SetValue(value);
+    datum.SetUnit(unit);
+    data.push_back(datum);
+}
 
-    if (!MUTEX_TRYLOCK(sessionCoummunalLock)) {
-        return retStatus;
+// Turns two snapshots into rates. Counters that couldn't be read this time are carried over from the previous
+// snapshot, so the next interval is measured from the last good read instead of being lost
+static VOID computeRtcStatsMetrics(PRtcStatsSnapshot pPrevious, PRtcStatsSnapshot pSnapshot, Aws::Vector<MetricDatum>& data)
+{
+    POutboundRtpSnapshot pOutbound = &pSnapshot->outboundRtp, pPrevOutbound = &pPrevious->outboundRtp;
+    PCandidatePairSnapshot pPair = &pSnapshot->candidatePair, pPrevPair = &pPrevious->candidatePair;
+    DOUBLE duration, framesPerSecond = 0.0, nacksPerSecond = 0.0, pliPerSecond = 0.0, framesDiscarded = 0.0, retxBytes = 0.0;
+    DOUBLE rttMs = 0.0, packetsSentPerSecond = 0.0, packetsReceivedPerSecond = 0.0, outgoingBitrate = 0.0;
+
+    if (!pOutbound->valid) {
+        *pOutbound = *pPrevOutbound;
+    } else if (pPrevOutbound->valid && pOutbound->timestamp > pPrevOutbound->timestamp) {
+        duration = (DOUBLE) (pOutbound->timestamp - pPrevOutbound->timestamp) / HUNDREDS_OF_NANOS_IN_A_SECOND;
+        framesPerSecond = (DOUBLE) (pOutbound->framesSent - pPrevOutbound->framesSent) / duration;
+        nacksPerSecond = (DOUBLE) (pOutbound->nackCount - pPrevOutbound->nackCount) / duration;
+        pliPerSecond = (DOUBLE) (pOutbound->pliCount - pPrevOutbound->pliCount) / duration;
+        addRtcStatsDatum(data, "FramesPerSecond", framesPerSecond, Aws::CloudWatch::Model::StandardUnit::Count_Second);
+        addRtcStatsDatum(data, "NackPerSecond", nacksPerSecond, Aws::CloudWatch::Model::StandardUnit::Count_Second);
+        addRtcStatsDatum(data, "PliCountPerSecond", pliPerSecond, Aws::CloudWatch::Model::StandardUnit::Count_Second);
+
+        // Nothing to relate the discards and retransmissions to until the media loop has written a frame
+        if (pOutbound->videoFramesGenerated != 0) {
+            framesDiscarded = (DOUBLE) (pOutbound->framesDiscardedOnSend - pPrevOutbound->framesDiscardedOnSend) /
+                (DOUBLE) pOutbound->videoFramesGenerated * 100.0;
+            addRtcStatsDatum(data, "PercentageFrameDiscarded", framesDiscarded, Aws::CloudWatch::Model::StandardUnit::Percent);
+        }
+        if (pOutbound->videoBytesGenerated != 0) {
+            retxBytes = (DOUBLE) (pOutbound->retransmittedBytesSent - pPrevOutbound->retransmittedBytesSent) /
+                (DOUBLE) pOutbound->videoBytesGenerated * 100.0;
+            addRtcStatsDatum(data, "PercentageFramesRetransmitted", retxBytes, Aws::CloudWatch::Model::StandardUnit::Percent);
+        }
+    }
+
+    if (!pPair->valid) {
+        *pPair = *pPrevPair;
     } else {
-        sessionCoummunalLockLocked = TRUE;
+        rttMs = pPair->currentRoundTripTime * 1000.0;
+        addRtcStatsDatum(data, "RoundTripTime", rttMs, Aws::CloudWatch::Model::StandardUnit::Milliseconds);
+        if (pPrevPair->valid && pPair->timestamp > pPrevPair->timestamp) {
+            duration = (DOUBLE) (pPair->timestamp - pPrevPair->timestamp) / HUNDREDS_OF_NANOS_IN_A_SECOND;
+            packetsSentPerSecond = (DOUBLE) (pPair->packetsSent - pPrevPair->packetsSent) / duration;
+            packetsReceivedPerSecond = (DOUBLE) (pPair->packetsReceived - pPrevPair->packetsReceived) / duration;
+            outgoingBitrate = (DOUBLE) (pPair->bytesSent - pPrevPair->bytesSent) * 8.0 / duration / 1000.0;
+            addRtcStatsDatum(data, "PacketsSentPerSecond", packetsSentPerSecond, Aws::CloudWatch::Model::StandardUnit::Count_Second);
+            addRtcStatsDatum(data, "PacketsReceivedPerSecond", packetsReceivedPerSecond, Aws::CloudWatch::Model::StandardUnit::Count_Second);
+            addRtcStatsDatum(data, "OutgoingBitrate", outgoingBitrate, Aws::CloudWatch::Model::StandardUnit::Kilobits_Second);
+        }
     }
 
-    CHK(pSampleStreamingSession != NULL, STATUS_NULL_ARG);
-    CHK(!ATOMIC_LOAD_BOOL(&pSampleStreamingSession->terminateFlag), retStatus);
+    DLOGI("[Canary] Session %s: %.1f fps, %.2f%% discarded, %.2f%% retransmitted, %.2f nack/s, %.2f pli/s, rtt %.1f ms, "
+          "%.1f pkts/s out, %.1f pkts/s in, %.1f kbps out",
+          pSnapshot->peerId, framesPerSecond, framesDiscarded, retxBytes, nacksPerSecond, pliPerSecond, rttMs, packetsSentPerSecond,
+          packetsReceivedPerSecond, outgoingBitrate);
+}
 
-    pSampleConfiguration = pSampleStreamingSession->pSampleConfiguration;
-    CHK(pSampleConfiguration != NULL, STATUS_NULL_ARG);
+// Single timer for the RTC stats of every session. Counters are copied into one half of the sampler's double buffer
+// under sessionCoummunalLock, then the rates are computed against the other half and published with the lock released
+STATUS sampleRtcStatsCallback(UINT32 timerId, UINT64 currentTime, UINT64 customData)
+{
+    UNUSED_PARAM(timerId);
+    UNUSED_PARAM(currentTime);
+    STATUS retStatus = STATUS_SUCCESS;
+    PSampleConfiguration pSampleConfiguration = (PSampleConfiguration) customData;
+    PRtcStatsSampler pSampler;
+    PSampleStreamingSession sessions[DEFAULT_MAX_CONCURRENT_STREAMING_SESSION];
+    RtcStatsSnapshot previous;
+    Aws::Vector<MetricDatum> data;
+    UINT32 i, sessionCount, next;
+    BOOL locked = FALSE;
+
+    CHK_WARN(pSampleConfiguration != NULL, STATUS_NULL_ARG, "[KVS Master] sampleRtcStatsCallback(): Passed argument is NULL");
     CHK(!ATOMIC_LOAD_BOOL(&pSampleConfiguration->appTerminateFlag), retStatus);
+    pSampler = &pSampleConfiguration->statsSampler;
 
-    // Use MUTEX_TRYLOCK to avoid possible dead lock when canceling timerQueue
-    if (!MUTEX_TRYLOCK(pSampleConfiguration->sampleConfigurationObjLock)) {
-        if (sessionCoummunalLockLocked) {
-            MUTEX_UNLOCK(sessionCoummunalLock);
-        }
-        return retStatus;
-    } else {
-        sampleConfigurationObjLockLocked = TRUE;
+    // Use MUTEX_TRYLOCK to avoid possible dead lock when canceling timerQueue. Losing the race drops nothing, the
+    // counters keep going and the next tick's deltas span both intervals
+    if (!MUTEX_TRYLOCK(sessionCoummunalLock)) {
+        pSampler->skippedTicks++;
+        CHK(FALSE, retStatus);
     }
+    locked = TRUE;
 
-    if(!ATOMIC_LOAD_BOOL(&pSampleStreamingSession->terminateFlag) && !ATOMIC_LOAD_BOOL(&pSampleConfiguration->appTerminateFlag)) {
-        if (pSampleStreamingSession->pVideoRtcRtpTransceiver) {
-                pSampleStreamingSession->canaryMetrics.requestedTypeOfStats = RTC_STATS_TYPE_OUTBOUND_RTP;
-                CHK_LOG_ERR(rtcPeerConnectionGetMetrics(pSampleStreamingSession->pPeerConnection, pSampleStreamingSession->pVideoRtcRtpTransceiver, &(pSampleStreamingSession->canaryMetrics)));
+    // Sessions are only freed under sessionCoummunalLock, the list lock is just needed to copy the pointers
+    MUTEX_LOCK(pSampleConfiguration->streamingSessionListReadLock);
+    sessionCount = pSampleConfiguration->streamingSessionCount;
+    MEMCPY(sessions, pSampleConfiguration->sampleStreamingSessionList, sessionCount * SIZEOF(PSampleStreamingSession));
+    MUTEX_UNLOCK(pSampleConfiguration->streamingSessionListReadLock);
+
+    next = pSampler->current ^ 1;
+    pSampler->snapshotCount[next] = 0;
+    for (i = 0; i < sessionCount; i++) {
+        if (!ATOMIC_LOAD_BOOL(&sessions[i]->terminateFlag) && sessions[i]->connectedTime != 0) {
+            snapshotRtcStats(sessions[i], &pSampler->snapshots[next][pSampler->snapshotCount[next]++]);
+        }
+    }
 
-                // Compute PLI rate before populateOutgoingRtpMetricsContext updates prev values
-                DOUBLE pliDuration = (DOUBLE)(pSampleStreamingSession->canaryMetrics.timestamp - pSampleStreamingSession->canaryOutgoingRTPMetricsContext.prevTs) / HUNDREDS_OF_NANOS_IN_A_SECOND;
-                if (pliDuration > 0) {
-                    DOUBLE pliPerSecond = ((DOUBLE) pSampleStreamingSession->canaryMetrics.rtcStatsObject.outboundRtpStreamStats.pliCount -
-                                           pSampleStreamingSession->canaryOutgoingRTPMetricsContext.prevPliCount) / pliDuration;
-                    Canary::Cloudwatch::getInstance().monitoring.pushPliCountPerSecond(pliPerSecond);
-                }
+    MUTEX_UNLOCK(sessionCoummunalLock);
+    locked = FALSE;
 
-                populateOutgoingRtpMetricsContext(pSampleStreamingSession);
-                Canary::POutgoingRTPMetricsContext pCanaryOutgoingRTPMetricsContext = reinterpret_cast<Canary::POutgoingRTPMetricsContext>(&(pSampleStreamingSession->canaryOutgoingRTPMetricsContext));
-                Canary::Cloudwatch::getInstance().monitoring.pushOutboundRtpStats(pCanaryOutgoingRTPMetricsContext);
-            }
+    for (i = 0; i < pSampler->snapshotCount[next]; i++) {
+        getPreviousRtcStatsSnapshot(pSampler, &pSampler->snapshots[next][i], &previous);
+        computeRtcStatsMetrics(&previous, &pSampler->snapshots[next][i], data);
+    }
+    pSampler->current = next;
 
-        // Extract RTT, packets sent/received rate, and bitrate from ICE candidate pair stats
-        {
-            RtcStats rtcCandidatePairMetrics;
-            rtcCandidatePairMetrics.requestedTypeOfStats = RTC_STATS_TYPE_CANDIDATE_PAIR;
-            if (STATUS_SUCCEEDED(rtcPeerConnectionGetMetrics(pSampleStreamingSession->pPeerConnection, NULL, &rtcCandidatePairMetrics))) {
-                DOUBLE rttMs = rtcCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.currentRoundTripTime * 1000.0;
-                DLOGD("[Canary] RoundTripTime: %lf ms", rttMs);
-                Canary::Cloudwatch::getInstance().monitoring.pushRoundTripTime(rttMs, Aws::CloudWatch::Model::StandardUnit::Milliseconds);
-
-                DOUBLE duration = (DOUBLE)(rtcCandidatePairMetrics.timestamp - pSampleStreamingSession->rtcMetricsHistory.prevTs) / HUNDREDS_OF_NANOS_IN_A_SECOND;
-                if (duration > 0) {
-                    DOUBLE pktsSentPerSec = (DOUBLE)(rtcCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.packetsSent -
-                                                     pSampleStreamingSession->rtcMetricsHistory.prevNumberOfPacketsSent) / duration;
-                    DOUBLE pktsRecvPerSec = (DOUBLE)(rtcCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.packetsReceived -
-                                                     pSampleStreamingSession->rtcMetricsHistory.prevNumberOfPacketsReceived) / duration;
-                    DOUBLE outBitrateKbps = ((DOUBLE)(rtcCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.bytesSent -
-                                                      pSampleStreamingSession->rtcMetricsHistory.prevNumberOfBytesSent) * 8.0) / duration / 1000.0;
-
-                    Canary::Cloudwatch::getInstance().monitoring.pushPacketsSentPerSecond(pktsSentPerSec);
-                    Canary::Cloudwatch::getInstance().monitoring.pushPacketsReceivedPerSecond(pktsRecvPerSec);
-                    Canary::Cloudwatch::getInstance().monitoring.pushOutgoingBitrate(outBitrateKbps);
-
-                    // Update prev values for next interval
-                    pSampleStreamingSession->rtcMetricsHistory.prevTs = rtcCandidatePairMetrics.timestamp;
-                    pSampleStreamingSession->rtcMetricsHistory.prevNumberOfPacketsSent =
-                        rtcCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.packetsSent;
-                    pSampleStreamingSession->rtcMetricsHistory.prevNumberOfPacketsReceived =
-                        rtcCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.packetsReceived;
-                    pSampleStreamingSession->rtcMetricsHistory.prevNumberOfBytesSent =
-                        rtcCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.bytesSent;
-                    pSampleStreamingSession->rtcMetricsHistory.prevNumberOfBytesReceived =
-                        rtcCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.bytesReceived;
-                }
-            }
-        }
-    } else {
-        retStatus = STATUS_TIMER_QUEUE_STOP_SCHEDULING;
+    if (!data.empty()) {
+        Canary::Cloudwatch::getInstance().monitoring.pushBatch(data);
+    }
+    if (pSampler->skippedTicks != 0) {
+        DLOGI("[Canary] Stats sampler has skipped %" PRIu64 " ticks while sessions were being freed", pSampler->skippedTicks);
     }
 
 CleanUp:
-    if (sampleConfigurationObjLockLocked) {
-        MUTEX_UNLOCK(pSampleConfiguration->sampleConfigurationObjLock);
-    }
-    if (sessionCoummunalLockLocked) {
+
+    if (locked) {
         MUTEX_UNLOCK(sessionCoummunalLock);
     }
+
     return retStatus;
 }
 
@@ -334,10 +387,6 @@ STATUS initMetricsTimers(PSampleStreamingSession pSampleStreamingSession)
     pSampleStreamingSession->pushProfilingThread = std::thread(sendProfilingMetricsThread, pSampleStreamingSession);
     pSampleStreamingSession->pushProfilingThread.join();
 
-    CHK_STATUS(timerQueueAddTimer(pSampleConfiguration->timerQueueHandle, METRICS_INVOCATION_PERIOD, METRICS_INVOCATION_PERIOD, canaryRtpOutboundStats, (UINT64) pSampleStreamingSession,
-                                      &pSampleStreamingSession->metricsTimerId));
-    DLOGD("[Canary] Added metricsTimer");
-
     CHK_STATUS(timerQueueAddTimer(pSampleConfiguration->timerQueueHandle, STREAMING_AVAILABILITY_PERIOD, STREAMING_AVAILABILITY_PERIOD,
                                       canaryMasterStreamingAvailability, (UINT64) pSampleStreamingSession,
                                       &pSampleStreamingSession->streamingAvailabilityTimerId));
@@ -383,12 +432,8 @@ VOID onConnectionStateChange(UINT64 customData, RTC_PEER_CONNECTION_STATE newSta
                 Canary::Cloudwatch::getInstance().monitoring.pushJoinSSCallToSessionJoined(joinSSCallToSessionJoined, Aws::CloudWatch::Model::StandardUnit::Milliseconds);
             }
             
-            pSampleStreamingSession->canaryOutgoingRTPMetricsContext.prevTs = GETTIME();
-            pSampleStreamingSession->canaryOutgoingRTPMetricsContext.prevFramesDiscardedOnSend = 0;
-            pSampleStreamingSession->canaryOutgoingRTPMetricsContext.prevNackCount = 0;
-            pSampleStreamingSession->canaryOutgoingRTPMetricsContext.prevRetxBytesSent = 0;
-            pSampleStreamingSession->canaryOutgoingRTPMetricsContext.prevPliCount = 0;
-            pSampleStreamingSession->canaryOutgoingRTPMetricsContext.prevFramesSent = 0;
+            // The stats sampler measures the first interval of the session from here
+            pSampleStreamingSession->connectedTime = GETTIME();
             CHK_STATUS(initMetricsTimers(pSampleStreamingSession));
             break;
         case RTC_PEER_CONNECTION_STATE_FAILED:
@@ -889,14 +934,19 @@ STATUS createSampleStreamingSession(PSampleConfiguration pSampleConfiguration, P
     pSampleStreamingSession->pVideoRtcRtpTransceiver = NULL;
 
     pSampleStreamingSession->pSampleConfiguration = pSampleConfiguration;
-    pSampleStreamingSession->rtcMetricsHistory.prevTs = GETTIME();
 
     pSampleStreamingSession->peerConnectionMetrics.version = PEER_CONNECTION_METRICS_CURRENT_VERSION;
     pSampleStreamingSession->iceMetrics.version = ICE_AGENT_METRICS_CURRENT_VERSION;
 
-    pSampleStreamingSession->metricsTimerId = MAX_UINT32;
     pSampleStreamingSession->streamingAvailabilityTimerId = MAX_UINT32;
 
+    // Start from the top rendition and let the bandwidth estimate bring it down
+    if (pSampleConfiguration->videoRenditionCount > 0) {
+        pSampleStreamingSession->videoRendition = pSampleConfiguration->videoRenditionCount - 1;
+        pSampleStreamingSession->targetVideoRendition = pSampleStreamingSession->videoRendition;
+        pSampleStreamingSession->estimatedBitrateKbps = (DOUBLE) pSampleConfiguration->videoRenditionBitrates[pSampleStreamingSession->videoRendition];
+    }
+
     ATOMIC_STORE_BOOL(&pSampleStreamingSession->firstIceSent, FALSE);
     ATOMIC_STORE_BOOL(&pSampleStreamingSession->firstIceReceived, FALSE);
 
@@ -992,17 +1042,11 @@ STATUS freeSampleStreamingSession(PSampleStreamingSession* ppSampleStreamingSess
     // the running thread but it's OK as it's re-entrant
     MUTEX_LOCK(pSampleConfiguration->sampleConfigurationObjLock);
 
-    if (pSampleConfiguration->iceCandidatePairStatsTimerId != MAX_UINT32 && pSampleConfiguration->streamingSessionCount == 0 &&
+    if (pSampleConfiguration->statsSamplerTimerId != MAX_UINT32 && pSampleConfiguration->streamingSessionCount == 0 &&
         IS_VALID_TIMER_QUEUE_HANDLE(pSampleConfiguration->timerQueueHandle)) {
-        CHK_LOG_ERR(timerQueueCancelTimer(pSampleConfiguration->timerQueueHandle, pSampleConfiguration->iceCandidatePairStatsTimerId,
+        CHK_LOG_ERR(timerQueueCancelTimer(pSampleConfiguration->timerQueueHandle, pSampleConfiguration->statsSamplerTimerId,
                                           (UINT64) pSampleConfiguration));
-        pSampleConfiguration->iceCandidatePairStatsTimerId = MAX_UINT32;
-    }
-
-    // Free the metrics timer, make new one for each session (therefore making a new one for each 60min storage session).
-    if (pSampleStreamingSession->metricsTimerId != MAX_UINT32 && IS_VALID_TIMER_QUEUE_HANDLE(pSampleConfiguration->timerQueueHandle)) {
-        CHK_LOG_ERR(timerQueueCancelTimer(pSampleConfiguration->timerQueueHandle, pSampleStreamingSession->metricsTimerId,
-                                          (UINT64) pSampleStreamingSession));
+        pSampleConfiguration->statsSamplerTimerId = MAX_UINT32;
     }
 
     // Free the streaming availability timer
@@ -1066,27 +1110,74 @@ VOID sampleBandwidthEstimationHandler(UINT64 customData, DOUBLE maximumBitrate)
     DLOGV("received bitrate suggestion: %f", maximumBitrate);
 }
 
+// Picks the rendition the video loop should move to from the current estimate, with hysteresis
+static VOID updateTargetVideoRendition(PSampleStreamingSession pSampleStreamingSession, UINT64 now)
+{
+    PSampleConfiguration pSampleConfiguration = pSampleStreamingSession->pSampleConfiguration;
+    PUINT64 pBitrates = pSampleConfiguration->videoRenditionBitrates;
+    DOUBLE estimate = pSampleStreamingSession->estimatedBitrateKbps;
+    SIZE_T current = ATOMIC_LOAD(&pSampleStreamingSession->targetVideoRendition), target = current;
+
+    // Down right away, to the highest rendition the estimate still covers
+    while (target > 0 && estimate < (DOUBLE) pBitrates[target]) {
+        target--;
+    }
+
+    if (target == current && current + 1 < pSampleConfiguration->videoRenditionCount &&
+        estimate >= (DOUBLE) pBitrates[current + 1] * SAMPLE_RENDITION_UP_SWITCH_MARGIN) {
+        if (pSampleStreamingSession->upSwitchCandidateTime == 0) {
+            pSampleStreamingSession->upSwitchCandidateTime = now;
+        } else if (now - pSampleStreamingSession->upSwitchCandidateTime >= SAMPLE_RENDITION_UP_SWITCH_HOLD) {
+            target = current + 1;
+        }
+    } else {
+        pSampleStreamingSession->upSwitchCandidateTime = 0;
+    }
+
+    if (target != current) {
+        pSampleStreamingSession->upSwitchCandidateTime = 0;
+        ATOMIC_STORE(&pSampleStreamingSession->targetVideoRenditionTime, (SIZE_T) now);
+        ATOMIC_STORE(&pSampleStreamingSession->targetVideoRendition, target);
+        DLOGI("[Canary] Session %s: estimate %.0f kbps, moving to the %" PRIu64 " kbps rendition at the next key frame", pSampleStreamingSession->peerId,
+              estimate, pBitrates[target]);
+    }
+}
+
 VOID sampleSenderBandwidthEstimationHandler(UINT64 customData, UINT32 txBytes, UINT32 rxBytes, UINT32 txPacketsCnt, UINT32 rxPacketsCnt,
                                             UINT64 duration)
 {
-    UNUSED_PARAM(customData);
-    UNUSED_PARAM(duration);
-    UNUSED_PARAM(rxBytes);
-    UNUSED_PARAM(txBytes);
-    UINT32 lostPacketsCnt = txPacketsCnt - rxPacketsCnt;
-    UINT32 percentLost = lostPacketsCnt * 100 / txPacketsCnt;
-    UINT32 bitrate = 1024;
+    PSampleStreamingSession pSampleStreamingSession = (PSampleStreamingSession) customData;
+    PSampleConfiguration pSampleConfiguration;
+    UINT32 lostPacketsCnt = txPacketsCnt > rxPacketsCnt ? txPacketsCnt - rxPacketsCnt : 0;
+    UINT32 percentLost = txPacketsCnt == 0 ? 0 : lostPacketsCnt * 100 / txPacketsCnt;
+    DOUBLE bitrate;
+
+    if (pSampleStreamingSession == NULL || ATOMIC_LOAD_BOOL(&pSampleStreamingSession->terminateFlag)) {
+        return;
+    }
+    pSampleConfiguration = pSampleStreamingSession->pSampleConfiguration;
+
+    bitrate = pSampleStreamingSession->estimatedBitrateKbps;
     if (percentLost < 2) {
         // increase encoder bitrate by 2 percent
-        bitrate *= 1.02f;
+        bitrate *= 1.02;
     } else if (percentLost > 5) {
         // decrease encoder bitrate by packet loss percent
-        bitrate *= (1.0f - percentLost / 100.0f);
+        bitrate *= (1.0 - percentLost / 100.0);
     }
     // otherwise keep bitrate the same
 
-    DLOGS("received sender bitrate estimation: suggested bitrate %u sent: %u bytes %u packets received: %u bytes %u packets in %lu msec, ", bitrate,
+    DLOGS("received sender bitrate estimation: suggested bitrate %.0f kbps sent: %u bytes %u packets received: %u bytes %u packets in %lu msec, ", bitrate,
           txBytes, txPacketsCnt, rxBytes, rxPacketsCnt, duration / 10000ULL);
+
+    // Keep the estimate within reach of the ladder so it can neither run away above the top rendition nor sink to zero
+    if (pSampleConfiguration->videoRenditionCount > 1) {
+        bitrate = MAX(bitrate, (DOUBLE) pSampleConfiguration->videoRenditionBitrates[0] / SAMPLE_RENDITION_ESTIMATE_HEADROOM);
+        bitrate = MIN(bitrate,
+                      (DOUBLE) pSampleConfiguration->videoRenditionBitrates[pSampleConfiguration->videoRenditionCount - 1] * SAMPLE_RENDITION_ESTIMATE_HEADROOM);
+        pSampleStreamingSession->estimatedBitrateKbps = bitrate;
+        updateTargetVideoRendition(pSampleStreamingSession, GETTIME());
+    }
 }
 
 STATUS handleRemoteCandidate(PSampleStreamingSession pSampleStreamingSession, PSignalingMessage pSignalingMessage)
@@ -1254,7 +1345,7 @@ STATUS createSampleConfiguration(PCHAR channelName, SIGNALING_CHANNEL_ROLE_TYPE
     pSampleConfiguration->clientInfo.signalingClientCreationMaxRetryAttempts = CREATE_SIGNALING_CLIENT_RETRY_ATTEMPTS_SENTINEL_VALUE;
     pSampleConfiguration->clientInfo.signalingMessagesMinimumThreads = KVS_SIGNALING_THREADPOOL_MIN;
     pSampleConfiguration->clientInfo.signalingMessagesMaximumThreads = KVS_SIGNALING_THREADPOOL_MAX;
-    pSampleConfiguration->iceCandidatePairStatsTimerId = MAX_UINT32;
+    pSampleConfiguration->statsSamplerTimerId = MAX_UINT32;
     pSampleConfiguration->pregenerateCertTimerId = MAX_UINT32;
     pSampleConfiguration->signalingClientMetrics.version = SIGNALING_CLIENT_METRICS_CURRENT_VERSION;
 
@@ -1375,108 +1466,6 @@ CleanUp:
     return retStatus;
 }
 
-STATUS getIceCandidatePairStatsCallback(UINT32 timerId, UINT64 currentTime, UINT64 customData)
-{
-    UNUSED_PARAM(timerId);
-    UNUSED_PARAM(currentTime);
-    STATUS retStatus = STATUS_SUCCESS;
-    PSampleConfiguration pSampleConfiguration = (PSampleConfiguration) customData;
-    UINT32 i;
-    UINT64 currentMeasureDuration = 0;
-    DOUBLE averagePacketsDiscardedOnSend = 0.0;
-    DOUBLE averageNumberOfPacketsSentPerSecond = 0.0;
-    DOUBLE averageNumberOfPacketsReceivedPerSecond = 0.0;
-    DOUBLE outgoingBitrate = 0.0;
-    DOUBLE incomingBitrate = 0.0;
-    BOOL locked = FALSE;
-
-    CHK_WARN(pSampleConfiguration != NULL, STATUS_NULL_ARG, "[KVS Master] getPeriodicStats(): Passed argument is NULL");
-
-    pSampleConfiguration->rtcIceCandidatePairMetrics.requestedTypeOfStats = RTC_STATS_TYPE_CANDIDATE_PAIR;
-
-    // Use MUTEX_TRYLOCK to avoid possible dead lock when canceling timerQueue
-    if (!MUTEX_TRYLOCK(pSampleConfiguration->sampleConfigurationObjLock)) {
-        return retStatus;
-    } else {
-        locked = TRUE;
-    }
-
-    for (i = 0; i < pSampleConfiguration->streamingSessionCount; ++i) {
-        if (STATUS_SUCCEEDED(rtcPeerConnectionGetMetrics(pSampleConfiguration->sampleStreamingSessionList[i]->pPeerConnection, NULL,
-                                                         &pSampleConfiguration->rtcIceCandidatePairMetrics))) {
-            currentMeasureDuration = (pSampleConfiguration->rtcIceCandidatePairMetrics.timestamp -
-                                      pSampleConfiguration->sampleStreamingSessionList[i]->rtcMetricsHistory.prevTs) /
-                HUNDREDS_OF_NANOS_IN_A_SECOND;
-            DLOGD("Current duration: %" PRIu64 " seconds", currentMeasureDuration);
-            if (currentMeasureDuration > 0) {
-                DLOGD("Selected local candidate ID: %s",
-                      pSampleConfiguration->rtcIceCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.localCandidateId);
-                DLOGD("Selected remote candidate ID: %s",
-                      pSampleConfiguration->rtcIceCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.remoteCandidateId);
-                DLOGD("Ice Candidate Pair state: %d", pSampleConfiguration->rtcIceCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.state);
-                DLOGD("Nomination state: %s",
-                      pSampleConfiguration->rtcIceCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.nominated ? "nominated"
-                                                                                                                      : "not nominated");
-                averageNumberOfPacketsSentPerSecond =
-                    (DOUBLE) (pSampleConfiguration->rtcIceCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.packetsSent -
-                              pSampleConfiguration->sampleStreamingSessionList[i]->rtcMetricsHistory.prevNumberOfPacketsSent) /
-                    (DOUBLE) currentMeasureDuration;
-                DLOGD("Packet send rate: %lf pkts/sec", averageNumberOfPacketsSentPerSecond);
-
-                averageNumberOfPacketsReceivedPerSecond =
-                    (DOUBLE) (pSampleConfiguration->rtcIceCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.packetsReceived -
-                              pSampleConfiguration->sampleStreamingSessionList[i]->rtcMetricsHistory.prevNumberOfPacketsReceived) /
-                    (DOUBLE) currentMeasureDuration;
-                DLOGD("Packet receive rate: %lf pkts/sec", averageNumberOfPacketsReceivedPerSecond);
-
-                outgoingBitrate = (DOUBLE) ((pSampleConfiguration->rtcIceCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.bytesSent -
-                                             pSampleConfiguration->sampleStreamingSessionList[i]->rtcMetricsHistory.prevNumberOfBytesSent) *
-                                            8.0) /
-                    currentMeasureDuration;
-                DLOGD("Outgoing bit rate: %lf bps", outgoingBitrate);
-
-                incomingBitrate = (DOUBLE) ((pSampleConfiguration->rtcIceCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.bytesReceived -
-                                             pSampleConfiguration->sampleStreamingSessionList[i]->rtcMetricsHistory.prevNumberOfBytesReceived) *
-                                            8.0) /
-                    currentMeasureDuration;
-                DLOGD("Incoming bit rate: %lf bps", incomingBitrate);
-
-                averagePacketsDiscardedOnSend =
-                    (DOUBLE) (pSampleConfiguration->rtcIceCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.packetsDiscardedOnSend -
-                              pSampleConfiguration->sampleStreamingSessionList[i]->rtcMetricsHistory.prevPacketsDiscardedOnSend) /
-                    (DOUBLE) currentMeasureDuration;
-                DLOGD("Packet discard rate: %lf pkts/sec", averagePacketsDiscardedOnSend);
-
-                DLOGD("Current STUN request round trip time: %lf sec",
-                      pSampleConfiguration->rtcIceCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.currentRoundTripTime);
-                DLOGD("Number of STUN responses received: %llu",
-                      pSampleConfiguration->rtcIceCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.responsesReceived);
-
-                pSampleConfiguration->sampleStreamingSessionList[i]->rtcMetricsHistory.prevTs =
-                    pSampleConfiguration->rtcIceCandidatePairMetrics.timestamp;
-                pSampleConfiguration->sampleStreamingSessionList[i]->rtcMetricsHistory.prevNumberOfPacketsSent =
-                    pSampleConfiguration->rtcIceCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.packetsSent;
-                pSampleConfiguration->sampleStreamingSessionList[i]->rtcMetricsHistory.prevNumberOfPacketsReceived =
-                    pSampleConfiguration->rtcIceCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.packetsReceived;
-                pSampleConfiguration->sampleStreamingSessionList[i]->rtcMetricsHistory.prevNumberOfBytesSent =
-                    pSampleConfiguration->rtcIceCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.bytesSent;
-                pSampleConfiguration->sampleStreamingSessionList[i]->rtcMetricsHistory.prevNumberOfBytesReceived =
-                    pSampleConfiguration->rtcIceCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.bytesReceived;
-                pSampleConfiguration->sampleStreamingSessionList[i]->rtcMetricsHistory.prevPacketsDiscardedOnSend =
-                    pSampleConfiguration->rtcIceCandidatePairMetrics.rtcStatsObject.iceCandidatePairStats.packetsDiscardedOnSend;
-            }
-        }
-    }
-
-CleanUp:
-
-    if (locked) {
-        MUTEX_UNLOCK(pSampleConfiguration->sampleConfigurationObjLock);
-    }
-
-    return retStatus;
-}
-
 STATUS pregenerateCertTimerCallback(UINT32 timerId, UINT64 currentTime, UINT64 customData)
 {
     UNUSED_PARAM(timerId);
@@ -1545,13 +1534,13 @@ STATUS freeSampleConfiguration(PSampleConfiguration* ppSampleConfiguration)
     remove((PCHAR)(std::string(FIRST_FRAME_TS_FILE_PATH) + pSampleConfiguration->fristFrameSentTSFileName).c_str());
 
     if (IS_VALID_TIMER_QUEUE_HANDLE(pSampleConfiguration->timerQueueHandle)) {
-        if (pSampleConfiguration->iceCandidatePairStatsTimerId != MAX_UINT32) {
-            retStatus = timerQueueCancelTimer(pSampleConfiguration->timerQueueHandle, pSampleConfiguration->iceCandidatePairStatsTimerId,
+        if (pSampleConfiguration->statsSamplerTimerId != MAX_UINT32) {
+            retStatus = timerQueueCancelTimer(pSampleConfiguration->timerQueueHandle, pSampleConfiguration->statsSamplerTimerId,
                                               (UINT64) pSampleConfiguration);
             if (STATUS_FAILED(retStatus)) {
                 DLOGE("Failed to cancel stats timer with: 0x%08x", retStatus);
             }
-            pSampleConfiguration->iceCandidatePairStatsTimerId = MAX_UINT32;
+            pSampleConfiguration->statsSamplerTimerId = MAX_UINT32;
         }
 
         if (pSampleConfiguration->pregenerateCertTimerId != MAX_UINT32) {
@@ -1882,7 +1871,7 @@ STATUS signalingMessageReceived(UINT64 customData, PReceivedSignalingMessage pRe
                 // NULL the pointer to avoid it being freed in the cleanup
                 pPendingMessageQueue = NULL;
             }
-            startStats = pSampleConfiguration->iceCandidatePairStatsTimerId == MAX_UINT32;
+            startStats = pSampleConfiguration->statsSamplerTimerId == MAX_UINT32;
             break;
 
         case SIGNALING_MESSAGE_TYPE_ANSWER:
@@ -1906,7 +1895,7 @@ STATUS signalingMessageReceived(UINT64 customData, PReceivedSignalingMessage pRe
                 pPendingMessageQueue = NULL;
             }
 
-            startStats = pSampleConfiguration->iceCandidatePairStatsTimerId == MAX_UINT32;
+            startStats = pSampleConfiguration->statsSamplerTimerId == MAX_UINT32;
             CHK_STATUS(signalingClientGetMetrics(pSampleConfiguration->signalingClientHandle, &pSampleConfiguration->signalingClientMetrics));
             DLOGP("[Signaling offer sent to answer received time] %" PRIu64 " ms",
                   pSampleConfiguration->signalingClientMetrics.signalingClientStats.offerToAnswerTime);
@@ -1949,10 +1938,10 @@ STATUS signalingMessageReceived(UINT64 customData, PReceivedSignalingMessage pRe
 
     if (startStats &&
         STATUS_FAILED(retStatus = timerQueueAddTimer(pSampleConfiguration->timerQueueHandle, SAMPLE_STATS_DURATION, SAMPLE_STATS_DURATION,
-                                                     getIceCandidatePairStatsCallback, (UINT64) pSampleConfiguration,
-                                                     &pSampleConfiguration->iceCandidatePairStatsTimerId))) {
-        DLOGW("Failed to add getIceCandidatePairStatsCallback to add to timer queue (code 0x%08x). "
-              "Cannot pull ice candidate pair metrics periodically",
+                                                     sampleRtcStatsCallback, (UINT64) pSampleConfiguration,
+                                                     &pSampleConfiguration->statsSamplerTimerId))) {
+        DLOGW("Failed to add sampleRtcStatsCallback to add to timer queue (code 0x%08x). "
+              "Cannot pull RTC metrics periodically",
               retStatus);
 
         // Reset the returned status
@@ -2086,13 +2075,9 @@ CleanUp:
 
 STATUS handleWriteFrameMetricIncrementation(PSampleStreamingSession pSampleStreamingSession, UINT32 frameSize)
 {
+    // The stats sampler takes and resets these
     std::lock_guard<std::mutex> lock(pSampleStreamingSession->countUpdateMutex);
-    if (pSampleStreamingSession->recorded.load()) {
-            pSampleStreamingSession->canaryOutgoingRTPMetricsContext.videoFramesGenerated = 0;
-            pSampleStreamingSession->canaryOutgoingRTPMetricsContext.videoBytesGenerated = 0;
-            pSampleStreamingSession->recorded = FALSE;
-        }
-        pSampleStreamingSession->canaryOutgoingRTPMetricsContext.videoFramesGenerated++;
-        pSampleStreamingSession->canaryOutgoingRTPMetricsContext.videoBytesGenerated += frameSize;
-        return STATUS_SUCCESS;
+    pSampleStreamingSession->canaryOutgoingRTPMetricsContext.videoFramesGenerated++;
+    pSampleStreamingSession->canaryOutgoingRTPMetricsContext.videoBytesGenerated += frameSize;
+    return STATUS_SUCCESS;
 }
\ No newline at end of file
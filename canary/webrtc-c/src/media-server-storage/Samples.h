@@ -34,6 +34,13 @@ Shared include file for the samples
 
 #define SAMPLE_SESSION_CLEANUP_WAIT_PERIOD (5 * HUNDREDS_OF_NANOS_IN_A_SECOND)
 
+// Video renditions the master can switch between. Switching down happens as soon as the estimate falls below the
+// current rendition, switching up only once it has cleared the next one by the margin for the whole hold period
+#define SAMPLE_MAX_VIDEO_RENDITIONS          4
+#define SAMPLE_RENDITION_UP_SWITCH_MARGIN    1.15
+#define SAMPLE_RENDITION_UP_SWITCH_HOLD      (5 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+#define SAMPLE_RENDITION_ESTIMATE_HEADROOM   1.5
+
 #define SAMPLE_PENDING_MESSAGE_CLEANUP_DURATION (20 * HUNDREDS_OF_NANOS_IN_A_SECOND)
 
 #define CA_CERT_PEM_FILE_EXTENSION ".pem"
@@ -80,14 +87,48 @@ typedef enum {
 typedef struct __SampleStreamingSession SampleStreamingSession;
 typedef struct __SampleStreamingSession* PSampleStreamingSession;
 
+// Raw counters read by the stats sampler. Rates are only derived later, from two snapshots of the same session
+typedef struct {
+    BOOL valid;
+    UINT64 timestamp;
+    UINT64 framesSent;
+    UINT64 framesDiscardedOnSend;
+    UINT64 nackCount;
+    UINT64 retransmittedBytesSent;
+    UINT64 pliCount;
+    // Generated by the media loop since the previous snapshot
+    UINT64 videoFramesGenerated;
+    UINT64 videoBytesGenerated;
+} OutboundRtpSnapshot, *POutboundRtpSnapshot;
+
+typedef struct {
+    BOOL valid;
+    UINT64 timestamp;
+    UINT64 packetsSent;
+    UINT64 packetsReceived;
+    UINT64 bytesSent;
+    DOUBLE currentRoundTripTime;
+} CandidatePairSnapshot, *PCandidatePairSnapshot;
+
 typedef struct {
-    UINT64 prevNumberOfPacketsSent;
-    UINT64 prevNumberOfPacketsReceived;
-    UINT64 prevNumberOfBytesSent;
-    UINT64 prevNumberOfBytesReceived;
-    UINT64 prevPacketsDiscardedOnSend;
-    UINT64 prevTs;
-} RtcMetricsHistory, *PRtcMetricsHistory;
+    // Together with the pointer identifies the session, a freed session's memory can be reused by the next one
+    PSampleStreamingSession pSampleStreamingSession;
+    UINT64 offerReceiveTime;
+    UINT64 connectedTime;
+    CHAR peerId[MAX_SIGNALING_CLIENT_ID_LEN + 1];
+    OutboundRtpSnapshot outboundRtp;
+    CandidatePairSnapshot candidatePair;
+} RtcStatsSnapshot, *PRtcStatsSnapshot;
+
+// Double buffer of snapshots owned by the sampler timer. Only the timer callback touches it
+typedef struct {
+    RtcStatsSnapshot snapshots[2][DEFAULT_MAX_CONCURRENT_STREAMING_SESSION];
+    UINT32 snapshotCount[2];
+    // Half holding the most recent snapshots
+    UINT32 current;
+    // Ticks that lost the session lock, the next one covers the longer interval instead
+    UINT64 skippedTicks;
+} RtcStatsSampler, *PRtcStatsSampler;
 
 typedef struct {
     volatile ATOMIC_BOOL appTerminateFlag;
@@ -108,7 +149,7 @@ typedef struct {
     TID audioSenderTid;
     TID videoSenderTid;
     TIMER_QUEUE_HANDLE timerQueueHandle;
-    UINT32 iceCandidatePairStatsTimerId;
+    UINT32 statsSamplerTimerId;
     SampleStreamingMediaType mediaType;
     startRoutine audioSource;
     startRoutine videoSource;
@@ -132,7 +173,7 @@ typedef struct {
     SignalingClientCallbacks signalingClientCallbacks;
     SignalingClientInfo clientInfo;
 
-    RtcStats rtcIceCandidatePairMetrics;
+    RtcStatsSampler statsSampler;
 
     MUTEX signalingSendMessageLock;
 
@@ -143,6 +184,10 @@ typedef struct {
     PCHAR fristFrameSentTSFileName;
     UINT64 startTime;
 
+    // Ladder of the sample video renditions in ascending bitrate order. Only one when switching is disabled
+    UINT32 videoRenditionCount;
+    UINT64 videoRenditionBitrates[SAMPLE_MAX_VIDEO_RENDITIONS];
+
     UINT32 pregenerateCertTimerId;
     PStackQueue pregeneratedCertificates; // Max MAX_RTCCONFIGURATION_CERTIFICATES certificates
 
@@ -159,24 +204,10 @@ typedef struct {
 typedef VOID (*StreamSessionShutdownCallback)(UINT64, PSampleStreamingSession);
 
 
+// Written by the media loop, read and reset by the stats sampler, both under countUpdateMutex
 typedef struct {
-    UINT64 prevNumberOfPacketsSent;
-    UINT64 prevNumberOfPacketsReceived;
-    UINT64 prevNumberOfBytesSent;
-    UINT64 prevNumberOfBytesReceived;
-    UINT64 prevFramesDiscardedOnSend;
-    UINT64 prevTs;
-    UINT64 prevVideoFramesGenerated;
-    UINT64 prevFramesSent;
-    UINT64 prevNackCount;
-    UINT64 prevRetxBytesSent;
-    UINT64 prevPliCount;
-    std::atomic<UINT64> videoFramesGenerated;
+    UINT64 videoFramesGenerated;
     UINT64 videoBytesGenerated;
-    DOUBLE framesPercentageDiscarded;
-    DOUBLE nacksPerSecond;
-    DOUBLE averageFramesSentPerSecond;
-    DOUBLE retxBytesPercentage;
 } OutgoingRTPMetricsContext;
 typedef OutgoingRTPMetricsContext* POutgoingRTPMetricsContext;
 
@@ -197,14 +228,11 @@ struct __SampleStreamingSession {
     CHAR peerId[MAX_SIGNALING_CLIENT_ID_LEN + 1];
     TID receiveAudioVideoSenderTid;
     UINT64 startUpLatency;
-    RtcMetricsHistory rtcMetricsHistory;
     BOOL remoteCanTrickleIce;
 
-    RtcStats canaryMetrics;
     OutgoingRTPMetricsContext canaryOutgoingRTPMetricsContext;
-    UINT32 metricsTimerId;
     UINT32 streamingAvailabilityTimerId;
-    std::atomic<BOOL> recorded;
+    UINT64 connectedTime;
     volatile ATOMIC_BOOL firstIceSent;
     volatile ATOMIC_BOOL firstIceReceived;
     std::mutex countUpdateMutex;
@@ -216,6 +244,14 @@ struct __SampleStreamingSession {
     UINT64 offerReceiveTime;
     PeerConnectionMetrics peerConnectionMetrics;
     KvsIceAgentMetrics iceMetrics;
+
+    // Rendition the video loop sends, it only moves to targetVideoRendition on a key frame
+    volatile SIZE_T videoRendition;
+    volatile SIZE_T targetVideoRendition;
+    volatile SIZE_T targetVideoRenditionTime;
+    // Only touched by the sender bandwidth estimation callback
+    DOUBLE estimatedBitrateKbps;
+    UINT64 upSwitchCandidateTime;
 };
 
 VOID sigintHandler(INT32);
@@ -225,7 +261,7 @@ PVOID sendAudioPackets(PVOID);
 PVOID sendGstreamerAudioVideo(PVOID);
 PVOID sampleReceiveAudioVideoFrame(PVOID);
 PVOID getPeriodicIceCandidatePairStats(PVOID);
-STATUS getIceCandidatePairStatsCallback(UINT32, UINT64, UINT64);
+STATUS sampleRtcStatsCallback(UINT32, UINT64, UINT64);
 STATUS pregenerateCertTimerCallback(UINT32, UINT64, UINT64);
 STATUS createSampleConfiguration(PCHAR, SIGNALING_CHANNEL_ROLE_TYPE, BOOL, BOOL, UINT32, PSampleConfiguration*);
 STATUS freeSampleConfiguration(PSampleConfiguration*);
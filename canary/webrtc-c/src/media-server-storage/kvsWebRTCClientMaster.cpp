@@ -6,15 +6,42 @@ extern PSampleConfiguration gSampleConfiguration;
 extern UINT32 gJoinSSTimeoutCount;
 extern UINT32 gCMasterUnexpectedDisconnectionCount;
 
+// Sample frames are packed into a single memory mapped archive per track so that the media threads never touch the disk.
+// There is one video archive per rendition, in the order of SampleConfiguration::videoRenditionBitrates
+Canary::FrameArchive gVideoFrameArchives[SAMPLE_MAX_VIDEO_RENDITIONS];
+Canary::FrameArchive gAudioFrameArchive;
+
+// Runs the first frame and stats side effects of the media loops off streamingSessionListReadLock
+Canary::SideEffectWorker gSideEffectWorker;
+
+typedef enum {
+    // args: offer receive time of the session, TRUE for the audio track
+    MASTER_SIDE_EFFECT_FIRST_FRAME_SENT,
+    // args: session, frame size, rendition bitrate in kbps
+    MASTER_SIDE_EFFECT_VIDEO_FRAME_SENT,
+    // args: previous and new rendition bitrate in kbps, when the switch was asked for
+    MASTER_SIDE_EFFECT_VIDEO_RENDITION_SWITCHED,
+} MASTER_SIDE_EFFECT_TYPE;
+
+// Time the media loops hold streamingSessionListReadLock per frame, in nanoseconds
+typedef struct {
+    UINT64 count;
+    UINT64 total;
+    UINT64 max;
+} SessionLockHoldStats, *PSessionLockHoldStats;
+
+static VOID handleMasterSideEffects(UINT64, Canary::PSideEffect, UINT32);
+static STATUS loadVideoRenditions(PSampleConfiguration, const std::string&, BOOL);
+
 INT32 main(INT32 argc, CHAR* argv[])
 {
     STATUS retStatus = STATUS_SUCCESS;
-    UINT32 frameSize;
     PSampleConfiguration pSampleConfiguration = NULL;
     PCHAR pChannelName;
     PCHAR pControlPlaneUri = NULL;
     CHAR controlPlaneUrl[MAX_CONTROL_PLANE_URI_CHAR_LEN];
     SignalingClientMetrics signalingClientMetrics;
+    PCHAR pInlineSideEffects;
     signalingClientMetrics.version = SIGNALING_CLIENT_METRICS_CURRENT_VERSION;
 
     auto canaryConfig = Canary::Config();
@@ -80,13 +107,20 @@ INT32 main(INT32 argc, CHAR* argv[])
     pSampleConfiguration->mediaType = SAMPLE_STREAMING_AUDIO_VIDEO;
     DLOGI("[KVS Master] Finished setting handlers");
 
-    // Check if the samples are present
-    DLOGI("[KVS Master] Checking sample video frame availability....");
-    CHK_STATUS(readFrameFromDisk(NULL, &frameSize, "./assets/h264SampleFrames/frame-0001.h264"));
-    DLOGI("[KVS Master] Checked sample video frame availability....available");
+    // Map the sample frames, packing them into archives first if this is the first run
+    DLOGI("[KVS Master] Loading sample video frames....");
+    CHK_STATUS(loadVideoRenditions(pSampleConfiguration, canaryConfig.storageVideoRenditions.value, canaryConfig.prefaultFrameArchive.value));
+    DLOGI("[KVS Master] Loaded %u sample video frames in %u renditions", gVideoFrameArchives[0].getFrameCount(),
+          pSampleConfiguration->videoRenditionCount);
+
+    CHK_STATUS(gAudioFrameArchive.openOrCreate(CANARY_AUDIO_FRAME_ARCHIVE_PATH, CANARY_AUDIO_FRAMES_PATH, NUMBER_OF_OPUS_FRAME_FILES,
+                                               SAMPLE_AUDIO_FRAME_DURATION, RTC_CODEC_OPUS, canaryConfig.prefaultFrameArchive.value));
+    DLOGI("[KVS Master] Loaded %u sample audio frames", gAudioFrameArchive.getFrameCount());
 
-    CHK_STATUS(readFrameFromDisk(NULL, &frameSize, "./assets/opusSampleFrames/sample-001.opus"));
-    DLOGI("[KVS Master] Checked sample audio frame availability....available");
+    // Set CANARY_INLINE_SIDE_EFFECTS to run them inside the media loops' critical section as before, for comparing lock hold times
+    pInlineSideEffects = GETENV("CANARY_INLINE_SIDE_EFFECTS");
+    CHK_STATUS(gSideEffectWorker.init(handleMasterSideEffects, (UINT64) pSampleConfiguration,
+                                      pInlineSideEffects != NULL && (TOLOWER(pInlineSideEffects[0]) == 't' || pInlineSideEffects[0] == '1')));
 
     // Initialize KVS WebRTC. This must be done before anything else, and must only be done once.
     CHK_STATUS(initKvsWebRtc());
@@ -123,6 +157,17 @@ CleanUp:
         Canary::Cloudwatch::getInstance().monitoring.pushCMasterUnexpectedDisconnection(gCMasterUnexpectedDisconnectionCount);
     }
 
+    // Stop the media loops first: their CleanUp pushes pacer and lock hold metrics and they post to the side effect worker
+    if (pSampleConfiguration != NULL) {
+        // Kick of the termination sequence
+        ATOMIC_STORE_BOOL(&pSampleConfiguration->appTerminateFlag, TRUE);
+        CVAR_BROADCAST(pSampleConfiguration->cvar);
+
+        if (pSampleConfiguration->mediaSenderTid != INVALID_TID_VALUE) {
+            THREAD_JOIN(pSampleConfiguration->mediaSenderTid, NULL);
+        }
+    }
+
     // Fetch signaling client metrics before CloudWatch deinit so we can push CMasterRetryCount
     if (pSampleConfiguration != NULL) {
         STATUS metricsStatus = signalingClientGetMetrics(pSampleConfiguration->signalingClientHandle, &signalingClientMetrics);
@@ -137,16 +182,12 @@ CleanUp:
         }
     }
 
+    // Media loops are joined, so this drains everything they posted while CloudWatch is still up
+    gSideEffectWorker.shutdown();
     Canary::Cloudwatch::deinit();
 
     DLOGI("[KVS Master] Cleaning up....");
     if (pSampleConfiguration != NULL) {
-        // Kick of the termination sequence
-        ATOMIC_STORE_BOOL(&pSampleConfiguration->appTerminateFlag, TRUE);
-
-        if (pSampleConfiguration->mediaSenderTid != INVALID_TID_VALUE) {
-            THREAD_JOIN(pSampleConfiguration->mediaSenderTid, NULL);
-        }
         retStatus = freeSignalingClient(&pSampleConfiguration->signalingClientHandle);
         if (retStatus != STATUS_SUCCESS) {
             DLOGE("[KVS Master] freeSignalingClient(): operation returned status code: 0x%08x", retStatus);
@@ -188,19 +229,19 @@ CleanUp:
 }
 
 // Save first-frame-sent time to file for consumer-end access.
-VOID writeFirstFrameSentTimeToFile(PCHAR fileName){
+VOID writeFirstFrameSentTimeToFile(PCHAR fileName, UINT64 sentTime){
     DLOGI("[Canary] Writing to {} file", fileName);
-    UINT64 currentTimeMilliS =  GETTIME() / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+    UINT64 currentTimeMilliS =  sentTime / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
     CHAR cuurrentTimeChars[MAX_UINT64_DIGIT_COUNT + 1]; // +1 accounts for null terminator
     UINT64 writeSize = SPRINTF(cuurrentTimeChars, "%llu", currentTimeMilliS);
     writeFile((PCHAR) fileName, false, false, static_cast<PBYTE>(static_cast<PVOID>(cuurrentTimeChars)), writeSize);
 }
 
-VOID calculateDisconnectToFrameSentTime(PSampleConfiguration pSampleConfiguration)
+VOID calculateDisconnectToFrameSentTime(PSampleConfiguration pSampleConfiguration, UINT64 sentTime)
 {
     UINT64 disconnectTime = pSampleConfiguration->storageDisconnectedTime.load();
     if (disconnectTime != 0){
-        DOUBLE storageDisconnectToFrameSentTime = (DOUBLE) (GETTIME() - disconnectTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+        DOUBLE storageDisconnectToFrameSentTime = (DOUBLE) (sentTime - disconnectTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
         Canary::Cloudwatch::getInstance().monitoring.pushStorageDisconnectToFrameSentTime(storageDisconnectToFrameSentTime,
                                                                         Aws::CloudWatch::Model::StandardUnit::Milliseconds);
         DLOGI("[Canary] Setting storageDisconnectedTime to zero (not set)");
@@ -210,22 +251,184 @@ VOID calculateDisconnectToFrameSentTime(PSampleConfiguration pSampleConfiguratio
     }
 }
 
+static VOID handleFirstFrameSent(PSampleConfiguration pSampleConfiguration, Canary::PSideEffect pEvent)
+{
+    UINT64 sentTime = pEvent->time, offerReceiveTime = pEvent->args[0];
+    BOOL isAudio = (BOOL) pEvent->args[1];
+
+    writeFirstFrameSentTimeToFile((PCHAR)(std::string(FIRST_FRAME_TS_FILE_PATH) + pSampleConfiguration->fristFrameSentTSFileName).c_str(), sentTime);
+    DLOGP("[Time to first frame] Time taken: %" PRIu64 " ms", (sentTime - offerReceiveTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+
+    DOUBLE timeToFirstFrame = (DOUBLE) (sentTime - pSampleConfiguration->offerReceiveTimestamp) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+    DLOGD("[Canary] Start up latency from offer received to first frame sent (timeToFirstFrame): %lf ms", timeToFirstFrame);
+    Canary::Cloudwatch::getInstance().monitoring.pushTimeToFirstFrame(timeToFirstFrame, Aws::CloudWatch::Model::StandardUnit::Milliseconds);
+
+    // Push JoinSSCallToFirstFrame — time from JoinStorageSession call to first frame sent
+    if (pSampleConfiguration->joinSSCallStartTime != 0) {
+        UINT64 joinSSToFirstFrame = (sentTime - pSampleConfiguration->joinSSCallStartTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+        DLOGI("[Canary] JoinSSCallToFirstFrame%s: %" PRIu64 " ms", isAudio ? " (audio)" : "", joinSSToFirstFrame);
+        Canary::Cloudwatch::getInstance().monitoring.pushJoinSSCallToFirstFrame(joinSSToFirstFrame, Aws::CloudWatch::Model::StandardUnit::Milliseconds);
+    }
+
+    calculateDisconnectToFrameSentTime(pSampleConfiguration, sentTime);
+}
+
+// Sessions may have been freed since the event was posted, so they are only touched while still in the list
+static VOID handleVideoFrameSent(PSampleConfiguration pSampleConfiguration, Canary::PSideEffect pEvent)
+{
+    PSampleStreamingSession pSampleStreamingSession = (PSampleStreamingSession) pEvent->args[0];
+    RtcEncoderStats encoderStats;
+    UINT32 i;
+
+    for (i = 0; i < pSampleConfiguration->streamingSessionCount && pSampleConfiguration->sampleStreamingSessionList[i] != pSampleStreamingSession; i++) {
+    }
+    if (i == pSampleConfiguration->streamingSessionCount) {
+        return;
+    }
+
+    handleWriteFrameMetricIncrementation(pSampleStreamingSession, (UINT32) pEvent->args[1]);
+
+    // based on bitrate of samples/h264SampleFrames/frame-* unless the rendition's bitrate is configured
+    MEMSET(&encoderStats, 0x00, SIZEOF(RtcEncoderStats));
+    encoderStats.width = 640;
+    encoderStats.height = 480;
+    encoderStats.targetBitrate = pEvent->args[2] != 0 ? (UINT32) (pEvent->args[2] * 1000) : 262000;
+    encoderStats.encodeTimeMsec = 4; // update encode time to an arbitrary number to demonstrate stats update
+    updateEncoderStats(pSampleStreamingSession->pVideoRtcRtpTransceiver, &encoderStats);
+}
+
+static VOID handleVideoRenditionSwitched(Canary::PSideEffect pEvent)
+{
+    UINT64 switchDelay = pEvent->time > pEvent->args[2] ? (pEvent->time - pEvent->args[2]) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND : 0;
+
+    DLOGI("[Canary] Switched video rendition from %" PRIu64 " kbps to %" PRIu64 " kbps, %" PRIu64 " ms after it was asked for", pEvent->args[0],
+          pEvent->args[1], switchDelay);
+    Canary::Cloudwatch::getInstance().monitoring.pushVideoRenditionSwitch(pEvent->args[1], switchDelay);
+}
+
+static VOID handleMasterSideEffects(UINT64 customData, Canary::PSideEffect pEvents, UINT32 count)
+{
+    PSampleConfiguration pSampleConfiguration = (PSampleConfiguration) customData;
+    // Inlined events run on the media loop, which already holds the session list lock
+    BOOL takeLock = !gSideEffectWorker.isInlined(), locked = FALSE;
+    UINT32 i;
+
+    // Stats for the whole batch under a single lock acquisition
+    for (i = 0; i < count; i++) {
+        if (pEvents[i].type == MASTER_SIDE_EFFECT_VIDEO_FRAME_SENT) {
+            if (takeLock && !locked) {
+                MUTEX_LOCK(pSampleConfiguration->streamingSessionListReadLock);
+                locked = TRUE;
+            }
+            handleVideoFrameSent(pSampleConfiguration, &pEvents[i]);
+        }
+    }
+    if (locked) {
+        MUTEX_UNLOCK(pSampleConfiguration->streamingSessionListReadLock);
+    }
+
+    for (i = 0; i < count; i++) {
+        if (pEvents[i].type == MASTER_SIDE_EFFECT_FIRST_FRAME_SENT) {
+            handleFirstFrameSent(pSampleConfiguration, &pEvents[i]);
+        } else if (pEvents[i].type == MASTER_SIDE_EFFECT_VIDEO_RENDITION_SWITCHED) {
+            handleVideoRenditionSwitched(&pEvents[i]);
+        }
+    }
+}
+
+// Maps one archive per rendition listed in STORAGE_CANARY_VIDEO_RENDITIONS, ordered by bitrate. Without renditions the
+// default sample frames are the only one and the sender bandwidth estimate is not acted on
+static STATUS loadVideoRenditions(PSampleConfiguration pSampleConfiguration, const std::string& renditions, BOOL prefault)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    std::vector<std::pair<UINT64, std::string>> ladder;
+    std::stringstream ss(renditions);
+    std::string rendition;
+    size_t separator;
+    UINT32 i;
+
+    while (std::getline(ss, rendition, ',')) {
+        separator = rendition.find(':');
+        CHK_ERR(separator != std::string::npos && separator + 1 < rendition.size(), STATUS_INVALID_ARG,
+                "[KVS Master] Invalid video rendition '%s', expected <kbps>:<frame directory>", rendition.c_str());
+        ladder.emplace_back(strtoull(rendition.c_str(), NULL, 10), rendition.substr(separator + 1));
+        CHK_ERR(ladder.back().first != 0, STATUS_INVALID_ARG, "[KVS Master] Invalid video rendition bitrate in '%s'", rendition.c_str());
+    }
+    CHK_ERR(ladder.size() <= SAMPLE_MAX_VIDEO_RENDITIONS, STATUS_INVALID_ARG, "[KVS Master] At most %u video renditions are supported",
+            SAMPLE_MAX_VIDEO_RENDITIONS);
+
+    if (ladder.empty()) {
+        CHK_STATUS(gVideoFrameArchives[0].openOrCreate(CANARY_VIDEO_FRAME_ARCHIVE_PATH, CANARY_VIDEO_FRAMES_PATH, NUMBER_OF_H264_FRAME_FILES,
+                                                       SAMPLE_VIDEO_FRAME_DURATION,
+                                                       RTC_CODEC_H264_PROFILE_42E01F_LEVEL_ASYMMETRY_ALLOWED_PACKETIZATION_MODE, prefault));
+        pSampleConfiguration->videoRenditionBitrates[0] = 0;
+        pSampleConfiguration->videoRenditionCount = 1;
+        CHK(FALSE, retStatus);
+    }
+
+    std::sort(ladder.begin(), ladder.end());
+    for (i = 0; i < ladder.size(); i++) {
+        CHK_STATUS(gVideoFrameArchives[i].openOrCreate((PCHAR) (ladder[i].second + CANARY_FRAME_ARCHIVE_EXTENSION).c_str(),
+                                                       (PCHAR) (ladder[i].second + CANARY_VIDEO_RENDITION_FRAMES_FILE).c_str(),
+                                                       NUMBER_OF_H264_FRAME_FILES, SAMPLE_VIDEO_FRAME_DURATION,
+                                                       RTC_CODEC_H264_PROFILE_42E01F_LEVEL_ASYMMETRY_ALLOWED_PACKETIZATION_MODE, prefault));
+        // The video loop walks all renditions with the same frame index
+        CHK_ERR(gVideoFrameArchives[i].getFrameCount() == gVideoFrameArchives[0].getFrameCount(), STATUS_INVALID_ARG,
+                "[KVS Master] Video rendition %s has %u frames, expected %u", ladder[i].second.c_str(), gVideoFrameArchives[i].getFrameCount(),
+                gVideoFrameArchives[0].getFrameCount());
+        pSampleConfiguration->videoRenditionBitrates[i] = ladder[i].first;
+        DLOGI("[KVS Master] Video rendition %u: %" PRIu64 " kbps from %s", i, ladder[i].first, ladder[i].second.c_str());
+    }
+    pSampleConfiguration->videoRenditionCount = (UINT32) ladder.size();
+
+CleanUp:
+
+    return retStatus;
+}
+
+static UINT64 monotonicTimeNanos()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (UINT64) now.tv_sec * 1000000000ULL + (UINT64) now.tv_nsec;
+}
+
+static VOID recordSessionLockHold(PSessionLockHoldStats pStats, UINT64 lockedTime)
+{
+    UINT64 holdTime = monotonicTimeNanos() - lockedTime;
+
+    pStats->count++;
+    pStats->total += holdTime;
+    pStats->max = MAX(pStats->max, holdTime);
+}
+
+static VOID logSessionLockHoldStats(PCHAR name, PSessionLockHoldStats pStats)
+{
+    DLOGI("%s session list lock hold time (%s side effects): avg %" PRIu64 " us, max %" PRIu64 " us over %" PRIu64 " frames", name,
+          gSideEffectWorker.isInlined() ? "inline" : "async", pStats->count == 0 ? 0 : pStats->total / pStats->count / 1000, pStats->max / 1000,
+          pStats->count);
+}
+
 PVOID sendVideoPackets(PVOID args)
 {
     STATUS retStatus = STATUS_SUCCESS;
     PSampleConfiguration pSampleConfiguration = (PSampleConfiguration) args;
-    RtcEncoderStats encoderStats;
+    PSampleStreamingSession pSampleStreamingSession;
+    SessionLockHoldStats lockHoldStats;
     Frame frame;
-    UINT32 fileIndex = 0, frameSize;
-    CHAR filePath[MAX_PATH_LEN + 1];
+    Frame renditionFrames[SAMPLE_MAX_VIDEO_RENDITIONS];
+    UINT32 fileIndex = 0, frameCount;
     STATUS status;
     UINT32 i;
-    UINT64 startTime, lastFrameTime, elapsed;
+    SIZE_T rendition, targetRendition;
+    Canary::FramePacer framePacer;
     UINT64 videoFrameDuration;
     PCHAR pFrameRate;
     PCHAR pNoLoopFrames;
     BOOL noLoopFrames;
-    MEMSET(&encoderStats, 0x00, SIZEOF(RtcEncoderStats));
+    UINT64 lockedTime;
+    MEMSET(&lockHoldStats, 0x00, SIZEOF(SessionLockHoldStats));
     CHK_ERR(pSampleConfiguration != NULL, STATUS_NULL_ARG, "[KVS Master] Streaming session is NULL");
 
     // Determine FPS from environment variable, defaulting to DEFAULT_FPS_VALUE (30)
@@ -245,8 +448,8 @@ PVOID sendVideoPackets(PVOID args)
     }
 
     frame.presentationTs = 0;
-    startTime = GETTIME();
-    lastFrameTime = startTime;
+    frameCount = gVideoFrameArchives[0].getFrameCount();
+    CHK_STATUS(framePacer.init(videoFrameDuration));
 
     // Check if we should stop after one pass through all frames (no looping)
     pNoLoopFrames = GETENV("CANARY_NO_LOOP_FRAMES");
@@ -254,64 +457,46 @@ PVOID sendVideoPackets(PVOID args)
                     (TOLOWER(pNoLoopFrames[0]) == 't' || pNoLoopFrames[0] == '1'));
 
     while (!ATOMIC_LOAD_BOOL(&pSampleConfiguration->appTerminateFlag)) {
-        fileIndex = fileIndex % NUMBER_OF_H264_FRAME_FILES + 1;
+        fileIndex = fileIndex % frameCount + 1;
 
         // If no-loop mode is enabled, stop after sending all frames once
         if (noLoopFrames && fileIndex == 1 && frame.presentationTs > 0) {
-            DLOGI("[KVS Master] All %u frames sent (no-loop mode), stopping video thread", NUMBER_OF_H264_FRAME_FILES);
+            DLOGI("[KVS Master] All %u frames sent (no-loop mode), stopping video thread", frameCount);
             break;
         }
 
-        SNPRINTF(filePath, MAX_PATH_LEN, "./assets/h264SampleFrames/frame-%04d.h264", fileIndex);
-
-        CHK_STATUS(readFrameFromDisk(NULL, &frameSize, filePath));
-
-        // Re-alloc if needed
-        if (frameSize > pSampleConfiguration->videoBufferSize) {
-            pSampleConfiguration->pVideoFrameBuffer = (PBYTE) MEMREALLOC(pSampleConfiguration->pVideoFrameBuffer, frameSize);
-            CHK_ERR(pSampleConfiguration->pVideoFrameBuffer != NULL, STATUS_NOT_ENOUGH_MEMORY, "[KVS Master] Failed to allocate video frame buffer");
-            pSampleConfiguration->videoBufferSize = frameSize;
+        // Points the frames into the mapped archives, no read or copy involved
+        frame.presentationTs += videoFrameDuration;
+        for (i = 0; i < pSampleConfiguration->videoRenditionCount; i++) {
+            renditionFrames[i] = frame;
+            CHK_STATUS(gVideoFrameArchives[i].getFrame(fileIndex - 1, &renditionFrames[i]));
         }
 
-        frame.frameData = pSampleConfiguration->pVideoFrameBuffer;
-        frame.size = frameSize;
-
-        CHK_STATUS(readFrameFromDisk(frame.frameData, &frameSize, filePath));
-
-        // based on bitrate of samples/h264SampleFrames/frame-*
-        encoderStats.width = 640;
-        encoderStats.height = 480;
-        encoderStats.targetBitrate = 262000;
-        frame.presentationTs += videoFrameDuration;
         MUTEX_LOCK(pSampleConfiguration->streamingSessionListReadLock);
+        lockedTime = monotonicTimeNanos();
 
+        // Only writeFrame runs under the lock, everything else is posted to the side effect worker
         for (i = 0; i < pSampleConfiguration->streamingSessionCount; ++i) {
+            pSampleStreamingSession = pSampleConfiguration->sampleStreamingSessionList[i];
+
+            // Renditions only change on a key frame of the rendition being switched to, so the decoder never sees a gap
+            rendition = pSampleStreamingSession->videoRendition;
+            targetRendition = ATOMIC_LOAD(&pSampleStreamingSession->targetVideoRendition);
+            if (targetRendition != rendition && renditionFrames[targetRendition].flags == FRAME_FLAG_KEY_FRAME) {
+                gSideEffectWorker.post(MASTER_SIDE_EFFECT_VIDEO_RENDITION_SWITCHED, GETTIME(), pSampleConfiguration->videoRenditionBitrates[rendition],
+                                       pSampleConfiguration->videoRenditionBitrates[targetRendition],
+                                       ATOMIC_LOAD(&pSampleStreamingSession->targetVideoRenditionTime));
+                rendition = targetRendition;
+                pSampleStreamingSession->videoRendition = rendition;
+            }
 
-            handleWriteFrameMetricIncrementation(pSampleConfiguration->sampleStreamingSessionList[i], frame.size);
-
-            status = writeFrame(pSampleConfiguration->sampleStreamingSessionList[i]->pVideoRtcRtpTransceiver, &frame);
-            if (pSampleConfiguration->sampleStreamingSessionList[i]->firstFrame && status == STATUS_SUCCESS) {
-                writeFirstFrameSentTimeToFile((PCHAR)(std::string(FIRST_FRAME_TS_FILE_PATH) + pSampleConfiguration->fristFrameSentTSFileName).c_str());
-                PROFILE_WITH_START_TIME(pSampleConfiguration->sampleStreamingSessionList[i]->offerReceiveTime, "Time to first frame");
-                
-                DOUBLE timeToFirstFrame = (DOUBLE) (GETTIME() - pSampleConfiguration->offerReceiveTimestamp) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
-                DLOGD("[Canary] Start up latency from offer received to first frame sent (timeToFirstFrame): %lf ms", timeToFirstFrame);
-                Canary::Cloudwatch::getInstance().monitoring.pushTimeToFirstFrame(timeToFirstFrame,
-                                                                                Aws::CloudWatch::Model::StandardUnit::Milliseconds);
-
-                // Push JoinSSCallToFirstFrame — time from JoinStorageSession call to first frame sent
-                if (pSampleConfiguration->joinSSCallStartTime != 0) {
-                    UINT64 joinSSToFirstFrame = (GETTIME() - pSampleConfiguration->joinSSCallStartTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
-                    DLOGI("[Canary] JoinSSCallToFirstFrame: %" PRIu64 " ms", joinSSToFirstFrame);
-                    Canary::Cloudwatch::getInstance().monitoring.pushJoinSSCallToFirstFrame(joinSSToFirstFrame, Aws::CloudWatch::Model::StandardUnit::Milliseconds);
-                }
-
-                calculateDisconnectToFrameSentTime(pSampleConfiguration);
-
-                pSampleConfiguration->sampleStreamingSessionList[i]->firstFrame = FALSE;
+            status = writeFrame(pSampleStreamingSession->pVideoRtcRtpTransceiver, &renditionFrames[rendition]);
+            gSideEffectWorker.post(MASTER_SIDE_EFFECT_VIDEO_FRAME_SENT, 0, (UINT64) pSampleStreamingSession, renditionFrames[rendition].size,
+                                   pSampleConfiguration->videoRenditionBitrates[rendition]);
+            if (pSampleStreamingSession->firstFrame && status == STATUS_SUCCESS) {
+                gSideEffectWorker.post(MASTER_SIDE_EFFECT_FIRST_FRAME_SENT, GETTIME(), pSampleStreamingSession->offerReceiveTime, FALSE);
+                pSampleStreamingSession->firstFrame = FALSE;
             }
-            encoderStats.encodeTimeMsec = 4; // update encode time to an arbitrary number to demonstrate stats update
-            updateEncoderStats(pSampleConfiguration->sampleStreamingSessionList[i]->pVideoRtcRtpTransceiver, &encoderStats);
             if (status != STATUS_SRTP_NOT_READY_YET) {
                 if (status != STATUS_SUCCESS) {
                     DLOGV("writeFrame() failed with 0x%08x", status);
@@ -321,19 +506,20 @@ PVOID sendVideoPackets(PVOID args)
                 fileIndex = 0;
             }
         }
+        recordSessionLockHold(&lockHoldStats, lockedTime);
         MUTEX_UNLOCK(pSampleConfiguration->streamingSessionListReadLock);
 
-        // Adjust sleep in the case the sleep itself and writeFrame take longer than expected. Since sleep makes sure that the thread
-        // will be paused at least until the given amount, we can assume that there's no too early frame scenario.
-        // Also, it's very unlikely to have a delay greater than videoFrameDuration, so the logic assumes that this is always
-        // true for simplicity.
-        elapsed = lastFrameTime - startTime;
-        THREAD_SLEEP(videoFrameDuration - elapsed % videoFrameDuration);
-        lastFrameTime = GETTIME();
+        // Sleep to an absolute deadline so that neither writeFrame nor the sleep itself push the following frames out
+        framePacer.wait();
     }
 
 CleanUp:
     DLOGI("[KVS Master] Closing video thread");
+    framePacer.logStats((PCHAR) "[KVS Master] Video");
+    logSessionLockHoldStats((PCHAR) "[KVS Master] Video", &lockHoldStats);
+    Canary::Cloudwatch::getInstance().monitoring.pushFramePacerStats(&framePacer);
+    Canary::Cloudwatch::getInstance().monitoring.pushSessionLockHoldTime(lockHoldStats.count == 0 ? 0 : lockHoldStats.total / lockHoldStats.count / 1000,
+                                                                         lockHoldStats.max / 1000);
     CHK_LOG_ERR(retStatus);
 
     return (PVOID) (ULONG_PTR) retStatus;
@@ -343,72 +529,54 @@ PVOID sendAudioPackets(PVOID args)
 {
     STATUS retStatus = STATUS_SUCCESS;
     PSampleConfiguration pSampleConfiguration = (PSampleConfiguration) args;
+    PSampleStreamingSession pSampleStreamingSession;
+    SessionLockHoldStats lockHoldStats;
     Frame frame;
-    UINT32 fileIndex = 0, frameSize;
-    CHAR filePath[MAX_PATH_LEN + 1];
+    UINT32 fileIndex = 0, frameCount;
     UINT32 i;
     STATUS status;
+    Canary::FramePacer framePacer;
+    UINT64 lockedTime;
+
+    MEMSET(&lockHoldStats, 0x00, SIZEOF(SessionLockHoldStats));
 
     CHK_ERR(pSampleConfiguration != NULL, STATUS_NULL_ARG, "[KVS Master] Streaming session is NULL");
     frame.presentationTs = 0;
+    frameCount = gAudioFrameArchive.getFrameCount();
+    CHK_STATUS(framePacer.init(SAMPLE_AUDIO_FRAME_DURATION));
 
     while (!ATOMIC_LOAD_BOOL(&pSampleConfiguration->appTerminateFlag)) {
-        fileIndex = fileIndex % NUMBER_OF_OPUS_FRAME_FILES + 1;
-        SNPRINTF(filePath, MAX_PATH_LEN, "./assets/opusSampleFrames/sample-%03d.opus", fileIndex);
-
-        CHK_STATUS(readFrameFromDisk(NULL, &frameSize, filePath));
-
-        // Re-alloc if needed
-        if (frameSize > pSampleConfiguration->audioBufferSize) {
-            pSampleConfiguration->pAudioFrameBuffer = (UINT8*) MEMREALLOC(pSampleConfiguration->pAudioFrameBuffer, frameSize);
-            CHK_ERR(pSampleConfiguration->pAudioFrameBuffer != NULL, STATUS_NOT_ENOUGH_MEMORY, "[KVS Master] Failed to allocate audio frame buffer");
-            pSampleConfiguration->audioBufferSize = frameSize;
-        }
-
-        frame.frameData = pSampleConfiguration->pAudioFrameBuffer;
-        frame.size = frameSize;
-
-        CHK_STATUS(readFrameFromDisk(frame.frameData, &frameSize, filePath));
+        fileIndex = fileIndex % frameCount + 1;
+        CHK_STATUS(gAudioFrameArchive.getFrame(fileIndex - 1, &frame));
 
         frame.presentationTs += SAMPLE_AUDIO_FRAME_DURATION;
 
         MUTEX_LOCK(pSampleConfiguration->streamingSessionListReadLock);
+        lockedTime = monotonicTimeNanos();
         for (i = 0; i < pSampleConfiguration->streamingSessionCount; ++i) {
-            status = writeFrame(pSampleConfiguration->sampleStreamingSessionList[i]->pAudioRtcRtpTransceiver, &frame);
+            pSampleStreamingSession = pSampleConfiguration->sampleStreamingSessionList[i];
+            status = writeFrame(pSampleStreamingSession->pAudioRtcRtpTransceiver, &frame);
             if (status != STATUS_SRTP_NOT_READY_YET) {
                 if (status != STATUS_SUCCESS) {
                     DLOGV("writeFrame() failed with 0x%08x", status);
-                } else if (pSampleConfiguration->sampleStreamingSessionList[i]->firstFrame && status == STATUS_SUCCESS) {
-                    writeFirstFrameSentTimeToFile((PCHAR)(std::string(FIRST_FRAME_TS_FILE_PATH) + pSampleConfiguration->fristFrameSentTSFileName).c_str());
-                    PROFILE_WITH_START_TIME(pSampleConfiguration->sampleStreamingSessionList[i]->offerReceiveTime, "Time to first frame");
-
-                    DOUBLE timeToFirstFrame = (DOUBLE) (GETTIME() - pSampleConfiguration->offerReceiveTimestamp) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
-                DLOGD("[Canary] Start up latency from offer received to first frame sent (timeToFirstFrame): %lf ms", timeToFirstFrame);
-                    Canary::Cloudwatch::getInstance().monitoring.pushTimeToFirstFrame(timeToFirstFrame,
-                                                                                Aws::CloudWatch::Model::StandardUnit::Milliseconds);
-
-                    // Push JoinSSCallToFirstFrame — time from JoinStorageSession call to first frame sent
-                    if (pSampleConfiguration->joinSSCallStartTime != 0) {
-                        UINT64 joinSSToFirstFrame = (GETTIME() - pSampleConfiguration->joinSSCallStartTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
-                        DLOGI("[Canary] JoinSSCallToFirstFrame (audio): %" PRIu64 " ms", joinSSToFirstFrame);
-                        Canary::Cloudwatch::getInstance().monitoring.pushJoinSSCallToFirstFrame(joinSSToFirstFrame, Aws::CloudWatch::Model::StandardUnit::Milliseconds);
-                    }
-
-                    calculateDisconnectToFrameSentTime(pSampleConfiguration);
-
-                    pSampleConfiguration->sampleStreamingSessionList[i]->firstFrame = FALSE;
+                } else if (pSampleStreamingSession->firstFrame) {
+                    gSideEffectWorker.post(MASTER_SIDE_EFFECT_FIRST_FRAME_SENT, GETTIME(), pSampleStreamingSession->offerReceiveTime, TRUE);
+                    pSampleStreamingSession->firstFrame = FALSE;
                 }
             } else {
                 // Reset file index to ensure first frame sent upon SRTP ready is a key frame.
                 fileIndex = 0;
             }
         }
+        recordSessionLockHold(&lockHoldStats, lockedTime);
         MUTEX_UNLOCK(pSampleConfiguration->streamingSessionListReadLock);
-        THREAD_SLEEP(SAMPLE_AUDIO_FRAME_DURATION);
+        framePacer.wait();
     }
 
 CleanUp:
     DLOGI("[KVS Master] closing audio thread");
+    framePacer.logStats((PCHAR) "[KVS Master] Audio");
+    logSessionLockHoldStats((PCHAR) "[KVS Master] Audio", &lockHoldStats);
     return (PVOID) (ULONG_PTR) retStatus;
 }
 
@@ -3,6 +3,7 @@ function(build_dependency lib_name)
   set(supported_libs
       kvsProducerC
       kvsWebRTC
+      benchmark
       )
   list(FIND supported_libs ${lib_name} index)
   if(${index} EQUAL -1)
@@ -0,0 +1,340 @@
+/**
+ * Microbenchmarks for the per frame NAL helpers of the plugin: format detection, CPD conversion and the AvCC/HEVC to
+ * Annex-B frame adaptation done for every WebRTC frame. Every iteration processes one frame of a synthetic GOP, so the
+ * reported time is per frame, and bytes_per_second is the frame payload throughput.
+ *
+ * The corpora mimic what h264parse/h265parse hand to the plugin in stream-format=avc/hvc1: an SEI followed by one or
+ * more slices per frame, a key frame every GOP_LENGTH frames, and slice data with emulation prevention bytes at a
+ * configurable density.
+ */
+#include <benchmark/benchmark.h>
+
+#include <map>
+#include <memory>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include "../src/GstPlugin.h"
+
+#define GOP_LENGTH              30
+#define KEY_FRAME_SIZE_MULTIPLE 6
+#define AVCC_NALU_LENGTH_SIZE   4
+
+namespace {
+
+enum BenchCodec {
+    BENCH_CODEC_H264,
+    BENCH_CODEC_H265,
+};
+
+struct Corpus {
+    std::vector<std::vector<BYTE>> frames;
+    std::vector<BOOL> keyFrames;
+    // avcC/hvcC codec private data
+    std::vector<BYTE> cpd;
+    // The same frames with Annex-B start codes instead of run lengths
+    std::vector<std::vector<BYTE>> annexBFrames;
+};
+
+// Random slice data with emulation prevention applied the way an encoder writes it. zeroPairPercent controls how often
+// the entropy coder happens to produce 00 00, each of those gets an 03 inserted when a byte <= 03 follows
+VOID appendSliceData(std::vector<BYTE>& out, UINT32 size, UINT32 zeroPairPercent, std::mt19937& rng)
+{
+    std::uniform_int_distribution<UINT32> byteDist(0, 255), percentDist(0, 99);
+    UINT32 zeros = 0, written = 0;
+    BYTE b;
+
+    while (written < size) {
+        if (zeros == 0 && percentDist(rng) < zeroPairPercent) {
+            out.push_back(0x00);
+            out.push_back(0x00);
+            out.push_back(0x03);
+            b = (BYTE) (byteDist(rng) & 0x03);
+            out.push_back(b);
+            written += 4;
+            zeros = b == 0x00 ? 1 : 0;
+            continue;
+        }
+
+        // Never end up with an accidental start code
+        b = (BYTE) byteDist(rng);
+        if (zeros >= 2 && b <= 0x03) {
+            out.push_back(0x03);
+            written++;
+            zeros = 0;
+        }
+        out.push_back(b);
+        written++;
+        zeros = b == 0x00 ? zeros + 1 : 0;
+    }
+
+    // A trailing zero would make the run length boundary ambiguous for Annex-B readers
+    if (out.back() == 0x00) {
+        out.back() = 0x80;
+    }
+}
+
+VOID appendNalu(std::vector<BYTE>& frame, std::vector<BYTE>& annexBFrame, const std::vector<BYTE>& nalu)
+{
+    UINT32 size = (UINT32) nalu.size();
+    BYTE runLength[AVCC_NALU_LENGTH_SIZE] = {(BYTE) (size >> 24), (BYTE) (size >> 16), (BYTE) (size >> 8), (BYTE) size};
+    BYTE startCode[] = {0x00, 0x00, 0x00, 0x01};
+
+    frame.insert(frame.end(), runLength, runLength + SIZEOF(runLength));
+    frame.insert(frame.end(), nalu.begin(), nalu.end());
+    annexBFrame.insert(annexBFrame.end(), startCode, startCode + SIZEOF(startCode));
+    annexBFrame.insert(annexBFrame.end(), nalu.begin(), nalu.end());
+}
+
+std::vector<BYTE> makeNalu(BenchCodec codec, BYTE type, UINT32 size, UINT32 zeroPairPercent, std::mt19937& rng)
+{
+    std::vector<BYTE> nalu;
+
+    if (codec == BENCH_CODEC_H264) {
+        // nal_ref_idc 3 for everything but SEI
+        nalu.push_back((BYTE) ((type == 6 ? 0x00 : 0x60) | type));
+    } else {
+        nalu.push_back((BYTE) (type << 1));
+        nalu.push_back(0x01);
+    }
+    appendSliceData(nalu, size, zeroPairPercent, rng);
+
+    return nalu;
+}
+
+std::vector<BYTE> makeCpd(BenchCodec codec, std::mt19937& rng)
+{
+    std::vector<BYTE> cpd, vps, sps, pps;
+
+    if (codec == BENCH_CODEC_H264) {
+        sps = makeNalu(codec, H264_SPS_NALU_TYPE, 24, 0, rng);
+        pps = makeNalu(codec, H264_PPS_NALU_TYPE, 4, 0, rng);
+
+        cpd = {AVCC_VERSION_CODE, 0x64, 0x00, 0x1f, AVCC_NALU_LEN_MINUS_ONE, AVCC_NUMBER_OF_SPS_ONE};
+        cpd.push_back((BYTE) (sps.size() >> 8));
+        cpd.push_back((BYTE) sps.size());
+        cpd.insert(cpd.end(), sps.begin(), sps.end());
+        cpd.push_back(0x01);
+        cpd.push_back((BYTE) (pps.size() >> 8));
+        cpd.push_back((BYTE) pps.size());
+        cpd.insert(cpd.end(), pps.begin(), pps.end());
+        return cpd;
+    }
+
+    vps = makeNalu(codec, H265_VPS_NALU_TYPE, 20, 0, rng);
+    sps = makeNalu(codec, H265_SPS_NALU_TYPE, 40, 0, rng);
+    pps = makeNalu(codec, H265_PPS_NALU_TYPE, 8, 0, rng);
+
+    // Reserved bits of chroma format and bit depths are left cleared, identifyCpdNalFormat only takes hvcC laid out
+    // that way for HEVC
+    cpd = {0x01, 0x01, 0x60, 0x00, 0x00, 0x00, 0x90, 0x00, 0x00, 0x00, 0x00, 0x00, 0x5d, 0xf0, 0x00, 0xfc, 0x01, 0x00, 0x00, 0x00, 0x00, 0x0f};
+    cpd.push_back(3);
+    for (auto nalu : {&vps, &sps, &pps}) {
+        cpd.push_back((BYTE) (0x80 | ((*nalu)[0] >> 1)));
+        cpd.push_back(0x00);
+        cpd.push_back(0x01);
+        cpd.push_back((BYTE) (nalu->size() >> 8));
+        cpd.push_back((BYTE) nalu->size());
+        cpd.insert(cpd.end(), nalu->begin(), nalu->end());
+    }
+
+    return cpd;
+}
+
+// Cached per argument set, building a corpus takes far longer than the benchmark runs
+const Corpus& getCorpus(BenchCodec codec, UINT32 slicesPerFrame, UINT32 frameSize, UINT32 zeroPairPercent)
+{
+    static std::map<std::tuple<INT32, UINT32, UINT32, UINT32>, std::unique_ptr<Corpus>> corpora;
+    auto& pCorpus = corpora[std::make_tuple((INT32) codec, slicesPerFrame, frameSize, zeroPairPercent)];
+    std::mt19937 rng(slicesPerFrame * 7919 + frameSize + zeroPairPercent);
+    BYTE sliceType, seiType = codec == BENCH_CODEC_H264 ? 6 : 39;
+    UINT32 i, s, sliceSize;
+    BOOL keyFrame;
+
+    if (pCorpus != nullptr) {
+        return *pCorpus;
+    }
+
+    pCorpus.reset(new Corpus());
+    pCorpus->cpd = makeCpd(codec, rng);
+    for (i = 0; i < GOP_LENGTH; i++) {
+        std::vector<BYTE> frame, annexBFrame;
+
+        keyFrame = i == 0;
+        if (codec == BENCH_CODEC_H264) {
+            sliceType = keyFrame ? IDR_NALU_TYPE : 1;
+        } else {
+            sliceType = keyFrame ? IDR_W_RADL_NALU_TYPE : 1;
+        }
+        sliceSize = MAX(frameSize * (keyFrame ? KEY_FRAME_SIZE_MULTIPLE : 1) / slicesPerFrame, 16);
+
+        appendNalu(frame, annexBFrame, makeNalu(codec, seiType, 24, 0, rng));
+        for (s = 0; s < slicesPerFrame; s++) {
+            appendNalu(frame, annexBFrame, makeNalu(codec, sliceType, sliceSize, zeroPairPercent, rng));
+        }
+
+        pCorpus->frames.push_back(std::move(frame));
+        pCorpus->annexBFrames.push_back(std::move(annexBFrame));
+        pCorpus->keyFrames.push_back(keyFrame);
+    }
+
+    return *pCorpus;
+}
+
+struct PluginDeleter {
+    VOID operator()(PGstKvsPlugin pGstKvsPlugin)
+    {
+        SAFE_MEMFREE(pGstKvsPlugin->pAdaptedFrameBuf);
+        MEMFREE(pGstKvsPlugin);
+    }
+};
+
+// Only the CPD and adapted frame buffer fields are touched by the helpers under test
+std::unique_ptr<GstKvsPlugin, PluginDeleter> createPlugin()
+{
+    return std::unique_ptr<GstKvsPlugin, PluginDeleter>((PGstKvsPlugin) MEMCALLOC(1, SIZEOF(GstKvsPlugin)));
+}
+
+VOID setCounters(benchmark::State& state, UINT64 bytes)
+{
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(bytes);
+}
+
+template <BenchCodec codec, BOOL annexB> VOID BM_IdentifyFrameNalFormat(benchmark::State& state)
+{
+    const Corpus& corpus = getCorpus(codec, (UINT32) state.range(0), (UINT32) state.range(1), (UINT32) state.range(2));
+    auto& frames = annexB ? corpus.annexBFrames : corpus.frames;
+    ELEMENTARY_STREAM_NAL_FORMAT format;
+    UINT64 bytes = 0;
+    SIZE_T i = 0;
+
+    // Make sure the corpus takes the path it is meant to measure
+    identifyFrameNalFormat((PBYTE) frames[0].data(), (UINT32) frames[0].size(), &format);
+    if (format != (annexB ? ELEMENTARY_STREAM_NAL_FORMAT_ANNEX_B : ELEMENTARY_STREAM_NAL_FORMAT_AVCC)) {
+        state.SkipWithError("Unexpected frame NAL format");
+        return;
+    }
+
+    for (auto _ : state) {
+        auto& frame = frames[i];
+        benchmark::DoNotOptimize(identifyFrameNalFormat((PBYTE) frame.data(), (UINT32) frame.size(), &format));
+        benchmark::DoNotOptimize(format);
+        bytes += frame.size();
+        i = (i + 1) % frames.size();
+    }
+
+    setCounters(state, bytes);
+}
+
+template <BenchCodec codec> VOID BM_IdentifyCpdNalFormat(benchmark::State& state)
+{
+    const Corpus& corpus = getCorpus(codec, 1, 1024, 0);
+    ELEMENTARY_STREAM_NAL_FORMAT format;
+
+    identifyCpdNalFormat((PBYTE) corpus.cpd.data(), (UINT32) corpus.cpd.size(), &format);
+    if (format != (codec == BENCH_CODEC_H264 ? ELEMENTARY_STREAM_NAL_FORMAT_AVCC : ELEMENTARY_STREAM_NAL_FORMAT_HEVC)) {
+        state.SkipWithError("Unexpected CPD NAL format");
+        return;
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(identifyCpdNalFormat((PBYTE) corpus.cpd.data(), (UINT32) corpus.cpd.size(), &format));
+        benchmark::DoNotOptimize(format);
+    }
+
+    setCounters(state, state.iterations() * corpus.cpd.size());
+}
+
+template <BenchCodec codec> VOID BM_ConvertCpdToAnnexB(benchmark::State& state)
+{
+    const Corpus& corpus = getCorpus(codec, 1, 1024, 0);
+    auto pGstKvsPlugin = createPlugin();
+
+    for (auto _ : state) {
+        if (codec == BENCH_CODEC_H264) {
+            benchmark::DoNotOptimize(convertCpdFromAvcToAnnexB(pGstKvsPlugin.get(), (PBYTE) corpus.cpd.data(), (UINT32) corpus.cpd.size()));
+        } else {
+            benchmark::DoNotOptimize(convertCpdFromHevcToAnnexB(pGstKvsPlugin.get(), (PBYTE) corpus.cpd.data(), (UINT32) corpus.cpd.size()));
+        }
+        benchmark::ClobberMemory();
+    }
+
+    setCounters(state, state.iterations() * corpus.cpd.size());
+}
+
+template <BenchCodec codec> VOID BM_AdaptVideoFrameFromAvccToAnnexB(benchmark::State& state)
+{
+    const Corpus& corpus = getCorpus(codec, (UINT32) state.range(0), (UINT32) state.range(1), (UINT32) state.range(2));
+    ELEMENTARY_STREAM_NAL_FORMAT nalFormat = codec == BENCH_CODEC_H264 ? ELEMENTARY_STREAM_NAL_FORMAT_AVCC : ELEMENTARY_STREAM_NAL_FORMAT_HEVC;
+    auto pGstKvsPlugin = createPlugin();
+    Frame frame;
+    STATUS retStatus;
+    UINT64 bytes = 0;
+    SIZE_T i = 0;
+
+    if (codec == BENCH_CODEC_H264) {
+        retStatus = convertCpdFromAvcToAnnexB(pGstKvsPlugin.get(), (PBYTE) corpus.cpd.data(), (UINT32) corpus.cpd.size());
+    } else {
+        retStatus = convertCpdFromHevcToAnnexB(pGstKvsPlugin.get(), (PBYTE) corpus.cpd.data(), (UINT32) corpus.cpd.size());
+    }
+    if (STATUS_FAILED(retStatus)) {
+        state.SkipWithError("Invalid CPD");
+        return;
+    }
+
+    MEMSET(&frame, 0x00, SIZEOF(Frame));
+    frame.trackId = DEFAULT_VIDEO_TRACK_ID;
+    for (auto _ : state) {
+        // The helper points the frame at the adapted buffer, so it is reset from the corpus every time
+        frame.frameData = (PBYTE) corpus.frames[i].data();
+        frame.size = (UINT32) corpus.frames[i].size();
+        frame.flags = corpus.keyFrames[i] ? FRAME_FLAG_KEY_FRAME : FRAME_FLAG_NONE;
+        benchmark::DoNotOptimize(adaptVideoFrameFromAvccToAnnexB(pGstKvsPlugin.get(), &frame, nalFormat));
+        benchmark::ClobberMemory();
+        bytes += corpus.frames[i].size();
+        i = (i + 1) % corpus.frames.size();
+    }
+
+    setCounters(state, bytes);
+}
+
+// Slices per frame, delta frame size in bytes and the percentage of emulation prevented zero pairs
+VOID frameArguments(benchmark::internal::Benchmark* pBenchmark)
+{
+    for (INT64 slices : {1, 4, 16}) {
+        for (INT64 frameSize : {2 * 1024, 16 * 1024, 128 * 1024}) {
+            for (INT64 zeroPairPercent : {0, 2}) {
+                pBenchmark->Args({slices, frameSize, zeroPairPercent});
+            }
+        }
+    }
+    pBenchmark->ArgNames({"slices", "size", "epb"});
+}
+
+} // namespace
+
+BENCHMARK_TEMPLATE(BM_IdentifyFrameNalFormat, BENCH_CODEC_H264, FALSE)->Apply(frameArguments);
+BENCHMARK_TEMPLATE(BM_IdentifyFrameNalFormat, BENCH_CODEC_H264, TRUE)->Apply(frameArguments);
+BENCHMARK_TEMPLATE(BM_IdentifyFrameNalFormat, BENCH_CODEC_H265, FALSE)->Apply(frameArguments);
+BENCHMARK_TEMPLATE(BM_IdentifyCpdNalFormat, BENCH_CODEC_H264);
+BENCHMARK_TEMPLATE(BM_IdentifyCpdNalFormat, BENCH_CODEC_H265);
+BENCHMARK_TEMPLATE(BM_ConvertCpdToAnnexB, BENCH_CODEC_H264);
+BENCHMARK_TEMPLATE(BM_ConvertCpdToAnnexB, BENCH_CODEC_H265);
+BENCHMARK_TEMPLATE(BM_AdaptVideoFrameFromAvccToAnnexB, BENCH_CODEC_H264)->Apply(frameArguments);
+BENCHMARK_TEMPLATE(BM_AdaptVideoFrameFromAvccToAnnexB, BENCH_CODEC_H265)->Apply(frameArguments);
+
+INT32 main(INT32 argc, CHAR* argv[])
+{
+    // The helpers read the run lengths through the PIC endianness accessors
+    initializeEndianness();
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+
+    return 0;
+}
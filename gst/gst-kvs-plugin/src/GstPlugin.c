@@ -73,6 +73,25 @@ GType gst_kvs_plugin_streaming_type_get_type(VOID)
     return kvsPluginStreamingType;
 }
 
+#define GST_TYPE_KVS_PLUGIN_FRAGMENT_TUNING (gst_kvs_plugin_fragment_tuning_get_type())
+GType gst_kvs_plugin_fragment_tuning_get_type(VOID)
+{
+    // Need to use static. Could have used a global as well
+    static GType kvsPluginFragmentTuning = 0;
+    static GEnumValue enumType[] = {
+        {GST_PLUGIN_FRAGMENT_TUNING_OFF, "only recommend the fragment duration", "off"},
+        {GST_PLUGIN_FRAGMENT_TUNING_LATENCY, "shortest fragments over the minimum duration", "latency"},
+        {GST_PLUGIN_FRAGMENT_TUNING_OVERHEAD, "longest fragments within the maximum duration and size", "overhead"},
+        {0, NULL, NULL},
+    };
+
+    if (kvsPluginFragmentTuning == 0) {
+        kvsPluginFragmentTuning = g_enum_register_static("GST_PLUGIN_FRAGMENT_TUNING", enumType);
+    }
+
+    return kvsPluginFragmentTuning;
+}
+
 #define GST_TYPE_KVS_PLUGIN_WEBRTC_CONNECTION_MODE (gst_kvs_plugin_connection_mode_get_type())
 GType gst_kvs_plugin_connection_mode_get_type(VOID)
 {
@@ -357,6 +376,118 @@ VOID gst_kvs_plugin_class_init(GstKvsPluginClass* klass)
                                     g_param_spec_boolean("connect-webrtc", "WebRTC Connect", "Whether to connect to WebRTC signaling channel",
                                                          DEFAULT_WEBRTC_CONNECT, (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
 
+    g_object_class_install_property(gobject_class, PROP_ASYNC_STARTUP,
+                                    g_param_spec_boolean("async-startup", "Async Startup",
+                                                         "Create the stream and bring up signaling concurrently in the background. "
+                                                         "Buffers arriving earlier are pre-rolled",
+                                                         DEFAULT_ASYNC_STARTUP, (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_STARTUP_PREROLL_SIZE,
+                                    g_param_spec_uint("startup-preroll-size", "Startup Pre-roll Size",
+                                                      "Frames held while the stream is created with async-startup. Unit: bytes", 0, G_MAXUINT,
+                                                      DEFAULT_STARTUP_PREROLL_SIZE_BYTES, (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_STARTUP_TIMES,
+                                    g_param_spec_boxed("startup-times", "Startup Times", "Per phase startup breakdown. Unit: milliseconds",
+                                                       GST_TYPE_STRUCTURE, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_PRODUCER_CACHE_FILE,
+                                    g_param_spec_string("producer-cache-file", "Producer Cache File",
+                                                        "File caching the stream description and data endpoint across restarts. "
+                                                        "Empty disables it",
+                                                        DEFAULT_PRODUCER_CACHE_FILE_PATH, (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_RECOVERY_STATS,
+                                    g_param_spec_boxed("recovery-stats", "Recovery Stats",
+                                                       "Stream error recoveries with the media re-sent and lost. Unit: milliseconds",
+                                                       GST_TYPE_STRUCTURE, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_FRAME_SHEDDING,
+                                    g_param_spec_boolean("frame-shedding", "Frame Shedding",
+                                                         "Shed non-reference frames, then whole GOPs, on the producer's latency, buffer and "
+                                                         "storage pressure and send QoS events upstream",
+                                                         DEFAULT_FRAME_SHEDDING, (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_SHEDDING_STATS,
+                                    g_param_spec_boxed("shedding-stats", "Shedding Stats", "Pressure events and shed frames by reason",
+                                                       GST_TYPE_STRUCTURE, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_METADATA_BATCHING,
+                                    g_param_spec_boolean("metadata-batching", "Metadata Batching",
+                                                         "Batch the fragment metadata events, last value per name, and put them once "
+                                                         "ahead of the next fragment",
+                                                         DEFAULT_METADATA_BATCHING, (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_METADATA_BATCH_SIZE,
+                                    g_param_spec_uint("metadata-batch-size", "Metadata Batch Size",
+                                                      "Metadata name and value bytes batched per fragment, the rest is dropped. Unit: bytes", 0,
+                                                      G_MAXUINT, DEFAULT_METADATA_BATCH_SIZE,
+                                                      (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_METADATA_STATS,
+                                    g_param_spec_boxed("metadata-stats", "Metadata Stats", "Batched, deduplicated, dropped and flushed metadata",
+                                                       GST_TYPE_STRUCTURE, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_UPLOAD_SESSIONS,
+                                    g_param_spec_uint("upload-sessions", "Upload Sessions",
+                                                      "Concurrent sessions uploading the segments in offline mode with a file start time", 1,
+                                                      MAX_UPLOAD_SESSIONS, DEFAULT_UPLOAD_SESSIONS,
+                                                      (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_UPLOAD_SEGMENT_DURATION,
+                                    g_param_spec_uint("upload-segment-duration", "Upload Segment Duration",
+                                                      "Duration of the key frame aligned segments spread over the upload sessions. Unit: seconds", 1,
+                                                      G_MAXUINT, DEFAULT_UPLOAD_SEGMENT_DURATION_SECONDS,
+                                                      (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_UPLOAD_JOURNAL,
+                                    g_param_spec_string("upload-journal", "Upload Journal",
+                                                        "File recording the persisted segments of a bulk upload, which are skipped when "
+                                                        "uploading the same input again. Empty disables it",
+                                                        DEFAULT_UPLOAD_JOURNAL_PATH, (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_UPLOAD_STATS,
+                                    g_param_spec_boxed("upload-stats", "Upload Stats", "Bulk upload segments and persisted fragments",
+                                                       GST_TYPE_STRUCTURE, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_MEMORY_REPORT_PERIOD,
+                                    g_param_spec_uint("memory-report-period", "Memory Report Period",
+                                                      "Period of the memory stats element messages on the bus, 0 to turn them off. Unit: seconds", 0,
+                                                      G_MAXUINT, DEFAULT_MEMORY_REPORT_PERIOD_SECONDS,
+                                                      (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_SIGNALING_POOL_SIZE,
+                                    g_param_spec_uint("signaling-pool-size", "Signaling Pool Size",
+                                                      "ICE candidates queued ahead of the offers of their peers, the rest is dropped", 1, G_MAXUINT,
+                                                      DEFAULT_SIGNALING_POOL_SIZE, (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_SIGNALING_POOL_STATS,
+                                    g_param_spec_boxed("signaling-pool-stats", "Signaling Pool Stats",
+                                                       "Hits, misses and drops of the pooled ICE candidates and pending queues", GST_TYPE_STRUCTURE,
+                                                       (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_FRAGMENT_TUNING,
+                                    g_param_spec_enum("fragment-tuning", "Fragment Tuning",
+                                                      "Fragment duration picked from the key frame cadence measured over the warm-up. "
+                                                      "Off only logs the recommendation",
+                                                      GST_TYPE_KVS_PLUGIN_FRAGMENT_TUNING, DEFAULT_FRAGMENT_TUNING,
+                                                      (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_FRAGMENT_TUNING_WARMUP,
+                                    g_param_spec_uint("fragment-tuning-warmup", "Fragment Tuning Warm-up",
+                                                      "Stream time the key frame cadence and bitrate are measured over. Unit: seconds", 0, G_MAXUINT,
+                                                      DEFAULT_FRAGMENT_TUNING_WARMUP_SECONDS, (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_FRAGMENT_STATS,
+                                    g_param_spec_boxed("fragment-stats", "Fragment Stats",
+                                                       "Measured key frame cadence and bitrate, recommendations and the fragment size and "
+                                                       "duration distributions",
+                                                       GST_TYPE_STRUCTURE, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_MEMORY_STATS,
+                                    g_param_spec_boxed("memory-stats", "Memory Stats", "Current, peak and allocation rate of the memory per subsystem",
+                                                       GST_TYPE_STRUCTURE, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
     g_object_class_install_property(gobject_class, PROP_STREAM_CREATE_TIMEOUT,
                                     g_param_spec_uint("stream-create-timeout", "Stream creation timeout", "Stream create timeout. Unit: seconds", 0,
                                                       G_MAXUINT, DEFAULT_STREAM_CREATE_TIMEOUT_SECONDS,
@@ -416,6 +547,17 @@ VOID gst_kvs_plugin_init(PGstKvsPlugin pGstKvsPlugin)
     pGstKvsPlugin->gstParams.rotationPeriodInSeconds = DEFAULT_ROTATION_PERIOD_SECONDS;
     pGstKvsPlugin->gstParams.logLevel = DEFAULT_LOG_LEVEL;
     pGstKvsPlugin->gstParams.fileLogPath = g_strdup(DEFAULT_FILE_LOG_PATH);
+    pGstKvsPlugin->gstParams.producerCacheFilePath = g_strdup(DEFAULT_PRODUCER_CACHE_FILE_PATH);
+    pGstKvsPlugin->gstParams.frameShedding = DEFAULT_FRAME_SHEDDING;
+    pGstKvsPlugin->gstParams.metadataBatching = DEFAULT_METADATA_BATCHING;
+    pGstKvsPlugin->gstParams.metadataBatchSize = DEFAULT_METADATA_BATCH_SIZE;
+    pGstKvsPlugin->gstParams.uploadSessions = DEFAULT_UPLOAD_SESSIONS;
+    pGstKvsPlugin->gstParams.uploadSegmentDurationInSeconds = DEFAULT_UPLOAD_SEGMENT_DURATION_SECONDS;
+    pGstKvsPlugin->gstParams.uploadJournalPath = g_strdup(DEFAULT_UPLOAD_JOURNAL_PATH);
+    pGstKvsPlugin->gstParams.memoryReportPeriodInSeconds = DEFAULT_MEMORY_REPORT_PERIOD_SECONDS;
+    pGstKvsPlugin->gstParams.signalingPoolSize = DEFAULT_SIGNALING_POOL_SIZE;
+    pGstKvsPlugin->gstParams.fragmentTuning = DEFAULT_FRAGMENT_TUNING;
+    pGstKvsPlugin->gstParams.fragmentTuningWarmupInSeconds = DEFAULT_FRAGMENT_TUNING_WARMUP_SECONDS;
     pGstKvsPlugin->gstParams.storageSizeInBytes = DEFAULT_STORAGE_SIZE_MB;
     pGstKvsPlugin->gstParams.credentialFilePath = g_strdup(DEFAULT_CREDENTIAL_FILE_PATH);
     pGstKvsPlugin->gstParams.fileStartTime = GETTIME() / HUNDREDS_OF_NANOS_IN_A_SECOND;
@@ -425,6 +567,8 @@ VOID gst_kvs_plugin_init(PGstKvsPlugin pGstKvsPlugin)
     pGstKvsPlugin->gstParams.trickleIce = DEFAULT_TRICKLE_ICE_MODE;
     pGstKvsPlugin->gstParams.enableStreaming = DEFAULT_ENABLE_STREAMING;
     pGstKvsPlugin->gstParams.webRtcConnect = DEFAULT_WEBRTC_CONNECT;
+    pGstKvsPlugin->gstParams.asyncStartup = DEFAULT_ASYNC_STARTUP;
+    pGstKvsPlugin->gstParams.startupPrerollSize = DEFAULT_STARTUP_PREROLL_SIZE_BYTES;
 
     ATOMIC_STORE_BOOL(&pGstKvsPlugin->enableStreaming, pGstKvsPlugin->gstParams.enableStreaming);
     ATOMIC_STORE_BOOL(&pGstKvsPlugin->connectWebRtc, pGstKvsPlugin->gstParams.webRtcConnect);
@@ -432,6 +576,19 @@ VOID gst_kvs_plugin_init(PGstKvsPlugin pGstKvsPlugin)
     pGstKvsPlugin->adaptedFrameBufSize = 0;
     pGstKvsPlugin->pAdaptedFrameBuf = NULL;
 
+    pGstKvsPlugin->frameStageFn = NULL;
+    pGstKvsPlugin->frameStageCustomData = 0;
+
+    MEMSET(&pGstKvsPlugin->startupTimes, 0x00, SIZEOF(StartupTimes));
+    pGstKvsPlugin->startupLock = INVALID_MUTEX_VALUE;
+    pGstKvsPlugin->sheddingLock = INVALID_MUTEX_VALUE;
+    pGstKvsPlugin->metadataLock = INVALID_MUTEX_VALUE;
+    pGstKvsPlugin->fragmentTuning.lock = INVALID_MUTEX_VALUE;
+    pGstKvsPlugin->memoryAccounting.reportTimerId = MAX_UINT32;
+    pGstKvsPlugin->pPrerollQueue = NULL;
+    pGstKvsPlugin->streamStartupTid = INVALID_TID_VALUE;
+    pGstKvsPlugin->webRtcStartupTid = INVALID_TID_VALUE;
+
     // Mark plugin as sink
     GST_OBJECT_FLAG_SET(pGstKvsPlugin, GST_ELEMENT_FLAG_SINK);
 }
@@ -444,6 +601,12 @@ VOID gst_kvs_plugin_finalize(GObject* object)
         return;
     }
 
+    freeMemoryAccounting(pGstKvsPlugin);
+    freeStartup(pGstKvsPlugin);
+    freeShedding(pGstKvsPlugin);
+    freeMetadataBatch(pGstKvsPlugin);
+    freeFragmentTuning(pGstKvsPlugin);
+
     if (pGstKvsPlugin->kvsContext.pDeviceInfo != NULL) {
         freeDeviceInfo(&pGstKvsPlugin->kvsContext.pDeviceInfo);
     }
@@ -464,6 +627,10 @@ VOID gst_kvs_plugin_finalize(GObject* object)
         freeCallbacksProvider(&pGstKvsPlugin->kvsContext.pClientCallbacks);
     }
 
+    // Only once the provider is gone as it calls into the cache and the bulk upload
+    freeProducerCache(&pGstKvsPlugin->kvsContext.pProducerCache);
+    freeBulkUpload(&pGstKvsPlugin->kvsContext.pBulkUpload);
+
     freeGstKvsWebRtcPlugin(pGstKvsPlugin);
 
     // Last object to be freed
@@ -480,6 +647,8 @@ VOID gst_kvs_plugin_finalize(GObject* object)
     g_free(pGstKvsPlugin->gstParams.accessKey);
     g_free(pGstKvsPlugin->audioCodecId);
     g_free(pGstKvsPlugin->gstParams.fileLogPath);
+    g_free(pGstKvsPlugin->gstParams.producerCacheFilePath);
+    g_free(pGstKvsPlugin->gstParams.uploadJournalPath);
 
     if (pGstKvsPlugin->gstParams.iotCertificate != NULL) {
         gst_structure_free(pGstKvsPlugin->gstParams.iotCertificate);
@@ -649,6 +818,47 @@ VOID gst_kvs_plugin_set_property(GObject* object, guint propId, const GValue* va
             pGstKvsPlugin->gstParams.webRtcConnect = g_value_get_boolean(value);
             ATOMIC_STORE_BOOL(&pGstKvsPlugin->connectWebRtc, pGstKvsPlugin->gstParams.webRtcConnect);
             break;
+        case PROP_ASYNC_STARTUP:
+            pGstKvsPlugin->gstParams.asyncStartup = g_value_get_boolean(value);
+            break;
+        case PROP_STARTUP_PREROLL_SIZE:
+            pGstKvsPlugin->gstParams.startupPrerollSize = g_value_get_uint(value);
+            break;
+        case PROP_PRODUCER_CACHE_FILE:
+            g_free(pGstKvsPlugin->gstParams.producerCacheFilePath);
+            pGstKvsPlugin->gstParams.producerCacheFilePath = g_strdup(g_value_get_string(value));
+            break;
+        case PROP_FRAME_SHEDDING:
+            pGstKvsPlugin->gstParams.frameShedding = g_value_get_boolean(value);
+            break;
+        case PROP_METADATA_BATCHING:
+            pGstKvsPlugin->gstParams.metadataBatching = g_value_get_boolean(value);
+            break;
+        case PROP_METADATA_BATCH_SIZE:
+            pGstKvsPlugin->gstParams.metadataBatchSize = g_value_get_uint(value);
+            break;
+        case PROP_UPLOAD_SESSIONS:
+            pGstKvsPlugin->gstParams.uploadSessions = g_value_get_uint(value);
+            break;
+        case PROP_UPLOAD_SEGMENT_DURATION:
+            pGstKvsPlugin->gstParams.uploadSegmentDurationInSeconds = g_value_get_uint(value);
+            break;
+        case PROP_UPLOAD_JOURNAL:
+            g_free(pGstKvsPlugin->gstParams.uploadJournalPath);
+            pGstKvsPlugin->gstParams.uploadJournalPath = g_strdup(g_value_get_string(value));
+            break;
+        case PROP_MEMORY_REPORT_PERIOD:
+            pGstKvsPlugin->gstParams.memoryReportPeriodInSeconds = g_value_get_uint(value);
+            break;
+        case PROP_SIGNALING_POOL_SIZE:
+            pGstKvsPlugin->gstParams.signalingPoolSize = g_value_get_uint(value);
+            break;
+        case PROP_FRAGMENT_TUNING:
+            pGstKvsPlugin->gstParams.fragmentTuning = (GST_PLUGIN_FRAGMENT_TUNING) g_value_get_enum(value);
+            break;
+        case PROP_FRAGMENT_TUNING_WARMUP:
+            pGstKvsPlugin->gstParams.fragmentTuningWarmupInSeconds = g_value_get_uint(value);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, propId, pspec);
             break;
@@ -784,6 +994,93 @@ VOID gst_kvs_plugin_get_property(GObject* object, guint propId, GValue* value, G
         case PROP_WEBRTC_CONNECT:
             g_value_set_boolean(value, pGstKvsPlugin->gstParams.webRtcConnect);
             break;
+        case PROP_ASYNC_STARTUP:
+            g_value_set_boolean(value, pGstKvsPlugin->gstParams.asyncStartup);
+            break;
+        case PROP_STARTUP_PREROLL_SIZE:
+            g_value_set_uint(value, pGstKvsPlugin->gstParams.startupPrerollSize);
+            break;
+        case PROP_PRODUCER_CACHE_FILE:
+            g_value_set_string(value, pGstKvsPlugin->gstParams.producerCacheFilePath);
+            break;
+        case PROP_RECOVERY_STATS: {
+            GstStructure* recoveryStats = getRecoveryStats(pGstKvsPlugin);
+            gst_value_set_structure(value, recoveryStats);
+            gst_structure_free(recoveryStats);
+            break;
+        }
+        case PROP_FRAME_SHEDDING:
+            g_value_set_boolean(value, pGstKvsPlugin->gstParams.frameShedding);
+            break;
+        case PROP_SHEDDING_STATS: {
+            GstStructure* sheddingStats = getSheddingStats(pGstKvsPlugin);
+            gst_value_set_structure(value, sheddingStats);
+            gst_structure_free(sheddingStats);
+            break;
+        }
+        case PROP_METADATA_BATCHING:
+            g_value_set_boolean(value, pGstKvsPlugin->gstParams.metadataBatching);
+            break;
+        case PROP_METADATA_BATCH_SIZE:
+            g_value_set_uint(value, pGstKvsPlugin->gstParams.metadataBatchSize);
+            break;
+        case PROP_UPLOAD_SESSIONS:
+            g_value_set_uint(value, pGstKvsPlugin->gstParams.uploadSessions);
+            break;
+        case PROP_UPLOAD_SEGMENT_DURATION:
+            g_value_set_uint(value, pGstKvsPlugin->gstParams.uploadSegmentDurationInSeconds);
+            break;
+        case PROP_UPLOAD_JOURNAL:
+            g_value_set_string(value, pGstKvsPlugin->gstParams.uploadJournalPath);
+            break;
+        case PROP_UPLOAD_STATS: {
+            GstStructure* uploadStats = getBulkUploadStats(pGstKvsPlugin);
+            gst_value_set_structure(value, uploadStats);
+            gst_structure_free(uploadStats);
+            break;
+        }
+        case PROP_MEMORY_REPORT_PERIOD:
+            g_value_set_uint(value, pGstKvsPlugin->gstParams.memoryReportPeriodInSeconds);
+            break;
+        case PROP_SIGNALING_POOL_SIZE:
+            g_value_set_uint(value, pGstKvsPlugin->gstParams.signalingPoolSize);
+            break;
+        case PROP_SIGNALING_POOL_STATS: {
+            GstStructure* signalingPoolStats = getSignalingPoolStats(pGstKvsPlugin);
+            gst_value_set_structure(value, signalingPoolStats);
+            gst_structure_free(signalingPoolStats);
+            break;
+        }
+        case PROP_FRAGMENT_TUNING:
+            g_value_set_enum(value, pGstKvsPlugin->gstParams.fragmentTuning);
+            break;
+        case PROP_FRAGMENT_TUNING_WARMUP:
+            g_value_set_uint(value, pGstKvsPlugin->gstParams.fragmentTuningWarmupInSeconds);
+            break;
+        case PROP_FRAGMENT_STATS: {
+            GstStructure* fragmentStats = getFragmentStats(pGstKvsPlugin);
+            gst_value_set_structure(value, fragmentStats);
+            gst_structure_free(fragmentStats);
+            break;
+        }
+        case PROP_MEMORY_STATS: {
+            GstStructure* memoryStats = getMemoryStats(pGstKvsPlugin);
+            gst_value_set_structure(value, memoryStats);
+            gst_structure_free(memoryStats);
+            break;
+        }
+        case PROP_METADATA_STATS: {
+            GstStructure* metadataStats = getMetadataStats(pGstKvsPlugin);
+            gst_value_set_structure(value, metadataStats);
+            gst_structure_free(metadataStats);
+            break;
+        }
+        case PROP_STARTUP_TIMES: {
+            GstStructure* startupTimes = getStartupTimes(pGstKvsPlugin);
+            gst_value_set_structure(value, startupTimes);
+            gst_structure_free(startupTimes);
+            break;
+        }
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, propId, pspec);
             break;
@@ -804,6 +1101,7 @@ gboolean gst_kvs_plugin_handle_plugin_event(GstCollectPads* pads, GstCollectData
     const GstStructure* gstStruct;
     PCHAR pName, pVal;
     UINT32 nalFlags = NAL_ADAPTATION_FLAG_NONE;
+    StreamCall streamCall;
 
     gint samplerate = 0, channels = 0;
     const gchar* mediaType;
@@ -811,11 +1109,24 @@ gboolean gst_kvs_plugin_handle_plugin_event(GstCollectPads* pads, GstCollectData
     switch (GST_EVENT_TYPE(event)) {
         case GST_EVENT_EOS:
             if (!ATOMIC_LOAD_BOOL(&pGstKvsPlugin->streamStopped)) {
+                // Everything pre-rolled so far has to make it into the stream before it stops
+                awaitStreamStartup(pGstKvsPlugin);
+
+                // So is the metadata batched since the last fragment
+                if (STATUS_FAILED(retStatus = flushMetadataBatch(pGstKvsPlugin))) {
+                    DLOGW("Failed to flush the batched metadata with 0x%08x", retStatus);
+                }
+
                 if (STATUS_FAILED(retStatus = stopKinesisVideoStreamSync(pGstKvsPlugin->kvsContext.streamHandle))) {
                     GST_ERROR_OBJECT(pGstKvsPlugin, "Failed to stop the stream with 0x%08x", retStatus);
                     CHK_STATUS(retStatus);
                 }
 
+                if (STATUS_FAILED(retStatus = stopBulkUploadSessions(pGstKvsPlugin))) {
+                    GST_ERROR_OBJECT(pGstKvsPlugin, "Failed to stop the bulk upload sessions with 0x%08x", retStatus);
+                    CHK_STATUS(retStatus);
+                }
+
                 ATOMIC_STORE_BOOL(&pGstKvsPlugin->streamStopped, TRUE);
             }
 
@@ -849,7 +1160,12 @@ gboolean gst_kvs_plugin_handle_plugin_event(GstCollectPads* pads, GstCollectData
                 }
 
                 // Send cpd to kinesis video stream
-                CHK_STATUS(kinesisVideoStreamFormatChanged(pGstKvsPlugin->kvsContext.streamHandle, KVS_PCM_CPD_SIZE_BYTE, cpd, trackId));
+                MEMSET(&streamCall, 0x00, SIZEOF(StreamCall));
+                streamCall.type = GST_PLUGIN_STREAM_CALL_FORMAT_CHANGED;
+                streamCall.frame.frameData = cpd;
+                streamCall.frame.size = KVS_PCM_CPD_SIZE_BYTE;
+                streamCall.frame.trackId = trackId;
+                CHK_STATUS(putStreamCall(pGstKvsPlugin, &streamCall));
             } else if (!pGstKvsPlugin->trackCpdReceived[trackId] && gst_structure_has_field(gststructforcaps, "codec_data")) {
                 const GValue* gstStreamFormat = gst_structure_get_value(gststructforcaps, "codec_data");
                 gstCpd = gst_value_serialize(gstStreamFormat);
@@ -880,6 +1196,13 @@ gboolean gst_kvs_plugin_handle_plugin_event(GstCollectPads* pads, GstCollectData
                         pGstKvsPlugin->videoCpdSize = cpdSize;
                     }
 
+                    // Baseline for spotting in-band parameter set changes on the key frames
+                    CHK_LOG_ERR(extractParameterSets(pGstKvsPlugin->videoCpd, pGstKvsPlugin->videoCpdSize, ELEMENTARY_STREAM_NAL_FORMAT_ANNEX_B,
+                                                     0 == STRCMP(pGstKvsPlugin->gstParams.codecId, DEFAULT_CODEC_ID_H265),
+                                                     &pGstKvsPlugin->videoCpdHash, NULL, NULL));
+                    pGstKvsPlugin->webRtcCpdHash = pGstKvsPlugin->videoCpdHash;
+                    pGstKvsPlugin->refusedCpdHash = 0;
+
                     // Prior to setting the CPD we need to set the flags
                     if (pGstKvsPlugin->gstParams.adaptCpdNals && pGstKvsPlugin->detectedCpdFormat == ELEMENTARY_STREAM_NAL_FORMAT_ANNEX_B) {
                         nalFlags |= NAL_ADAPTATION_ANNEXB_CPD_NALS;
@@ -889,11 +1212,19 @@ gboolean gst_kvs_plugin_handle_plugin_event(GstCollectPads* pads, GstCollectData
                         nalFlags |= NAL_ADAPTATION_ANNEXB_NALS;
                     }
 
-                    CHK_STATUS(kinesisVideoStreamSetNalAdaptationFlags(pGstKvsPlugin->kvsContext.streamHandle, nalFlags));
+                    MEMSET(&streamCall, 0x00, SIZEOF(StreamCall));
+                    streamCall.type = GST_PLUGIN_STREAM_CALL_SET_NAL_ADAPTATION_FLAGS;
+                    streamCall.nalAdaptationFlags = nalFlags;
+                    CHK_STATUS(putStreamCall(pGstKvsPlugin, &streamCall));
                 }
 
                 // Send cpd to kinesis video stream
-                CHK_STATUS(kinesisVideoStreamFormatChanged(pGstKvsPlugin->kvsContext.streamHandle, cpdSize, cpd, trackId));
+                MEMSET(&streamCall, 0x00, SIZEOF(StreamCall));
+                streamCall.type = GST_PLUGIN_STREAM_CALL_FORMAT_CHANGED;
+                streamCall.frame.frameData = cpd;
+                streamCall.frame.size = cpdSize;
+                streamCall.frame.trackId = trackId;
+                CHK_STATUS(putStreamCall(pGstKvsPlugin, &streamCall));
 
                 // Mark as received
                 pGstKvsPlugin->trackCpdReceived[trackId] = TRUE;
@@ -913,7 +1244,14 @@ gboolean gst_kvs_plugin_handle_plugin_event(GstCollectPads* pads, GstCollectData
                 gst_structure_get_boolean(gstStruct, KVS_ADD_METADATA_PERSISTENT, &persistent)) {
                 DLOGD("received " KVS_ADD_METADATA_G_STRUCT_NAME " event");
 
-                CHK_STATUS(putKinesisVideoFragmentMetadata(pGstKvsPlugin->kvsContext.streamHandle, pName, pVal, persistent));
+                CHK_STATUS(addMetadata(pGstKvsPlugin, pName, pVal, persistent));
+
+                gst_event_unref(event);
+                event = NULL;
+            } else if (gst_structure_has_name(gstStruct, KVS_ADD_METADATA_BATCH_G_STRUCT_NAME)) {
+                DLOGD("received " KVS_ADD_METADATA_BATCH_G_STRUCT_NAME " event");
+
+                CHK_STATUS(addMetadataStructure(pGstKvsPlugin, gstStruct));
 
                 gst_event_unref(event);
                 event = NULL;
@@ -964,23 +1302,36 @@ GstFlowReturn gst_kvs_plugin_handle_buffer(GstCollectPads* pads, GstCollectData*
     GstFlowReturn ret = GST_FLOW_OK;
     PGstKvsPluginTrackData pTrackData = (PGstKvsPluginTrackData) track_data;
 
-    BOOL isDroppable, delta;
+    BOOL isDroppable, delta, cpdChanged = FALSE, streamFrame;
     STATUS streamStatus = pGstKvsPlugin->streamStatus;
     GstMessage* message;
     UINT64 trackId;
-    FRAME_FLAGS frameFlags = FRAME_FLAG_NONE;
+    FRAME_FLAGS frameFlags = FRAME_FLAG_NONE, streamFlags;
     GstMapInfo info;
+    GstClockTime pts;
     STATUS status;
-    Frame frame;
+    StreamCall streamCall;
+    PFrame pFrame = &streamCall.frame;
+    UINT64 arrivalTime = 0;
 
     info.data = NULL;
 
+    if (pGstKvsPlugin->frameStageFn != NULL) {
+        arrivalTime = GETTIME();
+    }
+
     // eos reached
     if (buf == NULL && pTrackData == NULL) {
         if (!ATOMIC_LOAD_BOOL(&pGstKvsPlugin->streamStopped)) {
+            awaitStreamStartup(pGstKvsPlugin);
+
             if (STATUS_FAILED(status = stopKinesisVideoStreamSync(pGstKvsPlugin->kvsContext.streamHandle))) {
                 DLOGW("Failed to stop the stream with 0x%08x", status);
             }
+
+            if (STATUS_FAILED(status = stopBulkUploadSessions(pGstKvsPlugin))) {
+                DLOGW("Failed to stop the bulk upload sessions with 0x%08x", status);
+            }
         }
 
         ATOMIC_STORE_BOOL(&pGstKvsPlugin->streamStopped, TRUE);
@@ -995,6 +1346,12 @@ GstFlowReturn gst_kvs_plugin_handle_buffer(GstCollectPads* pads, GstCollectData*
         goto CleanUp;
     }
 
+    // The startup routine has already posted the error. Once the stream is ready the status can't have failed
+    if (!ATOMIC_LOAD_BOOL(&pGstKvsPlugin->streamReady) && STATUS_FAILED(getStreamStartupStatus(pGstKvsPlugin))) {
+        ret = GST_FLOW_ERROR;
+        goto CleanUp;
+    }
+
     if (STATUS_FAILED(streamStatus)) {
         // in offline case, we cant tell the pipeline to restream the file again in case of network outage.
         // therefore error out and let higher level application do the retry.
@@ -1004,9 +1361,9 @@ GstFlowReturn gst_kvs_plugin_handle_buffer(GstCollectPads* pads, GstCollectData*
             ret = GST_FLOW_ERROR;
             goto CleanUp;
         } else {
-            // resetStream, note that this will flush out producer buffer
-            if (STATUS_FAILED(status = kinesisVideoStreamResetStream(pGstKvsPlugin->kvsContext.streamHandle))) {
-                DLOGW("Failed to reset the stream with 0x%08x", status);
+            // Rewind to the last un-ACKed fragment, the producer buffer is only flushed as a last resort
+            if (STATUS_FAILED(status = recoverKinesisVideoStream(pGstKvsPlugin))) {
+                DLOGW("Failed to recover the stream with 0x%08x", status);
             }
 
             // reset state
@@ -1025,6 +1382,9 @@ GstFlowReturn gst_kvs_plugin_handle_buffer(GstCollectPads* pads, GstCollectData*
         goto CleanUp;
     }
 
+    // Upstream timestamp for the QoS events
+    pts = GST_BUFFER_PTS(buf);
+
     // In offline mode, if user specifies a file_start_time, the stream will be configured to use absolute
     // timestamp. Therefore in here we add the file_start_time to frame pts to create absolute timestamp.
     // If user did not specify file_start_time, file_start_time will be 0 and has no effect.
@@ -1070,29 +1430,66 @@ GstFlowReturn gst_kvs_plugin_handle_buffer(GstCollectPads* pads, GstCollectData*
         buf->pts += pGstKvsPlugin->producerStartTime - pGstKvsPlugin->firstPts;
     }
 
-    frame.version = FRAME_CURRENT_VERSION;
-    frame.flags = frameFlags;
-    frame.index = pGstKvsPlugin->frameCount;
-    frame.decodingTs = buf->dts / DEFAULT_TIME_UNIT_IN_NANOS;
-    frame.presentationTs = buf->pts / DEFAULT_TIME_UNIT_IN_NANOS;
-    frame.trackId = trackId;
-    frame.size = info.size;
-    frame.frameData = info.data;
-    frame.duration = 0;
-
-    if (ATOMIC_LOAD_BOOL(&pGstKvsPlugin->enableStreaming)) {
-        if (STATUS_FAILED(status = putKinesisVideoFrame(pGstKvsPlugin->kvsContext.streamHandle, &frame))) {
+    MEMSET(&streamCall, 0x00, SIZEOF(StreamCall));
+    streamCall.type = GST_PLUGIN_STREAM_CALL_PUT_FRAME;
+    pFrame->version = FRAME_CURRENT_VERSION;
+    pFrame->flags = frameFlags;
+    pFrame->index = pGstKvsPlugin->frameCount;
+    pFrame->decodingTs = buf->dts / DEFAULT_TIME_UNIT_IN_NANOS;
+    pFrame->presentationTs = buf->pts / DEFAULT_TIME_UNIT_IN_NANOS;
+    pFrame->trackId = trackId;
+    pFrame->size = info.size;
+    pFrame->frameData = info.data;
+    pFrame->duration = 0;
+
+    // Pre-rolled if the stream is still being created, WebRTC peers get the frame either way.
+    // Video frames can be shed under the producer's pressure, only from the stream
+    streamFrame = ATOMIC_LOAD_BOOL(&pGstKvsPlugin->enableStreaming) &&
+        !(pTrackData->trackType == MKV_TRACK_INFO_TYPE_VIDEO && shedVideoFrame(pGstKvsPlugin, &pTrackData->collect, pFrame, pts));
+
+    // Encoders changing the resolution mid-stream only signal it with new parameter sets on the key frame.
+    // The stream only switches on a key frame that goes to it
+    if (pTrackData->trackType == MKV_TRACK_INFO_TYPE_VIDEO &&
+        STATUS_FAILED(status = refreshInBandCpd(pGstKvsPlugin, pFrame, streamFrame, &cpdChanged))) {
+        DLOGW("Failed to refresh the in-band CPD with 0x%08x", status);
+    }
+
+    // Only the key frames starting a fragment keep the flag on their way to the stream, the one with new parameter sets always does
+    if (STATUS_FAILED(status = tuneFragment(pGstKvsPlugin, pFrame, streamFrame, cpdChanged, &streamFlags))) {
+        DLOGW("Failed to tune the fragments with 0x%08x", status);
+        streamFlags = frameFlags;
+    }
+
+    // Batched metadata goes ahead of the key frame starting the next fragment, audio only streams flush it every frame
+    if (streamFrame && (CHECK_FRAME_FLAG_KEY_FRAME(streamFlags) || pGstKvsPlugin->numVideoStreams == 0) &&
+        STATUS_FAILED(status = flushMetadataBatch(pGstKvsPlugin))) {
+        DLOGW("Failed to flush the batched metadata with 0x%08x", status);
+    }
+
+    if (streamFrame) {
+        pFrame->flags = streamFlags;
+        if (STATUS_FAILED(status = putStreamCall(pGstKvsPlugin, &streamCall))) {
             DLOGW("Failed to put frame with 0x%08x", status);
         }
+
+        pFrame->flags = frameFlags;
+    }
+
+    if (pGstKvsPlugin->frameStageFn != NULL) {
+        pGstKvsPlugin->frameStageFn(pGstKvsPlugin->frameStageCustomData, GST_PLUGIN_FRAME_STAGE_ARRIVED, pFrame, arrivalTime);
     }
 
     // Need to produce the frame into peer connections
     // Check whether the frame is in AvCC/HEVC and set the flag to adapt the
     // bits to Annex-B format for RTP
-    if (STATUS_FAILED(status = putFrameToWebRtcPeers(pGstKvsPlugin, &frame, pGstKvsPlugin->detectedCpdFormat))) {
+    if (STATUS_FAILED(status = putFrameToWebRtcPeers(pGstKvsPlugin, pFrame, pGstKvsPlugin->detectedCpdFormat))) {
         DLOGW("Failed to put frame to peer connections with 0x%08x", status);
     }
 
+    if (pGstKvsPlugin->frameStageFn != NULL) {
+        pGstKvsPlugin->frameStageFn(pGstKvsPlugin->frameStageCustomData, GST_PLUGIN_FRAME_STAGE_SENT_TO_PEERS, pFrame, GETTIME());
+    }
+
     pGstKvsPlugin->frameCount++;
 
 CleanUp:
@@ -1223,6 +1620,39 @@ GstStateChangeReturn gst_kvs_plugin_change_state(GstElement* element, GstStateCh
 
     switch (transition) {
         case GST_STATE_CHANGE_NULL_TO_READY:
+            MEMSET(&pGstKvsPlugin->startupTimes, 0x00, SIZEOF(StartupTimes));
+            pGstKvsPlugin->startupTimes.startTime = GETTIME();
+
+            if (STATUS_FAILED(status = initStartup(pGstKvsPlugin))) {
+                DLOGE("Failed to initialize startup with 0x%08x", status);
+                ret = GST_STATE_CHANGE_FAILURE;
+                goto CleanUp;
+            }
+
+            if (STATUS_FAILED(status = initShedding(pGstKvsPlugin))) {
+                DLOGE("Failed to initialize frame shedding with 0x%08x", status);
+                ret = GST_STATE_CHANGE_FAILURE;
+                goto CleanUp;
+            }
+
+            if (STATUS_FAILED(status = initMetadataBatch(pGstKvsPlugin))) {
+                DLOGE("Failed to initialize metadata batching with 0x%08x", status);
+                ret = GST_STATE_CHANGE_FAILURE;
+                goto CleanUp;
+            }
+
+            if (STATUS_FAILED(status = initMemoryAccounting(pGstKvsPlugin))) {
+                DLOGE("Failed to initialize memory accounting with 0x%08x", status);
+                ret = GST_STATE_CHANGE_FAILURE;
+                goto CleanUp;
+            }
+
+            if (STATUS_FAILED(status = initFragmentTuning(pGstKvsPlugin))) {
+                DLOGE("Failed to initialize fragment tuning with 0x%08x", status);
+                ret = GST_STATE_CHANGE_FAILURE;
+                goto CleanUp;
+            }
+
             if (STATUS_FAILED(status = initKinesisVideoStructs(pGstKvsPlugin))) {
                 DLOGE("Failed to initialize KVS structures with 0x%08x", status);
                 ret = GST_STATE_CHANGE_FAILURE;
@@ -1234,6 +1664,8 @@ GstStateChangeReturn gst_kvs_plugin_change_state(GstElement* element, GstStateCh
                 ret = GST_STATE_CHANGE_FAILURE;
                 goto CleanUp;
             }
+            pGstKvsPlugin->startupTimes.producerInitDuration = GETTIME() - pGstKvsPlugin->startupTimes.startTime;
+
             if (STATUS_FAILED(status = initTrackData(pGstKvsPlugin))) {
                 DLOGE("Failed to initialize track with 0x%08x", status);
                 ret = GST_STATE_CHANGE_FAILURE;
@@ -1249,8 +1681,15 @@ GstStateChangeReturn gst_kvs_plugin_change_state(GstElement* element, GstStateCh
                 goto CleanUp;
             }
 
+            if (STATUS_FAILED(status = initBulkUpload(pGstKvsPlugin))) {
+                DLOGE("Failed to initialize the bulk upload with 0x%08x", status);
+                ret = GST_STATE_CHANGE_FAILURE;
+                goto CleanUp;
+            }
+
             ATOMIC_STORE_BOOL(&pGstKvsPlugin->streamStopped, FALSE);
             pGstKvsPlugin->streamStatus = STATUS_SUCCESS;
+            MEMSET(&pGstKvsPlugin->recoveryStats, 0x00, SIZEOF(RecoveryStats));
             pGstKvsPlugin->lastDts = 0;
             pGstKvsPlugin->basePts = 0;
             pGstKvsPlugin->frameCount = 0;
@@ -1268,11 +1707,14 @@ GstStateChangeReturn gst_kvs_plugin_change_state(GstElement* element, GstStateCh
                 goto CleanUp;
             }
 
-            // Schedule the WebRTC master session servicing periodic routine
-            if (STATUS_FAILED(status = timerQueueAddTimer(pGstKvsPlugin->kvsContext.timerQueueHandle, GST_PLUGIN_SERVICE_ROUTINE_START,
-                                                          GST_PLUGIN_SERVICE_ROUTINE_PERIOD, sessionServiceHandler, (UINT64) pGstKvsPlugin,
-                                                          &pGstKvsPlugin->serviceRoutineTimerId))) {
-                DLOGE("Failed to schedule WebRTC service routine with 0x%08x", status);
+            // Streaming goes on without the reports
+            if (STATUS_FAILED(status = startMemoryReports(pGstKvsPlugin))) {
+                DLOGW("Failed to start the memory reports with 0x%08x", status);
+            }
+
+            // Creates the stream and brings up signaling, in the background with async startup
+            if (STATUS_FAILED(status = startStreamAndWebRtc(pGstKvsPlugin))) {
+                DLOGE("Failed to start the KVS stream and signaling client with 0x%08x", status);
                 ret = GST_STATE_CHANGE_FAILURE;
                 goto CleanUp;
             }
@@ -1282,6 +1724,8 @@ GstStateChangeReturn gst_kvs_plugin_change_state(GstElement* element, GstStateCh
             gst_collect_pads_start(pGstKvsPlugin->collect);
             break;
         case GST_STATE_CHANGE_PAUSED_TO_READY:
+            // The bring-ups replay into the stream and start the signaling client, neither may outlive the running state
+            awaitStartup(pGstKvsPlugin);
             gst_collect_pads_stop(pGstKvsPlugin->collect);
             break;
         default:
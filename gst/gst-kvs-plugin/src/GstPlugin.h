@@ -47,8 +47,16 @@ typedef struct __PendingMessageQueue* PPendingMessageQueue;
 #include <com/amazonaws/kinesis/video/cproducer/Include.h>
 #include <com/amazonaws/kinesis/video/webrtcclient/Include.h>
 #include "GstPluginUtils.h"
+#include "GstPluginPool.h"
 #include "KvsProducer.h"
+#include "KvsProducerCache.h"
 #include "KvsWebRtc.h"
+#include "GstPluginStartup.h"
+#include "KvsBulkUpload.h"
+#include "GstPluginShedding.h"
+#include "GstPluginMetadata.h"
+#include "GstPluginMemory.h"
+#include "GstPluginFragmentTuning.h"
 
 typedef enum {
     PROP_0,
@@ -92,6 +100,27 @@ typedef enum {
     PROP_WEBRTC_CONNECTION_MODE,
     PROP_ENABLE_STREAMING,
     PROP_WEBRTC_CONNECT,
+    PROP_ASYNC_STARTUP,
+    PROP_STARTUP_PREROLL_SIZE,
+    PROP_STARTUP_TIMES,
+    PROP_PRODUCER_CACHE_FILE,
+    PROP_RECOVERY_STATS,
+    PROP_FRAME_SHEDDING,
+    PROP_SHEDDING_STATS,
+    PROP_METADATA_BATCHING,
+    PROP_METADATA_BATCH_SIZE,
+    PROP_METADATA_STATS,
+    PROP_UPLOAD_SESSIONS,
+    PROP_UPLOAD_SEGMENT_DURATION,
+    PROP_UPLOAD_JOURNAL,
+    PROP_UPLOAD_STATS,
+    PROP_MEMORY_REPORT_PERIOD,
+    PROP_MEMORY_STATS,
+    PROP_SIGNALING_POOL_SIZE,
+    PROP_SIGNALING_POOL_STATS,
+    PROP_FRAGMENT_TUNING,
+    PROP_FRAGMENT_TUNING_WARMUP,
+    PROP_FRAGMENT_STATS,
 } KVS_GST_PLUGIN_PROPS;
 
 #define KVS_ADD_METADATA_G_STRUCT_NAME "kvs-add-metadata"
@@ -99,6 +128,9 @@ typedef enum {
 #define KVS_ADD_METADATA_VALUE         "value"
 #define KVS_ADD_METADATA_PERSISTENT    "persist"
 
+// Every field other than persist is a metadata name and value
+#define KVS_ADD_METADATA_BATCH_G_STRUCT_NAME "kvs-add-metadata-batch"
+
 #define KVS_ENABLE_STREAMING_G_STRUCT_NAME "kvs-enable-streaming"
 #define KVS_ENABLE_STREAMING_FIELD         "enable"
 
@@ -131,6 +163,12 @@ typedef enum {
 
 #define DEFAULT_MAX_CONCURRENT_WEBRTC_STREAMING_SESSION 10
 
+/**
+ * Control plane overrides, used to point the plugin at local stand-ins of the KVS and signaling services
+ */
+#define KVS_CONTROL_PLANE_URL_ENV_VAR        "AWS_KVS_CONTROL_PLANE_URL"
+#define KVS_WEBRTC_CONTROL_PLANE_URL_ENV_VAR "AWS_KVS_WEBRTC_CONTROL_PLANE_URL"
+
 G_BEGIN_DECLS
 
 #define KVS_GST_VERSION AWS_SDK_KVS_PRODUCER_VERSION_STRING
@@ -154,6 +192,19 @@ typedef enum {
     WEBRTC_CONNECTION_MODE_P2P_ONLY
 } WEBRTC_CONNECTION_MODE;
 
+typedef enum {
+    // The buffer was handed to the plugin by the collect pads
+    GST_PLUGIN_FRAME_STAGE_ARRIVED,
+    // The frame was written to every streaming session
+    GST_PLUGIN_FRAME_STAGE_SENT_TO_PEERS,
+} GST_PLUGIN_FRAME_STAGE;
+
+/**
+ * Per frame stage observer for in-process latency measurements. Takes the custom data, the stage, the frame as it is
+ * at that stage and the GETTIME() the stage was reached at. Called on the streaming thread, so it has to be cheap
+ */
+typedef VOID (*GstPluginFrameStageFunc)(UINT64, GST_PLUGIN_FRAME_STAGE, PFrame, UINT64);
+
 typedef STATUS (*freeCredentialProviderFunc)(PAwsCredentialProvider*);
 
 typedef struct __KvsContext KvsContext;
@@ -163,6 +214,10 @@ struct __KvsContext {
     PAwsCredentialProvider pCredentialProvider;
     PClientCallbacks pClientCallbacks;
     PStreamCallbacks pStreamCallbacks;
+    StreamCallbacks streamCallbacks;
+    ProducerCallbacks producerCallbacks;
+    PProducerCache pProducerCache;
+    PBulkUpload pBulkUpload;
     CLIENT_HANDLE clientHandle;
     STREAM_HANDLE streamHandle;
     TIMER_QUEUE_HANDLE timerQueueHandle;
@@ -219,13 +274,35 @@ struct __GstParams {
     WEBRTC_CONNECTION_MODE connectionMode;
     gboolean enableStreaming;
     gboolean webRtcConnect;
+    gboolean asyncStartup;
+    guint startupPrerollSize;
+    gchar* producerCacheFilePath;
+    gboolean frameShedding;
+    gboolean metadataBatching;
+    guint metadataBatchSize;
+    guint uploadSessions;
+    guint uploadSegmentDurationInSeconds;
+    gchar* uploadJournalPath;
+    guint memoryReportPeriodInSeconds;
+    guint signalingPoolSize;
+    GST_PLUGIN_FRAGMENT_TUNING fragmentTuning;
+    guint fragmentTuningWarmupInSeconds;
 };
 typedef struct __GstParams* PGstParams;
 
+typedef struct __PendingMessage PendingMessage;
+struct __PendingMessage {
+    ReceivedSignalingMessage receivedSignalingMessage;
+    struct __PendingMessage* pNext;
+};
+typedef struct __PendingMessage* PPendingMessage;
+
 struct __PendingMessageQueue {
     UINT64 hashValue;
     UINT64 createTime;
-    PStackQueue messageQueue;
+    // Pooled messages in arrival order
+    PPendingMessage pHead;
+    PPendingMessage pTail;
 };
 
 typedef struct __RtcMetricsHistory RtcMetricsHistory;
@@ -298,6 +375,9 @@ struct __GstKvsPlugin {
     MUTEX sessionListReadLock;
     MUTEX signalingLock;
     PStackQueue pPendingSignalingMessageForRemoteClient;
+    // Recycle the pending queues and messages through the connect storms
+    PObjectPool pPendingQueuePool;
+    PObjectPool pPendingMessagePool;
     PHashTable pRtcPeerConnectionForRemoteClient;
 
     PWebRtcStreamingSession streamingSessionList[DEFAULT_MAX_CONCURRENT_WEBRTC_STREAMING_SESSION];
@@ -332,11 +412,56 @@ struct __GstKvsPlugin {
     guint numVideoStreams;
 
     STATUS streamStatus;
+    RecoveryStats recoveryStats;
+
+    // Frame shedding on the producer's pressure callbacks
+    MUTEX sheddingLock;
+    GST_PLUGIN_SHEDDING_LEVEL sheddingLevel;
+    GST_PLUGIN_PRESSURE sheddingPressure;
+    UINT64 sheddingLevelTime;
+    UINT64 lastPressureTime;
+    BOOL sheddingGop;
+    // Level last reported upstream in a QoS event
+    GST_PLUGIN_SHEDDING_LEVEL sheddingQosLevel;
+    SheddingStats sheddingStats;
+
+    // Fragment metadata batched up to the next fragment
+    MUTEX metadataLock;
+    MetadataEntry metadataEntries[MAX_FRAGMENT_METADATA_COUNT];
+    UINT32 metadataCount;
+    UINT32 metadataSize;
+    MetadataStats metadataStats;
+
+    MemoryAccounting memoryAccounting;
+
+    // Key frames starting a fragment, the stream cuts one on each key frame it gets while tuning
+    FragmentTuning fragmentTuning;
 
     ELEMENTARY_STREAM_NAL_FORMAT detectedCpdFormat;
 
     BYTE videoCpd[GST_PLUGIN_MAX_CPD_SIZE];
     UINT32 videoCpdSize;
+    // Of the parameter sets in videoCpd, which WebRTC peers switch to on the key frame bringing them
+    UINT32 webRtcCpdHash;
+    // Of the parameter sets the stream's track has, only moves once the stream took the new CPD
+    UINT32 videoCpdHash;
+    // Of the parameter sets the stream couldn't switch to, not retried until the encoder changes them again
+    UINT32 refusedCpdHash;
+
+    // Startup. With async startup the stream calls are pre-rolled until the stream startup routine has created it
+    StartupTimes startupTimes;
+    volatile ATOMIC_BOOL streamReady;
+    STATUS streamStartupStatus;
+    BOOL dropUntilKeyFrame;
+    MUTEX startupLock;
+    PStackQueue pPrerollQueue;
+    UINT64 prerollSize;
+    TID streamStartupTid;
+    TID webRtcStartupTid;
+
+    // Not a property, only set by harnesses linking the plugin in
+    GstPluginFrameStageFunc frameStageFn;
+    UINT64 frameStageCustomData;
 };
 
 /* all information needed for one track */
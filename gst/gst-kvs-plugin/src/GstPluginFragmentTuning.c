@@ -0,0 +1,304 @@
+#define LOG_CLASS "GstPluginFragmentTuning"
+#include "GstPlugin.h"
+
+STATUS initFragmentTuning(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PFragmentTuning pTuning;
+    MUTEX lock;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+    pTuning = &pGstKvsPlugin->fragmentTuning;
+
+    if (!IS_VALID_MUTEX_VALUE(pTuning->lock)) {
+        pTuning->lock = MUTEX_CREATE(FALSE);
+        CHK(IS_VALID_MUTEX_VALUE(pTuning->lock), STATUS_INVALID_OPERATION);
+    }
+
+    lock = pTuning->lock;
+    MEMSET(pTuning, 0x00, SIZEOF(FragmentTuning));
+    pTuning->lock = lock;
+
+    // Audio only streams have no key frame cadence to tune to
+    pTuning->active =
+        pGstKvsPlugin->gstParams.fragmentTuning != GST_PLUGIN_FRAGMENT_TUNING_OFF && pGstKvsPlugin->mediaType != GST_PLUGIN_MEDIA_TYPE_AUDIO_ONLY;
+
+    // Until the warm-up is over the fragments are cut the way the configuration would have the SDK cut them
+    pTuning->threshold =
+        pGstKvsPlugin->gstParams.keyFrameFragmentation ? 0 : pGstKvsPlugin->gstParams.fragmentDurationInMillis * HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+
+    pTuning->gopMin = MAX_UINT64;
+    pTuning->fragmentSizes.min = MAX_UINT64;
+    pTuning->fragmentDurations.min = MAX_UINT64;
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS freeFragmentTuning(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+
+    if (IS_VALID_MUTEX_VALUE(pGstKvsPlugin->fragmentTuning.lock)) {
+        MUTEX_FREE(pGstKvsPlugin->fragmentTuning.lock);
+        pGstKvsPlugin->fragmentTuning.lock = INVALID_MUTEX_VALUE;
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+BOOL isFragmentTuningActive(PGstKvsPlugin pGstKvsPlugin)
+{
+    return pGstKvsPlugin != NULL && pGstKvsPlugin->fragmentTuning.active;
+}
+
+// The stream was reset or rewound, so the next key frame it gets has to open a fragment. The cut one is not sampled
+STATUS restartFragment(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PFragmentTuning pTuning;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+    pTuning = &pGstKvsPlugin->fragmentTuning;
+    CHK(IS_VALID_MUTEX_VALUE(pTuning->lock), retStatus);
+
+    MUTEX_LOCK(pTuning->lock);
+    pTuning->fragmentStarted = FALSE;
+    pTuning->fragmentTimestamp = 0;
+    pTuning->fragmentBytes = 0;
+    MUTEX_UNLOCK(pTuning->lock);
+
+CleanUp:
+
+    return retStatus;
+}
+
+static VOID addFragmentSample(PFragmentHistogram pHistogram, UINT64 count, UINT64 value)
+{
+    pHistogram->min = MIN(pHistogram->min, value);
+    pHistogram->max = MAX(pHistogram->max, value);
+    pHistogram->sum += value;
+    pHistogram->history[count % GST_PLUGIN_FRAGMENT_HISTORY_COUNT] = value;
+}
+
+// Fragment duration in ms the SDK cuts at the given number of key frame intervals, half an interval of slack for the jitter
+static UINT64 gopCountToFragmentDuration(UINT32 gopCount, UINT64 gop)
+{
+    return gopCount <= 1 ? 0 : (gopCount * gop - gop / 2) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+}
+
+static VOID completeWarmup(PGstKvsPlugin pGstKvsPlugin)
+{
+    PFragmentTuning pTuning = &pGstKvsPlugin->fragmentTuning;
+    UINT64 gop, elapsed, configured;
+    UINT32 gopCount, configuredGopCount;
+
+    gop = MAX(1, pTuning->gopSum / pTuning->gopCount);
+    elapsed = pTuning->lastTimestamp - pTuning->startTimestamp;
+    pTuning->bitrate = elapsed == 0 ? 0 : pTuning->byteCount * 8 * HUNDREDS_OF_NANOS_IN_A_SECOND / elapsed;
+
+    // Fewest key frame intervals reaching the minimum duration
+    pTuning->latencyGopCount = (UINT32) MAX(1, (GST_PLUGIN_MIN_TUNED_FRAGMENT_DURATION + gop - 1) / gop);
+
+    // Most key frame intervals within the maximum duration and size
+    gopCount = (UINT32) MAX(1, GST_PLUGIN_MAX_TUNED_FRAGMENT_DURATION / gop);
+    while (gopCount > 1 && gopCount * gop * pTuning->bitrate / 8 / HUNDREDS_OF_NANOS_IN_A_SECOND > GST_PLUGIN_MAX_TUNED_FRAGMENT_SIZE) {
+        gopCount--;
+    }
+
+    pTuning->overheadGopCount = gopCount;
+    pTuning->latencyGopCount = MIN(pTuning->latencyGopCount, pTuning->overheadGopCount);
+    pTuning->tuned = TRUE;
+
+    DLOGI("Key frame every %" PRIu64 " ms (%" PRIu64 " - %" PRIu64 " ms) at %" PRIu64
+          " bps, %u key frame intervals per fragment for latency, %u for overhead",
+          gop / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, pTuning->gopMin / HUNDREDS_OF_NANOS_IN_A_MILLISECOND,
+          pTuning->gopMax / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, pTuning->bitrate, pTuning->latencyGopCount, pTuning->overheadGopCount);
+
+    if (pTuning->active) {
+        gopCount =
+            pGstKvsPlugin->gstParams.fragmentTuning == GST_PLUGIN_FRAGMENT_TUNING_LATENCY ? pTuning->latencyGopCount : pTuning->overheadGopCount;
+        pTuning->threshold = gopCount <= 1 ? 0 : gopCount * gop - gop / 2;
+        DLOGI("Cutting the fragments every %u key frame intervals", gopCount);
+        return;
+    }
+
+    // Only the recommendation, the stream caps are fixed
+    configured =
+        pGstKvsPlugin->gstParams.keyFrameFragmentation ? 0 : pGstKvsPlugin->gstParams.fragmentDurationInMillis * HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+    configuredGopCount = (UINT32) MAX(1, (configured + gop - 1) / gop);
+    if (configuredGopCount < pTuning->latencyGopCount) {
+        DLOGW("Fragments of %u key frame intervals are under %" PRIu64 " ms, set fragment-duration to %" PRIu64
+              " with key-frame-fragmentation off or fragment-tuning to latency",
+              configuredGopCount, (UINT64) GST_PLUGIN_MIN_TUNED_FRAGMENT_DURATION / HUNDREDS_OF_NANOS_IN_A_MILLISECOND,
+              gopCountToFragmentDuration(pTuning->latencyGopCount, gop));
+    } else if (configuredGopCount > pTuning->overheadGopCount) {
+        if (pTuning->overheadGopCount == 1) {
+            DLOGW("Fragments of %u key frame intervals are over %" PRIu64 " ms or %u bytes, set key-frame-fragmentation on", configuredGopCount,
+                  (UINT64) GST_PLUGIN_MAX_TUNED_FRAGMENT_DURATION / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, GST_PLUGIN_MAX_TUNED_FRAGMENT_SIZE);
+        } else {
+            DLOGW("Fragments of %u key frame intervals are over %" PRIu64 " ms or %u bytes, set fragment-duration to %" PRIu64
+                  " or fragment-tuning to overhead",
+                  configuredGopCount, (UINT64) GST_PLUGIN_MAX_TUNED_FRAGMENT_DURATION / HUNDREDS_OF_NANOS_IN_A_MILLISECOND,
+                  GST_PLUGIN_MAX_TUNED_FRAGMENT_SIZE,
+                  gopCountToFragmentDuration(pTuning->overheadGopCount, gop));
+        }
+    }
+}
+
+// The encoder's cadence and bitrate are measured on every frame, the fragments only on the ones that reach the stream.
+// When the plugin cuts them, a key frame that changes the CPD always starts one so the new track info opens a fragment
+STATUS tuneFragment(PGstKvsPlugin pGstKvsPlugin, PFrame pFrame, BOOL streamed, BOOL forceFragmentStart, FRAME_FLAGS* pStreamFlags)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PFragmentTuning pTuning;
+    BOOL keyFrame, fragmentStart = FALSE, locked = FALSE;
+    UINT64 timestamp, gop;
+
+    CHK(pGstKvsPlugin != NULL && pFrame != NULL && pStreamFlags != NULL, STATUS_NULL_ARG);
+    pTuning = &pGstKvsPlugin->fragmentTuning;
+    *pStreamFlags = pFrame->flags;
+
+    // Audio only streams are cut on the duration alone
+    CHK(pGstKvsPlugin->numVideoStreams != 0 && IS_VALID_MUTEX_VALUE(pTuning->lock), retStatus);
+
+    keyFrame = CHECK_FRAME_FLAG_KEY_FRAME(pFrame->flags);
+    timestamp = pFrame->presentationTs;
+
+    MUTEX_LOCK(pTuning->lock);
+    locked = TRUE;
+
+    if (!pTuning->started) {
+        pTuning->startTimestamp = timestamp;
+        pTuning->lastTimestamp = timestamp;
+        pTuning->started = TRUE;
+    }
+
+    pTuning->lastTimestamp = MAX(pTuning->lastTimestamp, timestamp);
+
+    if (keyFrame) {
+        if (pTuning->keyFrameReceived && timestamp > pTuning->keyFrameTimestamp) {
+            gop = timestamp - pTuning->keyFrameTimestamp;
+            pTuning->gopMin = MIN(pTuning->gopMin, gop);
+            pTuning->gopMax = MAX(pTuning->gopMax, gop);
+            pTuning->gopSum += gop;
+            pTuning->gopCount++;
+        }
+
+        pTuning->keyFrameTimestamp = timestamp;
+        pTuning->keyFrameReceived = TRUE;
+
+        // Settled on the frames seen so far, the key frame goes into the next fragment either way
+        if (!pTuning->tuned && pTuning->gopCount >= GST_PLUGIN_FRAGMENT_TUNING_MIN_GOP_COUNT &&
+            pTuning->lastTimestamp - pTuning->startTimestamp >=
+                (UINT64) pGstKvsPlugin->gstParams.fragmentTuningWarmupInSeconds * HUNDREDS_OF_NANOS_IN_A_SECOND) {
+            completeWarmup(pGstKvsPlugin);
+        }
+
+        fragmentStart = streamed &&
+            ((forceFragmentStart && pTuning->active) || !pTuning->fragmentStarted || pTuning->threshold == 0 ||
+             timestamp >= pTuning->fragmentTimestamp + pTuning->threshold);
+    }
+
+    pTuning->byteCount += pFrame->size;
+    CHK(streamed, retStatus);
+
+    if (fragmentStart) {
+        if (pTuning->fragmentStarted) {
+            addFragmentSample(&pTuning->fragmentSizes, pTuning->fragmentCount, pTuning->fragmentBytes);
+            addFragmentSample(&pTuning->fragmentDurations, pTuning->fragmentCount, timestamp - pTuning->fragmentTimestamp);
+            pTuning->fragmentCount++;
+        }
+
+        pTuning->fragmentStarted = TRUE;
+        pTuning->fragmentTimestamp = timestamp;
+        pTuning->fragmentBytes = 0;
+    } else if (keyFrame && pTuning->active) {
+        // Goes into the current fragment as a regular frame
+        *pStreamFlags &= ~FRAME_FLAG_KEY_FRAME;
+    }
+
+    if (pTuning->fragmentStarted) {
+        pTuning->fragmentBytes += pFrame->size;
+    }
+
+CleanUp:
+
+    if (locked) {
+        MUTEX_UNLOCK(pTuning->lock);
+    }
+
+    return retStatus;
+}
+
+static INT32 compareFragmentSamples(const VOID* pFirst, const VOID* pSecond)
+{
+    UINT64 first = *(const UINT64*) pFirst, second = *(const UINT64*) pSecond;
+
+    return first < second ? -1 : (first > second ? 1 : 0);
+}
+
+static VOID setFragmentHistogram(GstStructure* pGstStruct, PCHAR prefix, PFragmentHistogram pHistogram, UINT64 count, UINT64 scale)
+{
+    UINT64 samples[GST_PLUGIN_FRAGMENT_HISTORY_COUNT];
+    UINT64 sampleCount = MIN(count, GST_PLUGIN_FRAGMENT_HISTORY_COUNT), p50 = 0, p90 = 0;
+    CHAR name[MAX_PATH_LEN];
+
+    // Percentiles over the most recent fragments only
+    if (sampleCount != 0) {
+        MEMCPY(samples, pHistogram->history, sampleCount * SIZEOF(UINT64));
+        qsort(samples, (SIZE_T) sampleCount, SIZEOF(UINT64), compareFragmentSamples);
+        p50 = samples[sampleCount * 50 / 100];
+        p90 = samples[sampleCount * 90 / 100];
+    }
+
+    SNPRINTF(name, SIZEOF(name), "%s-min", prefix);
+    gst_structure_set(pGstStruct, name, G_TYPE_UINT64, count == 0 ? 0 : pHistogram->min / scale, NULL);
+    SNPRINTF(name, SIZEOF(name), "%s-avg", prefix);
+    gst_structure_set(pGstStruct, name, G_TYPE_UINT64, count == 0 ? 0 : pHistogram->sum / count / scale, NULL);
+    SNPRINTF(name, SIZEOF(name), "%s-p50", prefix);
+    gst_structure_set(pGstStruct, name, G_TYPE_UINT64, p50 / scale, NULL);
+    SNPRINTF(name, SIZEOF(name), "%s-p90", prefix);
+    gst_structure_set(pGstStruct, name, G_TYPE_UINT64, p90 / scale, NULL);
+    SNPRINTF(name, SIZEOF(name), "%s-max", prefix);
+    gst_structure_set(pGstStruct, name, G_TYPE_UINT64, pHistogram->max / scale, NULL);
+}
+
+GstStructure* getFragmentStats(PGstKvsPlugin pGstKvsPlugin)
+{
+    PFragmentTuning pTuning = &pGstKvsPlugin->fragmentTuning;
+    FragmentTuning tuning;
+    GstStructure* pGstStruct;
+    UINT64 gop = 0;
+
+    // Not initialized until the element is ready
+    if (!IS_VALID_MUTEX_VALUE(pTuning->lock)) {
+        return gst_structure_new_empty(GST_PLUGIN_FRAGMENT_STATS_G_STRUCT_NAME);
+    }
+
+    MUTEX_LOCK(pTuning->lock);
+    tuning = *pTuning;
+    MUTEX_UNLOCK(pTuning->lock);
+
+    if (tuning.gopCount != 0) {
+        gop = tuning.gopSum / tuning.gopCount;
+    }
+
+    pGstStruct = gst_structure_new(
+        GST_PLUGIN_FRAGMENT_STATS_G_STRUCT_NAME, "active", G_TYPE_BOOLEAN, (gboolean) tuning.active, "tuned", G_TYPE_BOOLEAN, (gboolean) tuning.tuned,
+        "key-frame-interval", G_TYPE_UINT64, gop / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, "key-frame-interval-min", G_TYPE_UINT64,
+        tuning.gopCount == 0 ? 0 : tuning.gopMin / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, "key-frame-interval-max", G_TYPE_UINT64,
+        tuning.gopMax / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, "bitrate", G_TYPE_UINT64, tuning.bitrate, "latency-key-frame-intervals", G_TYPE_UINT,
+        tuning.latencyGopCount, "overhead-key-frame-intervals", G_TYPE_UINT, tuning.overheadGopCount, "fragment-threshold", G_TYPE_UINT64,
+        tuning.threshold / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, "fragments", G_TYPE_UINT64, tuning.fragmentCount, NULL);
+
+    setFragmentHistogram(pGstStruct, "fragment-size", &tuning.fragmentSizes, tuning.fragmentCount, 1);
+    setFragmentHistogram(pGstStruct, "fragment-duration", &tuning.fragmentDurations, tuning.fragmentCount, HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+
+    return pGstStruct;
+}
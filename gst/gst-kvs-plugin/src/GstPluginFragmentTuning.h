@@ -0,0 +1,95 @@
+#ifndef __GST_PLUGIN_FRAGMENT_TUNING_H__
+#define __GST_PLUGIN_FRAGMENT_TUNING_H__
+
+#define DEFAULT_FRAGMENT_TUNING                GST_PLUGIN_FRAGMENT_TUNING_OFF
+#define DEFAULT_FRAGMENT_TUNING_WARMUP_SECONDS 10
+
+// Key frame intervals needed to tell the cadence
+#define GST_PLUGIN_FRAGMENT_TUNING_MIN_GOP_COUNT 3
+
+// Shorter fragments cost more in PutMedia framing and ACKs than they save in latency
+#define GST_PLUGIN_MIN_TUNED_FRAGMENT_DURATION (1 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+
+// Longer fragments delay the playback start, the service takes up to 20 s and 50 MB
+#define GST_PLUGIN_MAX_TUNED_FRAGMENT_DURATION (10 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+#define GST_PLUGIN_MAX_TUNED_FRAGMENT_SIZE     (25 * 1024 * 1024)
+
+// Fragments kept for the percentiles of the distributions
+#define GST_PLUGIN_FRAGMENT_HISTORY_COUNT 64
+
+#define GST_PLUGIN_FRAGMENT_STATS_G_STRUCT_NAME "kvs-fragment-stats"
+
+typedef enum {
+    // Measures and recommends, the configured fragmentation applies
+    GST_PLUGIN_FRAGMENT_TUNING_OFF,
+    // Fewest key frame intervals per fragment over the minimum duration
+    GST_PLUGIN_FRAGMENT_TUNING_LATENCY,
+    // Most key frame intervals per fragment within the maximum duration and size
+    GST_PLUGIN_FRAGMENT_TUNING_OVERHEAD,
+} GST_PLUGIN_FRAGMENT_TUNING;
+
+typedef struct __FragmentHistogram FragmentHistogram;
+struct __FragmentHistogram {
+    UINT64 min;
+    UINT64 max;
+    UINT64 sum;
+    UINT64 history[GST_PLUGIN_FRAGMENT_HISTORY_COUNT];
+};
+typedef struct __FragmentHistogram* PFragmentHistogram;
+
+/**
+ * Measures the key frame cadence and bitrate over the warm-up and picks the key frame intervals per fragment for the
+ * target. The plugin then decides which key frames start a fragment and the rest go to the stream as regular frames.
+ * Shed frames count towards the cadence and the bitrate but not towards the fragments. Turned off, the fragments are
+ * tracked the way the SDK cuts them to report the same distributions
+ */
+typedef struct __FragmentTuning FragmentTuning;
+struct __FragmentTuning {
+    MUTEX lock;
+    // The plugin cuts the fragments, the stream starts one on each key frame it gets
+    BOOL active;
+    // Warm-up over, the recommendations are in
+    BOOL tuned;
+    // Minimum fragment duration before the next key frame starts a fragment, 0 for every key frame
+    UINT64 threshold;
+
+    BOOL started;
+    UINT64 startTimestamp;
+    UINT64 lastTimestamp;
+    UINT64 byteCount;
+    BOOL keyFrameReceived;
+    UINT64 keyFrameTimestamp;
+    UINT64 gopCount;
+    UINT64 gopMin;
+    UINT64 gopMax;
+    UINT64 gopSum;
+
+    UINT64 bitrate;
+    UINT32 latencyGopCount;
+    UINT32 overheadGopCount;
+
+    BOOL fragmentStarted;
+    UINT64 fragmentTimestamp;
+    UINT64 fragmentBytes;
+    UINT64 fragmentCount;
+    FragmentHistogram fragmentSizes;
+    FragmentHistogram fragmentDurations;
+};
+typedef struct __FragmentTuning* PFragmentTuning;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+STATUS initFragmentTuning(PGstKvsPlugin);
+STATUS freeFragmentTuning(PGstKvsPlugin);
+BOOL isFragmentTuningActive(PGstKvsPlugin);
+STATUS restartFragment(PGstKvsPlugin);
+STATUS tuneFragment(PGstKvsPlugin, PFrame, BOOL, BOOL, FRAME_FLAGS*);
+GstStructure* getFragmentStats(PGstKvsPlugin);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__GST_PLUGIN_FRAGMENT_TUNING_H__
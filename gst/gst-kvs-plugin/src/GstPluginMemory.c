@@ -0,0 +1,285 @@
+#define LOG_CLASS "GstPluginMemory"
+#include "GstPlugin.h"
+
+static const PCHAR gMemoryTagNames[GST_PLUGIN_MEMORY_TAG_COUNT] = {"content-store", "adapted-frame", "preroll", "signaling-queues", "process"};
+
+STATUS initMemoryAccounting(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PMemoryAccounting pMemoryAccounting;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+    pMemoryAccounting = &pGstKvsPlugin->memoryAccounting;
+
+    // A repeated NULL_TO_READY still has the previous run's report timer on the timer queue
+    CHK_LOG_ERR(freeMemoryAccounting(pGstKvsPlugin));
+
+    MEMSET(pMemoryAccounting->counters, 0x00, SIZEOF(pMemoryAccounting->counters));
+    pMemoryAccounting->startTime = GETTIME();
+    pMemoryAccounting->reportTime = pMemoryAccounting->startTime;
+    pMemoryAccounting->sessionCount = 0;
+    pMemoryAccounting->peakSessionCount = 0;
+    pMemoryAccounting->certificateCount = 0;
+
+    // Kept across the state changes
+    accountMemoryAlloc(pGstKvsPlugin, GST_PLUGIN_MEMORY_ADAPTED_FRAME, pGstKvsPlugin->adaptedFrameBufSize);
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS startMemoryReports(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    UINT64 period;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+    CHK(pGstKvsPlugin->gstParams.memoryReportPeriodInSeconds != 0, retStatus);
+    CHK(IS_VALID_TIMER_QUEUE_HANDLE(pGstKvsPlugin->kvsContext.timerQueueHandle), STATUS_INVALID_OPERATION);
+
+    period = pGstKvsPlugin->gstParams.memoryReportPeriodInSeconds * HUNDREDS_OF_NANOS_IN_A_SECOND;
+    CHK_STATUS(timerQueueAddTimer(pGstKvsPlugin->kvsContext.timerQueueHandle, period, period, memoryReportTimerCallback, (UINT64) pGstKvsPlugin,
+                                  &pGstKvsPlugin->memoryAccounting.reportTimerId));
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS freeMemoryAccounting(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PMemoryAccounting pMemoryAccounting;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+    pMemoryAccounting = &pGstKvsPlugin->memoryAccounting;
+
+    // The reports sample the clients which are freed after us
+    if (pMemoryAccounting->reportTimerId != MAX_UINT32 && IS_VALID_TIMER_QUEUE_HANDLE(pGstKvsPlugin->kvsContext.timerQueueHandle)) {
+        retStatus = timerQueueCancelTimer(pGstKvsPlugin->kvsContext.timerQueueHandle, pMemoryAccounting->reportTimerId, (UINT64) pGstKvsPlugin);
+        if (STATUS_FAILED(retStatus)) {
+            DLOGE("Failed to cancel memory report timer with: 0x%08x", retStatus);
+        }
+    }
+
+    pMemoryAccounting->reportTimerId = MAX_UINT32;
+
+CleanUp:
+
+    return retStatus;
+}
+
+VOID accountMemoryAlloc(PGstKvsPlugin pGstKvsPlugin, GST_PLUGIN_MEMORY_TAG tag, SIZE_T size)
+{
+    PMemoryCounter pCounter = &pGstKvsPlugin->memoryAccounting.counters[tag];
+    SIZE_T current, peak;
+
+    ATOMIC_ADD(&pCounter->allocated, size);
+    current = ATOMIC_ADD(&pCounter->current, size) + size;
+
+    peak = ATOMIC_LOAD(&pCounter->peak);
+    while (current > peak && !ATOMIC_COMPARE_EXCHANGE(&pCounter->peak, &peak, current)) {
+        // peak now holds the latest value, retry while ours is still larger
+    }
+}
+
+VOID accountMemoryFree(PGstKvsPlugin pGstKvsPlugin, GST_PLUGIN_MEMORY_TAG tag, SIZE_T size)
+{
+    ATOMIC_SUBTRACT(&pGstKvsPlugin->memoryAccounting.counters[tag].current, size);
+}
+
+// Sampled subsystems count the growth since the last sample as allocated
+static VOID setSampledMemory(PGstKvsPlugin pGstKvsPlugin, GST_PLUGIN_MEMORY_TAG tag, SIZE_T size, SIZE_T peak)
+{
+    PMemoryCounter pCounter = &pGstKvsPlugin->memoryAccounting.counters[tag];
+    SIZE_T current = ATOMIC_LOAD(&pCounter->current);
+
+    if (size > current) {
+        accountMemoryAlloc(pGstKvsPlugin, tag, size - current);
+    } else {
+        accountMemoryFree(pGstKvsPlugin, tag, current - size);
+    }
+
+    current = ATOMIC_LOAD(&pCounter->peak);
+    while (peak > current && !ATOMIC_COMPARE_EXCHANGE(&pCounter->peak, &current, peak)) {
+        // Same as above
+    }
+}
+
+static SIZE_T getContentStoreSize(CLIENT_HANDLE clientHandle)
+{
+    ClientMetrics clientMetrics;
+
+    clientMetrics.version = CLIENT_METRICS_CURRENT_VERSION;
+    if (!IS_VALID_CLIENT_HANDLE(clientHandle) || STATUS_FAILED(getKinesisVideoMetrics(clientHandle, &clientMetrics))) {
+        return 0;
+    }
+
+    return (SIZE_T) clientMetrics.contentStoreAllocatedSize;
+}
+
+// The resident set and its high water mark, zero where there is no procfs
+static VOID getProcessMemory(PSIZE_T pResident, PSIZE_T pPeak)
+{
+    CHAR line[GST_PLUGIN_PROC_STATUS_LINE_LEN];
+    PCHAR pStart, pEnd;
+    PSIZE_T pValue;
+    UINT64 value;
+    FILE* pFile;
+
+    *pResident = 0;
+    *pPeak = 0;
+
+    if (NULL == (pFile = FOPEN(GST_PLUGIN_PROC_STATUS_PATH, "r"))) {
+        return;
+    }
+
+    while (fgets(line, SIZEOF(line), pFile) != NULL) {
+        if (0 == STRNCMP(line, "VmRSS:", 6)) {
+            pValue = pResident;
+        } else if (0 == STRNCMP(line, "VmHWM:", 6)) {
+            pValue = pPeak;
+        } else {
+            continue;
+        }
+
+        // In kB
+        for (pStart = line + 6; *pStart == ' ' || *pStart == '\t'; pStart++) {
+        }
+        for (pEnd = pStart; *pEnd >= '0' && *pEnd <= '9'; pEnd++) {
+        }
+
+        if (pEnd != pStart && STATUS_SUCCEEDED(STRTOUI64(pStart, pEnd, 10, &value))) {
+            *pValue = (SIZE_T) value * 1024;
+        }
+    }
+
+    FCLOSE(pFile);
+}
+
+STATUS sampleMemory(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PMemoryAccounting pMemoryAccounting;
+    PBulkUpload pBulkUpload;
+    ObjectPoolStats queueStats, messageStats;
+    UINT32 i;
+    SIZE_T size, peak;
+    BOOL locked = FALSE;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+    pMemoryAccounting = &pGstKvsPlugin->memoryAccounting;
+
+    // Each of the bulk upload clients has a content store of its own
+    size = getContentStoreSize(pGstKvsPlugin->kvsContext.clientHandle);
+    if (NULL != (pBulkUpload = pGstKvsPlugin->kvsContext.pBulkUpload)) {
+        for (i = 1; i < pBulkUpload->sessionCount; i++) {
+            size += getContentStoreSize(pBulkUpload->sessions[i].clientHandle);
+        }
+    }
+    setSampledMemory(pGstKvsPlugin, GST_PLUGIN_MEMORY_CONTENT_STORE, size, size);
+
+    getProcessMemory(&size, &peak);
+    setSampledMemory(pGstKvsPlugin, GST_PLUGIN_MEMORY_PROCESS, size, peak);
+
+    // The pools keep what they have allocated, in use or not
+    MEMSET(&queueStats, 0x00, SIZEOF(ObjectPoolStats));
+    MEMSET(&messageStats, 0x00, SIZEOF(ObjectPoolStats));
+    getObjectPoolStats(pGstKvsPlugin->pPendingQueuePool, &queueStats);
+    getObjectPoolStats(pGstKvsPlugin->pPendingMessagePool, &messageStats);
+    size = queueStats.allocatedCount * SIZEOF(PendingMessageQueue) + messageStats.allocatedCount * SIZEOF(PendingMessage);
+    setSampledMemory(pGstKvsPlugin, GST_PLUGIN_MEMORY_SIGNALING_QUEUES, size, size);
+
+    CHK(IS_VALID_MUTEX_VALUE(pGstKvsPlugin->sessionLock), retStatus);
+    MUTEX_LOCK(pGstKvsPlugin->sessionLock);
+    locked = TRUE;
+
+    if (pGstKvsPlugin->pregeneratedCertificates != NULL) {
+        CHK_STATUS(stackQueueGetCount(pGstKvsPlugin->pregeneratedCertificates, &pMemoryAccounting->certificateCount));
+    }
+
+    pMemoryAccounting->sessionCount = pGstKvsPlugin->streamingSessionCount;
+    pMemoryAccounting->peakSessionCount = MAX(pMemoryAccounting->peakSessionCount, pMemoryAccounting->sessionCount);
+
+CleanUp:
+
+    if (locked) {
+        MUTEX_UNLOCK(pGstKvsPlugin->sessionLock);
+    }
+
+    return retStatus;
+}
+
+STATUS memoryReportTimerCallback(UINT32 timerId, UINT64 currentTime, UINT64 customData)
+{
+    UNUSED_PARAM(timerId);
+    STATUS retStatus = STATUS_SUCCESS;
+    PGstKvsPlugin pGstKvsPlugin = (PGstKvsPlugin) customData;
+    PMemoryAccounting pMemoryAccounting;
+    PMemoryCounter pCounter;
+    SIZE_T allocated;
+    UINT64 elapsed;
+    UINT32 i;
+
+    CHK_WARN(pGstKvsPlugin != NULL, STATUS_NULL_ARG, "memoryReportTimerCallback(): Passed argument is NULL");
+    pMemoryAccounting = &pGstKvsPlugin->memoryAccounting;
+
+    CHK_LOG_ERR(sampleMemory(pGstKvsPlugin));
+
+    // Rates over the last report period
+    elapsed = currentTime - pMemoryAccounting->reportTime;
+    pMemoryAccounting->reportTime = currentTime;
+    for (i = 0; i < GST_PLUGIN_MEMORY_TAG_COUNT; i++) {
+        pCounter = &pMemoryAccounting->counters[i];
+        allocated = ATOMIC_LOAD(&pCounter->allocated);
+        pCounter->rate = elapsed == 0 ? 0 : (allocated - pCounter->reportedAllocated) * HUNDREDS_OF_NANOS_IN_A_SECOND / elapsed;
+        pCounter->reportedAllocated = allocated;
+    }
+
+    gst_element_post_message(GST_ELEMENT(pGstKvsPlugin), gst_message_new_element(GST_OBJECT(pGstKvsPlugin), getMemoryStats(pGstKvsPlugin)));
+
+CleanUp:
+
+    return retStatus;
+}
+
+GstStructure* getMemoryStats(PGstKvsPlugin pGstKvsPlugin)
+{
+    PMemoryAccounting pMemoryAccounting = &pGstKvsPlugin->memoryAccounting;
+    PMemoryCounter pCounter;
+    GstStructure* pGstStruct;
+    CHAR name[MAX_PATH_LEN];
+    UINT64 elapsed, rate;
+    UINT32 i;
+
+    // The reports sample on their own
+    if (pMemoryAccounting->reportTimerId == MAX_UINT32) {
+        CHK_LOG_ERR(sampleMemory(pGstKvsPlugin));
+    }
+
+    elapsed = GETTIME() - pMemoryAccounting->startTime;
+    pGstStruct = gst_structure_new(GST_PLUGIN_MEMORY_STATS_G_STRUCT_NAME, "sessions", G_TYPE_UINT, pMemoryAccounting->sessionCount, "peak-sessions",
+                                   G_TYPE_UINT, pMemoryAccounting->peakSessionCount, "pregenerated-certificates", G_TYPE_UINT,
+                                   pMemoryAccounting->certificateCount, NULL);
+
+    for (i = 0; i < GST_PLUGIN_MEMORY_TAG_COUNT; i++) {
+        pCounter = &pMemoryAccounting->counters[i];
+
+        // Over the last report period, otherwise the average since the start
+        if (pMemoryAccounting->reportTimerId != MAX_UINT32) {
+            rate = pCounter->rate;
+        } else {
+            rate = elapsed == 0 ? 0 : ATOMIC_LOAD(&pCounter->allocated) * HUNDREDS_OF_NANOS_IN_A_SECOND / elapsed;
+        }
+
+        SNPRINTF(name, SIZEOF(name), "%s-bytes", gMemoryTagNames[i]);
+        gst_structure_set(pGstStruct, name, G_TYPE_UINT64, (UINT64) ATOMIC_LOAD(&pCounter->current), NULL);
+        SNPRINTF(name, SIZEOF(name), "%s-peak-bytes", gMemoryTagNames[i]);
+        gst_structure_set(pGstStruct, name, G_TYPE_UINT64, (UINT64) ATOMIC_LOAD(&pCounter->peak), NULL);
+        SNPRINTF(name, SIZEOF(name), "%s-rate", gMemoryTagNames[i]);
+        gst_structure_set(pGstStruct, name, G_TYPE_UINT64, rate, NULL);
+    }
+
+    return pGstStruct;
+}
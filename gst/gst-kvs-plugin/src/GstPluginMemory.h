@@ -0,0 +1,69 @@
+#ifndef __GST_PLUGIN_MEMORY_H__
+#define __GST_PLUGIN_MEMORY_H__
+
+// Off by default, the stats are still there to read from the property
+#define DEFAULT_MEMORY_REPORT_PERIOD_SECONDS 0
+
+#define GST_PLUGIN_MEMORY_STATS_G_STRUCT_NAME "kvs-memory-stats"
+
+#define GST_PLUGIN_PROC_STATUS_PATH     "/proc/self/status"
+#define GST_PLUGIN_PROC_STATUS_LINE_LEN 128
+
+typedef enum {
+    // Sampled from the producer clients
+    GST_PLUGIN_MEMORY_CONTENT_STORE,
+    // Counted as the buffers grow and shrink
+    GST_PLUGIN_MEMORY_ADAPTED_FRAME,
+    GST_PLUGIN_MEMORY_PREROLL,
+    // Sampled from the pending queues
+    GST_PLUGIN_MEMORY_SIGNALING_QUEUES,
+    // Resident set of the process, covers what the SDKs allocate for the sessions and certificates
+    GST_PLUGIN_MEMORY_PROCESS,
+    GST_PLUGIN_MEMORY_TAG_COUNT,
+} GST_PLUGIN_MEMORY_TAG;
+
+typedef struct __MemoryCounter MemoryCounter;
+struct __MemoryCounter {
+    volatile SIZE_T current;
+    volatile SIZE_T peak;
+    // Total ever allocated, the rate is taken off its growth
+    volatile SIZE_T allocated;
+    SIZE_T reportedAllocated;
+    UINT64 rate;
+};
+typedef struct __MemoryCounter* PMemoryCounter;
+
+/**
+ * Bytes held per subsystem. The hot paths only touch the counters with atomics, everything else is sampled when the
+ * stats are read or reported
+ */
+typedef struct __MemoryAccounting MemoryAccounting;
+struct __MemoryAccounting {
+    MemoryCounter counters[GST_PLUGIN_MEMORY_TAG_COUNT];
+    UINT64 startTime;
+    UINT64 reportTime;
+    UINT32 reportTimerId;
+    UINT32 sessionCount;
+    UINT32 peakSessionCount;
+    UINT32 certificateCount;
+};
+typedef struct __MemoryAccounting* PMemoryAccounting;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+STATUS initMemoryAccounting(PGstKvsPlugin);
+STATUS startMemoryReports(PGstKvsPlugin);
+STATUS freeMemoryAccounting(PGstKvsPlugin);
+VOID accountMemoryAlloc(PGstKvsPlugin, GST_PLUGIN_MEMORY_TAG, SIZE_T);
+VOID accountMemoryFree(PGstKvsPlugin, GST_PLUGIN_MEMORY_TAG, SIZE_T);
+STATUS sampleMemory(PGstKvsPlugin);
+STATUS memoryReportTimerCallback(UINT32, UINT64, UINT64);
+GstStructure* getMemoryStats(PGstKvsPlugin);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__GST_PLUGIN_MEMORY_H__
@@ -0,0 +1,212 @@
+#define LOG_CLASS "GstPluginMetadata"
+#include "GstPlugin.h"
+
+STATUS initMetadataBatch(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+
+    if (!IS_VALID_MUTEX_VALUE(pGstKvsPlugin->metadataLock)) {
+        pGstKvsPlugin->metadataLock = MUTEX_CREATE(FALSE);
+        CHK(IS_VALID_MUTEX_VALUE(pGstKvsPlugin->metadataLock), STATUS_INVALID_OPERATION);
+    }
+
+    pGstKvsPlugin->metadataCount = 0;
+    pGstKvsPlugin->metadataSize = 0;
+    MEMSET(&pGstKvsPlugin->metadataStats, 0x00, SIZEOF(MetadataStats));
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS freeMetadataBatch(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+
+    if (IS_VALID_MUTEX_VALUE(pGstKvsPlugin->metadataLock)) {
+        MUTEX_FREE(pGstKvsPlugin->metadataLock);
+        pGstKvsPlugin->metadataLock = INVALID_MUTEX_VALUE;
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS addMetadata(PGstKvsPlugin pGstKvsPlugin, PCHAR pName, PCHAR pValue, BOOL persistent)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PMetadataEntry pEntry;
+    StreamCall streamCall;
+    UINT32 nameLen, valueLen, size, i;
+    BOOL locked = FALSE;
+
+    CHK(pGstKvsPlugin != NULL && pName != NULL && pValue != NULL, STATUS_NULL_ARG);
+
+    nameLen = (UINT32) STRLEN(pName);
+    valueLen = (UINT32) STRLEN(pValue);
+    CHK(nameLen != 0 && nameLen <= MKV_MAX_TAG_NAME_LEN && valueLen <= MKV_MAX_TAG_VALUE_LEN, STATUS_INVALID_ARG_LEN);
+
+    // Without batching every metadata goes to the stream right away
+    if (!pGstKvsPlugin->gstParams.metadataBatching || !IS_VALID_MUTEX_VALUE(pGstKvsPlugin->metadataLock)) {
+        MEMSET(&streamCall, 0x00, SIZEOF(StreamCall));
+        streamCall.type = GST_PLUGIN_STREAM_CALL_PUT_METADATA;
+        streamCall.pMetadataName = pName;
+        streamCall.pMetadataValue = pValue;
+        streamCall.persistent = persistent;
+        CHK_STATUS(putStreamCall(pGstKvsPlugin, &streamCall));
+        CHK(FALSE, retStatus);
+    }
+
+    MUTEX_LOCK(pGstKvsPlugin->metadataLock);
+    locked = TRUE;
+
+    pGstKvsPlugin->metadataStats.receivedCount++;
+
+    for (i = 0; i < pGstKvsPlugin->metadataCount && STRCMP(pGstKvsPlugin->metadataEntries[i].name, pName) != 0; i++) {
+    }
+
+    // The last value of a name within the fragment wins
+    if (i < pGstKvsPlugin->metadataCount) {
+        pEntry = &pGstKvsPlugin->metadataEntries[i];
+        size = pGstKvsPlugin->metadataSize - (UINT32) STRLEN(pEntry->value) + valueLen;
+    } else {
+        pEntry = NULL;
+        size = pGstKvsPlugin->metadataSize + nameLen + valueLen;
+    }
+
+    if ((pEntry == NULL && pGstKvsPlugin->metadataCount == MAX_FRAGMENT_METADATA_COUNT) || size > pGstKvsPlugin->gstParams.metadataBatchSize) {
+        pGstKvsPlugin->metadataStats.droppedCount++;
+        DLOGD("Dropping metadata %s over the fragment's batch", pName);
+        CHK(FALSE, retStatus);
+    }
+
+    if (pEntry == NULL) {
+        pEntry = &pGstKvsPlugin->metadataEntries[pGstKvsPlugin->metadataCount++];
+        STRCPY(pEntry->name, pName);
+    } else {
+        pGstKvsPlugin->metadataStats.deduplicatedCount++;
+    }
+
+    STRCPY(pEntry->value, pValue);
+    pEntry->persistent = persistent;
+    pGstKvsPlugin->metadataSize = size;
+
+CleanUp:
+
+    if (locked) {
+        MUTEX_UNLOCK(pGstKvsPlugin->metadataLock);
+    }
+
+    return retStatus;
+}
+
+STATUS addMetadataStructure(PGstKvsPlugin pGstKvsPlugin, const GstStructure* pGstStruct)
+{
+    STATUS retStatus = STATUS_SUCCESS, status;
+    const GValue* pGValue;
+    PCHAR pName, pValue;
+    gboolean persistent = FALSE;
+    gint i;
+
+    CHK(pGstKvsPlugin != NULL && pGstStruct != NULL, STATUS_NULL_ARG);
+
+    // The persistence applies to all of the fields
+    gst_structure_get_boolean(pGstStruct, KVS_ADD_METADATA_PERSISTENT, &persistent);
+
+    for (i = 0; i < gst_structure_n_fields(pGstStruct); i++) {
+        pName = (PCHAR) gst_structure_nth_field_name(pGstStruct, (guint) i);
+        if (0 == STRCMP(pName, KVS_ADD_METADATA_PERSISTENT)) {
+            continue;
+        }
+
+        // Strings as is, numbers and the like in their serialized form
+        pGValue = gst_structure_get_value(pGstStruct, pName);
+        pValue = G_VALUE_HOLDS_STRING(pGValue) ? g_value_dup_string(pGValue) : gst_value_serialize(pGValue);
+        if (pValue == NULL) {
+            DLOGW("Skipping metadata %s that can't be serialized", pName);
+            continue;
+        }
+
+        // One bad field doesn't cost the others
+        if (STATUS_FAILED(status = addMetadata(pGstKvsPlugin, pName, pValue, persistent))) {
+            DLOGW("Failed to add metadata %s with 0x%08x", pName, status);
+            retStatus = status;
+        }
+
+        g_free(pValue);
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS flushMetadataBatch(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS, status;
+    MetadataEntry entries[MAX_FRAGMENT_METADATA_COUNT];
+    StreamCall streamCall;
+    UINT32 count, i, flushedCount = 0;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+    CHK(pGstKvsPlugin->gstParams.metadataBatching && IS_VALID_MUTEX_VALUE(pGstKvsPlugin->metadataLock), retStatus);
+
+    // Taken out of the lock so the event thread isn't held up by the stream
+    MUTEX_LOCK(pGstKvsPlugin->metadataLock);
+    count = pGstKvsPlugin->metadataCount;
+    MEMCPY(entries, pGstKvsPlugin->metadataEntries, count * SIZEOF(MetadataEntry));
+    pGstKvsPlugin->metadataCount = 0;
+    pGstKvsPlugin->metadataSize = 0;
+    if (count != 0) {
+        pGstKvsPlugin->metadataStats.flushCount++;
+    }
+    MUTEX_UNLOCK(pGstKvsPlugin->metadataLock);
+
+    CHK(count != 0, retStatus);
+
+    for (i = 0; i < count; i++) {
+        MEMSET(&streamCall, 0x00, SIZEOF(StreamCall));
+        streamCall.type = GST_PLUGIN_STREAM_CALL_PUT_METADATA;
+        streamCall.pMetadataName = entries[i].name;
+        streamCall.pMetadataValue = entries[i].value;
+        streamCall.persistent = entries[i].persistent;
+
+        if (STATUS_FAILED(status = putStreamCall(pGstKvsPlugin, &streamCall))) {
+            DLOGW("Failed to put metadata %s with 0x%08x", entries[i].name, status);
+            retStatus = status;
+        } else {
+            flushedCount++;
+        }
+    }
+
+    MUTEX_LOCK(pGstKvsPlugin->metadataLock);
+    pGstKvsPlugin->metadataStats.flushedCount += flushedCount;
+    MUTEX_UNLOCK(pGstKvsPlugin->metadataLock);
+
+CleanUp:
+
+    return retStatus;
+}
+
+GstStructure* getMetadataStats(PGstKvsPlugin pGstKvsPlugin)
+{
+    MetadataStats metadataStats;
+
+    // Not initialized until the element is ready
+    if (!IS_VALID_MUTEX_VALUE(pGstKvsPlugin->metadataLock)) {
+        return gst_structure_new_empty(GST_PLUGIN_METADATA_STATS_G_STRUCT_NAME);
+    }
+
+    MUTEX_LOCK(pGstKvsPlugin->metadataLock);
+    metadataStats = pGstKvsPlugin->metadataStats;
+    MUTEX_UNLOCK(pGstKvsPlugin->metadataLock);
+
+    return gst_structure_new(GST_PLUGIN_METADATA_STATS_G_STRUCT_NAME, "received", G_TYPE_UINT64, metadataStats.receivedCount, "deduplicated",
+                             G_TYPE_UINT64, metadataStats.deduplicatedCount, "dropped", G_TYPE_UINT64, metadataStats.droppedCount, "flushed",
+                             G_TYPE_UINT64, metadataStats.flushedCount, "flushes", G_TYPE_UINT64, metadataStats.flushCount, NULL);
+}
@@ -0,0 +1,46 @@
+#ifndef __GST_PLUGIN_METADATA_H__
+#define __GST_PLUGIN_METADATA_H__
+
+#define DEFAULT_METADATA_BATCHING FALSE
+
+// Name and value bytes batched per fragment, defaults to what the SDK can take
+#define DEFAULT_METADATA_BATCH_SIZE (MAX_FRAGMENT_METADATA_COUNT * (MKV_MAX_TAG_NAME_LEN + MKV_MAX_TAG_VALUE_LEN))
+
+#define GST_PLUGIN_METADATA_STATS_G_STRUCT_NAME "kvs-metadata-stats"
+
+typedef struct __MetadataEntry MetadataEntry;
+struct __MetadataEntry {
+    CHAR name[MKV_MAX_TAG_NAME_LEN + 1];
+    CHAR value[MKV_MAX_TAG_VALUE_LEN + 1];
+    BOOL persistent;
+};
+typedef struct __MetadataEntry* PMetadataEntry;
+
+typedef struct __MetadataStats MetadataStats;
+struct __MetadataStats {
+    UINT64 receivedCount;
+    // Replaced by a later value with the same name before the flush
+    UINT64 deduplicatedCount;
+    // Over the count or size cap of the fragment
+    UINT64 droppedCount;
+    UINT64 flushedCount;
+    UINT64 flushCount;
+};
+typedef struct __MetadataStats* PMetadataStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+STATUS initMetadataBatch(PGstKvsPlugin);
+STATUS freeMetadataBatch(PGstKvsPlugin);
+STATUS addMetadata(PGstKvsPlugin, PCHAR, PCHAR, BOOL);
+STATUS addMetadataStructure(PGstKvsPlugin, const GstStructure*);
+STATUS flushMetadataBatch(PGstKvsPlugin);
+GstStructure* getMetadataStats(PGstKvsPlugin);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__GST_PLUGIN_METADATA_H__
@@ -0,0 +1,135 @@
+#define LOG_CLASS "GstPluginPool"
+#include "GstPlugin.h"
+
+STATUS createObjectPool(UINT32 objectSize, UINT32 capacity, PObjectPool* ppObjectPool)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PObjectPool pObjectPool = NULL;
+
+    CHK(ppObjectPool != NULL, STATUS_NULL_ARG);
+    CHK(objectSize != 0 && capacity != 0, STATUS_INVALID_ARG);
+
+    // The pointer arrays follow the struct
+    CHK(NULL != (pObjectPool = (PObjectPool) MEMCALLOC(1, SIZEOF(ObjectPool) + 2 * capacity * SIZEOF(PVOID))), STATUS_NOT_ENOUGH_MEMORY);
+    pObjectPool->objectSize = objectSize;
+    pObjectPool->capacity = capacity;
+    pObjectPool->ppObjects = (PVOID*) (pObjectPool + 1);
+    pObjectPool->ppFreeObjects = pObjectPool->ppObjects + capacity;
+
+    pObjectPool->lock = MUTEX_CREATE(FALSE);
+    CHK(IS_VALID_MUTEX_VALUE(pObjectPool->lock), STATUS_INVALID_OPERATION);
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus)) {
+        freeObjectPool(&pObjectPool);
+    }
+
+    if (ppObjectPool != NULL) {
+        *ppObjectPool = pObjectPool;
+    }
+
+    return retStatus;
+}
+
+STATUS freeObjectPool(PObjectPool* ppObjectPool)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PObjectPool pObjectPool;
+    UINT32 i;
+
+    CHK(ppObjectPool != NULL, STATUS_NULL_ARG);
+
+    pObjectPool = *ppObjectPool;
+    CHK(pObjectPool != NULL, retStatus);
+
+    // Including the ones still in use, which makes them invalid
+    for (i = 0; i < pObjectPool->stats.allocatedCount; i++) {
+        MEMFREE(pObjectPool->ppObjects[i]);
+    }
+
+    if (IS_VALID_MUTEX_VALUE(pObjectPool->lock)) {
+        MUTEX_FREE(pObjectPool->lock);
+    }
+
+    MEMFREE(pObjectPool);
+    *ppObjectPool = NULL;
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS objectPoolGet(PObjectPool pObjectPool, PVOID* ppObject)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PObjectPoolStats pStats;
+    PVOID pObject = NULL;
+    BOOL locked = FALSE;
+
+    CHK(pObjectPool != NULL && ppObject != NULL, STATUS_NULL_ARG);
+    pStats = &pObjectPool->stats;
+
+    MUTEX_LOCK(pObjectPool->lock);
+    locked = TRUE;
+
+    if (pObjectPool->freeCount != 0) {
+        pObject = pObjectPool->ppFreeObjects[--pObjectPool->freeCount];
+        pStats->hitCount++;
+    } else {
+        if (pStats->allocatedCount == pObjectPool->capacity) {
+            pStats->rejectedCount++;
+            CHK(FALSE, STATUS_NOT_ENOUGH_MEMORY);
+        }
+
+        CHK(NULL != (pObject = MEMALLOC(pObjectPool->objectSize)), STATUS_NOT_ENOUGH_MEMORY);
+        pObjectPool->ppObjects[pStats->allocatedCount++] = pObject;
+        pStats->missCount++;
+    }
+
+    pStats->inUseCount++;
+    pStats->peakInUseCount = MAX(pStats->peakInUseCount, pStats->inUseCount);
+
+CleanUp:
+
+    if (locked) {
+        MUTEX_UNLOCK(pObjectPool->lock);
+    }
+
+    if (ppObject != NULL) {
+        *ppObject = pObject;
+    }
+
+    return retStatus;
+}
+
+STATUS objectPoolPut(PObjectPool pObjectPool, PVOID pObject)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pObjectPool != NULL && pObject != NULL, STATUS_NULL_ARG);
+
+    MUTEX_LOCK(pObjectPool->lock);
+    pObjectPool->ppFreeObjects[pObjectPool->freeCount++] = pObject;
+    pObjectPool->stats.inUseCount--;
+    MUTEX_UNLOCK(pObjectPool->lock);
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS getObjectPoolStats(PObjectPool pObjectPool, PObjectPoolStats pStats)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pObjectPool != NULL && pStats != NULL, STATUS_NULL_ARG);
+
+    MUTEX_LOCK(pObjectPool->lock);
+    *pStats = pObjectPool->stats;
+    MUTEX_UNLOCK(pObjectPool->lock);
+
+CleanUp:
+
+    return retStatus;
+}
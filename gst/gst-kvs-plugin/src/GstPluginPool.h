@@ -0,0 +1,49 @@
+#ifndef __GST_PLUGIN_POOL_H__
+#define __GST_PLUGIN_POOL_H__
+
+typedef struct __ObjectPoolStats ObjectPoolStats;
+struct __ObjectPoolStats {
+    // Handed out a returned object
+    UINT64 hitCount;
+    // Had to allocate, which only happens until the pool reaches its capacity
+    UINT64 missCount;
+    // At capacity with every object in use
+    UINT64 rejectedCount;
+    UINT32 allocatedCount;
+    UINT32 inUseCount;
+    UINT32 peakInUseCount;
+};
+typedef struct __ObjectPoolStats* PObjectPoolStats;
+
+/**
+ * Fixed size objects allocated on demand up to the capacity and recycled instead of freed until the pool itself is
+ */
+typedef struct __ObjectPool ObjectPool;
+struct __ObjectPool {
+    MUTEX lock;
+    UINT32 objectSize;
+    UINT32 capacity;
+    // All of the objects allocated, to free them with the pool
+    PVOID* ppObjects;
+    // Stack of the returned ones, the most recently used is handed out first while it's still in the cache
+    PVOID* ppFreeObjects;
+    UINT32 freeCount;
+    ObjectPoolStats stats;
+};
+typedef struct __ObjectPool* PObjectPool;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+STATUS createObjectPool(UINT32, UINT32, PObjectPool*);
+STATUS freeObjectPool(PObjectPool*);
+STATUS objectPoolGet(PObjectPool, PVOID*);
+STATUS objectPoolPut(PObjectPool, PVOID);
+STATUS getObjectPoolStats(PObjectPool, PObjectPoolStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__GST_PLUGIN_POOL_H__
@@ -0,0 +1,176 @@
+#define LOG_CLASS "GstPluginShedding"
+#include "GstPlugin.h"
+
+STATUS initShedding(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+
+    if (!IS_VALID_MUTEX_VALUE(pGstKvsPlugin->sheddingLock)) {
+        pGstKvsPlugin->sheddingLock = MUTEX_CREATE(FALSE);
+        CHK(IS_VALID_MUTEX_VALUE(pGstKvsPlugin->sheddingLock), STATUS_INVALID_OPERATION);
+    }
+
+    pGstKvsPlugin->sheddingLevel = GST_PLUGIN_SHEDDING_LEVEL_NONE;
+    pGstKvsPlugin->sheddingPressure = GST_PLUGIN_PRESSURE_LATENCY;
+    pGstKvsPlugin->sheddingLevelTime = 0;
+    pGstKvsPlugin->lastPressureTime = 0;
+    pGstKvsPlugin->sheddingGop = FALSE;
+    pGstKvsPlugin->sheddingQosLevel = GST_PLUGIN_SHEDDING_LEVEL_NONE;
+    MEMSET(&pGstKvsPlugin->sheddingStats, 0x00, SIZEOF(SheddingStats));
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS freeShedding(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+
+    if (IS_VALID_MUTEX_VALUE(pGstKvsPlugin->sheddingLock)) {
+        MUTEX_FREE(pGstKvsPlugin->sheddingLock);
+        pGstKvsPlugin->sheddingLock = INVALID_MUTEX_VALUE;
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS reportPressure(PGstKvsPlugin pGstKvsPlugin, GST_PLUGIN_PRESSURE pressure)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    UINT64 now = GETTIME();
+
+    CHK(pGstKvsPlugin != NULL && pressure < GST_PLUGIN_PRESSURE_COUNT, STATUS_INVALID_ARG);
+    CHK(pGstKvsPlugin->gstParams.frameShedding && IS_VALID_MUTEX_VALUE(pGstKvsPlugin->sheddingLock), retStatus);
+
+    MUTEX_LOCK(pGstKvsPlugin->sheddingLock);
+
+    pGstKvsPlugin->sheddingStats.pressureCount[pressure]++;
+    pGstKvsPlugin->sheddingPressure = pressure;
+    pGstKvsPlugin->lastPressureTime = now;
+
+    // Start with the frames nobody misses and only escalate if that does not relieve the pressure
+    if (pGstKvsPlugin->sheddingLevel == GST_PLUGIN_SHEDDING_LEVEL_NONE ||
+        (pGstKvsPlugin->sheddingLevel == GST_PLUGIN_SHEDDING_LEVEL_NON_REFERENCE &&
+         now >= pGstKvsPlugin->sheddingLevelTime + SHEDDING_ESCALATION_PERIOD)) {
+        pGstKvsPlugin->sheddingLevel++;
+        pGstKvsPlugin->sheddingLevelTime = now;
+        DLOGW("Raising frame shedding to level %u on pressure %u", pGstKvsPlugin->sheddingLevel, pressure);
+    }
+
+    MUTEX_UNLOCK(pGstKvsPlugin->sheddingLock);
+
+CleanUp:
+
+    return retStatus;
+}
+
+BOOL shedVideoFrame(PGstKvsPlugin pGstKvsPlugin, GstCollectData* pCollectData, PFrame pFrame, GstClockTime pts)
+{
+    PSheddingStats pSheddingStats = &pGstKvsPlugin->sheddingStats;
+    GST_PLUGIN_SHEDDING_LEVEL level;
+    GST_PLUGIN_PRESSURE pressure;
+    BOOL shed = FALSE, nonReference = FALSE, keyFrame = CHECK_FRAME_FLAG_KEY_FRAME(pFrame->flags);
+    UINT64 now = GETTIME();
+    GstEvent* qosEvent;
+
+    // Offline mode blocks on pressure rather than evicting
+    if (!pGstKvsPlugin->gstParams.frameShedding || IS_OFFLINE_STREAMING_MODE(pGstKvsPlugin->gstParams.streamingType) ||
+        !IS_VALID_MUTEX_VALUE(pGstKvsPlugin->sheddingLock)) {
+        return FALSE;
+    }
+
+    MUTEX_LOCK(pGstKvsPlugin->sheddingLock);
+
+    // Step down a level at a time once the pressure is gone
+    if (pGstKvsPlugin->sheddingLevel != GST_PLUGIN_SHEDDING_LEVEL_NONE && now >= pGstKvsPlugin->lastPressureTime + SHEDDING_RELAX_PERIOD &&
+        now >= pGstKvsPlugin->sheddingLevelTime + SHEDDING_RELAX_PERIOD) {
+        pGstKvsPlugin->sheddingLevel--;
+        pGstKvsPlugin->sheddingLevelTime = now;
+        DLOGI("Lowering frame shedding to level %u", pGstKvsPlugin->sheddingLevel);
+    }
+
+    level = pGstKvsPlugin->sheddingLevel;
+    pressure = pGstKvsPlugin->sheddingPressure;
+
+    MUTEX_UNLOCK(pGstKvsPlugin->sheddingLock);
+
+    // GOPs are resumed on a key frame only. Escalating mid-GOP sheds the rest of it as it would not decode
+    if (keyFrame || level == GST_PLUGIN_SHEDDING_LEVEL_GOP) {
+        pGstKvsPlugin->sheddingGop = level == GST_PLUGIN_SHEDDING_LEVEL_GOP;
+    }
+
+    if (pGstKvsPlugin->sheddingGop) {
+        shed = TRUE;
+        pSheddingStats->gopFrameCount++;
+    } else if (level == GST_PLUGIN_SHEDDING_LEVEL_NON_REFERENCE && !keyFrame &&
+               STATUS_SUCCEEDED(identifyNonReferenceFrame(pFrame->frameData, pFrame->size, pGstKvsPlugin->detectedCpdFormat,
+                                                          0 == STRCMP(pGstKvsPlugin->gstParams.codecId, DEFAULT_CODEC_ID_H265), &nonReference)) &&
+               nonReference) {
+        shed = TRUE;
+        pSheddingStats->nonReferenceFrameCount++;
+    }
+
+    if (shed) {
+        pSheddingStats->shedFrameCount[pressure]++;
+    } else if (level == GST_PLUGIN_SHEDDING_LEVEL_NONE) {
+        pGstKvsPlugin->sheddingQosLevel = GST_PLUGIN_SHEDDING_LEVEL_NONE;
+    }
+
+    // Ask upstream for less, encoders can lower the bitrate or the frame rate. Once per level change and then once per
+    // GOP while it lasts, a QoS event per shed frame would only flood the upstream elements
+    if (shed && (level != pGstKvsPlugin->sheddingQosLevel || keyFrame)) {
+        pGstKvsPlugin->sheddingQosLevel = level;
+        qosEvent = gst_event_new_qos(GST_QOS_TYPE_OVERFLOW, 1.0 + level * SHEDDING_QOS_PROPORTION_STEP, 0,
+                                     gst_segment_to_running_time(&pCollectData->segment, GST_FORMAT_TIME, pts));
+        if (gst_pad_push_event(pCollectData->pad, qosEvent)) {
+            pSheddingStats->qosEventCount++;
+        }
+    }
+
+    return shed;
+}
+
+STATUS streamLatencyPressureHandler(UINT64 customData, STREAM_HANDLE streamHandle, UINT64 currentBufferDuration)
+{
+    UNUSED_PARAM(streamHandle);
+    UNUSED_PARAM(currentBufferDuration);
+
+    return reportPressure((PGstKvsPlugin) customData, GST_PLUGIN_PRESSURE_LATENCY);
+}
+
+STATUS bufferDurationOverflowPressureHandler(UINT64 customData, STREAM_HANDLE streamHandle, UINT64 remainingDuration)
+{
+    UNUSED_PARAM(streamHandle);
+    UNUSED_PARAM(remainingDuration);
+
+    return reportPressure((PGstKvsPlugin) customData, GST_PLUGIN_PRESSURE_BUFFER_DURATION);
+}
+
+STATUS storageOverflowPressureHandler(UINT64 customData, UINT64 remainingBytes)
+{
+    UNUSED_PARAM(remainingBytes);
+
+    return reportPressure((PGstKvsPlugin) customData, GST_PLUGIN_PRESSURE_STORAGE);
+}
+
+GstStructure* getSheddingStats(PGstKvsPlugin pGstKvsPlugin)
+{
+    PSheddingStats pSheddingStats = &pGstKvsPlugin->sheddingStats;
+
+    return gst_structure_new(
+        GST_PLUGIN_SHEDDING_STATS_G_STRUCT_NAME, "latency-pressures", G_TYPE_UINT64, pSheddingStats->pressureCount[GST_PLUGIN_PRESSURE_LATENCY],
+        "buffer-duration-pressures", G_TYPE_UINT64, pSheddingStats->pressureCount[GST_PLUGIN_PRESSURE_BUFFER_DURATION], "storage-pressures",
+        G_TYPE_UINT64, pSheddingStats->pressureCount[GST_PLUGIN_PRESSURE_STORAGE], "latency-shed-frames", G_TYPE_UINT64,
+        pSheddingStats->shedFrameCount[GST_PLUGIN_PRESSURE_LATENCY], "buffer-duration-shed-frames", G_TYPE_UINT64,
+        pSheddingStats->shedFrameCount[GST_PLUGIN_PRESSURE_BUFFER_DURATION], "storage-shed-frames", G_TYPE_UINT64,
+        pSheddingStats->shedFrameCount[GST_PLUGIN_PRESSURE_STORAGE], "non-reference-shed-frames", G_TYPE_UINT64,
+        pSheddingStats->nonReferenceFrameCount, "gop-shed-frames", G_TYPE_UINT64, pSheddingStats->gopFrameCount, "qos-events", G_TYPE_UINT64,
+        pSheddingStats->qosEventCount, NULL);
+}
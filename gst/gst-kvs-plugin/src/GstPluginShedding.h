@@ -0,0 +1,60 @@
+#ifndef __GST_PLUGIN_SHEDDING_H__
+#define __GST_PLUGIN_SHEDDING_H__
+
+#define DEFAULT_FRAME_SHEDDING FALSE
+
+// Time under continuous pressure before shedding non-reference frames escalates to shedding whole GOPs
+#define SHEDDING_ESCALATION_PERIOD (2 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+
+// Time without pressure before shedding steps down a level
+#define SHEDDING_RELAX_PERIOD (5 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+
+// Proportion reported upstream in the QoS events per shedding level, above 1.0 asks for less data
+#define SHEDDING_QOS_PROPORTION_STEP 0.5
+
+#define GST_PLUGIN_SHEDDING_STATS_G_STRUCT_NAME "kvs-shedding-stats"
+
+typedef enum {
+    GST_PLUGIN_SHEDDING_LEVEL_NONE,
+    // Frames no other frame references, shedding them leaves the rest decodable
+    GST_PLUGIN_SHEDDING_LEVEL_NON_REFERENCE,
+    // Everything up to the next key frame that finds the pressure gone
+    GST_PLUGIN_SHEDDING_LEVEL_GOP,
+} GST_PLUGIN_SHEDDING_LEVEL;
+
+typedef enum {
+    GST_PLUGIN_PRESSURE_LATENCY,
+    GST_PLUGIN_PRESSURE_BUFFER_DURATION,
+    GST_PLUGIN_PRESSURE_STORAGE,
+    GST_PLUGIN_PRESSURE_COUNT,
+} GST_PLUGIN_PRESSURE;
+
+typedef struct __SheddingStats SheddingStats;
+struct __SheddingStats {
+    UINT64 pressureCount[GST_PLUGIN_PRESSURE_COUNT];
+    // Shed frames by the pressure in effect when they were shed
+    UINT64 shedFrameCount[GST_PLUGIN_PRESSURE_COUNT];
+    UINT64 nonReferenceFrameCount;
+    UINT64 gopFrameCount;
+    UINT64 qosEventCount;
+};
+typedef struct __SheddingStats* PSheddingStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+STATUS initShedding(PGstKvsPlugin);
+STATUS freeShedding(PGstKvsPlugin);
+STATUS reportPressure(PGstKvsPlugin, GST_PLUGIN_PRESSURE);
+BOOL shedVideoFrame(PGstKvsPlugin, GstCollectData*, PFrame, GstClockTime);
+STATUS streamLatencyPressureHandler(UINT64, STREAM_HANDLE, UINT64);
+STATUS bufferDurationOverflowPressureHandler(UINT64, STREAM_HANDLE, UINT64);
+STATUS storageOverflowPressureHandler(UINT64, UINT64);
+GstStructure* getSheddingStats(PGstKvsPlugin);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__GST_PLUGIN_SHEDDING_H__
@@ -0,0 +1,411 @@
+#define LOG_CLASS "GstPluginStartup"
+#include "GstPlugin.h"
+
+// Frees the calls still queued for a stream that never came up
+static VOID freePrerollCalls(PGstKvsPlugin pGstKvsPlugin)
+{
+    StackQueueIterator iterator;
+    UINT64 data;
+
+    stackQueueGetIterator(pGstKvsPlugin->pPrerollQueue, &iterator);
+    while (IS_VALID_ITERATOR(iterator)) {
+        stackQueueIteratorGetItem(iterator, &data);
+        stackQueueIteratorNext(&iterator);
+        MEMFREE((PStreamCall) data);
+    }
+
+    stackQueueClear(pGstKvsPlugin->pPrerollQueue, FALSE);
+}
+
+STATUS initStartup(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+
+    // A repeated NULL_TO_READY reuses the lock and the queue, so join and drop what the previous run left behind first
+    awaitStartup(pGstKvsPlugin);
+
+    ATOMIC_STORE_BOOL(&pGstKvsPlugin->streamReady, FALSE);
+    pGstKvsPlugin->streamStartupStatus = STATUS_SUCCESS;
+    pGstKvsPlugin->dropUntilKeyFrame = FALSE;
+    pGstKvsPlugin->prerollSize = 0;
+    pGstKvsPlugin->streamStartupTid = INVALID_TID_VALUE;
+    pGstKvsPlugin->webRtcStartupTid = INVALID_TID_VALUE;
+
+    if (!IS_VALID_MUTEX_VALUE(pGstKvsPlugin->startupLock)) {
+        pGstKvsPlugin->startupLock = MUTEX_CREATE(FALSE);
+        CHK(IS_VALID_MUTEX_VALUE(pGstKvsPlugin->startupLock), STATUS_INVALID_OPERATION);
+    }
+
+    if (pGstKvsPlugin->pPrerollQueue == NULL) {
+        CHK_STATUS(stackQueueCreate(&pGstKvsPlugin->pPrerollQueue));
+    } else {
+        freePrerollCalls(pGstKvsPlugin);
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+static STATUS executeStreamCallOnStream(STREAM_HANDLE streamHandle, PStreamCall pStreamCall)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    switch (pStreamCall->type) {
+        case GST_PLUGIN_STREAM_CALL_PUT_FRAME:
+            CHK_STATUS(putKinesisVideoFrame(streamHandle, &pStreamCall->frame));
+            break;
+        case GST_PLUGIN_STREAM_CALL_FORMAT_CHANGED:
+            CHK_STATUS(
+                kinesisVideoStreamFormatChanged(streamHandle, pStreamCall->frame.size, pStreamCall->frame.frameData, pStreamCall->frame.trackId));
+            break;
+        case GST_PLUGIN_STREAM_CALL_SWITCH_FORMAT:
+            CHK_STATUS(
+                switchKinesisVideoStreamFormat(streamHandle, pStreamCall->frame.frameData, pStreamCall->frame.size, pStreamCall->frame.trackId));
+            break;
+        case GST_PLUGIN_STREAM_CALL_SET_NAL_ADAPTATION_FLAGS:
+            CHK_STATUS(kinesisVideoStreamSetNalAdaptationFlags(streamHandle, pStreamCall->nalAdaptationFlags));
+            break;
+        case GST_PLUGIN_STREAM_CALL_PUT_METADATA:
+            CHK_STATUS(putKinesisVideoFragmentMetadata(streamHandle, pStreamCall->pMetadataName, pStreamCall->pMetadataValue,
+                                                       pStreamCall->persistent));
+            break;
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+static STATUS executeStreamCall(PGstKvsPlugin pGstKvsPlugin, PStreamCall pStreamCall)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    STREAM_HANDLE streamHandles[MAX_UPLOAD_SESSIONS];
+    UINT32 count, i;
+
+    if (pGstKvsPlugin->kvsContext.pBulkUpload == NULL) {
+        CHK_STATUS(executeStreamCallOnStream(pGstKvsPlugin->kvsContext.streamHandle, pStreamCall));
+        CHK(FALSE, retStatus);
+    }
+
+    // Bulk uploads route the frames of a segment to its session
+    CHK_STATUS(getBulkUploadStreamHandles(pGstKvsPlugin->kvsContext.pBulkUpload, pStreamCall, streamHandles, &count));
+    for (i = 0; i < count; i++) {
+        CHK_STATUS(executeStreamCallOnStream(streamHandles[i], pStreamCall));
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+// Copies the call and everything it points to into a single allocation
+static STATUS copyStreamCall(PStreamCall pStreamCall, PStreamCall* ppCopy)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PStreamCall pCopy = NULL;
+    UINT32 dataSize = 0, nameSize = 0, valueSize = 0;
+    PBYTE pData;
+
+    if (pStreamCall->type == GST_PLUGIN_STREAM_CALL_PUT_FRAME || pStreamCall->type == GST_PLUGIN_STREAM_CALL_FORMAT_CHANGED ||
+        pStreamCall->type == GST_PLUGIN_STREAM_CALL_SWITCH_FORMAT) {
+        dataSize = pStreamCall->frame.size;
+    } else if (pStreamCall->type == GST_PLUGIN_STREAM_CALL_PUT_METADATA) {
+        nameSize = (UINT32) STRLEN(pStreamCall->pMetadataName) + 1;
+        valueSize = (UINT32) STRLEN(pStreamCall->pMetadataValue) + 1;
+    }
+
+    pCopy = (PStreamCall) MEMALLOC(SIZEOF(StreamCall) + dataSize + nameSize + valueSize);
+    CHK(pCopy != NULL, STATUS_NOT_ENOUGH_MEMORY);
+
+    *pCopy = *pStreamCall;
+    pData = (PBYTE) (pCopy + 1);
+
+    if (dataSize != 0) {
+        MEMCPY(pData, pStreamCall->frame.frameData, dataSize);
+        pCopy->frame.frameData = pData;
+        pData += dataSize;
+    }
+
+    if (nameSize != 0) {
+        MEMCPY(pData, pStreamCall->pMetadataName, nameSize);
+        pCopy->pMetadataName = (PCHAR) pData;
+        pData += nameSize;
+        MEMCPY(pData, pStreamCall->pMetadataValue, valueSize);
+        pCopy->pMetadataValue = (PCHAR) pData;
+    }
+
+    *ppCopy = pCopy;
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS putStreamCall(PGstKvsPlugin pGstKvsPlugin, PStreamCall pStreamCall)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PStreamCall pCopy = NULL;
+    BOOL locked = FALSE, isFrame;
+
+    CHK(pGstKvsPlugin != NULL && pStreamCall != NULL, STATUS_NULL_ARG);
+    isFrame = pStreamCall->type == GST_PLUGIN_STREAM_CALL_PUT_FRAME;
+
+    // Lock free once the stream is up. Until then the lock orders us against the pre-roll replay
+    if (!ATOMIC_LOAD_BOOL(&pGstKvsPlugin->streamReady)) {
+        MUTEX_LOCK(pGstKvsPlugin->startupLock);
+        locked = TRUE;
+
+        CHK_STATUS(pGstKvsPlugin->streamStartupStatus);
+    }
+
+    // Frames following one the pre-roll had no room for can't be decoded until the next key frame
+    if (isFrame && pGstKvsPlugin->dropUntilKeyFrame) {
+        if (!CHECK_FRAME_FLAG_KEY_FRAME(pStreamCall->frame.flags)) {
+            pGstKvsPlugin->startupTimes.prerollDroppedFrameCount++;
+            CHK(FALSE, retStatus);
+        }
+
+        pGstKvsPlugin->dropUntilKeyFrame = FALSE;
+    }
+
+    if (ATOMIC_LOAD_BOOL(&pGstKvsPlugin->streamReady)) {
+        CHK_STATUS(executeStreamCall(pGstKvsPlugin, pStreamCall));
+        CHK(FALSE, retStatus);
+    }
+
+    if (isFrame && pGstKvsPlugin->prerollSize + pStreamCall->frame.size > pGstKvsPlugin->gstParams.startupPrerollSize) {
+        DLOGW("Startup pre-roll of %u bytes is full, dropping frames until the stream is ready", pGstKvsPlugin->gstParams.startupPrerollSize);
+        pGstKvsPlugin->dropUntilKeyFrame = TRUE;
+        pGstKvsPlugin->startupTimes.prerollDroppedFrameCount++;
+        CHK(FALSE, retStatus);
+    }
+
+    CHK_STATUS(copyStreamCall(pStreamCall, &pCopy));
+    CHK_STATUS(stackQueueEnqueue(pGstKvsPlugin->pPrerollQueue, (UINT64) pCopy));
+    pCopy = NULL;
+
+    if (isFrame) {
+        pGstKvsPlugin->prerollSize += pStreamCall->frame.size;
+        accountMemoryAlloc(pGstKvsPlugin, GST_PLUGIN_MEMORY_PREROLL, pStreamCall->frame.size);
+        pGstKvsPlugin->startupTimes.prerollFrameCount++;
+    }
+
+CleanUp:
+
+    if (locked) {
+        MUTEX_UNLOCK(pGstKvsPlugin->startupLock);
+    }
+
+    SAFE_MEMFREE(pCopy);
+
+    return retStatus;
+}
+
+// Replays the pre-rolled calls in order. Called with the startup lock held
+static STATUS replayStreamCalls(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS, status;
+    BOOL empty = FALSE;
+    UINT64 data;
+    PStreamCall pStreamCall;
+
+    CHK_STATUS(stackQueueIsEmpty(pGstKvsPlugin->pPrerollQueue, &empty));
+    while (!empty) {
+        CHK_STATUS(stackQueueDequeue(pGstKvsPlugin->pPrerollQueue, &data));
+        pStreamCall = (PStreamCall) data;
+
+        // Same as a call made after startup, a failed call doesn't stop the ones after it
+        if (STATUS_FAILED(status = executeStreamCall(pGstKvsPlugin, pStreamCall))) {
+            DLOGW("Failed to replay pre-rolled stream call %u with 0x%08x", pStreamCall->type, status);
+        }
+
+        MEMFREE(pStreamCall);
+        CHK_STATUS(stackQueueIsEmpty(pGstKvsPlugin->pPrerollQueue, &empty));
+    }
+
+    accountMemoryFree(pGstKvsPlugin, GST_PLUGIN_MEMORY_PREROLL, pGstKvsPlugin->prerollSize);
+    pGstKvsPlugin->prerollSize = 0;
+
+CleanUp:
+
+    return retStatus;
+}
+
+static PVOID streamStartupRoutine(PVOID args)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PGstKvsPlugin pGstKvsPlugin = (PGstKvsPlugin) args;
+    BOOL locked = FALSE;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+
+    retStatus = startKinesisVideoStream(pGstKvsPlugin);
+
+    MUTEX_LOCK(pGstKvsPlugin->startupLock);
+    locked = TRUE;
+
+    pGstKvsPlugin->streamStartupStatus = retStatus;
+    CHK_STATUS(retStatus);
+    CHK_STATUS(replayStreamCalls(pGstKvsPlugin));
+
+    pGstKvsPlugin->startupTimes.streamReadyTime = GETTIME() - pGstKvsPlugin->startupTimes.startTime;
+    ATOMIC_STORE_BOOL(&pGstKvsPlugin->streamReady, TRUE);
+
+    DLOGI("Stream ready %" PRIu64 " ms after start with %u frames pre-rolled and %u dropped",
+          pGstKvsPlugin->startupTimes.streamReadyTime / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, pGstKvsPlugin->startupTimes.prerollFrameCount,
+          pGstKvsPlugin->startupTimes.prerollDroppedFrameCount);
+
+CleanUp:
+
+    if (locked) {
+        MUTEX_UNLOCK(pGstKvsPlugin->startupLock);
+    }
+
+    if (STATUS_FAILED(retStatus) && pGstKvsPlugin != NULL) {
+        GST_ELEMENT_ERROR(pGstKvsPlugin, LIBRARY, INIT, (NULL), ("Failed to create the stream with 0x%08x", retStatus));
+    }
+
+    return (PVOID)(ULONG_PTR) retStatus;
+}
+
+static PVOID webRtcStartupRoutine(PVOID args)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PGstKvsPlugin pGstKvsPlugin = (PGstKvsPlugin) args;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+
+    CHK_STATUS(startKinesisVideoWebRtc(pGstKvsPlugin));
+
+    pGstKvsPlugin->startupTimes.webRtcReadyTime = GETTIME() - pGstKvsPlugin->startupTimes.startTime;
+    DLOGI("Signaling client ready %" PRIu64 " ms after start", pGstKvsPlugin->startupTimes.webRtcReadyTime / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus) && pGstKvsPlugin != NULL) {
+        GST_ELEMENT_ERROR(pGstKvsPlugin, LIBRARY, INIT, (NULL), ("Failed to start the signaling client with 0x%08x", retStatus));
+    }
+
+    return (PVOID)(ULONG_PTR) retStatus;
+}
+
+STATUS startStreamAndWebRtc(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+
+    if (pGstKvsPlugin->gstParams.asyncStartup) {
+        // Neither bring-up depends on the other, so the control plane round trips overlap
+        CHK_STATUS(THREAD_CREATE(&pGstKvsPlugin->streamStartupTid, streamStartupRoutine, (PVOID) pGstKvsPlugin));
+        CHK_STATUS(THREAD_CREATE(&pGstKvsPlugin->webRtcStartupTid, webRtcStartupRoutine, (PVOID) pGstKvsPlugin));
+    } else {
+        CHK_STATUS(startKinesisVideoStream(pGstKvsPlugin));
+        pGstKvsPlugin->startupTimes.streamReadyTime = GETTIME() - pGstKvsPlugin->startupTimes.startTime;
+        ATOMIC_STORE_BOOL(&pGstKvsPlugin->streamReady, TRUE);
+
+        CHK_STATUS(startKinesisVideoWebRtc(pGstKvsPlugin));
+        pGstKvsPlugin->startupTimes.webRtcReadyTime = GETTIME() - pGstKvsPlugin->startupTimes.startTime;
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS awaitStreamStartup(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+
+    if (IS_VALID_TID_VALUE(pGstKvsPlugin->streamStartupTid)) {
+        THREAD_JOIN(pGstKvsPlugin->streamStartupTid, NULL);
+        pGstKvsPlugin->streamStartupTid = INVALID_TID_VALUE;
+    }
+
+    retStatus = pGstKvsPlugin->streamStartupStatus;
+
+CleanUp:
+
+    return retStatus;
+}
+
+// Joins both bring-ups, for the element going down while they still run
+STATUS awaitStartup(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+
+    retStatus = awaitStreamStartup(pGstKvsPlugin);
+    if (IS_VALID_TID_VALUE(pGstKvsPlugin->webRtcStartupTid)) {
+        THREAD_JOIN(pGstKvsPlugin->webRtcStartupTid, NULL);
+        pGstKvsPlugin->webRtcStartupTid = INVALID_TID_VALUE;
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+// The startup routine writes the status under the startup lock
+STATUS getStreamStartupStatus(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+    CHK(IS_VALID_MUTEX_VALUE(pGstKvsPlugin->startupLock), retStatus);
+
+    MUTEX_LOCK(pGstKvsPlugin->startupLock);
+    retStatus = pGstKvsPlugin->streamStartupStatus;
+    MUTEX_UNLOCK(pGstKvsPlugin->startupLock);
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS freeStartup(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+
+    // The routines use the stream and signaling handles which are freed after us
+    awaitStartup(pGstKvsPlugin);
+
+    if (pGstKvsPlugin->pPrerollQueue != NULL) {
+        freePrerollCalls(pGstKvsPlugin);
+        stackQueueFree(pGstKvsPlugin->pPrerollQueue);
+        pGstKvsPlugin->pPrerollQueue = NULL;
+    }
+
+    if (IS_VALID_MUTEX_VALUE(pGstKvsPlugin->startupLock)) {
+        MUTEX_FREE(pGstKvsPlugin->startupLock);
+        pGstKvsPlugin->startupLock = INVALID_MUTEX_VALUE;
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+GstStructure* getStartupTimes(PGstKvsPlugin pGstKvsPlugin)
+{
+    PStartupTimes pStartupTimes = &pGstKvsPlugin->startupTimes;
+
+    // Unfinished phases read 0
+    return gst_structure_new(GST_PLUGIN_STARTUP_TIMES_G_STRUCT_NAME, "producer-init-ms", G_TYPE_UINT64,
+                             pStartupTimes->producerInitDuration / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, "stream-create-ms", G_TYPE_UINT64,
+                             pStartupTimes->streamCreateDuration / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, "signaling-create-ms", G_TYPE_UINT64,
+                             pStartupTimes->signalingCreateDuration / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, "signaling-fetch-ms", G_TYPE_UINT64,
+                             pStartupTimes->signalingFetchDuration / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, "signaling-connect-ms", G_TYPE_UINT64,
+                             pStartupTimes->signalingConnectDuration / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, "stream-ready-ms", G_TYPE_UINT64,
+                             pStartupTimes->streamReadyTime / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, "webrtc-ready-ms", G_TYPE_UINT64,
+                             pStartupTimes->webRtcReadyTime / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, "preroll-frames", G_TYPE_UINT,
+                             pStartupTimes->prerollFrameCount, "preroll-dropped-frames", G_TYPE_UINT, pStartupTimes->prerollDroppedFrameCount, NULL);
+}
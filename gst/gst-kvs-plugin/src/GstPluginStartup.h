@@ -0,0 +1,69 @@
+#ifndef __GST_PLUGIN_STARTUP_H__
+#define __GST_PLUGIN_STARTUP_H__
+
+#define DEFAULT_ASYNC_STARTUP              FALSE
+#define DEFAULT_STARTUP_PREROLL_SIZE_BYTES (8 * 1024 * 1024)
+
+#define GST_PLUGIN_STARTUP_TIMES_G_STRUCT_NAME "kvs-startup-times"
+
+typedef enum {
+    GST_PLUGIN_STREAM_CALL_PUT_FRAME,
+    GST_PLUGIN_STREAM_CALL_FORMAT_CHANGED,
+    GST_PLUGIN_STREAM_CALL_SET_NAL_ADAPTATION_FLAGS,
+    GST_PLUGIN_STREAM_CALL_PUT_METADATA,
+    // Format change of a stream that is already streaming
+    GST_PLUGIN_STREAM_CALL_SWITCH_FORMAT,
+} GST_PLUGIN_STREAM_CALL;
+
+/**
+ * A call into the KVS stream. With async startup the calls made before the stream is created are copied into the
+ * pre-roll queue and replayed in order once it is
+ */
+typedef struct __StreamCall StreamCall;
+struct __StreamCall {
+    GST_PLUGIN_STREAM_CALL type;
+    // The frame to put, or the CPD of a format change or switch in frameData, size and trackId
+    Frame frame;
+    UINT32 nalAdaptationFlags;
+    PCHAR pMetadataName;
+    PCHAR pMetadataValue;
+    BOOL persistent;
+};
+typedef struct __StreamCall* PStreamCall;
+
+/**
+ * Startup breakdown. Durations and times since NULL_TO_READY are in 100ns
+ */
+typedef struct __StartupTimes StartupTimes;
+struct __StartupTimes {
+    UINT64 startTime;
+    UINT64 producerInitDuration;
+    UINT64 streamCreateDuration;
+    UINT64 signalingCreateDuration;
+    UINT64 signalingFetchDuration;
+    UINT64 signalingConnectDuration;
+    UINT64 streamReadyTime;
+    UINT64 webRtcReadyTime;
+    UINT32 prerollFrameCount;
+    UINT32 prerollDroppedFrameCount;
+};
+typedef struct __StartupTimes* PStartupTimes;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+STATUS initStartup(PGstKvsPlugin);
+STATUS startStreamAndWebRtc(PGstKvsPlugin);
+STATUS putStreamCall(PGstKvsPlugin, PStreamCall);
+STATUS awaitStreamStartup(PGstKvsPlugin);
+STATUS awaitStartup(PGstKvsPlugin);
+STATUS getStreamStartupStatus(PGstKvsPlugin);
+STATUS freeStartup(PGstKvsPlugin);
+GstStructure* getStartupTimes(PGstKvsPlugin);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__GST_PLUGIN_STARTUP_H__
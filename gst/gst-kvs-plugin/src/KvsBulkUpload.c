@@ -0,0 +1,501 @@
+#define LOG_CLASS "KvsBulkUpload"
+#include "GstPlugin.h"
+
+// Journal lines are <segment start>,<segment end>,<fragment count> with the timestamps in 100ns
+static STATUS loadUploadJournal(PBulkUpload pBulkUpload)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PCHAR pContent = NULL, pLine, pNewLine, pComma;
+    UINT64 size = 0, startTimestamp;
+    UINT32 lineCount = 0;
+    BOOL exists = FALSE;
+
+    CHK_STATUS(fileExists(pBulkUpload->journalPath, &exists));
+    CHK(exists, retStatus);
+
+    CHK_STATUS(readFile(pBulkUpload->journalPath, FALSE, NULL, &size));
+    CHK(NULL != (pContent = (PCHAR) MEMALLOC(size + 1)), STATUS_NOT_ENOUGH_MEMORY);
+    if (size > 0) {
+        CHK_STATUS(readFile(pBulkUpload->journalPath, FALSE, (PBYTE) pContent, &size));
+    }
+
+    pContent[size] = '\0';
+
+    for (pLine = pContent; NULL != (pLine = STRCHR(pLine, '\n')); pLine++) {
+        lineCount++;
+    }
+
+    CHK(NULL != (pBulkUpload->pJournaledSegments = (PUINT64) MEMALLOC((lineCount + 1) * SIZEOF(UINT64))), STATUS_NOT_ENOUGH_MEMORY);
+
+    // A line torn by a crash is skipped, the segment is uploaded again
+    for (pLine = pContent; *pLine != '\0'; pLine = pNewLine) {
+        pNewLine = STRCHR(pLine, '\n');
+        if (pNewLine == NULL) {
+            break;
+        }
+
+        *pNewLine++ = '\0';
+        pComma = STRCHR(pLine, ',');
+        if (pComma == NULL) {
+            continue;
+        }
+
+        *pComma = '\0';
+        if (STATUS_SUCCEEDED(STRTOUI64(pLine, NULL, 10, &startTimestamp))) {
+            pBulkUpload->pJournaledSegments[pBulkUpload->journaledSegmentCount++] = startTimestamp;
+        }
+    }
+
+    DLOGI("Loaded %u persisted segments from the upload journal", pBulkUpload->journaledSegmentCount);
+
+CleanUp:
+
+    SAFE_MEMFREE(pContent);
+
+    return retStatus;
+}
+
+static BOOL isSegmentJournaled(PBulkUpload pBulkUpload, UINT64 startTimestamp)
+{
+    UINT32 i;
+
+    for (i = 0; i < pBulkUpload->journaledSegmentCount; i++) {
+        if (pBulkUpload->pJournaledSegments[i] == startTimestamp) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+// Retires the persisted segments at the head of the session. Called under the lock
+static STATUS completeUploadSegments(PUploadSession pSession)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PBulkUpload pBulkUpload = pSession->pBulkUpload;
+    PUploadSegment pSegment;
+    CHAR line[UPLOAD_JOURNAL_ENTRY_MAX_LEN];
+    UINT64 item;
+    BOOL empty;
+    INT32 written;
+
+    CHK_STATUS(stackQueueIsEmpty(pSession->pSegments, &empty));
+    while (!empty) {
+        CHK_STATUS(stackQueuePeek(pSession->pSegments, &item));
+        pSegment = (PUploadSegment) item;
+        CHK(pSegment->closed && pSegment->persistedCount >= pSegment->fragmentCount, retStatus);
+
+        CHK_STATUS(stackQueueDequeue(pSession->pSegments, &item));
+        pBulkUpload->stats.completedSegmentCount++;
+        DLOGI("Session %u persisted the segment at %" PRIu64 " with %u fragments", pSession->index, pSegment->startTimestamp,
+              pSegment->fragmentCount);
+
+        if (pBulkUpload->journalPath[0] != '\0') {
+            written = SNPRINTF(line, SIZEOF(line), "%" PRIu64 ",%" PRIu64 ",%u\n", pSegment->startTimestamp, pSegment->endTimestamp,
+                               pSegment->fragmentCount);
+            if (written <= 0 || (UINT32) written >= SIZEOF(line) ||
+                STATUS_FAILED(writeFile(pBulkUpload->journalPath, FALSE, TRUE, (PBYTE) line, (UINT64) written))) {
+                DLOGW("Failed to journal the segment at %" PRIu64, pSegment->startTimestamp);
+            }
+        }
+
+        MEMFREE(pSegment);
+        CHK_STATUS(stackQueueIsEmpty(pSession->pSegments, &empty));
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+// Closes the current segment, called under the lock
+static STATUS closeUploadSegment(PBulkUpload pBulkUpload)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pBulkUpload->pSegment != NULL, retStatus);
+
+    pBulkUpload->pSegment->closed = TRUE;
+    CHK_STATUS(completeUploadSegments(pBulkUpload->pSession));
+
+CleanUp:
+
+    pBulkUpload->pSegment = NULL;
+    pBulkUpload->pSession = NULL;
+
+    return retStatus;
+}
+
+// Starts a new segment on the key frame at or past the segment duration
+static STATUS advanceUploadSegment(PBulkUpload pBulkUpload, UINT64 timestamp)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PUploadSegment pSegment = NULL;
+    PUploadSession pSession;
+    BOOL locked = FALSE;
+
+    CHK(!pBulkUpload->segmentStarted || timestamp >= pBulkUpload->segmentStartTimestamp + pBulkUpload->segmentDuration, retStatus);
+
+    MUTEX_LOCK(pBulkUpload->lock);
+    locked = TRUE;
+
+    CHK_STATUS(closeUploadSegment(pBulkUpload));
+    pBulkUpload->segmentStarted = TRUE;
+    pBulkUpload->segmentStartTimestamp = timestamp;
+    pBulkUpload->stats.segmentCount++;
+
+    if (isSegmentJournaled(pBulkUpload, timestamp)) {
+        pBulkUpload->stats.skippedSegmentCount++;
+        DLOGI("Skipping the segment at %" PRIu64 " persisted earlier", timestamp);
+        CHK(FALSE, retStatus);
+    }
+
+    // Round robin, a session that falls behind blocks the input once its buffer is full
+    pSession = &pBulkUpload->sessions[pBulkUpload->nextSession];
+    pBulkUpload->nextSession = (pBulkUpload->nextSession + 1) % pBulkUpload->sessionCount;
+
+    CHK(NULL != (pSegment = (PUploadSegment) MEMCALLOC(1, SIZEOF(UploadSegment))), STATUS_NOT_ENOUGH_MEMORY);
+    pSegment->startTimestamp = timestamp;
+    pSegment->endTimestamp = timestamp;
+    CHK_STATUS(stackQueueEnqueue(pSession->pSegments, (UINT64) pSegment));
+
+    pBulkUpload->pSession = pSession;
+    pBulkUpload->pSegment = pSegment;
+    pSegment = NULL;
+
+CleanUp:
+
+    SAFE_MEMFREE(pSegment);
+
+    if (locked) {
+        MUTEX_UNLOCK(pBulkUpload->lock);
+    }
+
+    return retStatus;
+}
+
+STATUS initBulkUpload(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PBulkUpload pBulkUpload = NULL;
+    PUploadSession pSession;
+    UINT32 i;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+    CHK(pGstKvsPlugin->kvsContext.pBulkUpload == NULL && pGstKvsPlugin->gstParams.uploadSessions > 1 &&
+            IS_OFFLINE_STREAMING_MODE(pGstKvsPlugin->gstParams.streamingType),
+        retStatus);
+
+    // Placing the segments takes absolute timecodes and accounting for them the ACKs of key frame aligned fragments
+    if (!pGstKvsPlugin->gstParams.absoluteFragmentTimecodes || !pGstKvsPlugin->gstParams.keyFrameFragmentation ||
+        !pGstKvsPlugin->gstParams.fragmentAcks || pGstKvsPlugin->mediaType == GST_PLUGIN_MEDIA_TYPE_AUDIO_ONLY) {
+        DLOGW("Bulk upload needs a file start time, key frame fragmentation, fragment ACKs and a video track, uploading over one session");
+        CHK(FALSE, retStatus);
+    }
+
+    CHK(NULL != (pBulkUpload = (PBulkUpload) MEMCALLOC(1, SIZEOF(BulkUpload))), STATUS_NOT_ENOUGH_MEMORY);
+    pBulkUpload->pGstKvsPlugin = pGstKvsPlugin;
+    pBulkUpload->sessionCount = MIN(pGstKvsPlugin->gstParams.uploadSessions, MAX_UPLOAD_SESSIONS);
+    pBulkUpload->segmentDuration = (UINT64) pGstKvsPlugin->gstParams.uploadSegmentDurationInSeconds * HUNDREDS_OF_NANOS_IN_A_SECOND;
+    pBulkUpload->lock = MUTEX_CREATE(FALSE);
+    CHK(IS_VALID_MUTEX_VALUE(pBulkUpload->lock), STATUS_INVALID_OPERATION);
+
+    for (i = 0; i < pBulkUpload->sessionCount; i++) {
+        pSession = &pBulkUpload->sessions[i];
+        pSession->pBulkUpload = pBulkUpload;
+        pSession->index = i;
+        pSession->clientHandle = INVALID_CLIENT_HANDLE_VALUE;
+        pSession->streamHandle = INVALID_STREAM_HANDLE_VALUE;
+        pSession->streamCallbacks.version = STREAM_CALLBACKS_CURRENT_VERSION;
+        pSession->streamCallbacks.customData = (UINT64) pSession;
+        pSession->streamCallbacks.fragmentAckReceivedFn = bulkUploadFragmentAckHandler;
+        CHK_STATUS(stackQueueCreate(&pSession->pSegments));
+
+        // Session 0 has the plugin's error handler already
+        if (i != 0) {
+            pSession->streamCallbacks.streamErrorReportFn = bulkUploadStreamErrorReportHandler;
+        }
+    }
+
+    if (pGstKvsPlugin->gstParams.uploadJournalPath[0] != '\0') {
+        STRNCPY(pBulkUpload->journalPath, pGstKvsPlugin->gstParams.uploadJournalPath, MAX_PATH_LEN);
+        CHK_STATUS(loadUploadJournal(pBulkUpload));
+    }
+
+    CHK_STATUS(addStreamCallbacks(pGstKvsPlugin->kvsContext.pClientCallbacks, &pBulkUpload->sessions[0].streamCallbacks));
+
+    DLOGI("Bulk uploading %u second segments over %u sessions", pGstKvsPlugin->gstParams.uploadSegmentDurationInSeconds,
+          pBulkUpload->sessionCount);
+
+    pGstKvsPlugin->kvsContext.pBulkUpload = pBulkUpload;
+    pBulkUpload = NULL;
+
+CleanUp:
+
+    CHK_LOG_ERR(retStatus);
+
+    freeBulkUpload(&pBulkUpload);
+
+    return retStatus;
+}
+
+STATUS startBulkUploadSessions(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PBulkUpload pBulkUpload;
+    PUploadSession pSession;
+    PStreamCallbacks pStreamCallbacks = NULL;
+    PAuthCallbacks pAuthCallbacks;
+    PCHAR pControlPlaneUrl;
+    UINT32 i;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+    CHK(NULL != (pBulkUpload = pGstKvsPlugin->kvsContext.pBulkUpload), retStatus);
+
+    pBulkUpload->sessions[0].clientHandle = pGstKvsPlugin->kvsContext.clientHandle;
+    pBulkUpload->sessions[0].streamHandle = pGstKvsPlugin->kvsContext.streamHandle;
+
+    if (NULL == (pControlPlaneUrl = GETENV(KVS_CONTROL_PLANE_URL_ENV_VAR))) {
+        pControlPlaneUrl = EMPTY_STRING;
+    }
+
+    // Each of the other sessions is a client of its own with the plugin's device and stream info
+    for (i = 1; i < pBulkUpload->sessionCount; i++) {
+        pSession = &pBulkUpload->sessions[i];
+
+        CHK_STATUS(createAbstractDefaultCallbacksProvider(DEFAULT_CALLBACK_CHAIN_COUNT, API_CALL_CACHE_TYPE_ALL, DEFAULT_API_CACHE_PERIOD,
+                                                          pGstKvsPlugin->pRegion, pControlPlaneUrl, pGstKvsPlugin->caCertPath,
+                                                          KVS_PRODUCER_CLIENT_USER_AGENT_NAME, NULL, &pSession->pClientCallbacks));
+
+        CHK_STATUS(createContinuousRetryStreamCallbacks(pSession->pClientCallbacks, &pStreamCallbacks));
+        pStreamCallbacks = NULL;
+
+        CHK_STATUS(addStreamCallbacks(pSession->pClientCallbacks, &pSession->streamCallbacks));
+        CHK_STATUS(createCredentialProviderAuthCallbacks(pSession->pClientCallbacks, pGstKvsPlugin->kvsContext.pCredentialProvider, &pAuthCallbacks));
+        CHK_STATUS(createKinesisVideoClient(pGstKvsPlugin->kvsContext.pDeviceInfo, pSession->pClientCallbacks, &pSession->clientHandle));
+        CHK_STATUS(createKinesisVideoStreamSync(pSession->clientHandle, pGstKvsPlugin->kvsContext.pStreamInfo, &pSession->streamHandle));
+    }
+
+    DLOGI("Bulk upload sessions are ready");
+
+CleanUp:
+
+    CHK_LOG_ERR(retStatus);
+
+    if (pStreamCallbacks != NULL) {
+        freeContinuousRetryStreamCallbacks(&pStreamCallbacks);
+    }
+
+    return retStatus;
+}
+
+STATUS stopBulkUploadSessions(PGstKvsPlugin pGstKvsPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS, status;
+    PBulkUpload pBulkUpload;
+    UINT64 pendingCount;
+    UINT32 i, count;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
+    CHK(NULL != (pBulkUpload = pGstKvsPlugin->kvsContext.pBulkUpload), retStatus);
+
+    MUTEX_LOCK(pBulkUpload->lock);
+    status = closeUploadSegment(pBulkUpload);
+    MUTEX_UNLOCK(pBulkUpload->lock);
+    CHK_STATUS(status);
+
+    // Session 0 is stopped with the plugin's stream. Stopping waits for the remaining ACKs
+    for (i = 1; i < pBulkUpload->sessionCount; i++) {
+        if (IS_VALID_STREAM_HANDLE(pBulkUpload->sessions[i].streamHandle) &&
+            STATUS_FAILED(status = stopKinesisVideoStreamSync(pBulkUpload->sessions[i].streamHandle))) {
+            DLOGW("Failed to stop the stream of upload session %u with 0x%08x", i, status);
+            retStatus = status;
+        }
+    }
+
+    MUTEX_LOCK(pBulkUpload->lock);
+    for (i = 0, pendingCount = 0; i < pBulkUpload->sessionCount; i++) {
+        if (STATUS_SUCCEEDED(stackQueueGetCount(pBulkUpload->sessions[i].pSegments, &count))) {
+            pendingCount += count;
+        }
+    }
+    MUTEX_UNLOCK(pBulkUpload->lock);
+
+    if (pendingCount != 0) {
+        DLOGW("%" PRIu64 " segments were not fully persisted and will be uploaded again on the next run", pendingCount);
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS freeBulkUpload(PBulkUpload* ppBulkUpload)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PBulkUpload pBulkUpload;
+    PUploadSession pSession;
+    UINT64 item;
+    BOOL empty;
+    UINT32 i;
+
+    CHK(ppBulkUpload != NULL, STATUS_NULL_ARG);
+    CHK(NULL != (pBulkUpload = *ppBulkUpload), retStatus);
+
+    for (i = 0; i < pBulkUpload->sessionCount; i++) {
+        pSession = &pBulkUpload->sessions[i];
+
+        if (i != 0) {
+            if (IS_VALID_CLIENT_HANDLE(pSession->clientHandle)) {
+                freeKinesisVideoClient(&pSession->clientHandle);
+            }
+
+            if (pSession->pClientCallbacks != NULL) {
+                freeCallbacksProvider(&pSession->pClientCallbacks);
+            }
+        }
+
+        if (pSession->pSegments != NULL) {
+            for (stackQueueIsEmpty(pSession->pSegments, &empty); !empty; stackQueueIsEmpty(pSession->pSegments, &empty)) {
+                stackQueueDequeue(pSession->pSegments, &item);
+                MEMFREE((PVOID) item);
+            }
+
+            stackQueueFree(pSession->pSegments);
+        }
+    }
+
+    if (IS_VALID_MUTEX_VALUE(pBulkUpload->lock)) {
+        MUTEX_FREE(pBulkUpload->lock);
+    }
+
+    SAFE_MEMFREE(pBulkUpload->pJournaledSegments);
+    MEMFREE(pBulkUpload);
+    *ppBulkUpload = NULL;
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS getBulkUploadStreamHandles(PBulkUpload pBulkUpload, PStreamCall pStreamCall, PSTREAM_HANDLE pStreamHandles, PUINT32 pCount)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    UINT32 i;
+
+    CHK(pBulkUpload != NULL && pStreamCall != NULL && pStreamHandles != NULL && pCount != NULL, STATUS_NULL_ARG);
+    *pCount = 0;
+
+    switch (pStreamCall->type) {
+        case GST_PLUGIN_STREAM_CALL_PUT_FRAME:
+            if (CHECK_FRAME_FLAG_KEY_FRAME(pStreamCall->frame.flags)) {
+                CHK_STATUS(advanceUploadSegment(pBulkUpload, pStreamCall->frame.presentationTs));
+            }
+
+            // Nothing before the first key frame and nothing of a skipped segment
+            CHK(pBulkUpload->pSegment != NULL, retStatus);
+
+            MUTEX_LOCK(pBulkUpload->lock);
+            if (CHECK_FRAME_FLAG_KEY_FRAME(pStreamCall->frame.flags)) {
+                pBulkUpload->pSegment->fragmentCount++;
+            }
+
+            pBulkUpload->pSegment->endTimestamp = MAX(pBulkUpload->pSegment->endTimestamp, pStreamCall->frame.presentationTs);
+            MUTEX_UNLOCK(pBulkUpload->lock);
+
+            pStreamHandles[(*pCount)++] = pBulkUpload->pSession->streamHandle;
+            break;
+
+        case GST_PLUGIN_STREAM_CALL_PUT_METADATA:
+            if (pBulkUpload->pSession != NULL) {
+                pStreamHandles[(*pCount)++] = pBulkUpload->pSession->streamHandle;
+            }
+            break;
+
+        default:
+            // Every session streams the same tracks
+            for (i = 0; i < pBulkUpload->sessionCount; i++) {
+                pStreamHandles[(*pCount)++] = pBulkUpload->sessions[i].streamHandle;
+            }
+            break;
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS bulkUploadFragmentAckHandler(UINT64 customData, STREAM_HANDLE streamHandle, UPLOAD_HANDLE uploadHandle, PFragmentAck pFragmentAck)
+{
+    UNUSED_PARAM(streamHandle);
+    UNUSED_PARAM(uploadHandle);
+
+    STATUS retStatus = STATUS_SUCCESS;
+    PUploadSession pSession = (PUploadSession) customData;
+    PUploadSegment pSegment;
+    UINT64 item;
+    BOOL locked = FALSE, empty;
+
+    CHK(pSession != NULL && pFragmentAck != NULL, STATUS_NULL_ARG);
+    CHK(pFragmentAck->ackType == FRAGMENT_ACK_TYPE_PERSISTED, retStatus);
+
+    MUTEX_LOCK(pSession->pBulkUpload->lock);
+    locked = TRUE;
+
+    CHK(!pSession->ackReceived || pFragmentAck->timestamp > pSession->lastAckTimestamp, retStatus);
+    pSession->ackReceived = TRUE;
+    pSession->lastAckTimestamp = pFragmentAck->timestamp;
+    pSession->pBulkUpload->stats.persistedFragmentCount++;
+
+    // The fragments of a session are persisted in order, so they belong to its oldest segment
+    CHK_STATUS(stackQueueIsEmpty(pSession->pSegments, &empty));
+    CHK(!empty, retStatus);
+    CHK_STATUS(stackQueuePeek(pSession->pSegments, &item));
+    pSegment = (PUploadSegment) item;
+    pSegment->persistedCount++;
+    CHK_STATUS(completeUploadSegments(pSession));
+
+CleanUp:
+
+    if (locked) {
+        MUTEX_UNLOCK(pSession->pBulkUpload->lock);
+    }
+
+    return retStatus;
+}
+
+STATUS bulkUploadStreamErrorReportHandler(UINT64 customData, STREAM_HANDLE streamHandle, UPLOAD_HANDLE uploadHandle, UINT64 erroredTimecode,
+                                          STATUS statusCode)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PUploadSession pSession = (PUploadSession) customData;
+
+    CHK(pSession != NULL, STATUS_NULL_ARG);
+
+    DLOGW("Upload session %u failed", pSession->index);
+    CHK_STATUS(streamErrorReportHandler((UINT64) pSession->pBulkUpload->pGstKvsPlugin, streamHandle, uploadHandle, erroredTimecode, statusCode));
+
+CleanUp:
+
+    return retStatus;
+}
+
+GstStructure* getBulkUploadStats(PGstKvsPlugin pGstKvsPlugin)
+{
+    PBulkUpload pBulkUpload = pGstKvsPlugin->kvsContext.pBulkUpload;
+    UploadStats uploadStats;
+    UINT32 sessionCount = 1;
+
+    MEMSET(&uploadStats, 0x00, SIZEOF(UploadStats));
+    if (pBulkUpload != NULL) {
+        MUTEX_LOCK(pBulkUpload->lock);
+        uploadStats = pBulkUpload->stats;
+        MUTEX_UNLOCK(pBulkUpload->lock);
+        sessionCount = pBulkUpload->sessionCount;
+    }
+
+    return gst_structure_new(GST_PLUGIN_UPLOAD_STATS_G_STRUCT_NAME, "sessions", G_TYPE_UINT, sessionCount, "segments", G_TYPE_UINT64,
+                             uploadStats.segmentCount, "skipped-segments", G_TYPE_UINT64, uploadStats.skippedSegmentCount, "completed-segments",
+                             G_TYPE_UINT64, uploadStats.completedSegmentCount, "persisted-fragments", G_TYPE_UINT64,
+                             uploadStats.persistedFragmentCount, NULL);
+}
@@ -0,0 +1,98 @@
+#ifndef __KVS_BULK_UPLOAD_H__
+#define __KVS_BULK_UPLOAD_H__
+
+#define DEFAULT_UPLOAD_SESSIONS                 1
+#define MAX_UPLOAD_SESSIONS                     8
+#define DEFAULT_UPLOAD_SEGMENT_DURATION_SECONDS 60
+#define DEFAULT_UPLOAD_JOURNAL_PATH             ""
+
+#define UPLOAD_JOURNAL_ENTRY_MAX_LEN 64
+
+#define GST_PLUGIN_UPLOAD_STATS_G_STRUCT_NAME "kvs-upload-stats"
+
+typedef struct __BulkUpload BulkUpload;
+typedef struct __BulkUpload* PBulkUpload;
+
+/**
+ * Fragments starting on the key frames of a segment duration, uploaded over one session
+ */
+typedef struct __UploadSegment UploadSegment;
+struct __UploadSegment {
+    UINT64 startTimestamp;
+    UINT64 endTimestamp;
+    UINT32 fragmentCount;
+    UINT32 persistedCount;
+    // No more fragments after the next segment started
+    BOOL closed;
+};
+typedef struct __UploadSegment* PUploadSegment;
+
+typedef struct __UploadSession UploadSession;
+struct __UploadSession {
+    PBulkUpload pBulkUpload;
+    UINT32 index;
+    // Session 0 uses the plugin's own client and stream, the others their own
+    PClientCallbacks pClientCallbacks;
+    CLIENT_HANDLE clientHandle;
+    STREAM_HANDLE streamHandle;
+    StreamCallbacks streamCallbacks;
+    // Segments yet to be persisted in upload order
+    PStackQueue pSegments;
+    // Re-sent fragments get ACKed again after a reconnect
+    BOOL ackReceived;
+    UINT64 lastAckTimestamp;
+};
+typedef struct __UploadSession* PUploadSession;
+
+typedef struct __UploadStats UploadStats;
+struct __UploadStats {
+    UINT64 segmentCount;
+    // Persisted by an earlier run according to the journal
+    UINT64 skippedSegmentCount;
+    UINT64 completedSegmentCount;
+    UINT64 persistedFragmentCount;
+};
+typedef struct __UploadStats* PUploadStats;
+
+/**
+ * Offline upload spreading key frame aligned segments over concurrent sessions. The segments carry absolute timecodes
+ * so the service places them whatever order they land in. Every segment with all of its fragments persisted is
+ * recorded in the journal and skipped when the same input is uploaded again
+ */
+struct __BulkUpload {
+    PGstKvsPlugin pGstKvsPlugin;
+    MUTEX lock;
+    UINT32 sessionCount;
+    UploadSession sessions[MAX_UPLOAD_SESSIONS];
+    UINT32 nextSession;
+    UINT64 segmentDuration;
+    BOOL segmentStarted;
+    UINT64 segmentStartTimestamp;
+    // NULL while skipping a segment
+    PUploadSession pSession;
+    PUploadSegment pSegment;
+    CHAR journalPath[MAX_PATH_LEN + 1];
+    // Start timestamps of the journaled segments
+    PUINT64 pJournaledSegments;
+    UINT32 journaledSegmentCount;
+    UploadStats stats;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+STATUS initBulkUpload(PGstKvsPlugin);
+STATUS startBulkUploadSessions(PGstKvsPlugin);
+STATUS stopBulkUploadSessions(PGstKvsPlugin);
+STATUS freeBulkUpload(PBulkUpload*);
+STATUS getBulkUploadStreamHandles(PBulkUpload, PStreamCall, PSTREAM_HANDLE, PUINT32);
+STATUS bulkUploadFragmentAckHandler(UINT64, STREAM_HANDLE, UPLOAD_HANDLE, PFragmentAck);
+STATUS bulkUploadStreamErrorReportHandler(UINT64, STREAM_HANDLE, UPLOAD_HANDLE, UINT64, STATUS);
+GstStructure* getBulkUploadStats(PGstKvsPlugin);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__KVS_BULK_UPLOAD_H__
@@ -125,7 +125,9 @@ STATUS initKinesisVideoStream(PGstKvsPlugin pGstPlugin)
     pGstPlugin->kvsContext.pStreamInfo->streamCaps.fragmentDuration =
         pGstPlugin->gstParams.fragmentDurationInMillis * HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
     pGstPlugin->kvsContext.pStreamInfo->streamCaps.timecodeScale = pGstPlugin->gstParams.timeCodeScaleInMillis * HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
-    pGstPlugin->kvsContext.pStreamInfo->streamCaps.keyFrameFragmentation = pGstPlugin->gstParams.keyFrameFragmentation;
+    // The tuning picks the key frames starting a fragment itself
+    pGstPlugin->kvsContext.pStreamInfo->streamCaps.keyFrameFragmentation =
+        pGstPlugin->gstParams.keyFrameFragmentation || isFragmentTuningActive(pGstPlugin);
     pGstPlugin->kvsContext.pStreamInfo->streamCaps.frameTimecodes = pGstPlugin->gstParams.frameTimecodes;
     pGstPlugin->kvsContext.pStreamInfo->streamCaps.absoluteFragmentTimes = pGstPlugin->gstParams.absoluteFragmentTimecodes;
     pGstPlugin->kvsContext.pStreamInfo->streamCaps.fragmentAcks = pGstPlugin->gstParams.fragmentAcks;
@@ -146,6 +148,10 @@ STATUS initKinesisVideoStream(PGstKvsPlugin pGstPlugin)
             pGstPlugin->gstParams.connectionStalenessInSeconds * HUNDREDS_OF_NANOS_IN_A_SECOND;
     }
 
+    if (pGstPlugin->kvsContext.pProducerCache != NULL) {
+        pGstPlugin->kvsContext.pProducerCache->pStreamInfo = pGstPlugin->kvsContext.pStreamInfo;
+    }
+
     // Replace the video codecId
     STRNCPY(pGstPlugin->kvsContext.pStreamInfo->streamCaps.trackInfoList[0].codecId, pGstPlugin->gstParams.codecId, MKV_MAX_CODEC_ID_LEN);
 
@@ -154,10 +160,24 @@ STATUS initKinesisVideoStream(PGstKvsPlugin pGstPlugin)
         STRNCPY(pGstPlugin->kvsContext.pStreamInfo->streamCaps.trackInfoList[1].codecId, pGstPlugin->audioCodecId, MKV_MAX_CODEC_ID_LEN);
     }
 
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS startKinesisVideoStream(PGstKvsPlugin pGstPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    UINT64 startTime = GETTIME();
+
+    CHK(pGstPlugin != NULL, STATUS_NULL_ARG);
+
     CHK_STATUS(
         createKinesisVideoStreamSync(pGstPlugin->kvsContext.clientHandle, pGstPlugin->kvsContext.pStreamInfo, &pGstPlugin->kvsContext.streamHandle));
 
-    pGstPlugin->frameCount = 0;
+    // The bulk upload sessions besides the plugin's own stream
+    CHK_STATUS(startBulkUploadSessions(pGstPlugin));
+    pGstPlugin->startupTimes.streamCreateDuration = GETTIME() - startTime;
 
     DLOGI("Stream is ready");
 
@@ -172,6 +192,7 @@ STATUS initKinesisVideoProducer(PGstKvsPlugin pGstPlugin)
     PAuthCallbacks pAuthCallbacks;
     PStreamCallbacks pStreamCallbacks;
     BOOL freeStreamCallbacksOnError = TRUE;
+    PCHAR pControlPlaneUrl;
 
     CHK(pGstPlugin != NULL, STATUS_NULL_ARG);
 
@@ -187,13 +208,37 @@ STATUS initKinesisVideoProducer(PGstKvsPlugin pGstPlugin)
     pGstPlugin->kvsContext.pDeviceInfo->clientInfo.stopStreamTimeout =
         pGstPlugin->gstParams.streamStopTimeoutInSeconds * HUNDREDS_OF_NANOS_IN_A_SECOND;
 
+    if (NULL == (pControlPlaneUrl = GETENV(KVS_CONTROL_PLANE_URL_ENV_VAR))) {
+        pControlPlaneUrl = EMPTY_STRING;
+    }
+
     CHK_STATUS(createAbstractDefaultCallbacksProvider(DEFAULT_CALLBACK_CHAIN_COUNT, API_CALL_CACHE_TYPE_ALL, DEFAULT_API_CACHE_PERIOD,
-                                                      pGstPlugin->pRegion, EMPTY_STRING, pGstPlugin->caCertPath, KVS_PRODUCER_CLIENT_USER_AGENT_NAME,
-                                                      NULL, &pGstPlugin->kvsContext.pClientCallbacks));
+                                                      pGstPlugin->pRegion, pControlPlaneUrl, pGstPlugin->caCertPath,
+                                                      KVS_PRODUCER_CLIENT_USER_AGENT_NAME, NULL, &pGstPlugin->kvsContext.pClientCallbacks));
+
+    // The file cache sits in front of the in-memory one so warm restarts skip DescribeStream and GetDataEndpoint.
+    // It stays off with a control plane override as that is a stand-in
+    if (pGstPlugin->gstParams.producerCacheFilePath[0] != '\0' && pControlPlaneUrl[0] == '\0') {
+        CHK_STATUS(createProducerCache(pGstPlugin->gstParams.producerCacheFilePath, pGstPlugin->gstParams.streamName, pGstPlugin->pRegion,
+                                       DEFAULT_API_CACHE_PERIOD, pGstPlugin->kvsContext.pClientCallbacks, &pGstPlugin->kvsContext.pProducerCache));
+    }
 
     CHK_STATUS(createContinuousRetryStreamCallbacks(pGstPlugin->kvsContext.pClientCallbacks, &pStreamCallbacks));
     freeStreamCallbacksOnError = FALSE;
 
+    // Surface the errors the SDK does not recover from on its own
+    pGstPlugin->kvsContext.streamCallbacks.version = STREAM_CALLBACKS_CURRENT_VERSION;
+    pGstPlugin->kvsContext.streamCallbacks.customData = (UINT64) pGstPlugin;
+    pGstPlugin->kvsContext.streamCallbacks.streamErrorReportFn = streamErrorReportHandler;
+    pGstPlugin->kvsContext.streamCallbacks.streamLatencyPressureFn = streamLatencyPressureHandler;
+    pGstPlugin->kvsContext.streamCallbacks.bufferDurationOverflowPressureFn = bufferDurationOverflowPressureHandler;
+    CHK_STATUS(addStreamCallbacks(pGstPlugin->kvsContext.pClientCallbacks, &pGstPlugin->kvsContext.streamCallbacks));
+
+    pGstPlugin->kvsContext.producerCallbacks.version = PRODUCER_CALLBACKS_CURRENT_VERSION;
+    pGstPlugin->kvsContext.producerCallbacks.customData = (UINT64) pGstPlugin;
+    pGstPlugin->kvsContext.producerCallbacks.storageOverflowPressureFn = storageOverflowPressureHandler;
+    CHK_STATUS(addProducerCallbacks(pGstPlugin->kvsContext.pClientCallbacks, &pGstPlugin->kvsContext.producerCallbacks));
+
     CHK_STATUS(
         createCredentialProviderAuthCallbacks(pGstPlugin->kvsContext.pClientCallbacks, pGstPlugin->kvsContext.pCredentialProvider, &pAuthCallbacks));
 
@@ -214,6 +259,81 @@ CleanUp:
     return retStatus;
 }
 
+STATUS streamErrorReportHandler(UINT64 customData, STREAM_HANDLE streamHandle, UPLOAD_HANDLE uploadHandle, UINT64 erroredTimecode, STATUS statusCode)
+{
+    UNUSED_PARAM(streamHandle);
+    UNUSED_PARAM(uploadHandle);
+
+    STATUS retStatus = STATUS_SUCCESS;
+    PGstKvsPlugin pGstPlugin = (PGstKvsPlugin) customData;
+
+    CHK(pGstPlugin != NULL, STATUS_NULL_ARG);
+
+    DLOGW("Stream error 0x%08x at timecode %" PRIu64, statusCode, erroredTimecode);
+
+    // The buffer handler recovers on the next frame
+    if (!IS_RECOVERABLE_ERROR(statusCode)) {
+        pGstPlugin->streamStatus = statusCode;
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS recoverKinesisVideoStream(PGstKvsPlugin pGstPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS, status;
+    StreamMetrics before, after;
+    UINT64 resentDuration = 0;
+
+    CHK(pGstPlugin != NULL, STATUS_NULL_ARG);
+
+    // Whichever way the stream comes back, the next key frame opens a fragment instead of going in as a regular frame
+    CHK_LOG_ERR(restartFragment(pGstPlugin));
+
+    MEMSET(&before, 0x00, SIZEOF(StreamMetrics));
+    before.version = STREAM_METRICS_CURRENT_VERSION;
+    after = before;
+    CHK_LOG_ERR(getKinesisVideoStreamMetrics(pGstPlugin->kvsContext.streamHandle, &before));
+
+    // Restart the upload session from the last un-ACKed fragment keeping the content store intact.
+    // The view grows by what is rolled back for re-sending
+    if (STATUS_SUCCEEDED(status = kinesisVideoStreamResetConnection(pGstPlugin->kvsContext.streamHandle))) {
+        CHK_LOG_ERR(getKinesisVideoStreamMetrics(pGstPlugin->kvsContext.streamHandle, &after));
+        if (after.currentViewDuration > before.currentViewDuration) {
+            resentDuration = after.currentViewDuration - before.currentViewDuration;
+        }
+
+        pGstPlugin->recoveryStats.resentDuration += resentDuration;
+        DLOGI("Restarted the upload session, re-sending %" PRIu64 " ms of media", resentDuration / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+    } else {
+        // Last resort, this flushes out the producer buffer
+        DLOGW("Failed to reset the connection with 0x%08x, resetting the stream", status);
+        CHK_STATUS(kinesisVideoStreamResetStream(pGstPlugin->kvsContext.streamHandle));
+
+        pGstPlugin->recoveryStats.lostDuration += before.currentViewDuration;
+        pGstPlugin->recoveryStats.streamResetCount++;
+        DLOGW("Reset the stream, lost %" PRIu64 " ms of buffered media", before.currentViewDuration / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+    }
+
+    pGstPlugin->recoveryStats.recoveryCount++;
+
+CleanUp:
+
+    return retStatus;
+}
+
+GstStructure* getRecoveryStats(PGstKvsPlugin pGstPlugin)
+{
+    PRecoveryStats pRecoveryStats = &pGstPlugin->recoveryStats;
+
+    return gst_structure_new(GST_PLUGIN_RECOVERY_STATS_G_STRUCT_NAME, "recoveries", G_TYPE_UINT, pRecoveryStats->recoveryCount, "stream-resets",
+                             G_TYPE_UINT, pRecoveryStats->streamResetCount, "resent-ms", G_TYPE_UINT64,
+                             pRecoveryStats->resentDuration / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, "lost-ms", G_TYPE_UINT64,
+                             pRecoveryStats->lostDuration / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, NULL);
+}
+
 STATUS identifyFrameNalFormat(PBYTE pData, UINT32 size, ELEMENTARY_STREAM_NAL_FORMAT* pFormat)
 {
     STATUS retStatus = STATUS_SUCCESS;
@@ -264,6 +384,61 @@ CleanUp:
     return retStatus;
 }
 
+STATUS identifyNonReferenceFrame(PBYTE pData, UINT32 size, ELEMENTARY_STREAM_NAL_FORMAT format, BOOL hevc, PBOOL pNonReference)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PBYTE pEnd = pData + size, pNal = NULL;
+    UINT32 runLen;
+    BYTE nalType;
+    BOOL nonReference = FALSE;
+
+    CHK(pData != NULL && pNonReference != NULL, STATUS_NULL_ARG);
+
+    // The first VCL NAL decides, anything we can't parse counts as referenced
+    while (pData < pEnd) {
+        if (IS_AVCC_HEVC_CPD_NAL_FORMAT(format)) {
+            CHK(pData + SIZEOF(UINT32) < pEnd, retStatus);
+            runLen = (UINT32) GET_UNALIGNED_BIG_ENDIAN((PUINT32) pData);
+            CHK(runLen != 0 && pData + SIZEOF(UINT32) + runLen <= pEnd, retStatus);
+            pNal = pData + SIZEOF(UINT32);
+            pData = pNal + runLen;
+        } else {
+            // Annex-B, the NAL header follows the 3 byte tail of the start code
+            while (pData + 3 < pEnd && !(pData[0] == 0x00 && pData[1] == 0x00 && pData[2] == 0x01)) {
+                pData++;
+            }
+
+            CHK(pData + 3 < pEnd, retStatus);
+            pNal = pData + 3;
+            pData = pNal;
+        }
+
+        if (hevc) {
+            // VCL types are below 32, the even ones up to RSV_VCL_N14 are sub-layer non-reference pictures
+            nalType = (pNal[0] >> 1) & 0x3F;
+            if (nalType < 32) {
+                nonReference = nalType <= 14 && nalType % 2 == 0;
+                CHK(FALSE, retStatus);
+            }
+        } else {
+            // VCL types are 1 to 5, nal_ref_idc of 0 marks a non-reference picture
+            nalType = pNal[0] & 0x1F;
+            if (nalType >= 1 && nalType <= 5) {
+                nonReference = (pNal[0] & 0x60) == 0;
+                CHK(FALSE, retStatus);
+            }
+        }
+    }
+
+CleanUp:
+
+    if (pNonReference != NULL) {
+        *pNonReference = nonReference;
+    }
+
+    return retStatus;
+}
+
 STATUS identifyCpdNalFormat(PBYTE pData, UINT32 size, ELEMENTARY_STREAM_NAL_FORMAT* pFormat)
 {
     STATUS retStatus = STATUS_SUCCESS;
@@ -405,3 +580,435 @@ CleanUp:
 
     return retStatus;
 }
+
+// Finds the next Annex-B NALu at or after *ppCur. The NALu ends before the next start code
+// with the trailing zero bytes trimmed, the end is only looked for when pNaluSize is given
+static STATUS getNextAnnexBNalu(PBYTE* ppCur, PBYTE pEnd, PBYTE* ppNalu, PUINT32 pNaluSize)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PBYTE pCur = *ppCur, pNalu, pNaluEnd;
+
+    while (pCur + 3 < pEnd && !(pCur[0] == 0x00 && pCur[1] == 0x00 && pCur[2] == 0x01)) {
+        pCur++;
+    }
+
+    CHK(pCur + 3 < pEnd, STATUS_FORMAT_ERROR);
+    pNalu = pCur + 3;
+    pCur = pNalu;
+
+    if (pNaluSize != NULL) {
+        while (pCur + 3 <= pEnd && !(pCur[0] == 0x00 && pCur[1] == 0x00 && pCur[2] == 0x01)) {
+            pCur++;
+        }
+
+        if (pCur + 3 > pEnd) {
+            pCur = pEnd;
+        }
+
+        for (pNaluEnd = pCur; pNaluEnd > pNalu && *(pNaluEnd - 1) == 0x00; pNaluEnd--) {
+        }
+
+        CHK(pNaluEnd > pNalu, STATUS_FORMAT_ERROR);
+        *pNaluSize = (UINT32) (pNaluEnd - pNalu);
+    }
+
+    *ppNalu = pNalu;
+    *ppCur = pCur;
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS extractParameterSets(PBYTE pData, UINT32 size, ELEMENTARY_STREAM_NAL_FORMAT format, BOOL hevc, PUINT32 pHash, PBYTE pAnnexBCpd,
+                            PUINT32 pAnnexBCpdSize)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PBYTE pCur = pData, pEnd = pData + size, pNalu;
+    UINT32 naluSize = 0, hash = 0, offset = 0, runLen;
+    BYTE start4ByteCode[] = {0x00, 0x00, 0x00, 0x01};
+    BYTE naluType;
+    BOOL vpsFound = FALSE, spsFound = FALSE, ppsFound = FALSE, parameterSet;
+
+    CHK(pData != NULL && pHash != NULL, STATUS_NULL_ARG);
+    CHK(pAnnexBCpd == NULL || pAnnexBCpdSize != NULL, STATUS_NULL_ARG);
+
+    // Parameter sets precede the first VCL NALu of the access unit
+    while (pCur < pEnd) {
+        if (IS_AVCC_HEVC_CPD_NAL_FORMAT(format)) {
+            CHK(pCur + SIZEOF(UINT32) < pEnd, STATUS_FORMAT_ERROR);
+            runLen = (UINT32) GET_UNALIGNED_BIG_ENDIAN((PUINT32) pCur);
+            pNalu = pCur + SIZEOF(UINT32);
+            CHK(runLen != 0 && runLen <= (UINT32) (pEnd - pNalu), STATUS_FORMAT_ERROR);
+            naluSize = runLen;
+            pCur = pNalu + runLen;
+        } else if (STATUS_FAILED(getNextAnnexBNalu(&pCur, pEnd, &pNalu, NULL))) {
+            break;
+        }
+
+        if (hevc) {
+            naluType = (pNalu[0] >> 1) & 0x3F;
+            if (naluType < 32) {
+                break;
+            }
+
+            vpsFound |= naluType == H265_VPS_NALU_TYPE;
+            spsFound |= naluType == H265_SPS_NALU_TYPE;
+            ppsFound |= naluType == H265_PPS_NALU_TYPE;
+            parameterSet = naluType >= H265_VPS_NALU_TYPE && naluType <= H265_PPS_NALU_TYPE;
+        } else {
+            naluType = pNalu[0] & 0x1F;
+            if (naluType >= 1 && naluType <= 5) {
+                break;
+            }
+
+            spsFound |= naluType == H264_SPS_NALU_TYPE;
+            ppsFound |= naluType == H264_PPS_NALU_TYPE;
+            parameterSet = naluType == H264_SPS_NALU_TYPE || naluType == H264_PPS_NALU_TYPE;
+        }
+
+        // Only walk to the end of the Annex-B NALus we need, the others end at the next start code anyway
+        if (!IS_AVCC_HEVC_CPD_NAL_FORMAT(format) && parameterSet) {
+            pCur = pNalu - 3;
+            CHK_STATUS(getNextAnnexBNalu(&pCur, pEnd, &pNalu, &naluSize));
+        }
+
+        if (parameterSet) {
+            hash = updateCrc32(hash, pNalu, naluSize);
+
+            if (pAnnexBCpd != NULL) {
+                CHK(offset + SIZEOF(start4ByteCode) + naluSize <= *pAnnexBCpdSize, STATUS_BUFFER_TOO_SMALL);
+                MEMCPY(pAnnexBCpd + offset, start4ByteCode, SIZEOF(start4ByteCode));
+                offset += SIZEOF(start4ByteCode);
+                MEMCPY(pAnnexBCpd + offset, pNalu, naluSize);
+                offset += naluSize;
+            }
+        }
+    }
+
+    // A partial set can't replace the CPD
+    if (!spsFound || !ppsFound || (hevc && !vpsFound)) {
+        hash = 0;
+        offset = 0;
+    }
+
+CleanUp:
+
+    if (pHash != NULL) {
+        *pHash = STATUS_SUCCEEDED(retStatus) ? hash : 0;
+    }
+
+    if (pAnnexBCpdSize != NULL && pAnnexBCpd != NULL) {
+        *pAnnexBCpdSize = STATUS_SUCCEEDED(retStatus) ? offset : 0;
+    }
+
+    return retStatus;
+}
+
+STATUS convertCpdFromAnnexBToAvc(PBYTE pData, UINT32 size, PBYTE pCpd, PUINT32 pCpdSize)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PBYTE pCur, pEnd = pData + size, pNalu, pSps = NULL;
+    UINT32 naluSize, spsSize = 0, offset = 6, countOffset = 5, pass, count;
+    BYTE naluType;
+
+    CHK(pData != NULL && pCpd != NULL && pCpdSize != NULL, STATUS_NULL_ARG);
+    CHK(*pCpdSize > offset, STATUS_BUFFER_TOO_SMALL);
+
+    // The SPS array then the PPS array, each NALu prefixed by its 16 bit size
+    for (pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            CHK(offset < *pCpdSize, STATUS_BUFFER_TOO_SMALL);
+            countOffset = offset++;
+        }
+
+        for (pCur = pData, count = 0; STATUS_SUCCEEDED(getNextAnnexBNalu(&pCur, pEnd, &pNalu, &naluSize));) {
+            naluType = pNalu[0] & 0x1F;
+            if (naluType != (pass == 0 ? H264_SPS_NALU_TYPE : H264_PPS_NALU_TYPE)) {
+                continue;
+            }
+
+            CHK(naluSize <= MAX_UINT16 && offset + SIZEOF(UINT16) + naluSize <= *pCpdSize, STATUS_BUFFER_TOO_SMALL);
+            PUT_UNALIGNED_BIG_ENDIAN((PINT16) (pCpd + offset), (UINT16) naluSize);
+            offset += SIZEOF(UINT16);
+            MEMCPY(pCpd + offset, pNalu, naluSize);
+            offset += naluSize;
+            count++;
+
+            if (pSps == NULL && pass == 0) {
+                pSps = pNalu;
+                spsSize = naluSize;
+            }
+        }
+
+        CHK(count != 0 && count <= (pass == 0 ? 0x1F : 0xFF), STATUS_FORMAT_ERROR);
+        pCpd[countOffset] = (BYTE) (pass == 0 ? 0xE0 | count : count);
+    }
+
+    // Profile, compatibility and level come from the first SPS
+    CHK(spsSize >= 4, STATUS_FORMAT_ERROR);
+    pCpd[0] = AVCC_VERSION_CODE;
+    pCpd[1] = pSps[1];
+    pCpd[2] = pSps[2];
+    pCpd[3] = pSps[3];
+    pCpd[4] = AVCC_NALU_LEN_MINUS_ONE;
+    *pCpdSize = offset;
+
+CleanUp:
+
+    return retStatus;
+}
+
+// Reads from an RBSP, past the end reads zeroes
+static UINT32 readRbspBits(PBYTE pRbsp, UINT32 size, PUINT32 pBitPos, UINT32 bitCount)
+{
+    UINT32 value = 0, i;
+
+    for (i = 0; i < bitCount; i++, (*pBitPos)++) {
+        value <<= 1;
+        if (*pBitPos / 8 < size) {
+            value |= (pRbsp[*pBitPos / 8] >> (7 - *pBitPos % 8)) & 0x01;
+        }
+    }
+
+    return value;
+}
+
+static UINT32 readRbspExpGolomb(PBYTE pRbsp, UINT32 size, PUINT32 pBitPos)
+{
+    UINT32 leadingZeros = 0;
+
+    while (leadingZeros < 31 && *pBitPos < size * 8 && readRbspBits(pRbsp, size, pBitPos, 1) == 0) {
+        leadingZeros++;
+    }
+
+    return (1u << leadingZeros) - 1 + readRbspBits(pRbsp, size, pBitPos, leadingZeros);
+}
+
+STATUS convertCpdFromAnnexBToHevc(PBYTE pData, UINT32 size, PBYTE pCpd, PUINT32 pCpdSize)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    BYTE rbsp[GST_PLUGIN_MAX_CPD_SIZE];
+    BYTE naluTypes[] = {H265_VPS_NALU_TYPE, H265_SPS_NALU_TYPE, H265_PPS_NALU_TYPE};
+    BOOL subLayerProfilePresent[8], subLayerLevelPresent[8];
+    PBYTE pCur, pEnd = pData + size, pNalu, pSps = NULL;
+    UINT32 naluSize, spsSize = 0, rbspSize = 0, offset = HEVC_CPD_HEADER_SIZE, countOffset, count, bitPos, zeroCount, i, j;
+    UINT32 maxSubLayersMinus1, temporalIdNesting, chromaFormatIdc, bitDepthLumaMinus8, bitDepthChromaMinus8;
+
+    CHK(pData != NULL && pCpd != NULL && pCpdSize != NULL, STATUS_NULL_ARG);
+
+    // One complete array per parameter set type, each NALu prefixed by its 16 bit size
+    for (i = 0; i < ARRAY_SIZE(naluTypes); i++) {
+        CHK(offset + 1 + SIZEOF(UINT16) <= *pCpdSize, STATUS_BUFFER_TOO_SMALL);
+        pCpd[offset] = 0x80 | naluTypes[i];
+        countOffset = offset + 1;
+        offset += 1 + SIZEOF(UINT16);
+
+        for (pCur = pData, count = 0; STATUS_SUCCEEDED(getNextAnnexBNalu(&pCur, pEnd, &pNalu, &naluSize));) {
+            if (((pNalu[0] >> 1) & 0x3F) != naluTypes[i]) {
+                continue;
+            }
+
+            CHK(naluSize <= MAX_UINT16 && offset + SIZEOF(UINT16) + naluSize <= *pCpdSize, STATUS_BUFFER_TOO_SMALL);
+            PUT_UNALIGNED_BIG_ENDIAN((PINT16) (pCpd + offset), (UINT16) naluSize);
+            offset += SIZEOF(UINT16);
+            MEMCPY(pCpd + offset, pNalu, naluSize);
+            offset += naluSize;
+            count++;
+
+            if (pSps == NULL && naluTypes[i] == H265_SPS_NALU_TYPE) {
+                pSps = pNalu;
+                spsSize = naluSize;
+            }
+        }
+
+        CHK(count != 0, STATUS_FORMAT_ERROR);
+        PUT_UNALIGNED_BIG_ENDIAN((PINT16) (pCpd + countOffset), (UINT16) count);
+    }
+
+    // Strip the emulation prevention bytes from the first SPS past its 2 byte header
+    for (i = 2, zeroCount = 0; i < spsSize && rbspSize < SIZEOF(rbsp); i++) {
+        if (zeroCount == 2 && pSps[i] == 0x03) {
+            zeroCount = 0;
+            continue;
+        }
+
+        zeroCount = pSps[i] == 0x00 ? zeroCount + 1 : 0;
+        rbsp[rbspSize++] = pSps[i];
+    }
+
+    // The general profile, tier and level are byte aligned after the first byte
+    CHK(rbspSize > 13, STATUS_FORMAT_ERROR);
+    MEMCPY(pCpd + 1, rbsp + 1, 12);
+
+    bitPos = 4;
+    maxSubLayersMinus1 = readRbspBits(rbsp, rbspSize, &bitPos, 3);
+    temporalIdNesting = readRbspBits(rbsp, rbspSize, &bitPos, 1);
+    bitPos += 96;
+
+    for (j = 0; j < maxSubLayersMinus1; j++) {
+        subLayerProfilePresent[j] = readRbspBits(rbsp, rbspSize, &bitPos, 1);
+        subLayerLevelPresent[j] = readRbspBits(rbsp, rbspSize, &bitPos, 1);
+    }
+
+    if (maxSubLayersMinus1 > 0) {
+        bitPos += 2 * (8 - maxSubLayersMinus1);
+    }
+
+    for (j = 0; j < maxSubLayersMinus1; j++) {
+        bitPos += (subLayerProfilePresent[j] ? 88 : 0) + (subLayerLevelPresent[j] ? 8 : 0);
+    }
+
+    // sps_seq_parameter_set_id
+    readRbspExpGolomb(rbsp, rbspSize, &bitPos);
+    chromaFormatIdc = readRbspExpGolomb(rbsp, rbspSize, &bitPos);
+    if (chromaFormatIdc == 3) {
+        // separate_colour_plane_flag
+        bitPos++;
+    }
+
+    // Width and height
+    readRbspExpGolomb(rbsp, rbspSize, &bitPos);
+    readRbspExpGolomb(rbsp, rbspSize, &bitPos);
+
+    // Conformance window offsets
+    if (readRbspBits(rbsp, rbspSize, &bitPos, 1) != 0) {
+        for (j = 0; j < 4; j++) {
+            readRbspExpGolomb(rbsp, rbspSize, &bitPos);
+        }
+    }
+
+    bitDepthLumaMinus8 = readRbspExpGolomb(rbsp, rbspSize, &bitPos);
+    bitDepthChromaMinus8 = readRbspExpGolomb(rbsp, rbspSize, &bitPos);
+    CHK(bitPos <= rbspSize * 8, STATUS_FORMAT_ERROR);
+
+    // The segmentation, parallelism and frame rate are not signalled in the SPS and left unknown
+    pCpd[0] = 0x01;
+    pCpd[13] = 0xF0;
+    pCpd[14] = 0x00;
+    pCpd[15] = 0xFC;
+    pCpd[16] = 0xFC | (BYTE) (chromaFormatIdc & 0x03);
+    pCpd[17] = 0xF8 | (BYTE) (bitDepthLumaMinus8 & 0x07);
+    pCpd[18] = 0xF8 | (BYTE) (bitDepthChromaMinus8 & 0x07);
+    pCpd[19] = 0x00;
+    pCpd[20] = 0x00;
+    pCpd[21] = (BYTE) (((maxSubLayersMinus1 + 1) << 3) | (temporalIdNesting << 2) | 0x03);
+    pCpd[22] = (BYTE) ARRAY_SIZE(naluTypes);
+    *pCpdSize = offset;
+
+CleanUp:
+
+    return retStatus;
+}
+
+// WebRTC peers take the new parameter sets on the key frame that brings them. The stream's track only takes them through
+// a switch, which needs a realtime stream that is up and the key frame going to it
+STATUS refreshInBandCpd(PGstKvsPlugin pGstKvsPlugin, PFrame pFrame, BOOL streamed, PBOOL pChanged)
+{
+    STATUS retStatus = STATUS_SUCCESS, status;
+    BYTE annexBCpd[GST_PLUGIN_MAX_CPD_SIZE], trackCpd[GST_PLUGIN_MAX_CPD_SIZE];
+    UINT32 hash, annexBCpdSize = SIZEOF(annexBCpd), trackCpdSize = SIZEOF(trackCpd);
+    ELEMENTARY_STREAM_NAL_FORMAT format;
+    StreamCall streamCall;
+    BOOL hevc, switchStream;
+
+    CHK(pGstKvsPlugin != NULL && pFrame != NULL && pChanged != NULL, STATUS_NULL_ARG);
+    *pChanged = FALSE;
+
+    // Only changes are tracked, the first CPD comes from the caps
+    CHK(pGstKvsPlugin->videoCpdSize != 0 && CHECK_FRAME_FLAG_KEY_FRAME(pFrame->flags), retStatus);
+
+    format = pGstKvsPlugin->detectedCpdFormat;
+    hevc = 0 == STRCMP(pGstKvsPlugin->gstParams.codecId, DEFAULT_CODEC_ID_H265);
+
+    // Steady state, most key frames repeat the parameter sets or carry none
+    CHK_STATUS(extractParameterSets(pFrame->frameData, pFrame->size, format, hevc, &hash, NULL, NULL));
+    switchStream = streamed && hash != pGstKvsPlugin->videoCpdHash && hash != pGstKvsPlugin->refusedCpdHash;
+    CHK(hash != 0 && (hash != pGstKvsPlugin->webRtcCpdHash || switchStream), retStatus);
+
+    CHK_STATUS(extractParameterSets(pFrame->frameData, pFrame->size, format, hevc, &hash, annexBCpd, &annexBCpdSize));
+
+    if (hash != pGstKvsPlugin->webRtcCpdHash) {
+        DLOGI("In-band parameter sets changed on frame %u", pFrame->index);
+        MEMCPY(pGstKvsPlugin->videoCpd, annexBCpd, annexBCpdSize);
+        pGstKvsPlugin->videoCpdSize = annexBCpdSize;
+        pGstKvsPlugin->webRtcCpdHash = hash;
+    }
+
+    CHK(switchStream, retStatus);
+
+    // Bulk and offline uploads can't drop the buffered media the reset takes, and the pre-roll has no stream to reset yet.
+    // The next key frame retries once the stream is up
+    CHK(ATOMIC_LOAD_BOOL(&pGstKvsPlugin->streamReady), retStatus);
+    if (IS_OFFLINE_STREAMING_MODE(pGstKvsPlugin->gstParams.streamingType) || pGstKvsPlugin->kvsContext.pBulkUpload != NULL) {
+        DLOGW("The stream keeps the CPD it started with, only realtime streams switch to in-band parameter set changes");
+        pGstKvsPlugin->refusedCpdHash = hash;
+        CHK(FALSE, retStatus);
+    }
+
+    // The track keeps the CPD format it started with
+    switch (format) {
+        case ELEMENTARY_STREAM_NAL_FORMAT_AVCC:
+            CHK_STATUS(convertCpdFromAnnexBToAvc(annexBCpd, annexBCpdSize, trackCpd, &trackCpdSize));
+            break;
+        case ELEMENTARY_STREAM_NAL_FORMAT_HEVC:
+            CHK_STATUS(convertCpdFromAnnexBToHevc(annexBCpd, annexBCpdSize, trackCpd, &trackCpdSize));
+            break;
+        default:
+            MEMCPY(trackCpd, annexBCpd, annexBCpdSize);
+            trackCpdSize = annexBCpdSize;
+            break;
+    }
+
+    // Ahead of the key frame so the stream switches on it
+    MEMSET(&streamCall, 0x00, SIZEOF(StreamCall));
+    streamCall.type = GST_PLUGIN_STREAM_CALL_SWITCH_FORMAT;
+    streamCall.frame.frameData = trackCpd;
+    streamCall.frame.size = trackCpdSize;
+    streamCall.frame.trackId = DEFAULT_VIDEO_TRACK_ID;
+    if (STATUS_FAILED(status = putStreamCall(pGstKvsPlugin, &streamCall))) {
+        DLOGW("The stream refused the CPD of frame %u with 0x%08x", pFrame->index, status);
+        pGstKvsPlugin->refusedCpdHash = hash;
+        CHK(FALSE, status);
+    }
+
+    pGstKvsPlugin->videoCpdHash = hash;
+    pGstKvsPlugin->refusedCpdHash = 0;
+    *pChanged = TRUE;
+
+    // The reset took the open fragment with it
+    CHK_LOG_ERR(restartFragment(pGstKvsPlugin));
+
+CleanUp:
+
+    return retStatus;
+}
+
+// Ends the open fragment and resets the stream, so the track takes the new CPD ahead of the key frame carrying it and
+// the next fragment starts a new MKV segment. The reset drops the media buffered and not yet ACKed
+STATUS switchKinesisVideoStreamFormat(STREAM_HANDLE streamHandle, PBYTE pCpd, UINT32 cpdSize, UINT64 trackId)
+{
+    STATUS retStatus = STATUS_SUCCESS, status;
+    Frame eofr = EOFR_FRAME_INITIALIZER;
+    StreamMetrics metrics;
+
+    CHK(pCpd != NULL, STATUS_NULL_ARG);
+
+    MEMSET(&metrics, 0x00, SIZEOF(StreamMetrics));
+    metrics.version = STREAM_METRICS_CURRENT_VERSION;
+
+    if (STATUS_FAILED(status = putKinesisVideoFrame(streamHandle, &eofr))) {
+        DLOGW("Failed to end the fragment ahead of the format switch with 0x%08x", status);
+    }
+
+    CHK_LOG_ERR(getKinesisVideoStreamMetrics(streamHandle, &metrics));
+    CHK_STATUS(kinesisVideoStreamResetStream(streamHandle));
+    DLOGI("Reset the stream for the format switch, dropped %" PRIu64 " ms of buffered media",
+          metrics.currentViewDuration / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+
+    CHK_STATUS(kinesisVideoStreamFormatChanged(streamHandle, cpdSize, pCpd, trackId));
+
+CleanUp:
+
+    return retStatus;
+}
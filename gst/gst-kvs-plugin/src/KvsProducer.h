@@ -62,15 +62,51 @@ typedef enum {
 
 #define IS_AVCC_HEVC_CPD_NAL_FORMAT(f) (((f) == ELEMENTARY_STREAM_NAL_FORMAT_AVCC) || ((f) == ELEMENTARY_STREAM_NAL_FORMAT_HEVC))
 
+#define GST_PLUGIN_RECOVERY_STATS_G_STRUCT_NAME "kvs-recovery-stats"
+
+/**
+ * Stream error recoveries. Durations are in 100ns
+ */
+typedef struct __RecoveryStats RecoveryStats;
+struct __RecoveryStats {
+    UINT32 recoveryCount;
+    // Recoveries that had to fall back to resetting the stream
+    UINT32 streamResetCount;
+    // Media rolled back to the last un-ACKed fragment and sent again
+    UINT64 resentDuration;
+    // Buffered media flushed by the stream resets
+    UINT64 lostDuration;
+};
+typedef struct __RecoveryStats* PRecoveryStats;
+
+// C linkage so the frame path benchmark can call into the plugin
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 STATUS traverseDirectoryPemFileScan(UINT64, DIR_ENTRY_TYPES, PCHAR, PCHAR);
 STATUS lookForSslCert(PGstKvsPlugin);
 STATUS initKinesisVideoStream(PGstKvsPlugin);
+STATUS startKinesisVideoStream(PGstKvsPlugin);
 STATUS initKinesisVideoProducer(PGstKvsPlugin);
+STATUS streamErrorReportHandler(UINT64, STREAM_HANDLE, UPLOAD_HANDLE, UINT64, STATUS);
+STATUS recoverKinesisVideoStream(PGstKvsPlugin);
+GstStructure* getRecoveryStats(PGstKvsPlugin);
 STATUS initTrackData(PGstKvsPlugin);
 STATUS identifyFrameNalFormat(PBYTE, UINT32, ELEMENTARY_STREAM_NAL_FORMAT*);
 STATUS identifyCpdNalFormat(PBYTE, UINT32, ELEMENTARY_STREAM_NAL_FORMAT*);
+STATUS identifyNonReferenceFrame(PBYTE, UINT32, ELEMENTARY_STREAM_NAL_FORMAT, BOOL, PBOOL);
 STATUS convertCpdFromAvcToAnnexB(PGstKvsPlugin, PBYTE, UINT32);
 STATUS convertCpdFromHevcToAnnexB(PGstKvsPlugin, PBYTE, UINT32);
+STATUS extractParameterSets(PBYTE, UINT32, ELEMENTARY_STREAM_NAL_FORMAT, BOOL, PUINT32, PBYTE, PUINT32);
+STATUS convertCpdFromAnnexBToAvc(PBYTE, UINT32, PBYTE, PUINT32);
+STATUS convertCpdFromAnnexBToHevc(PBYTE, UINT32, PBYTE, PUINT32);
+STATUS refreshInBandCpd(PGstKvsPlugin, PFrame, BOOL, PBOOL);
+STATUS switchKinesisVideoStreamFormat(STREAM_HANDLE, PBYTE, UINT32, UINT64);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif //__KVS_PRODUCER_FUNCTIONALITY_H__
 
@@ -0,0 +1,502 @@
+#define LOG_CLASS "KvsProducerCache"
+#include "GstPlugin.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+// The client callbacks only carry the provider's custom data so the interposed callbacks look their cache up by it
+static GMutex gProducerCacheLock;
+static GSList* gProducerCaches = NULL;
+
+static PProducerCache findProducerCache(UINT64 customData)
+{
+    PProducerCache pProducerCache = NULL;
+    GSList* pCur;
+
+    g_mutex_lock(&gProducerCacheLock);
+    for (pCur = gProducerCaches; pCur != NULL && pProducerCache == NULL; pCur = pCur->next) {
+        if (((PProducerCache) pCur->data)->clientCustomData == customData) {
+            pProducerCache = (PProducerCache) pCur->data;
+        }
+    }
+    g_mutex_unlock(&gProducerCacheLock);
+
+    return pProducerCache;
+}
+
+// Needs the cache lock held
+static BOOL isProducerCacheEntryServable(PProducerCache pProducerCache, PCHAR streamName)
+{
+    UINT64 now = GETTIME() / HUNDREDS_OF_NANOS_IN_A_SECOND;
+
+    return pProducerCache->entryValid && 0 == STRCMP(streamName, pProducerCache->entry.streamName) &&
+        now < pProducerCache->entry.updateTime + pProducerCache->cachePeriod / HUNDREDS_OF_NANOS_IN_A_SECOND;
+}
+
+static BOOL isProducerCacheFieldValid(PCHAR pField, PCHAR pExtraChars)
+{
+    PCHAR pCur;
+
+    for (pCur = pField; *pCur != '\0'; pCur++) {
+        if (!((*pCur >= 'a' && *pCur <= 'z') || (*pCur >= 'A' && *pCur <= 'Z') || (*pCur >= '0' && *pCur <= '9') ||
+              STRCHR(pExtraChars, *pCur) != NULL)) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+// The stream ARN is only known once the stream is tagged
+static BOOL isProducerCacheEntryValid(PProducerCacheEntry pEntry)
+{
+    return pEntry->streamName[0] != '\0' && isProducerCacheFieldValid(pEntry->streamName, PRODUCER_CACHE_STREAM_NAME_CHARS) &&
+        pEntry->region[0] != '\0' && isProducerCacheFieldValid(pEntry->region, PRODUCER_CACHE_REGION_CHARS) &&
+        isProducerCacheFieldValid(pEntry->streamArn, PRODUCER_CACHE_ARN_CHARS) && pEntry->dataEndpoint[0] != '\0' &&
+        isProducerCacheFieldValid(pEntry->dataEndpoint, PRODUCER_CACHE_ENDPOINT_CHARS);
+}
+
+// Splits the line in place
+static STATUS parseProducerCacheEntry(PCHAR pLine, PProducerCacheEntry pEntry)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PCHAR pFields[PRODUCER_CACHE_ENTRY_FIELD_COUNT];
+    PCHAR pCur = pLine, pComma;
+    UINT32 i;
+
+    for (i = 0; i < PRODUCER_CACHE_ENTRY_FIELD_COUNT; i++) {
+        pFields[i] = pCur;
+        pComma = STRCHR(pCur, ',');
+        if (i < PRODUCER_CACHE_ENTRY_FIELD_COUNT - 1) {
+            CHK(pComma != NULL, STATUS_INVALID_ARG);
+            *pComma = '\0';
+            pCur = pComma + 1;
+        } else {
+            CHK(pComma == NULL, STATUS_INVALID_ARG);
+        }
+    }
+
+    CHK(STRLEN(pFields[0]) <= MAX_STREAM_NAME_LEN && STRLEN(pFields[1]) <= MAX_REGION_NAME_LEN && STRLEN(pFields[2]) <= MAX_ARN_LEN &&
+            STRLEN(pFields[3]) <= MAX_URI_CHAR_LEN && pFields[3][0] != '\0',
+        STATUS_INVALID_ARG);
+
+    STRCPY(pEntry->streamName, pFields[0]);
+    STRCPY(pEntry->region, pFields[1]);
+    STRCPY(pEntry->streamArn, pFields[2]);
+    STRCPY(pEntry->dataEndpoint, pFields[3]);
+    CHK(isProducerCacheEntryValid(pEntry) && pFields[4][0] != '\0', STATUS_INVALID_ARG);
+    CHK_STATUS(STRTOUI64(pFields[4], NULL, 10, &pEntry->updateTime));
+
+CleanUp:
+
+    return retStatus;
+}
+
+static STATUS readProducerCacheFile(PCHAR filePath, PCHAR* ppContent, PUINT64 pSize)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PCHAR pContent = NULL;
+    UINT64 size = 0;
+    BOOL exists = FALSE;
+
+    CHK_STATUS(fileExists(filePath, &exists));
+    if (exists) {
+        CHK_STATUS(readFile(filePath, FALSE, NULL, &size));
+    }
+
+    CHK(NULL != (pContent = (PCHAR) MEMALLOC(size + 1)), STATUS_NOT_ENOUGH_MEMORY);
+    if (size > 0) {
+        CHK_STATUS(readFile(filePath, FALSE, (PBYTE) pContent, &size));
+    }
+
+    pContent[size] = '\0';
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus)) {
+        SAFE_MEMFREE(pContent);
+        size = 0;
+    }
+
+    *ppContent = pContent;
+    *pSize = size;
+
+    return retStatus;
+}
+
+static STATUS describeStreamCached(UINT64 customData, PCHAR streamName, PServiceCallContext pServiceCallContext)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PProducerCache pProducerCache = findProducerCache(customData);
+    StreamDescription streamDescription;
+    BOOL served = FALSE;
+
+    CHK(pProducerCache != NULL && pServiceCallContext != NULL, STATUS_NULL_ARG);
+
+    MUTEX_LOCK(pProducerCache->lock);
+    if (pProducerCache->pStreamInfo != NULL && isProducerCacheEntryServable(pProducerCache, streamName)) {
+        // The stream was active when the endpoint was cached, the rest of the description is ours
+        MEMSET(&streamDescription, 0x00, SIZEOF(StreamDescription));
+        streamDescription.version = STREAM_DESCRIPTION_CURRENT_VERSION;
+        STRNCPY(streamDescription.streamName, streamName, MAX_STREAM_NAME_LEN);
+        STRNCPY(streamDescription.contentType, pProducerCache->pStreamInfo->streamCaps.contentType, MAX_CONTENT_TYPE_LEN);
+        STRNCPY(streamDescription.streamArn, pProducerCache->entry.streamArn, MAX_ARN_LEN);
+        STRNCPY(streamDescription.kmsKeyId, pProducerCache->pStreamInfo->kmsKeyId, MAX_ARN_LEN);
+        streamDescription.streamStatus = STREAM_STATUS_ACTIVE;
+        streamDescription.retention = pProducerCache->pStreamInfo->retention;
+        served = TRUE;
+    }
+    MUTEX_UNLOCK(pProducerCache->lock);
+
+    if (served) {
+        DLOGI("Describing stream %s from the producer cache", streamName);
+        CHK_STATUS(describeStreamResultEvent(pServiceCallContext->customData, SERVICE_CALL_RESULT_OK, &streamDescription));
+    } else {
+        CHK_STATUS(pProducerCache->describeStreamFn(customData, streamName, pServiceCallContext));
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+static STATUS getStreamingEndpointCached(UINT64 customData, PCHAR streamName, PCHAR apiName, PServiceCallContext pServiceCallContext)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PProducerCache pProducerCache = findProducerCache(customData);
+    CHAR dataEndpoint[MAX_URI_CHAR_LEN + 1];
+    BOOL served = FALSE;
+
+    CHK(pProducerCache != NULL && pServiceCallContext != NULL, STATUS_NULL_ARG);
+
+    MUTEX_LOCK(pProducerCache->lock);
+    if (isProducerCacheEntryServable(pProducerCache, streamName)) {
+        STRCPY(dataEndpoint, pProducerCache->entry.dataEndpoint);
+        served = TRUE;
+    } else {
+        // Persist whatever the control plane returns once the producer streams to it
+        pProducerCache->entryDirty = TRUE;
+    }
+    MUTEX_UNLOCK(pProducerCache->lock);
+
+    if (served) {
+        DLOGI("Getting the data endpoint of stream %s from the producer cache", streamName);
+        CHK_STATUS(getStreamingEndpointResultEvent(pServiceCallContext->customData, SERVICE_CALL_RESULT_OK, dataEndpoint));
+    } else {
+        CHK_STATUS(pProducerCache->getStreamingEndpointFn(customData, streamName, apiName, pServiceCallContext));
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+static STATUS tagResourceCached(UINT64 customData, PCHAR streamArn, UINT32 tagCount, PTag tags, PServiceCallContext pServiceCallContext)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PProducerCache pProducerCache = findProducerCache(customData);
+
+    CHK(pProducerCache != NULL, STATUS_NULL_ARG);
+
+    // Tagging is the only call the ARN of a described or created stream reaches
+    if (streamArn != NULL) {
+        MUTEX_LOCK(pProducerCache->lock);
+        STRNCPY(pProducerCache->entry.streamArn, streamArn, MAX_ARN_LEN);
+        MUTEX_UNLOCK(pProducerCache->lock);
+    }
+
+    CHK_STATUS(pProducerCache->tagResourceFn(customData, streamArn, tagCount, tags, pServiceCallContext));
+
+CleanUp:
+
+    return retStatus;
+}
+
+static STATUS putStreamCached(UINT64 customData, PCHAR streamName, PCHAR containerType, UINT64 startTimestamp, BOOL absoluteFragmentTimes,
+                              BOOL ackRequired, PCHAR streamingEndpoint, PServiceCallContext pServiceCallContext)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PProducerCache pProducerCache = findProducerCache(customData);
+
+    CHK(pProducerCache != NULL, STATUS_NULL_ARG);
+
+    MUTEX_LOCK(pProducerCache->lock);
+    if (pProducerCache->entryDirty && streamingEndpoint != NULL && 0 == STRCMP(streamName, pProducerCache->entry.streamName)) {
+        STRNCPY(pProducerCache->entry.dataEndpoint, streamingEndpoint, MAX_URI_CHAR_LEN);
+        pProducerCache->entry.updateTime = GETTIME() / HUNDREDS_OF_NANOS_IN_A_SECOND;
+        pProducerCache->entryValid = TRUE;
+        pProducerCache->entryDirty = FALSE;
+        CHK_LOG_ERR(producerCacheSave(pProducerCache));
+    }
+    MUTEX_UNLOCK(pProducerCache->lock);
+
+    CHK_STATUS(pProducerCache->putStreamFn(customData, streamName, containerType, startTimestamp, absoluteFragmentTimes, ackRequired,
+                                           streamingEndpoint, pServiceCallContext));
+
+CleanUp:
+
+    return retStatus;
+}
+
+static STATUS producerCacheStreamErrorHandler(UINT64 customData, STREAM_HANDLE streamHandle, UPLOAD_HANDLE uploadHandle, UINT64 erroredTimecode,
+                                              STATUS statusCode)
+{
+    UNUSED_PARAM(streamHandle);
+    UNUSED_PARAM(uploadHandle);
+    UNUSED_PARAM(erroredTimecode);
+
+    STATUS retStatus = STATUS_SUCCESS;
+    PProducerCache pProducerCache = (PProducerCache) customData;
+
+    CHK(pProducerCache != NULL, STATUS_NULL_ARG);
+
+    // A stale ARN or endpoint surfaces as an error, the retry goes back to the control plane
+    DLOGW("Invalidating the producer cache of stream %s on error 0x%08x", pProducerCache->entry.streamName, statusCode);
+    MUTEX_LOCK(pProducerCache->lock);
+    retStatus = producerCacheInvalidate(pProducerCache);
+    MUTEX_UNLOCK(pProducerCache->lock);
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS createProducerCache(PCHAR filePath, PCHAR streamName, PCHAR region, UINT64 cachePeriod, PClientCallbacks pClientCallbacks,
+                           PProducerCache* ppProducerCache)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PProducerCache pProducerCache = NULL;
+
+    CHK(filePath != NULL && streamName != NULL && region != NULL && pClientCallbacks != NULL && ppProducerCache != NULL, STATUS_NULL_ARG);
+    CHK(filePath[0] != '\0' && STRLEN(filePath) + ARRAY_SIZE(PRODUCER_CACHE_TEMP_FILE_TEMPLATE) <= MAX_PATH_LEN, STATUS_INVALID_ARG);
+    CHK(STRLEN(streamName) <= MAX_STREAM_NAME_LEN && STRLEN(region) <= MAX_REGION_NAME_LEN, STATUS_INVALID_ARG);
+    CHK_ERR(isProducerCacheFieldValid(streamName, PRODUCER_CACHE_STREAM_NAME_CHARS) && isProducerCacheFieldValid(region, PRODUCER_CACHE_REGION_CHARS),
+            STATUS_INVALID_ARG, "Stream name %s or region %s can't be cached", streamName, region);
+
+    CHK(NULL != (pProducerCache = (PProducerCache) MEMCALLOC(1, SIZEOF(ProducerCache))), STATUS_NOT_ENOUGH_MEMORY);
+    pProducerCache->lock = INVALID_MUTEX_VALUE;
+
+    STRCPY(pProducerCache->filePath, filePath);
+    STRCPY(pProducerCache->entry.streamName, streamName);
+    STRCPY(pProducerCache->entry.region, region);
+    pProducerCache->cachePeriod = cachePeriod;
+    pProducerCache->clientCustomData = pClientCallbacks->customData;
+    pProducerCache->lock = MUTEX_CREATE(FALSE);
+    CHK(IS_VALID_MUTEX_VALUE(pProducerCache->lock), STATUS_INVALID_OPERATION);
+
+    CHK_LOG_ERR(producerCacheLoad(pProducerCache));
+
+    // Add the stream callbacks first, it is the only step that can fail once the client callbacks are interposed
+    pProducerCache->streamCallbacks.version = STREAM_CALLBACKS_CURRENT_VERSION;
+    pProducerCache->streamCallbacks.customData = (UINT64) pProducerCache;
+    pProducerCache->streamCallbacks.streamErrorReportFn = producerCacheStreamErrorHandler;
+    CHK_STATUS(addStreamCallbacks(pClientCallbacks, &pProducerCache->streamCallbacks));
+
+    g_mutex_lock(&gProducerCacheLock);
+    gProducerCaches = g_slist_prepend(gProducerCaches, pProducerCache);
+    g_mutex_unlock(&gProducerCacheLock);
+
+    pProducerCache->describeStreamFn = pClientCallbacks->describeStreamFn;
+    pProducerCache->getStreamingEndpointFn = pClientCallbacks->getStreamingEndpointFn;
+    pProducerCache->tagResourceFn = pClientCallbacks->tagResourceFn;
+    pProducerCache->putStreamFn = pClientCallbacks->putStreamFn;
+    pClientCallbacks->describeStreamFn = describeStreamCached;
+    pClientCallbacks->getStreamingEndpointFn = getStreamingEndpointCached;
+    pClientCallbacks->tagResourceFn = tagResourceCached;
+    pClientCallbacks->putStreamFn = putStreamCached;
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus)) {
+        freeProducerCache(&pProducerCache);
+    }
+
+    if (ppProducerCache != NULL) {
+        *ppProducerCache = pProducerCache;
+    }
+
+    return retStatus;
+}
+
+STATUS freeProducerCache(PProducerCache* ppProducerCache)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PProducerCache pProducerCache;
+
+    CHK(ppProducerCache != NULL, STATUS_NULL_ARG);
+    pProducerCache = *ppProducerCache;
+    CHK(pProducerCache != NULL, retStatus);
+
+    g_mutex_lock(&gProducerCacheLock);
+    gProducerCaches = g_slist_remove(gProducerCaches, pProducerCache);
+    g_mutex_unlock(&gProducerCacheLock);
+
+    if (IS_VALID_MUTEX_VALUE(pProducerCache->lock)) {
+        MUTEX_FREE(pProducerCache->lock);
+    }
+
+    SAFE_MEMFREE(*ppProducerCache);
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS producerCacheLoad(PProducerCache pProducerCache)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PCHAR pContent = NULL, pLine, pNewLine;
+    UINT64 size, now = GETTIME() / HUNDREDS_OF_NANOS_IN_A_SECOND;
+    ProducerCacheEntry entry;
+
+    CHK(pProducerCache != NULL, STATUS_NULL_ARG);
+
+    pProducerCache->entryValid = FALSE;
+    CHK_STATUS(readProducerCacheFile(pProducerCache->filePath, &pContent, &size));
+
+    for (pLine = pContent; pLine != NULL && *pLine != '\0'; pLine = pNewLine) {
+        if (NULL != (pNewLine = STRCHR(pLine, '\n'))) {
+            *pNewLine++ = '\0';
+        }
+
+        // Skip the entries of other streams and the malformed ones
+        if (STATUS_FAILED(parseProducerCacheEntry(pLine, &entry)) || 0 != STRCMP(entry.streamName, pProducerCache->entry.streamName) ||
+            0 != STRCMP(entry.region, pProducerCache->entry.region)) {
+            continue;
+        }
+
+        if (now < entry.updateTime + pProducerCache->cachePeriod / HUNDREDS_OF_NANOS_IN_A_SECOND) {
+            pProducerCache->entry = entry;
+            pProducerCache->entryValid = TRUE;
+            DLOGI("Loaded the data endpoint %s of stream %s from the producer cache", entry.dataEndpoint, entry.streamName);
+        } else {
+            DLOGI("The producer cache entry of stream %s has expired", entry.streamName);
+        }
+
+        break;
+    }
+
+CleanUp:
+
+    SAFE_MEMFREE(pContent);
+
+    return retStatus;
+}
+
+STATUS producerCacheSave(PProducerCache pProducerCache)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PCHAR pContent = NULL, pOut = NULL, pLine, pNewLine;
+    CHAR key[MAX_STREAM_NAME_LEN + MAX_REGION_NAME_LEN + 3], line[PRODUCER_CACHE_ENTRY_MAX_LEN];
+    CHAR tempFilePath[MAX_PATH_LEN + 1], lockFilePath[MAX_PATH_LEN + 1];
+    ProducerCacheEntry entry;
+    UINT64 size, outSize = 0, lineLen, offset;
+    UINT32 keyLen, entryCount = 0;
+    INT32 written, lockFd = -1, tempFd = -1;
+    ssize_t result;
+    BOOL tempCreated = FALSE;
+
+    CHK(pProducerCache != NULL, STATUS_NULL_ARG);
+
+    // Processes sharing the path update it as well, so the whole read-modify-write holds a lock. It is taken on a file
+    // next to the cache because the rename below replaces the cache file itself
+    SNPRINTF(lockFilePath, SIZEOF(lockFilePath), "%s%s", pProducerCache->filePath, PRODUCER_CACHE_LOCK_FILE_EXTENSION);
+    CHK_ERR((lockFd = open(lockFilePath, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) >= 0, STATUS_OPEN_FILE_FAILED, "Failed to open %s with errno %d",
+            lockFilePath, errno);
+    CHK_ERR(0 == flock(lockFd, LOCK_EX), STATUS_INVALID_OPERATION, "Failed to lock %s with errno %d", lockFilePath, errno);
+
+    CHK_STATUS(readProducerCacheFile(pProducerCache->filePath, &pContent, &size));
+    CHK(NULL != (pOut = (PCHAR) MEMALLOC(size + PRODUCER_CACHE_ENTRY_MAX_LEN)), STATUS_NOT_ENOUGH_MEMORY);
+
+    // Our entry goes first so the least recently written ones fall off the end
+    if (pProducerCache->entryValid) {
+        CHK_ERR(isProducerCacheEntryValid(&pProducerCache->entry), STATUS_INVALID_ARG, "Not caching the unexpected endpoint %s or ARN %s",
+                pProducerCache->entry.dataEndpoint, pProducerCache->entry.streamArn);
+        written = SNPRINTF(pOut, PRODUCER_CACHE_ENTRY_MAX_LEN, "%s,%s,%s,%s,%" PRIu64 "\n", pProducerCache->entry.streamName,
+                           pProducerCache->entry.region, pProducerCache->entry.streamArn, pProducerCache->entry.dataEndpoint,
+                           pProducerCache->entry.updateTime);
+        CHK(written > 0 && written < PRODUCER_CACHE_ENTRY_MAX_LEN, STATUS_BUFFER_TOO_SMALL);
+        outSize = written;
+        entryCount++;
+    }
+
+    keyLen = SNPRINTF(key, SIZEOF(key), "%s,%s,", pProducerCache->entry.streamName, pProducerCache->entry.region);
+    for (pLine = pContent; *pLine != '\0' && entryCount < PRODUCER_CACHE_MAX_ENTRY_COUNT; pLine = pNewLine) {
+        pNewLine = STRCHR(pLine, '\n');
+        pNewLine = pNewLine == NULL ? pLine + STRLEN(pLine) : pNewLine + 1;
+        lineLen = pNewLine - pLine;
+
+        // Only well formed entries of the other streams are carried over
+        if (lineLen >= SIZEOF(line)) {
+            continue;
+        }
+
+        MEMCPY(line, pLine, lineLen);
+        line[lineLen] = '\0';
+        if (line[lineLen - 1] == '\n') {
+            line[lineLen - 1] = '\0';
+        }
+
+        if (0 != STRNCMP(pLine, key, keyLen) && STATUS_SUCCEEDED(parseProducerCacheEntry(line, &entry))) {
+            MEMCPY(pOut + outSize, pLine, lineLen);
+            outSize += lineLen;
+            if (pOut[outSize - 1] != '\n') {
+                pOut[outSize++] = '\n';
+            }
+            entryCount++;
+        }
+    }
+
+    // Readers only ever see the old or the new file, never a torn one. The data is synced before the rename so a
+    // crash can't leave the new name pointing at an empty file
+    SNPRINTF(tempFilePath, SIZEOF(tempFilePath), "%s%s", pProducerCache->filePath, PRODUCER_CACHE_TEMP_FILE_TEMPLATE);
+    CHK_ERR((tempFd = mkstemp(tempFilePath)) >= 0, STATUS_OPEN_FILE_FAILED, "Failed to create %s with errno %d", tempFilePath, errno);
+    tempCreated = TRUE;
+    for (offset = 0; offset < outSize; offset += result) {
+        result = write(tempFd, pOut + offset, outSize - offset);
+        CHK(result > 0 || (result < 0 && errno == EINTR), STATUS_WRITE_TO_FILE_FAILED);
+        result = MAX(result, 0);
+    }
+    CHK(0 == fsync(tempFd), STATUS_WRITE_TO_FILE_FAILED);
+    CHK(0 == close(tempFd), STATUS_WRITE_TO_FILE_FAILED);
+    tempFd = -1;
+    CHK(0 == rename(tempFilePath, pProducerCache->filePath), STATUS_WRITE_TO_FILE_FAILED);
+    tempCreated = FALSE;
+
+CleanUp:
+
+    if (tempFd >= 0) {
+        close(tempFd);
+    }
+
+    if (tempCreated) {
+        unlink(tempFilePath);
+    }
+
+    // Closing releases the lock
+    if (lockFd >= 0) {
+        close(lockFd);
+    }
+
+    SAFE_MEMFREE(pContent);
+    SAFE_MEMFREE(pOut);
+
+    return retStatus;
+}
+
+STATUS producerCacheInvalidate(PProducerCache pProducerCache)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pProducerCache != NULL, STATUS_NULL_ARG);
+    CHK(pProducerCache->entryValid, retStatus);
+
+    pProducerCache->entryValid = FALSE;
+    pProducerCache->entryDirty = FALSE;
+    CHK_STATUS(producerCacheSave(pProducerCache));
+
+CleanUp:
+
+    return retStatus;
+}
@@ -0,0 +1,74 @@
+#ifndef __KVS_PRODUCER_CACHE_H__
+#define __KVS_PRODUCER_CACHE_H__
+
+#define DEFAULT_PRODUCER_CACHE_FILE_PATH ""
+
+#define PRODUCER_CACHE_TEMP_FILE_TEMPLATE  ".XXXXXX"
+#define PRODUCER_CACHE_LOCK_FILE_EXTENSION ".lock"
+#define PRODUCER_CACHE_MAX_ENTRY_COUNT     32
+#define PRODUCER_CACHE_ENTRY_FIELD_COUNT   5
+#define PRODUCER_CACHE_ENTRY_MAX_LEN       (MAX_STREAM_NAME_LEN + MAX_REGION_NAME_LEN + MAX_ARN_LEN + MAX_URI_CHAR_LEN + 32)
+
+// Characters allowed besides the alphanumeric ones, none of them is a separator of the file
+#define PRODUCER_CACHE_STREAM_NAME_CHARS   "_.-"
+#define PRODUCER_CACHE_REGION_CHARS        "-"
+#define PRODUCER_CACHE_ARN_CHARS           ":/_.-"
+#define PRODUCER_CACHE_ENDPOINT_CHARS      ":/_.-"
+
+/**
+ * Control plane results of one stream, persisted as a line of
+ * <stream name>,<region>,<stream ARN>,<data endpoint>,<update time in epoch seconds>
+ * Entries with a field outside the KVS charsets are neither written nor read back
+ */
+typedef struct __ProducerCacheEntry ProducerCacheEntry;
+struct __ProducerCacheEntry {
+    CHAR streamName[MAX_STREAM_NAME_LEN + 1];
+    CHAR region[MAX_REGION_NAME_LEN + 1];
+    CHAR streamArn[MAX_ARN_LEN + 1];
+    CHAR dataEndpoint[MAX_URI_CHAR_LEN + 1];
+    UINT64 updateTime;
+};
+typedef struct __ProducerCacheEntry* PProducerCacheEntry;
+
+/**
+ * File backed cache of the DescribeStream and GetDataEndpoint results. It sits in front of the callbacks provider's
+ * client callbacks, serves a valid entry without calling the control plane and records the results the producer
+ * actually streamed with
+ */
+typedef struct __ProducerCache ProducerCache;
+struct __ProducerCache {
+    CHAR filePath[MAX_PATH_LEN + 1];
+    UINT64 cachePeriod;
+    // Value the client passes to the client callbacks, used to find the cache
+    UINT64 clientCustomData;
+    // Set once the stream info is created, the description is only served from then on
+    PStreamInfo pStreamInfo;
+    MUTEX lock;
+    ProducerCacheEntry entry;
+    // Whether the entry can be served, FALSE after a miss or an invalidation
+    BOOL entryValid;
+    // Whether the endpoint in use came from the control plane and is yet to be persisted
+    BOOL entryDirty;
+    DescribeStreamFunc describeStreamFn;
+    GetStreamingEndpointFunc getStreamingEndpointFn;
+    PutStreamFunc putStreamFn;
+    TagResourceFunc tagResourceFn;
+    StreamCallbacks streamCallbacks;
+};
+typedef struct __ProducerCache* PProducerCache;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+STATUS createProducerCache(PCHAR, PCHAR, PCHAR, UINT64, PClientCallbacks, PProducerCache*);
+STATUS freeProducerCache(PProducerCache*);
+STATUS producerCacheLoad(PProducerCache);
+STATUS producerCacheSave(PProducerCache);
+STATUS producerCacheInvalidate(PProducerCache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__KVS_PRODUCER_CACHE_H__
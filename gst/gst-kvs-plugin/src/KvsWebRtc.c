@@ -87,9 +87,8 @@ STATUS signalingClientMessageReceivedFn(UINT64 customData, PReceivedSignalingMes
     BOOL locked = TRUE;
     UINT32 clientIdHash;
     UINT64 hashValue = 0;
-    PPendingMessageQueue pPendingMessageQueue = NULL;
+    PPendingMessageQueue pPendingMessageQueue = NULL, pQueuedMessageQueue;
     PWebRtcStreamingSession pStreamingSession = NULL;
-    PReceivedSignalingMessage pReceivedSignalingMessageCopy = NULL;
 
     CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
 
@@ -179,19 +178,15 @@ STATUS signalingClientMessageReceivedFn(UINT64 customData, PReceivedSignalingMes
                 CHK_STATUS(getPendingMessageQueueForHash(pGstKvsPlugin->pPendingSignalingMessageForRemoteClient, clientIdHash, FALSE,
                                                          &pPendingMessageQueue));
                 if (pPendingMessageQueue == NULL) {
-                    CHK_STATUS(createMessageQueue(clientIdHash, &pPendingMessageQueue));
+                    CHK_STATUS(createMessageQueue(pGstKvsPlugin, clientIdHash, &pPendingMessageQueue));
                     CHK_STATUS(stackQueueEnqueue(pGstKvsPlugin->pPendingSignalingMessageForRemoteClient, (UINT64) pPendingMessageQueue));
                 }
 
-                pReceivedSignalingMessageCopy = (PReceivedSignalingMessage) MEMCALLOC(1, SIZEOF(ReceivedSignalingMessage));
-
-                *pReceivedSignalingMessageCopy = *pReceivedSignalingMessage;
-
-                CHK_STATUS(stackQueueEnqueue(pPendingMessageQueue->messageQueue, (UINT64) pReceivedSignalingMessageCopy));
-
-                // NULL the pointers to not free any longer
+                // NULL the pointer as the pending queue list owns it from here on
+                pQueuedMessageQueue = pPendingMessageQueue;
                 pPendingMessageQueue = NULL;
-                pReceivedSignalingMessageCopy = NULL;
+
+                CHK_STATUS(queuePendingMessage(pGstKvsPlugin, pQueuedMessageQueue, pReceivedSignalingMessage));
             } else {
                 CHK_STATUS(handleRemoteCandidate(pStreamingSession, &pReceivedSignalingMessage->signalingMessage));
             }
@@ -204,9 +199,8 @@ STATUS signalingClientMessageReceivedFn(UINT64 customData, PReceivedSignalingMes
 
 CleanUp:
 
-    SAFE_MEMFREE(pReceivedSignalingMessageCopy);
     if (pPendingMessageQueue != NULL) {
-        freeMessageQueue(pPendingMessageQueue);
+        freeMessageQueue(pGstKvsPlugin, pPendingMessageQueue);
     }
 
     if (locked) {
@@ -217,6 +211,62 @@ CleanUp:
     return retStatus;
 }
 
+static VOID clearPendingMessageQueues(PGstKvsPlugin pGstKvsPlugin)
+{
+    UINT64 data;
+    StackQueueIterator iterator;
+
+    stackQueueGetIterator(pGstKvsPlugin->pPendingSignalingMessageForRemoteClient, &iterator);
+    while (IS_VALID_ITERATOR(iterator)) {
+        stackQueueIteratorGetItem(iterator, &data);
+        stackQueueIteratorNext(&iterator);
+        freeMessageQueue(pGstKvsPlugin, (PPendingMessageQueue) data);
+    }
+
+    stackQueueClear(pGstKvsPlugin->pPendingSignalingMessageForRemoteClient, FALSE);
+}
+
+// A repeated NULL_TO_READY returns the queued candidates to the pools and keeps them, unless signaling-pool-size changed
+static STATUS initPendingMessages(PGstKvsPlugin pGstPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    UINT32 poolSize = pGstPlugin->gstParams.signalingPoolSize;
+    BOOL locked = FALSE;
+
+    if (pGstPlugin->pPendingSignalingMessageForRemoteClient == NULL) {
+        CHK_STATUS(stackQueueCreate(&pGstPlugin->pPendingSignalingMessageForRemoteClient));
+    } else {
+        if (IS_VALID_MUTEX_VALUE(pGstPlugin->sessionLock)) {
+            MUTEX_LOCK(pGstPlugin->sessionLock);
+            locked = TRUE;
+        }
+
+        clearPendingMessageQueues(pGstPlugin);
+    }
+
+    if (pGstPlugin->pPendingMessagePool != NULL && pGstPlugin->pPendingMessagePool->capacity != poolSize) {
+        freeObjectPool(&pGstPlugin->pPendingMessagePool);
+        freeObjectPool(&pGstPlugin->pPendingQueuePool);
+    }
+
+    // Every pending peer holds at least one candidate, so the queues never outnumber the candidates
+    if (pGstPlugin->pPendingQueuePool == NULL) {
+        CHK_STATUS(createObjectPool(SIZEOF(PendingMessageQueue), poolSize, &pGstPlugin->pPendingQueuePool));
+    }
+
+    if (pGstPlugin->pPendingMessagePool == NULL) {
+        CHK_STATUS(createObjectPool(SIZEOF(PendingMessage), poolSize, &pGstPlugin->pPendingMessagePool));
+    }
+
+CleanUp:
+
+    if (locked) {
+        MUTEX_UNLOCK(pGstPlugin->sessionLock);
+    }
+
+    return retStatus;
+}
+
 STATUS initKinesisVideoWebRtc(PGstKvsPlugin pGstPlugin)
 {
     STATUS retStatus = STATUS_SUCCESS;
@@ -258,6 +308,12 @@ STATUS initKinesisVideoWebRtc(PGstKvsPlugin pGstPlugin)
     pGstPlugin->kvsContext.channelInfo.pCertPath = pGstPlugin->caCertPath;
     pGstPlugin->kvsContext.channelInfo.messageTtl = 0; // Default is 60 seconds
 
+    // Keep the endpoints of a stand-in out of the file cache shared with real runs
+    pGstPlugin->kvsContext.channelInfo.pControlPlaneUrl = GETENV(KVS_WEBRTC_CONTROL_PLANE_URL_ENV_VAR);
+    if (pGstPlugin->kvsContext.channelInfo.pControlPlaneUrl != NULL) {
+        pGstPlugin->kvsContext.channelInfo.cachingPolicy = SIGNALING_API_CALL_CACHE_TYPE_NONE;
+    }
+
     pGstPlugin->kvsContext.signalingClientCallbacks.version = SIGNALING_CLIENT_CALLBACKS_CURRENT_VERSION;
     pGstPlugin->kvsContext.signalingClientCallbacks.errorReportFn = signalingClientErrorFn;
     pGstPlugin->kvsContext.signalingClientCallbacks.stateChangeFn = signalingClientStateChangedFn;
@@ -269,7 +325,7 @@ STATUS initKinesisVideoWebRtc(PGstKvsPlugin pGstPlugin)
     STRCPY(pGstPlugin->kvsContext.signalingClientInfo.clientId, DEFAULT_MASTER_CLIENT_ID);
     pGstPlugin->kvsContext.signalingClientInfo.cacheFilePath = NULL; // Use the default path
 
-    CHK_STATUS(stackQueueCreate(&pGstPlugin->pPendingSignalingMessageForRemoteClient));
+    CHK_STATUS(initPendingMessages(pGstPlugin));
     CHK_STATUS(hashTableCreateWithParams(GST_PLUGIN_HASH_TABLE_BUCKET_COUNT, GST_PLUGIN_HASH_TABLE_BUCKET_LENGTH,
                                          &pGstPlugin->pRtcPeerConnectionForRemoteClient));
 
@@ -281,19 +337,43 @@ STATUS initKinesisVideoWebRtc(PGstKvsPlugin pGstPlugin)
                                                GST_PLUGIN_PRE_GENERATE_CERT_PERIOD, pregenerateCertTimerCallback, (UINT64) pGstPlugin,
                                                &pGstPlugin->pregenerateCertTimerId));
 
+CleanUp:
+
+    CHK_LOG_ERR(retStatus);
+
+    return retStatus;
+}
+
+STATUS startKinesisVideoWebRtc(PGstKvsPlugin pGstPlugin)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    UINT64 time;
+
+    CHK(pGstPlugin != NULL, STATUS_NULL_ARG);
+
     // Create the signaling client
+    time = GETTIME();
     CHK_STATUS(createSignalingClientSync(&pGstPlugin->kvsContext.signalingClientInfo, &pGstPlugin->kvsContext.channelInfo,
                                          &pGstPlugin->kvsContext.signalingClientCallbacks, pGstPlugin->kvsContext.pCredentialProvider,
                                          &pGstPlugin->kvsContext.signalingHandle));
+    pGstPlugin->startupTimes.signalingCreateDuration = GETTIME() - time;
 
     // Get signaling client to Ready state
+    time = GETTIME();
     CHK_STATUS(signalingClientFetchSync(pGstPlugin->kvsContext.signalingHandle));
+    pGstPlugin->startupTimes.signalingFetchDuration = GETTIME() - time;
 
     // Get signaling client to connect state
     if (ATOMIC_LOAD_BOOL(&pGstPlugin->connectWebRtc)) {
+        time = GETTIME();
         CHK_STATUS(signalingClientConnectSync(pGstPlugin->kvsContext.signalingHandle));
+        pGstPlugin->startupTimes.signalingConnectDuration = GETTIME() - time;
     }
 
+    // Schedule the WebRTC master session servicing periodic routine
+    CHK_STATUS(timerQueueAddTimer(pGstPlugin->kvsContext.timerQueueHandle, GST_PLUGIN_SERVICE_ROUTINE_START, GST_PLUGIN_SERVICE_ROUTINE_PERIOD,
+                                  sessionServiceHandler, (UINT64) pGstPlugin, &pGstPlugin->serviceRoutineTimerId));
+
 CleanUp:
 
     CHK_LOG_ERR(retStatus);
@@ -301,25 +381,25 @@ CleanUp:
     return retStatus;
 }
 
-STATUS createMessageQueue(UINT64 hashValue, PPendingMessageQueue* ppPendingMessageQueue)
+STATUS createMessageQueue(PGstKvsPlugin pGstKvsPlugin, UINT64 hashValue, PPendingMessageQueue* ppPendingMessageQueue)
 {
     STATUS retStatus = STATUS_SUCCESS;
     PPendingMessageQueue pPendingMessageQueue = NULL;
 
-    CHK(ppPendingMessageQueue != NULL, STATUS_NULL_ARG);
+    CHK(pGstKvsPlugin != NULL && ppPendingMessageQueue != NULL, STATUS_NULL_ARG);
+
+    if (STATUS_FAILED(retStatus = objectPoolGet(pGstKvsPlugin->pPendingQueuePool, (PVOID*) &pPendingMessageQueue))) {
+        DLOGW("Dropping the ICE candidates of a new peer with %u peers pending", pGstKvsPlugin->gstParams.signalingPoolSize);
+        CHK(FALSE, retStatus);
+    }
 
-    CHK(NULL != (pPendingMessageQueue = (PPendingMessageQueue) MEMCALLOC(1, SIZEOF(PendingMessageQueue))), STATUS_NOT_ENOUGH_MEMORY);
     pPendingMessageQueue->hashValue = hashValue;
     pPendingMessageQueue->createTime = GETTIME();
-    CHK_STATUS(stackQueueCreate(&pPendingMessageQueue->messageQueue));
+    pPendingMessageQueue->pHead = NULL;
+    pPendingMessageQueue->pTail = NULL;
 
 CleanUp:
 
-    if (STATUS_FAILED(retStatus) && pPendingMessageQueue != NULL) {
-        freeMessageQueue(pPendingMessageQueue);
-        pPendingMessageQueue = NULL;
-    }
-
     if (ppPendingMessageQueue != NULL) {
         *ppPendingMessageQueue = pPendingMessageQueue;
     }
@@ -327,24 +407,57 @@ CleanUp:
     return retStatus;
 }
 
-STATUS freeMessageQueue(PPendingMessageQueue pPendingMessageQueue)
+STATUS freeMessageQueue(PGstKvsPlugin pGstKvsPlugin, PPendingMessageQueue pPendingMessageQueue)
 {
     STATUS retStatus = STATUS_SUCCESS;
+    PPendingMessage pPendingMessage;
+
+    CHK(pGstKvsPlugin != NULL, STATUS_NULL_ARG);
 
     // free is idempotent
     CHK(pPendingMessageQueue != NULL, retStatus);
 
-    if (pPendingMessageQueue->messageQueue != NULL) {
-        stackQueueClear(pPendingMessageQueue->messageQueue, TRUE);
-        stackQueueFree(pPendingMessageQueue->messageQueue);
+    // Back to the pools for the next peer
+    while (NULL != (pPendingMessage = pPendingMessageQueue->pHead)) {
+        pPendingMessageQueue->pHead = pPendingMessage->pNext;
+        objectPoolPut(pGstKvsPlugin->pPendingMessagePool, pPendingMessage);
     }
 
-    MEMFREE(pPendingMessageQueue);
+    objectPoolPut(pGstKvsPlugin->pPendingQueuePool, pPendingMessageQueue);
 
 CleanUp:
     return retStatus;
 }
 
+STATUS queuePendingMessage(PGstKvsPlugin pGstKvsPlugin, PPendingMessageQueue pPendingMessageQueue, PReceivedSignalingMessage pReceivedSignalingMessage)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PPendingMessage pPendingMessage = NULL;
+
+    CHK(pGstKvsPlugin != NULL && pPendingMessageQueue != NULL && pReceivedSignalingMessage != NULL, STATUS_NULL_ARG);
+
+    // A full pool pushes back on the peers flooding candidates ahead of their offers instead of growing the heap
+    if (STATUS_FAILED(retStatus = objectPoolGet(pGstKvsPlugin->pPendingMessagePool, (PVOID*) &pPendingMessage))) {
+        DLOGW("Dropping an ICE candidate with %u candidates pending", pGstKvsPlugin->gstParams.signalingPoolSize);
+        CHK(FALSE, retStatus);
+    }
+
+    pPendingMessage->receivedSignalingMessage = *pReceivedSignalingMessage;
+    pPendingMessage->pNext = NULL;
+
+    if (pPendingMessageQueue->pTail == NULL) {
+        pPendingMessageQueue->pHead = pPendingMessage;
+    } else {
+        pPendingMessageQueue->pTail->pNext = pPendingMessage;
+    }
+
+    pPendingMessageQueue->pTail = pPendingMessage;
+
+CleanUp:
+
+    return retStatus;
+}
+
 STATUS freeGstKvsWebRtcPlugin(PGstKvsPlugin pGstKvsPlugin)
 {
     STATUS retStatus = STATUS_SUCCESS;
@@ -360,19 +473,14 @@ STATUS freeGstKvsWebRtcPlugin(PGstKvsPlugin pGstKvsPlugin)
     }
 
     if (pGstKvsPlugin->pPendingSignalingMessageForRemoteClient != NULL) {
-        // Iterate and free all the pending queues
-        stackQueueGetIterator(pGstKvsPlugin->pPendingSignalingMessageForRemoteClient, &iterator);
-        while (IS_VALID_ITERATOR(iterator)) {
-            stackQueueIteratorGetItem(iterator, &data);
-            stackQueueIteratorNext(&iterator);
-            freeMessageQueue((PPendingMessageQueue) data);
-        }
-
-        stackQueueClear(pGstKvsPlugin->pPendingSignalingMessageForRemoteClient, FALSE);
+        clearPendingMessageQueues(pGstKvsPlugin);
         stackQueueFree(pGstKvsPlugin->pPendingSignalingMessageForRemoteClient);
         pGstKvsPlugin->pPendingSignalingMessageForRemoteClient = NULL;
     }
 
+    freeObjectPool(&pGstKvsPlugin->pPendingMessagePool);
+    freeObjectPool(&pGstKvsPlugin->pPendingQueuePool);
+
     if (pGstKvsPlugin->pRtcPeerConnectionForRemoteClient != NULL) {
         hashTableClear(pGstKvsPlugin->pRtcPeerConnectionForRemoteClient);
         hashTableFree(pGstKvsPlugin->pRtcPeerConnectionForRemoteClient);
@@ -628,14 +736,16 @@ CleanUp:
     return retStatus;
 }
 
-STATUS removeExpiredMessageQueues(PStackQueue pPendingQueue)
+STATUS removeExpiredMessageQueues(PGstKvsPlugin pGstKvsPlugin)
 {
     STATUS retStatus = STATUS_SUCCESS;
     PPendingMessageQueue pPendingMessageQueue = NULL;
+    PStackQueue pPendingQueue;
     UINT32 i, count;
     UINT64 data, curTime;
 
-    CHK(pPendingQueue != NULL, STATUS_NULL_ARG);
+    CHK(pGstKvsPlugin != NULL && pGstKvsPlugin->pPendingSignalingMessageForRemoteClient != NULL, STATUS_NULL_ARG);
+    pPendingQueue = pGstKvsPlugin->pPendingSignalingMessageForRemoteClient;
 
     curTime = GETTIME();
     CHK_STATUS(stackQueueGetCount(pPendingQueue, &count));
@@ -648,7 +758,7 @@ STATUS removeExpiredMessageQueues(PStackQueue pPendingQueue)
         pPendingMessageQueue = (PPendingMessageQueue) data;
         if (pPendingMessageQueue->createTime + GST_PLUGIN_PENDING_MESSAGE_CLEANUP_DURATION < curTime) {
             // Message queue has expired and needs to be freed
-            CHK_STATUS(freeMessageQueue(pPendingMessageQueue));
+            CHK_STATUS(freeMessageQueue(pGstKvsPlugin, pPendingMessageQueue));
         } else {
             // Enqueue back again as it's still valued
             CHK_STATUS(stackQueueEnqueue(pPendingQueue, data));
@@ -922,31 +1032,21 @@ CleanUp:
 STATUS submitPendingIceCandidate(PPendingMessageQueue pPendingMessageQueue, PWebRtcStreamingSession pStreamingSession)
 {
     STATUS retStatus = STATUS_SUCCESS;
-    BOOL noPendingSignalingMessageForClient = FALSE;
-    PReceivedSignalingMessage pReceivedSignalingMessage = NULL;
-    UINT64 hashValue;
-
-    CHK(pPendingMessageQueue != NULL && pPendingMessageQueue->messageQueue != NULL && pStreamingSession != NULL, STATUS_NULL_ARG);
-
-    do {
-        CHK_STATUS(stackQueueIsEmpty(pPendingMessageQueue->messageQueue, &noPendingSignalingMessageForClient));
-        if (!noPendingSignalingMessageForClient) {
-            hashValue = 0;
-            CHK_STATUS(stackQueueDequeue(pPendingMessageQueue->messageQueue, &hashValue));
-            pReceivedSignalingMessage = (PReceivedSignalingMessage) hashValue;
-            CHK(pReceivedSignalingMessage != NULL, STATUS_INTERNAL_ERROR);
-            if (pReceivedSignalingMessage->signalingMessage.messageType == SIGNALING_MESSAGE_TYPE_ICE_CANDIDATE) {
-                CHK_STATUS(handleRemoteCandidate(pStreamingSession, &pReceivedSignalingMessage->signalingMessage));
-            }
-            SAFE_MEMFREE(pReceivedSignalingMessage);
+    PPendingMessage pPendingMessage;
+
+    CHK(pPendingMessageQueue != NULL && pStreamingSession != NULL, STATUS_NULL_ARG);
+
+    // The messages go back to the pool with the queue
+    for (pPendingMessage = pPendingMessageQueue->pHead; pPendingMessage != NULL; pPendingMessage = pPendingMessage->pNext) {
+        if (pPendingMessage->receivedSignalingMessage.signalingMessage.messageType == SIGNALING_MESSAGE_TYPE_ICE_CANDIDATE) {
+            CHK_STATUS(handleRemoteCandidate(pStreamingSession, &pPendingMessage->receivedSignalingMessage.signalingMessage));
         }
-    } while (!noPendingSignalingMessageForClient);
+    }
 
-    CHK_STATUS(freeMessageQueue(pPendingMessageQueue));
+    CHK_STATUS(freeMessageQueue(pStreamingSession->pGstKvsPlugin, pPendingMessageQueue));
 
 CleanUp:
 
-    SAFE_MEMFREE(pReceivedSignalingMessage);
     CHK_LOG_ERR(retStatus);
     return retStatus;
 }
@@ -1321,7 +1421,7 @@ STATUS sessionServiceHandler(UINT32 timerId, UINT64 currentTime, UINT64 customDa
     }
 
     // Check if any lingering pending message queues
-    CHK_STATUS(removeExpiredMessageQueues(pGstKvsPlugin->pPendingSignalingMessageForRemoteClient));
+    CHK_STATUS(removeExpiredMessageQueues(pGstKvsPlugin));
 
     // periodically wake up and clean up terminated streaming session
     MUTEX_UNLOCK(pGstKvsPlugin->sessionLock);
@@ -1425,6 +1525,7 @@ STATUS adaptVideoFrameFromAvccToAnnexB(PGstKvsPlugin pGstKvsPlugin, PFrame pFram
     // Check if we need to allocate/re-allocate
     if (pGstKvsPlugin->adaptedFrameBufSize < overallSize) {
         CHK(NULL != (pGstKvsPlugin->pAdaptedFrameBuf = (PBYTE) MEMREALLOC(pGstKvsPlugin->pAdaptedFrameBuf, overallSize)), STATUS_NOT_ENOUGH_MEMORY);
+        accountMemoryAlloc(pGstKvsPlugin, GST_PLUGIN_MEMORY_ADAPTED_FRAME, overallSize - pGstKvsPlugin->adaptedFrameBufSize);
         pGstKvsPlugin->adaptedFrameBufSize = overallSize;
     }
 
@@ -1468,3 +1569,20 @@ CleanUp:
 
     return retStatus;
 }
+
+GstStructure* getSignalingPoolStats(PGstKvsPlugin pGstKvsPlugin)
+{
+    ObjectPoolStats queueStats, messageStats;
+
+    MEMSET(&queueStats, 0x00, SIZEOF(ObjectPoolStats));
+    MEMSET(&messageStats, 0x00, SIZEOF(ObjectPoolStats));
+    getObjectPoolStats(pGstKvsPlugin->pPendingQueuePool, &queueStats);
+    getObjectPoolStats(pGstKvsPlugin->pPendingMessagePool, &messageStats);
+
+    return gst_structure_new(GST_PLUGIN_SIGNALING_POOL_STATS_G_STRUCT_NAME, "message-hits", G_TYPE_UINT64, messageStats.hitCount, "message-misses",
+                             G_TYPE_UINT64, messageStats.missCount, "messages-dropped", G_TYPE_UINT64, messageStats.rejectedCount, "messages-pending",
+                             G_TYPE_UINT, messageStats.inUseCount, "peak-messages-pending", G_TYPE_UINT, messageStats.peakInUseCount, "queue-hits",
+                             G_TYPE_UINT64, queueStats.hitCount, "queue-misses", G_TYPE_UINT64, queueStats.missCount, "queues-dropped", G_TYPE_UINT64,
+                             queueStats.rejectedCount, "queues-pending", G_TYPE_UINT, queueStats.inUseCount, "peak-queues-pending", G_TYPE_UINT,
+                             queueStats.peakInUseCount, NULL);
+}
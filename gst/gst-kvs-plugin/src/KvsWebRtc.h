@@ -8,6 +8,11 @@
 #define DEFAULT_WEBRTC_CONNECTION_MODE WEBRTC_CONNECTION_MODE_DEFAULT
 #define DEFAULT_WEBRTC_CONNECT         TRUE
 
+// ICE candidates queued ahead of their peer's offer
+#define DEFAULT_SIGNALING_POOL_SIZE 64
+
+#define GST_PLUGIN_SIGNALING_POOL_STATS_G_STRUCT_NAME "kvs-signaling-pool-stats"
+
 #define GST_PLUGIN_HASH_TABLE_BUCKET_COUNT  50
 #define GST_PLUGIN_HASH_TABLE_BUCKET_LENGTH 2
 
@@ -43,18 +48,24 @@
 
 typedef VOID (*StreamSessionShutdownCallback)(UINT64, PWebRtcStreamingSession);
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 STATUS signalingClientStateChangedFn(UINT64, SIGNALING_CLIENT_STATE);
 STATUS signalingClientErrorFn(UINT64, STATUS, PCHAR, UINT32);
 STATUS signalingClientMessageReceivedFn(UINT64, PReceivedSignalingMessage);
 STATUS initKinesisVideoWebRtc(PGstKvsPlugin);
+STATUS startKinesisVideoWebRtc(PGstKvsPlugin);
 STATUS freeGstKvsWebRtcPlugin(PGstKvsPlugin);
-STATUS createMessageQueue(UINT64, PPendingMessageQueue*);
-STATUS freeMessageQueue(PPendingMessageQueue);
+STATUS createMessageQueue(PGstKvsPlugin, UINT64, PPendingMessageQueue*);
+STATUS freeMessageQueue(PGstKvsPlugin, PPendingMessageQueue);
+STATUS queuePendingMessage(PGstKvsPlugin, PPendingMessageQueue, PReceivedSignalingMessage);
 STATUS gatherIceServerStats(PWebRtcStreamingSession);
 STATUS freeWebRtcStreamingSession(PWebRtcStreamingSession*);
 STATUS streamingSessionOnShutdown(PWebRtcStreamingSession, UINT64, StreamSessionShutdownCallback);
 STATUS pregenerateCertTimerCallback(UINT32, UINT64, UINT64);
-STATUS removeExpiredMessageQueues(PStackQueue);
+STATUS removeExpiredMessageQueues(PGstKvsPlugin);
 STATUS getPendingMessageQueueForHash(PStackQueue, UINT64, BOOL, PPendingMessageQueue*);
 STATUS createWebRtcStreamingSession(PGstKvsPlugin, PCHAR, BOOL, PWebRtcStreamingSession*);
 STATUS initializePeerConnection(PGstKvsPlugin, PRtcPeerConnection*);
@@ -77,5 +88,10 @@ VOID onSampleStreamingSessionShutdown(UINT64, PWebRtcStreamingSession);
 STATUS sessionServiceHandler(UINT32, UINT64, UINT64);
 STATUS putFrameToWebRtcPeers(PGstKvsPlugin, PFrame, ELEMENTARY_STREAM_NAL_FORMAT);
 STATUS adaptVideoFrameFromAvccToAnnexB(PGstKvsPlugin, PFrame, ELEMENTARY_STREAM_NAL_FORMAT);
+GstStructure* getSignalingPoolStats(PGstKvsPlugin);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif //__KVS_WEBRTC_FUNCTIONALITY_H__
\ No newline at end of file
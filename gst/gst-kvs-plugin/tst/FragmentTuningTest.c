@@ -0,0 +1,79 @@
+/**
+ * Fragment tuning across a stream recovery. While the plugin cuts the fragments, a key frame that doesn't start one goes
+ * to the stream as a regular frame, so the first key frame after a recovery has to keep its flag for the stream to
+ * open a fragment on it. There is no stream behind the element here, the recovery fails at the SDK and the fragment
+ * has to restart regardless.
+ */
+#include "../src/GstPlugin.h"
+
+// Shorter than the configured fragment duration, so the warm-up cuts a fragment every few key frames
+#define TEST_GOP_DURATION           (1 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+#define TEST_FRAGMENT_DURATION_MS   5000
+#define TEST_FRAME_SIZE             1000
+
+static UINT32 gFailureCount = 0;
+
+#define EXPECT(condition)                                                                                                                            \
+    do {                                                                                                                                             \
+        if (!(condition)) {                                                                                                                          \
+            printf("%s:%d: expected %s\n", __FILE__, __LINE__, #condition);                                                                          \
+            gFailureCount++;                                                                                                                         \
+        }                                                                                                                                            \
+    } while (FALSE)
+
+// Returns whether the key frame goes to the stream as one
+static BOOL tuneKeyFrame(PGstKvsPlugin pGstKvsPlugin, UINT64 timestamp)
+{
+    Frame frame;
+    FRAME_FLAGS streamFlags = FRAME_FLAG_NONE;
+
+    MEMSET(&frame, 0x00, SIZEOF(Frame));
+    frame.presentationTs = timestamp;
+    frame.decodingTs = timestamp;
+    frame.size = TEST_FRAME_SIZE;
+    frame.flags = FRAME_FLAG_KEY_FRAME;
+
+    EXPECT(STATUS_SUCCEEDED(tuneFragment(pGstKvsPlugin, &frame, TRUE, FALSE, &streamFlags)));
+
+    return CHECK_FRAME_FLAG_KEY_FRAME(streamFlags);
+}
+
+static VOID testKeyFrameAfterRecovery(GST_PLUGIN_FRAGMENT_TUNING fragmentTuning)
+{
+    PGstKvsPlugin pGstKvsPlugin = (PGstKvsPlugin) MEMCALLOC(1, SIZEOF(GstKvsPlugin));
+
+    pGstKvsPlugin->gstParams.fragmentTuning = fragmentTuning;
+    pGstKvsPlugin->gstParams.fragmentTuningWarmupInSeconds = DEFAULT_FRAGMENT_TUNING_WARMUP_SECONDS;
+    pGstKvsPlugin->gstParams.keyFrameFragmentation = FALSE;
+    pGstKvsPlugin->gstParams.fragmentDurationInMillis = TEST_FRAGMENT_DURATION_MS;
+    pGstKvsPlugin->mediaType = GST_PLUGIN_MEDIA_TYPE_VIDEO_ONLY;
+    pGstKvsPlugin->numVideoStreams = 1;
+    pGstKvsPlugin->kvsContext.streamHandle = INVALID_STREAM_HANDLE_VALUE;
+
+    EXPECT(STATUS_SUCCEEDED(initFragmentTuning(pGstKvsPlugin)));
+    EXPECT(isFragmentTuningActive(pGstKvsPlugin));
+
+    EXPECT(tuneKeyFrame(pGstKvsPlugin, 0));
+    EXPECT(!tuneKeyFrame(pGstKvsPlugin, TEST_GOP_DURATION));
+
+    EXPECT(STATUS_FAILED(recoverKinesisVideoStream(pGstKvsPlugin)));
+
+    EXPECT(tuneKeyFrame(pGstKvsPlugin, 2 * TEST_GOP_DURATION));
+    EXPECT(!tuneKeyFrame(pGstKvsPlugin, 3 * TEST_GOP_DURATION));
+
+    freeFragmentTuning(pGstKvsPlugin);
+    MEMFREE(pGstKvsPlugin);
+}
+
+INT32 main(VOID)
+{
+    testKeyFrameAfterRecovery(GST_PLUGIN_FRAGMENT_TUNING_LATENCY);
+    testKeyFrameAfterRecovery(GST_PLUGIN_FRAGMENT_TUNING_OVERHEAD);
+
+    if (gFailureCount != 0) {
+        printf("%u expectations failed\n", gFailureCount);
+        return 1;
+    }
+
+    return 0;
+}